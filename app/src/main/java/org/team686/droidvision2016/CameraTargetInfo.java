@@ -11,6 +11,24 @@ public class CameraTargetInfo {
     protected double hWidth;
     protected double vWidth;
 
+    // Detector that found the target, 0 for the primary target
+    protected int channel = 0;
+
+    // Tracker prediction to the time the frame was handed to the robot connection
+    protected int id = -1;
+    protected double hAnglePredicted;
+    protected double vAnglePredicted;
+    protected double hAngleRate;
+    protected double vAngleRate;
+    protected double hAngleVariance;
+    protected double vAngleVariance;
+
+    // solvePnP pose, when the pose stage is enabled
+    protected boolean hasPose = false;
+    protected double range;
+    protected double bearing;
+    protected double skew;
+
     // Coordinate frame:
     // +x is out the camera's optical axis
     // +y is to the left of the image
@@ -26,6 +44,32 @@ public class CameraTargetInfo {
         vWidth = _vWidth;
     }
 
+    public void setPrediction(int _id, double _hAnglePredicted, double _vAnglePredicted,
+                              double _hAngleRate, double _vAngleRate,
+                              double _hAngleVariance, double _vAngleVariance)
+    {
+        id = _id;
+        hAnglePredicted = _hAnglePredicted;
+        vAnglePredicted = _vAnglePredicted;
+        hAngleRate = _hAngleRate;
+        vAngleRate = _vAngleRate;
+        hAngleVariance = _hAngleVariance;
+        vAngleVariance = _vAngleVariance;
+    }
+
+    public void setChannel(int _channel)
+    {
+        channel = _channel;
+    }
+
+    public void setPose(double _range, double _bearing, double _skew)
+    {
+        hasPose = true;
+        range = _range;
+        bearing = _bearing;
+        skew = _skew;
+    }
+
     private double doubleize(double value) {
         double leftover = value % 1;
         if (leftover < 1e-7) {
@@ -43,6 +87,23 @@ public class CameraTargetInfo {
             j.put("vAngle", doubleize(vAngle));
             j.put("hWidth", doubleize(hWidth));
             j.put("vWidth", doubleize(vWidth));
+            if (channel != 0) {
+                j.put("channel", channel);
+            }
+            if (id >= 0) {
+                j.put("id", id);
+                j.put("hAnglePredicted", doubleize(hAnglePredicted));
+                j.put("vAnglePredicted", doubleize(vAnglePredicted));
+                j.put("hAngleRate", doubleize(hAngleRate));
+                j.put("vAngleRate", doubleize(vAngleRate));
+                j.put("hAngleVariance", doubleize(hAngleVariance));
+                j.put("vAngleVariance", doubleize(vAngleVariance));
+            }
+            if (hasPose) {
+                j.put("range", doubleize(range));
+                j.put("bearing", doubleize(bearing));
+                j.put("skew", doubleize(skew));
+            }
         }
         catch (JSONException e)
         {
@@ -11,6 +11,19 @@ public class NativePart {
     public static final int DISP_MODE_TARGETS = 2;
     public static final int DISP_MODE_TARGETS_PLUS = 3;
 
+    // Trace stages recorded from Java, must match TraceStage in frame_trace.h
+    public static final int TRACE_SEND_QUEUE = 11;
+    public static final int TRACE_SERIALIZE = 12;
+    public static final int TRACE_SOCKET_WRITE = 13;
+
+    // Load shedding flags in TargetsInfo.degradation, must match Degradation in frame_budget.h
+    public static final int DEGRADE_SKIP_VISUALIZE = 1;
+    public static final int DEGRADE_CAP_CANDIDATES = 2;
+    public static final int DEGRADE_DECIMATE = 4;
+    public static final int DEGRADE_SKIP_FRAME = 8;
+    public static final int DEGRADE_DEADLINE = 16;
+    public static final int DEGRADE_THERMAL = 32;
+
     public static native void processFrame(
             int tex1,
             int tex2,
@@ -23,8 +36,150 @@ public class NativePart {
             int s_max,
             int v_min,
             int v_max,
+            long captureTimeNs,
             TargetsInfo destInfo);
 
+    /**
+     * Records a span of the frame identified by traceId (its capture start time, in
+     * System.nanoTime() units) into the native trace ring.
+     */
+    public static native void traceSpan(long traceId, int stage, long startNs, long endNs);
+
+    /**
+     * Writes the native trace ring to path as Chrome trace_event JSON.
+     */
+    public static native boolean dumpTrace(String path);
+
+    /**
+     * Turns hardware counter profiling of the pipeline stages on or off, resetting the totals.
+     * Needs perf_event_open to be permitted (perf_event_paranoid) on the device.
+     */
+    public static native void setPerfProfiling(boolean enabled);
+
+    /**
+     * Logs the per-stage counter summary collected since profiling was enabled.
+     */
+    public static native void logPerfSummary();
+
+    /**
+     * Starts recording every processed frame, its HSV thresholds and its targets into a ring
+     * of numFrames frames in a memory-mapped file. Unless rawFrames is set, frames are stored
+     * as the lossless threshold mask plus a sub-sampled colour image.
+     */
+    public static native boolean startRecording(String path, int numFrames, boolean rawFrames);
+
+    public static native void stopRecording();
+
+    /**
+     * Sets a distortion-free camera model for width x height frames, used until a calibration
+     * is loaded.
+     */
+    public static native void setCameraPinhole(int width, int height, double focalLengthPixels);
+
+    /**
+     * Loads camera intrinsics and distortion coefficients from an OpenCV calibration file
+     * (camera_matrix, distortion_coefficients, image_width, image_height). Target angles are
+     * computed from undistorted corner points with this model.
+     */
+    public static native boolean loadCameraCalibration(String path);
+
+    /**
+     * Turns solvePnP pose estimation of the reported targets on or off.
+     */
+    public static native void setPoseEstimation(boolean enabled);
+
+    /**
+     * Sets the target's four corners in metres as {x, y, z} triples, clockwise from the top-left
+     * as seen from the camera, with x right, y down and z away from the camera.
+     */
+    public static native boolean setTargetModel(double[] corners);
+
+    /**
+     * Replaces the slider-driven detector with several detectors sharing one colour conversion,
+     * one per line: "name channel hMin hMax sMin sMax vMin vMax" optionally followed by
+     * "minWidth maxWidth minHeight maxHeight minFullness maxFullness". Lines starting with '#'
+     * are comments. An empty spec restores the slider-driven detector.
+     */
+    public static native boolean setDetectors(String spec);
+
+    /**
+     * Replaces the detection pipeline, one stage per line: "decimate factor=N", "hsv",
+     * "threshold", "erode size=N", "dilate size=N", "open size=N", "close size=N",
+     * "median size=N", "contours" and "filter key=value...". Per-pixel stages are fused into one
+     * pass. See pipeline_plan.h for the parameters. Takes effect on the next frame; returns false for an invalid pipeline.
+     */
+    public static native boolean setPipeline(String spec);
+
+    /**
+     * setPipeline() with the contents of a file.
+     */
+    public static native boolean loadPipeline(String path);
+
+    /**
+     * Replays the recordings listed in a golden manifest through the default pipeline and
+     * compares the targets with the recorded ones; see golden_corpus.h for the manifest format.
+     * Writes a per-frame report to reportPath and returns the number of diverging frames plus
+     * slow recordings, or -1 when the manifest or a recording cannot be read.
+     */
+    public static native int verifyGolden(String manifestPath, String reportPath);
+
+    /**
+     * Runs every frame of a golden manifest through the detector on numWorkers threads (0 for one
+     * per worker core, off the vision thread's cores) and writes per-recording target statistics and the slowest frames to reportPath.
+     * Returns the frames per second over the whole corpus, or -1 when it cannot be read.
+     */
+    public static native double evaluateCorpus(String manifestPath, String reportPath, int numWorkers);
+
+    /**
+     * Searches for the HSV threshold that best separates the targets of a golden manifest's frames
+     * from their background and writes its precision and recall to reportPath. Returns the bounds
+     * as {hMin, hMax, sMin, sMax, vMin, vMax}, or null when no frame could be labelled.
+     */
+    public static native int[] tuneThreshold(String manifestPath, String reportPath);
+
+    /**
+     * Copies the newest frame's results into info. Any thread may call this at any rate: it never
+     * waits for the GL thread, and a reader that falls behind just skips frames. Returns the
+     * frame's sequence number, which only grows, or 0 before the first frame.
+     */
+    public static native long readLatestTargets(TargetsInfo info);
+
+    /**
+     * Publishes every frame's results, and optionally the RGBA frame, to a shared-memory region
+     * that processes on the device can map; see shared_export_format.h for the layout. A null
+     * path uses an anonymous memfd. The region is created at the next frame.
+     */
+    public static native boolean startSharedExport(String path, int resultSlots, boolean exportFrames);
+
+    public static native void stopSharedExport();
+
+    /**
+     * Moves the vision, worker and background threads onto the big or little cores or an explicit
+     * CPU list, and optionally sets their nice values, e.g. "vision=big background=little
+     * vision_nice=-8"; see cpu_topology.h. Returns false and changes nothing on a bad spec.
+     */
+    public static native boolean setThreadPlacement(String spec);
+
+    /**
+     * Tunes the thermal governor that lowers processing detail as the phone heats up, e.g.
+     * "warm=50 hot=60 severe=70" in degrees Celsius, or "trace=PATH" to record its samples; see
+     * thermal_governor.h. Returns false and changes nothing on a bad spec.
+     */
+    public static native boolean setThermalGovernor(String spec);
+
+    /**
+     * Replaces the exclusion mask, the parts of the frame the threshold pass skips, one region
+     * per line: "rect x=X y=Y width=W height=H" in fractions of the frame, or "bitmap path=PATH"
+     * for a binary PGM stretched over the frame. See exclusion_mask.h. An empty spec excludes
+     * nothing; returns false and changes nothing on a bad spec.
+     */
+    public static native boolean setExclusionMask(String spec);
+
+    /**
+     * setExclusionMask() with the contents of a file.
+     */
+    public static native boolean loadExclusionMask(String path);
+
     /**
      * Classes referenced from native code, DO NOT CHANGE ANY NAMING!!!!
      */
@@ -34,13 +189,45 @@ public class NativePart {
             public double centroidY;
             public double width;
             public double height;
+            // Detector channel; only channel 0 targets are tracked
+            public int channel;
+            // Tracker output: stable id, centroid extrapolated to the time
+            // processFrame returned, velocity (pixels/s), variance (pixels^2)
+            public int id;
+            public double predictedX;
+            public double predictedY;
+            public double velocityX;
+            public double velocityY;
+            public double varianceX;
+            public double varianceY;
+            // Camera model output in radians, in CameraTargetInfo's frame
+            public double hAngle;
+            public double vAngle;
+            public double hWidth;
+            public double vWidth;
+            public double hAnglePredicted;
+            public double vAnglePredicted;
+            public double hAngleRate;
+            public double vAngleRate;
+            public double hAngleVariance;
+            public double vAngleVariance;
+            // Pose stage output, when enabled and solved: range (m), bearing and skew (radians)
+            public boolean hasPose;
+            public double range;
+            public double bearing;
+            public double skew;
         }
 
         public int numTargets;
         public final Target[] targets;
+        // DEGRADE_* flags applied to this frame and the frame budget level (0-4)
+        public int degradation;
+        public int degradationLevel;
+        // Camera timestamp of the frame these results came from
+        public long captureTimeNs;
 
         public TargetsInfo() {
-            targets = new Target[3];
+            targets = new Target[8];
             for (int i = 0; i < targets.length; i++) {
                 targets[i] = new Target();
             }
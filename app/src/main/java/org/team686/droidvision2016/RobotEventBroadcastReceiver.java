@@ -11,6 +11,8 @@ public class RobotEventBroadcastReceiver extends BroadcastReceiver {
     public static final String ACTION_SHOT_TAKEN = "ACTION_SHOT_TAKEN";
     public static final String ACTION_WANT_VISION = "ACTION_WANT_VISION";
     public static final String ACTION_WANT_INTAKE = "ACTION_WANT_INTAKE";
+    public static final String ACTION_THRESHOLD_TUNED = "ACTION_THRESHOLD_TUNED";
+    public static final String EXTRA_HSV_BOUNDS = "EXTRA_HSV_BOUNDS";
 
 
     private RobotEventListener m_listener;
@@ -22,6 +24,7 @@ public class RobotEventBroadcastReceiver extends BroadcastReceiver {
         intentFilter.addAction(ACTION_SHOT_TAKEN);
         intentFilter.addAction(ACTION_WANT_VISION);
         intentFilter.addAction(ACTION_WANT_INTAKE);
+        intentFilter.addAction(ACTION_THRESHOLD_TUNED);
         context.registerReceiver(this, intentFilter);
     }
 
@@ -36,5 +39,8 @@ public class RobotEventBroadcastReceiver extends BroadcastReceiver {
         if (ACTION_WANT_INTAKE.equals(intent.getAction())) {
             m_listener.wantsIntakeMode();
         }
+        if (ACTION_THRESHOLD_TUNED.equals(intent.getAction())) {
+            m_listener.thresholdTuned(intent.getIntArrayExtra(EXTRA_HSV_BOUNDS));
+        }
     }
 }
@@ -4,4 +4,5 @@ public interface RobotEventListener {
     public void shotTaken();
     public void wantsVisionMode();
     public void wantsIntakeMode();
+    public void thresholdTuned(int[] hsvBounds);
 }
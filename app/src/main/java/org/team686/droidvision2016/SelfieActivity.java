@@ -53,6 +53,11 @@ public class SelfieActivity extends Activity implements RobotEventListener {
 
     }
 
+    @Override
+    public void thresholdTuned(int[] hsvBounds) {
+
+    }
+
     @Override
     protected void onDestroy() {
         super.onDestroy();
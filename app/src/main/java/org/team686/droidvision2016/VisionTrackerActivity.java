@@ -90,6 +90,15 @@ public class VisionTrackerActivity extends Activity implements RobotConnectionSt
 //        }
     }
 
+    @Override
+    public void thresholdTuned(int[] hsvBounds) {
+        Log.i("VisionActivity", "Tuned threshold H " + hsvBounds[0] + "-" + hsvBounds[1]
+                + " S " + hsvBounds[2] + "-" + hsvBounds[3] + " V " + hsvBounds[4] + "-" + hsvBounds[5]);
+        m_prefs.setThresholdHRange(hsvBounds[0], hsvBounds[1]);
+        m_prefs.setThresholdSRange(hsvBounds[2], hsvBounds[3]);
+        m_prefs.setThresholdVRange(hsvBounds[4], hsvBounds[5]);
+    }
+
     private class PowerStateBroadcastReceiver extends BroadcastReceiver {
 
         public PowerStateBroadcastReceiver(VisionTrackerActivity activity) {
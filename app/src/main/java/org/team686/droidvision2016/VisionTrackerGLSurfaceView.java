@@ -21,6 +21,7 @@ import android.view.SurfaceHolder;
 import android.widget.TextView;
 import android.widget.Toast;
 
+import java.io.File;
 import java.util.HashMap;
 
 public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implements BetterCameraGLSurfaceView.CameraTextureListener {
@@ -33,11 +34,14 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
     TextView mFpsText = null;
     private RobotConnection mRobotConnection;
     private Preferences m_prefs;
+    // Only touched on the GL thread, refilled by every processFrame call
+    private final NativePart.TargetsInfo mTargetsInfo = new NativePart.TargetsInfo();
+    static final String kCalibrationFile = "camera_calibration.yml";
+    static final String kPipelineFile = "pipeline.cfg";
+    static final String kExclusionFile = "exclusion.cfg";
 
     static final int kHeight = 480;
     static final int kWidth = 640;
-    static final double kCenterCol = ((double) kWidth) / 2.0 - .5;
-    static final double kCenterRow = ((double) kHeight) / 2.0 - .5;
 
     static BetterCamera2Renderer.Settings getCameraSettings() {
         BetterCamera2Renderer.Settings settings = new BetterCamera2Renderer.Settings();
@@ -89,6 +93,19 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
             }
         });
         // NativePart.initCL();
+        NativePart.setCameraPinhole(width, height, getFocalLengthPixels());
+        File calibration = new File(getContext().getExternalFilesDir(null), kCalibrationFile);
+        if (calibration.exists() && !NativePart.loadCameraCalibration(calibration.getPath())) {
+            Log.e(LOGTAG, "Ignoring camera calibration " + calibration);
+        }
+        File pipeline = new File(getContext().getExternalFilesDir(null), kPipelineFile);
+        if (pipeline.exists() && !NativePart.loadPipeline(pipeline.getPath())) {
+            Log.e(LOGTAG, "Ignoring pipeline " + pipeline);
+        }
+        File exclusion = new File(getContext().getExternalFilesDir(null), kExclusionFile);
+        if (exclusion.exists() && !NativePart.loadExclusionMask(exclusion.getPath())) {
+            Log.e(LOGTAG, "Ignoring exclusion mask " + exclusion);
+        }
         frameCounter = 0;
         lastNanoTime = System.nanoTime();
     }
@@ -124,35 +141,44 @@ public class VisionTrackerGLSurfaceView extends BetterCameraGLSurfaceView implem
             frameCounter = 0;
             lastNanoTime = System.nanoTime();
         }
-        NativePart.TargetsInfo targetsInfo = new NativePart.TargetsInfo();
+        NativePart.TargetsInfo targetsInfo = mTargetsInfo;
         Pair<Integer, Integer> hRange = m_prefs != null ? m_prefs.getThresholdHRange() : blankPair();
         Pair<Integer, Integer> sRange = m_prefs != null ? m_prefs.getThresholdSRange() : blankPair();
         Pair<Integer, Integer> vRange = m_prefs != null ? m_prefs.getThresholdVRange() : blankPair();
         NativePart.processFrame(texIn, texOut, width, height, procMode, hRange.first, hRange.second,
-                sRange.first, sRange.second, vRange.first, vRange.second, targetsInfo);
+                sRange.first, sRange.second, vRange.first, vRange.second, image_timestamp, targetsInfo);
+        if ((targetsInfo.degradation & NativePart.DEGRADE_SKIP_FRAME) != 0) {
+            // Shed under load; the robot keeps its last update rather than an empty one
+            Log.d(LOGTAG, "Frame skipped, budget level " + targetsInfo.degradationLevel);
+            return false;
+        }
 
         VisionUpdate visionUpdate = new VisionUpdate(image_timestamp);
+        visionUpdate.setDegradation(targetsInfo.degradation);
         Log.i(LOGTAG, "Num targets = " + targetsInfo.numTargets);
         for (int i = 0; i < targetsInfo.numTargets; ++i)
         {
             NativePart.TargetsInfo.Target target = targetsInfo.targets[i];
 
             // RS 5/22/2017 send horiz/vert angles to center of target and angular height and width
-            double hAngle = Math.atan2(-(target.centroidX - kCenterCol), getFocalLengthPixels());
-            double vAngle = Math.atan2(-(target.centroidY - kCenterRow), getFocalLengthPixels());
-
-            double hWidth = target.width  / kWidth  * getHorizFieldOfViewRad();
-            double vWidth = target.height / kHeight * getVertFieldOfViewRad();
-
-            Log.i(LOGTAG, "Target at: (" + hAngle + ", " + vAngle + "), width: (" + hWidth + ", " + vWidth + ")");
-            visionUpdate.addCameraTargetInfo(new CameraTargetInfo(hAngle, vAngle, hWidth, vWidth));
+            // Angles come from the native camera model, with lens distortion removed
+            Log.i(LOGTAG, "Target " + target.id + " at: (" + target.hAngle + ", " + target.vAngle + "), width: (" + target.hWidth + ", " + target.vWidth + ")");
+            CameraTargetInfo info = new CameraTargetInfo(target.hAngle, target.vAngle, target.hWidth, target.vWidth);
+            info.setPrediction(target.id, target.hAnglePredicted, target.vAnglePredicted,
+                    target.hAngleRate, target.vAngleRate,
+                    target.hAngleVariance, target.vAngleVariance);
+            info.setChannel(target.channel);
+            if (target.hasPose) {
+                info.setPose(target.range, target.bearing, target.skew);
+            }
+            visionUpdate.addCameraTargetInfo(info);
         }
 
         if (mRobotConnection != null) {
             TargetUpdateMessage update = new TargetUpdateMessage(visionUpdate, System.nanoTime());
             mRobotConnection.send(update);
         }
-        return true;
+        return (targetsInfo.degradation & NativePart.DEGRADE_SKIP_VISUALIZE) == 0;
     }
 
     public void setRobotConnection(RobotConnection robotConnection) {
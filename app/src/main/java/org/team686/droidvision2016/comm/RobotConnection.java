@@ -2,21 +2,28 @@ package org.team686.droidvision2016.comm;
 
 import android.content.Context;
 import android.content.Intent;
+import android.os.Process;
 import android.util.Log;
 
+import org.team686.droidvision2016.BuildConfig;
+import org.team686.droidvision2016.NativePart;
 import org.team686.droidvision2016.RobotEventBroadcastReceiver;
 import org.team686.droidvision2016.comm.messages.HeartbeatMessage;
 import org.team686.droidvision2016.comm.messages.OffWireMessage;
 import org.team686.droidvision2016.comm.messages.VisionMessage;
 
 import java.io.BufferedReader;
+import java.io.File;
 import java.io.IOException;
 import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.net.Socket;
 import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
 import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicBoolean;
 
 public class RobotConnection {
     public static final int K_ROBOT_PORT = 8254;
@@ -24,6 +31,9 @@ public class RobotConnection {
     public static final int K_CONNECTOR_SLEEP_MS = 100;
     public static final int K_THRESHOLD_HEARTBEAT = 800;
     public static final int K_SEND_HEARTBEAT_PERIOD = 100;
+    public static final int K_RECORDING_FRAMES = 30 * 60;
+    public static final int K_SHARED_RESULT_SLOTS = 64;
+    public static final String K_SHARED_EXPORT_FILE = "vision.shm";
 
     private int m_port;
     private String m_host;
@@ -38,6 +48,11 @@ public class RobotConnection {
 
     private ArrayBlockingQueue<VisionMessage> mToSend = new ArrayBlockingQueue<VisionMessage>(30);
 
+    // Golden verification, corpus evaluation and threshold tuning replay recordings for
+    // seconds to minutes; debug builds only, one at a time
+    private final ExecutorService m_diagnostics = Executors.newSingleThreadExecutor();
+    private final AtomicBoolean m_diagnostic_running = new AtomicBoolean(false);
+
     protected class WriteThread implements Runnable {
 
         @Override
@@ -52,6 +67,10 @@ public class RobotConnection {
                 if (nextToSend == null) {
                     continue;
                 }
+                if (nextToSend.getTraceId() != 0) {
+                    NativePart.traceSpan(nextToSend.getTraceId(), NativePart.TRACE_SEND_QUEUE,
+                            nextToSend.getCreatedAt(), System.nanoTime());
+                }
                 sendToWire(nextToSend);
             }
         }
@@ -73,6 +92,81 @@ public class RobotConnection {
                     broadcastWantIntakeMode();
                 }
             }
+            if ("dump_trace".equals(message.getType())) {
+                dumpTrace();
+            }
+            if ("record".equals(message.getType())) {
+                if ("on".equals(message.getMessage()) || "raw".equals(message.getMessage())) {
+                    startRecording("raw".equals(message.getMessage()));
+                } else if ("off".equals(message.getMessage())) {
+                    NativePart.stopRecording();
+                }
+            }
+            if ("perf_profiling".equals(message.getType())) {
+                if ("on".equals(message.getMessage())) {
+                    NativePart.setPerfProfiling(true);
+                } else if ("off".equals(message.getMessage())) {
+                    NativePart.setPerfProfiling(false);
+                } else if ("summary".equals(message.getMessage())) {
+                    NativePart.logPerfSummary();
+                }
+            }
+
+            if ("pose_estimation".equals(message.getType())) {
+                NativePart.setPoseEstimation("on".equals(message.getMessage()));
+            }
+
+            if ("detectors".equals(message.getType())) {
+                if (!NativePart.setDetectors(message.getMessage())) {
+                    Log.e("Connection", "Ignoring malformed detector list");
+                }
+            }
+
+            if ("pipeline".equals(message.getType())) {
+                if (!NativePart.setPipeline(message.getMessage())) {
+                    Log.e("Connection", "Ignoring invalid pipeline");
+                }
+            }
+
+            if ("verify_golden".equals(message.getType())) {
+                verifyGolden(message.getMessage());
+            }
+
+            if ("evaluate_corpus".equals(message.getType())) {
+                evaluateCorpus(message.getMessage());
+            }
+
+            if ("tune_threshold".equals(message.getType())) {
+                tuneThreshold(message.getMessage());
+            }
+
+            if ("exclusion_mask".equals(message.getType())) {
+                if (!NativePart.setExclusionMask(message.getMessage())) {
+                    Log.e("Connection", "Ignoring invalid exclusion mask");
+                }
+            }
+
+            if ("thread_placement".equals(message.getType())) {
+                if (!NativePart.setThreadPlacement(message.getMessage())) {
+                    Log.e("Connection", "Ignoring invalid thread placement");
+                }
+            }
+
+            if ("thermal_governor".equals(message.getType())) {
+                if (!NativePart.setThermalGovernor(message.getMessage())) {
+                    Log.e("Connection", "Ignoring invalid thermal governor settings");
+                }
+            }
+
+            if ("shared_export".equals(message.getType())) {
+                if ("on".equals(message.getMessage()) || "frames".equals(message.getMessage())) {
+                    File file = new File(getOutputDir(), K_SHARED_EXPORT_FILE);
+                    NativePart.startSharedExport(file.getPath(), K_SHARED_RESULT_SLOTS,
+                            "frames".equals(message.getMessage()));
+                } else if ("off".equals(message.getMessage())) {
+                    NativePart.stopSharedExport();
+                }
+            }
 
             Log.w("Connection" , message.getType() + " " + message.getMessage());
         }
@@ -228,11 +322,20 @@ public class RobotConnection {
     }
 
     private synchronized boolean sendToWire(VisionMessage message) {
+        long traceId = message.getTraceId();
+        long serializeStart = System.nanoTime();
         String toSend = message.toJson() + "\n";
+        if (traceId != 0) {
+            NativePart.traceSpan(traceId, NativePart.TRACE_SERIALIZE, serializeStart, System.nanoTime());
+        }
         if (m_socket != null && m_socket.isConnected()) {
             try {
+                long writeStart = System.nanoTime();
                 OutputStream os = m_socket.getOutputStream();
                 os.write(toSend.getBytes());
+                if (traceId != 0) {
+                    NativePart.traceSpan(traceId, NativePart.TRACE_SOCKET_WRITE, writeStart, System.nanoTime());
+                }
                 return true;
             } catch (IOException e) {
                 Log.w("RobotConnection", "Could not send data to socket, try to reconnect");
@@ -246,6 +349,99 @@ public class RobotConnection {
         return mToSend.offer(message);
     }
 
+    private File getOutputDir() {
+        File dir = m_context.getExternalFilesDir(null);
+        if (dir == null) {
+            dir = m_context.getFilesDir();
+        }
+        return dir;
+    }
+
+    public boolean dumpTrace() {
+        File file = new File(getOutputDir(), "trace-" + System.currentTimeMillis() + ".json");
+        Log.i("RobotConnection", "Dumping frame trace to " + file.getPath());
+        return NativePart.dumpTrace(file.getPath());
+    }
+
+    public boolean startRecording(boolean rawFrames) {
+        File file = new File(getOutputDir(), "recording-" + System.currentTimeMillis() + ".dvrec");
+        Log.i("RobotConnection", "Recording frames to " + file.getPath());
+        return NativePart.startRecording(file.getPath(), K_RECORDING_FRAMES, rawFrames);
+    }
+
+    private boolean runDiagnostic(final String name, final Runnable job) {
+        if (!BuildConfig.DEBUG) {
+            Log.w("RobotConnection", "Ignoring " + name + ", diagnostics are only in debug builds");
+            return false;
+        }
+        if (!m_diagnostic_running.compareAndSet(false, true)) {
+            Log.w("RobotConnection", "Ignoring " + name + ", another diagnostic is running");
+            return false;
+        }
+        m_diagnostics.execute(new Runnable() {
+            @Override
+            public void run() {
+                Process.setThreadPriority(Process.THREAD_PRIORITY_BACKGROUND);
+                try {
+                    job.run();
+                } finally {
+                    m_diagnostic_running.set(false);
+                }
+            }
+        });
+        return true;
+    }
+
+    // Replays the golden corpus described by manifestName (in the output dir) off the read thread
+    public boolean verifyGolden(final String manifestName) {
+        final File manifest = new File(getOutputDir(), manifestName);
+        final File report = new File(getOutputDir(), "golden-" + System.currentTimeMillis() + ".txt");
+        return runDiagnostic("golden verification", new Runnable() {
+            @Override
+            public void run() {
+                int failures = NativePart.verifyGolden(manifest.getPath(), report.getPath());
+                if (failures == 0) {
+                    Log.i("RobotConnection", "Golden corpus passed, report in " + report.getPath());
+                } else {
+                    Log.e("RobotConnection", "Golden corpus failed (" + failures + "), report in " + report.getPath());
+                }
+            }
+        });
+    }
+
+    public boolean evaluateCorpus(final String manifestName) {
+        final File manifest = new File(getOutputDir(), manifestName);
+        final File report = new File(getOutputDir(), "corpus-" + System.currentTimeMillis() + ".txt");
+        return runDiagnostic("corpus evaluation", new Runnable() {
+            @Override
+            public void run() {
+                double fps = NativePart.evaluateCorpus(manifest.getPath(), report.getPath(), 0);
+                if (fps >= 0) {
+                    Log.i("RobotConnection", "Corpus evaluated at " + fps + " frames/s, report in " + report.getPath());
+                } else {
+                    Log.e("RobotConnection", "Corpus evaluation failed for " + manifest.getPath());
+                }
+            }
+        });
+    }
+
+    public boolean tuneThreshold(final String manifestName) {
+        final File manifest = new File(getOutputDir(), manifestName);
+        final File report = new File(getOutputDir(), "tune-" + System.currentTimeMillis() + ".txt");
+        return runDiagnostic("threshold tuning", new Runnable() {
+            @Override
+            public void run() {
+                int[] bounds = NativePart.tuneThreshold(manifest.getPath(), report.getPath());
+                if (bounds == null) {
+                    Log.e("RobotConnection", "HSV tuning failed for " + manifest.getPath());
+                    return;
+                }
+                Log.i("RobotConnection", "HSV tuned, report in " + report.getPath());
+                broadcastThresholdTuned(bounds);
+            }
+        });
+    }
+
     public void broadcastRobotConnected() {
         Intent i = new Intent(RobotConnectionStatusBroadcastReceiver.ACTION_ROBOT_CONNECTED);
         m_context.sendBroadcast(i);
@@ -266,6 +462,12 @@ public class RobotConnection {
         m_context.sendBroadcast(i);
     }
 
+    public void broadcastThresholdTuned(int[] hsvBounds) {
+        Intent i = new Intent(RobotEventBroadcastReceiver.ACTION_THRESHOLD_TUNED);
+        i.putExtra(RobotEventBroadcastReceiver.EXTRA_HSV_BOUNDS, hsvBounds);
+        m_context.sendBroadcast(i);
+    }
+
     public void broadcastRobotDisconnected() {
         Intent i = new Intent(RobotConnectionStatusBroadcastReceiver.ACTION_ROBOT_DISCONNECTED);
         m_context.sendBroadcast(i);
@@ -13,12 +13,24 @@ import java.util.List;
 public class VisionUpdate {
     protected List<CameraTargetInfo> m_targets;
     protected long m_captured = 0;
+    protected int m_degradation = 0;
 
     public VisionUpdate(long capturedAtTimestamp) {
         m_captured = capturedAtTimestamp;
         m_targets = new ArrayList<>(3);
     }
 
+    public long getCapturedAt() {
+        return m_captured;
+    }
+
+    /**
+     * NativePart.DEGRADE_* flags describing the load shedding applied to this frame.
+     */
+    public void setDegradation(int degradation) {
+        m_degradation = degradation;
+    }
+
     public void addCameraTargetInfo(CameraTargetInfo t) {
         m_targets.add(t);
     }
@@ -28,6 +40,9 @@ public class VisionUpdate {
         JSONObject j = new JSONObject();
         try {
             j.put("capturedAgoMs", captured_ago);
+            if (m_degradation != 0) {
+                j.put("degradation", m_degradation);
+            }
             JSONArray arr = new JSONArray();
             for (CameraTargetInfo t : m_targets) {
                 if (t != null) {
@@ -11,6 +11,17 @@ public class TargetUpdateMessage extends VisionMessage {
         mUpdate = update;
         mTimestamp = timestamp;
     }
+
+    @Override
+    public long getTraceId() {
+        return mUpdate.getCapturedAt();
+    }
+
+    @Override
+    public long getCreatedAt() {
+        return mTimestamp;
+    }
+
     @Override
     public String getType() {
         return "targets";
@@ -12,6 +12,16 @@ public abstract class VisionMessage {
 
     public abstract String getMessage();
 
+    // Frame trace id (capture start time) for NativePart.traceSpan, 0 if untraced
+    public long getTraceId() {
+        return 0;
+    }
+
+    // System.nanoTime() at which the message was created and queued
+    public long getCreatedAt() {
+        return 0;
+    }
+
     public String toJson() {
         JSONObject j = new JSONObject();
         try {
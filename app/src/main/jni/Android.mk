@@ -5,7 +5,17 @@ include $(CLEAR_VARS)
 include $(LOCAL_PATH)/OpenCV.mk
 
 LOCAL_MODULE    := JNIpart
-LOCAL_SRC_FILES := jni.c image_processor.cpp
+LOCAL_SRC_FILES := jni.c image_processor.cpp target_tracker.cpp \
+                   frame_trace.cpp perf_counters.cpp \
+                   deferred_log.cpp target_detector.cpp \
+                   frame_recorder.cpp recording_reader.cpp quad_fit.cpp \
+                   frame_budget.cpp camera_model.cpp \
+                   pose_estimator.cpp target_filter.cpp multi_detector.cpp \
+                   pipeline_plan.cpp filter_chain.cpp golden_corpus.cpp \
+                   scene_generator.cpp corpus_runner.cpp hsv_tuner.cpp \
+                   target_results.cpp shared_export.cpp \
+                   cpu_topology.cpp thermal_governor.cpp \
+                   field_fusion.cpp bit_mask.cpp exclusion_mask.cpp
 LOCAL_LDLIBS    += -llog -lGLESv2 -lEGL -ldl
 LOCAL_CPPFLAGS  += -O3 -std=c++11
 
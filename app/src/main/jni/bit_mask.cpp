@@ -0,0 +1,229 @@
+#include "bit_mask.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+const uint64_t kAllOnes = ~0ULL;
+const uint64_t kHighBits = 0x8080808080808080ULL;
+const uint64_t kLowBits7 = 0x7f7f7f7f7f7f7f7fULL;
+// Multiplying the high bit of each byte by this gathers them into the top
+// byte, byte i's bit landing in bit 56 + i
+const uint64_t kGatherHighBits = 0x0002040810204081ULL;
+
+// Eight 0/255 bytes for each byte of bits
+struct UnpackTable {
+  UnpackTable() {
+    for (int bits = 0; bits < 256; ++bits) {
+      uint64_t bytes = 0;
+      for (int i = 0; i < 8; ++i) {
+        if (bits & (1 << i)) {
+          bytes |= 0xffULL << (8 * i);
+        }
+      }
+      entries[bits] = bytes;
+    }
+  }
+  uint64_t entries[256];
+};
+
+const UnpackTable kUnpackTable;
+
+// Bits past width in the last word of a row
+uint64_t tailMask(int width) {
+  int bits = width % 64;
+  return bits == 0 ? kAllOnes : (1ULL << bits) - 1;
+}
+
+// 64 bits of a scratch row starting offset bits after word w; the row sits
+// one word into scratch, so offsets within +-63 stay inside it
+inline uint64_t window(const uint64_t *scratch, int w, int offset) {
+  int bit = (w + 1) * 64 + offset;
+  int word = bit >> 6;
+  int shift = bit & 63;
+  if (shift == 0) {
+    return scratch[word];
+  }
+  return (scratch[word] >> shift) | (scratch[word + 1] << (64 - shift));
+}
+
+// Min (erode) or max (dilate) over a row of `size` bits centred on each
+// pixel, in place. Pixels outside the row count as 1 for erosion and 0 for
+// dilation, so they never change the result.
+void horizontalPass(bool erode, int size, int width, uint64_t *row,
+                    uint64_t *scratch) {
+  if (size == 1) {
+    return;
+  }
+  int words = (width + 63) / 64;
+  uint64_t fill = erode ? kAllOnes : 0;
+  scratch[0] = fill;
+  memcpy(scratch + 1, row, words * sizeof(uint64_t));
+  if (erode) {
+    scratch[words] |= ~tailMask(width);
+  }
+  scratch[words + 1] = fill;
+  int first = -(size / 2);
+  int last = first + size - 1;
+  for (int w = 0; w < words; ++w) {
+    uint64_t value = window(scratch, w, first);
+    for (int offset = first + 1; offset <= last; ++offset) {
+      uint64_t shifted = window(scratch, w, offset);
+      value = erode ? value & shifted : value | shifted;
+    }
+    row[w] = value;
+  }
+  row[words - 1] &= tailMask(width);
+}
+
+void morph(const BitMask &src, bool erode, int size, BitMask *dst) {
+  dst->create(src.width(), src.height());
+  const int words = src.wordsPerRow();
+  const int height = src.height();
+  const int first = -(size / 2);
+  // Rows outside the mask are left out, which makes them neutral
+  for (int y = 0; y < height; ++y) {
+    int top = std::max(y + first, 0);
+    int bottom = std::min(y + first + size - 1, height - 1);
+    uint64_t *out = dst->row(y);
+    memcpy(out, src.row(top), words * sizeof(uint64_t));
+    for (int source = top + 1; source <= bottom; ++source) {
+      const uint64_t *in = src.row(source);
+      if (erode) {
+        for (int w = 0; w < words; ++w) {
+          out[w] &= in[w];
+        }
+      } else {
+        for (int w = 0; w < words; ++w) {
+          out[w] |= in[w];
+        }
+      }
+    }
+    horizontalPass(erode, size, src.width(), out, dst->scratch());
+  }
+}
+
+int64_t popcount(uint64_t word) {
+  return __builtin_popcountll(word);
+}
+
+} // namespace
+
+void BitMask::create(int width, int height) {
+  if (width == width_ && height == height_) {
+    std::fill(words_.begin(), words_.end(), 0);
+    return;
+  }
+  width_ = width;
+  height_ = height;
+  words_per_row_ = (width + 63) / 64;
+  words_.assign(static_cast<size_t>(words_per_row_) * height, 0);
+  scratch_.assign(words_per_row_ + 2, 0);
+}
+
+void BitMask::fromMat(const cv::Mat &mask) {
+  CV_Assert(mask.type() == CV_8UC1);
+  create(mask.cols, mask.rows);
+  for (int y = 0; y < height_; ++y) {
+    packMaskRow(mask.ptr<uint8_t>(y), width_, row(y));
+  }
+}
+
+void BitMask::toMat(cv::Mat *mask) const {
+  mask->create(height_, width_, CV_8UC1);
+  for (int y = 0; y < height_; ++y) {
+    unpackMaskRow(row(y), width_, mask->ptr<uint8_t>(y));
+  }
+}
+
+int64_t BitMask::count() const {
+  int64_t total = 0;
+  for (auto word : words_) {
+    total += popcount(word);
+  }
+  return total;
+}
+
+int64_t BitMask::count(const cv::Rect &rect) const {
+  cv::Rect clipped = rect & cv::Rect(0, 0, width_, height_);
+  if (clipped.area() == 0) {
+    return 0;
+  }
+  int first_word = clipped.x / 64;
+  int last_word = (clipped.x + clipped.width - 1) / 64;
+  uint64_t first_mask = kAllOnes << (clipped.x % 64);
+  uint64_t last_mask = tailMask(clipped.x + clipped.width);
+  int64_t total = 0;
+  for (int y = clipped.y; y < clipped.y + clipped.height; ++y) {
+    const uint64_t *words = row(y);
+    if (first_word == last_word) {
+      total += popcount(words[first_word] & first_mask & last_mask);
+      continue;
+    }
+    total += popcount(words[first_word] & first_mask);
+    for (int w = first_word + 1; w < last_word; ++w) {
+      total += popcount(words[w]);
+    }
+    total += popcount(words[last_word] & last_mask);
+  }
+  return total;
+}
+
+void packMaskRow(const uint8_t *bytes, int width, uint64_t *bits) {
+  int words = (width + 63) / 64;
+  memset(bits, 0, words * sizeof(uint64_t));
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint64_t v;
+    memcpy(&v, bytes + x, sizeof(v));
+    // High bit of every nonzero byte, without carries between bytes
+    v = (((v & kLowBits7) + kLowBits7) | v) & kHighBits;
+    bits[x / 64] |= ((v * kGatherHighBits) >> 56) << (x % 64);
+  }
+  for (; x < width; ++x) {
+    if (bytes[x] != 0) {
+      bits[x / 64] |= 1ULL << (x % 64);
+    }
+  }
+}
+
+void unpackMaskRow(const uint64_t *bits, int width, uint8_t *bytes) {
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    uint64_t v = kUnpackTable.entries[(bits[x / 64] >> (x % 64)) & 0xff];
+    memcpy(bytes + x, &v, sizeof(v));
+  }
+  for (; x < width; ++x) {
+    bytes[x] = (bits[x / 64] >> (x % 64)) & 1 ? 255 : 0;
+  }
+}
+
+void erodeBits(const BitMask &src, int size, BitMask *dst) {
+  morph(src, true, size, dst);
+}
+
+void dilateBits(const BitMask &src, int size, BitMask *dst) {
+  morph(src, false, size, dst);
+}
+
+void morphBits(const BitMask &src, BitMorphOp op, int size, BitMask *temp,
+               BitMask *dst) {
+  switch (op) {
+  case BIT_ERODE:
+    erodeBits(src, size, dst);
+    break;
+  case BIT_DILATE:
+    dilateBits(src, size, dst);
+    break;
+  case BIT_OPEN:
+    erodeBits(src, size, temp);
+    dilateBits(*temp, size, dst);
+    break;
+  case BIT_CLOSE:
+    dilateBits(src, size, temp);
+    erodeBits(*temp, size, dst);
+    break;
+  }
+}
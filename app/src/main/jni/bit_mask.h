@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Largest square kernel the word-parallel morphology takes; a row only
+// ever reaches into its neighbouring words
+const int kMaxBitKernel = 63;
+
+enum BitMorphOp { BIT_ERODE, BIT_DILATE, BIT_OPEN, BIT_CLOSE };
+
+// Binary mask at one bit per pixel: pixel x of a row is bit x % 64 of word
+// x / 64. Bits past the width are always 0. An 8-bit mask row of 640
+// pixels is 10 words, so a whole VGA mask fits in 38 KB and the operations
+// below handle 64 pixels per instruction.
+class BitMask {
+ public:
+  BitMask() : width_(0), height_(0), words_per_row_(0) {}
+
+  // Allocates and clears; keeps the buffer when the size is unchanged
+  void create(int width, int height);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int wordsPerRow() const { return words_per_row_; }
+  uint64_t *row(int y) { return &words_[y * words_per_row_]; }
+  const uint64_t *row(int y) const { return &words_[y * words_per_row_]; }
+
+  // Any nonzero pixel of an 8-bit mask is set
+  void fromMat(const cv::Mat &mask);
+  // Set pixels become 255, the rest 0; mask is created at the same size
+  void toMat(cv::Mat *mask) const;
+
+  // Pixels set, in the whole mask or within rect
+  int64_t count() const;
+  int64_t count(const cv::Rect &rect) const;
+
+  // One row with a spare word either side, for operating on a row in place
+  uint64_t *scratch() { return &scratch_[0]; }
+
+ private:
+  int width_;
+  int height_;
+  int words_per_row_;
+  std::vector<uint64_t> words_;
+  std::vector<uint64_t> scratch_;
+};
+
+// Packs width bytes (0 or nonzero) into bits, eight at a time; the tail of
+// the last word is cleared
+void packMaskRow(const uint8_t *bytes, int width, uint64_t *bits);
+// The reverse, writing 0 or 255
+void unpackMaskRow(const uint64_t *bits, int width, uint8_t *bytes);
+
+// Morphology with a size x size square, anchored at its centre as
+// cv::morphologyEx anchors it, and with pixels outside the mask never
+// changing the result, as with OpenCV's default border. The outputs have
+// the same result as cv::morphologyEx on the unpacked mask. src and dst
+// must differ; size is 1 to kMaxBitKernel.
+void erodeBits(const BitMask &src, int size, BitMask *dst);
+void dilateBits(const BitMask &src, int size, BitMask *dst);
+// Open and close run through temp
+void morphBits(const BitMask &src, BitMorphOp op, int size, BitMask *temp,
+               BitMask *dst);
@@ -0,0 +1,209 @@
+#include "camera_model.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "common.hpp"
+
+namespace {
+
+// Fixed point iterations of the distortion inverse, as cv::undistortPoints
+const int kUndistortIterations = 8;
+
+pthread_mutex_t sModelLock = PTHREAD_MUTEX_INITIALIZER;
+// 640x480 with the focal length of a typical phone until Camera2 reports one
+CameraModel sModel = {640, 480, 520.0, 520.0, 319.5, 239.5, {0, 0, 0, 0, 0},
+                      false};
+
+void setModel(const CameraModel &model) {
+  pthread_mutex_lock(&sModelLock);
+  sModel = model;
+  pthread_mutex_unlock(&sModelLock);
+}
+
+} // namespace
+
+extern "C" void cameraSetPinhole(int width, int height,
+                                 double focal_length_pixels) {
+  setModel(pinholeCameraModel(width, height, focal_length_pixels));
+  LOGI("Camera model %dx%d f=%.1lf, no distortion", width, height,
+       focal_length_pixels);
+}
+
+extern "C" int cameraLoadCalibration(const char *path) {
+  cv::Mat camera_matrix;
+  cv::Mat distortion;
+  int width = 0;
+  int height = 0;
+  try {
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+      LOGE("Could not open camera calibration %s", path);
+      return -1;
+    }
+    fs["camera_matrix"] >> camera_matrix;
+    fs["distortion_coefficients"] >> distortion;
+    fs["image_width"] >> width;
+    fs["image_height"] >> height;
+  } catch (const cv::Exception &e) {
+    LOGE("Could not parse camera calibration %s: %s", path, e.what());
+    return -1;
+  }
+  if (camera_matrix.rows != 3 || camera_matrix.cols != 3 || width <= 0 ||
+      height <= 0 || distortion.total() > 5) {
+    LOGE("%s is not a usable camera calibration", path);
+    return -1;
+  }
+  camera_matrix.convertTo(camera_matrix, CV_64F);
+  distortion.convertTo(distortion, CV_64F);
+
+  CameraModel model;
+  model.width = width;
+  model.height = height;
+  model.fx = camera_matrix.at<double>(0, 0);
+  model.fy = camera_matrix.at<double>(1, 1);
+  model.cx = camera_matrix.at<double>(0, 2);
+  model.cy = camera_matrix.at<double>(1, 2);
+  std::fill(model.distortion, model.distortion + 5, 0.0);
+  model.distorted = false;
+  for (size_t i = 0; i < distortion.total(); ++i) {
+    model.distortion[i] = distortion.ptr<double>()[i];
+    model.distorted = model.distorted || model.distortion[i] != 0;
+  }
+  setModel(model);
+  LOGI("Camera model %dx%d fx=%.1lf fy=%.1lf c=(%.1lf, %.1lf) from %s", width,
+       height, model.fx, model.fy, model.cx, model.cy, path);
+  return 0;
+}
+
+CameraModel pinholeCameraModel(int width, int height,
+                               double focal_length_pixels) {
+  CameraModel model;
+  model.width = width;
+  model.height = height;
+  model.fx = model.fy = focal_length_pixels;
+  // Same centre as the old Java angle code
+  model.cx = width / 2.0 - .5;
+  model.cy = height / 2.0 - .5;
+  std::fill(model.distortion, model.distortion + 5, 0.0);
+  model.distorted = false;
+  return model;
+}
+
+CameraModel cameraModel(int w, int h) {
+  pthread_mutex_lock(&sModelLock);
+  CameraModel model = sModel;
+  pthread_mutex_unlock(&sModelLock);
+  if (w != model.width || h != model.height) {
+    // Pixels stay square at another resolution, so both focal lengths take
+    // one factor. Another aspect ratio is a centred crop of the calibrated
+    // image scaled to cover w x h, as the camera's scaler makes it.
+    double scale = std::max(static_cast<double>(w) / model.width,
+                            static_cast<double>(h) / model.height);
+    model.fx *= scale;
+    model.fy *= scale;
+    model.cx = (model.cx + .5) * scale - .5 - (model.width * scale - w) / 2;
+    model.cy = (model.cy + .5) * scale - .5 - (model.height * scale - h) / 2;
+    model.width = w;
+    model.height = h;
+  }
+  return model;
+}
+
+cv::Point2d cameraNormalize(const CameraModel &model, cv::Point2d pixel) {
+  double x0 = (pixel.x - model.cx) / model.fx;
+  double y0 = (pixel.y - model.cy) / model.fy;
+  if (!model.distorted) {
+    return cv::Point2d(x0, y0);
+  }
+  const double k1 = model.distortion[0];
+  const double k2 = model.distortion[1];
+  const double p1 = model.distortion[2];
+  const double p2 = model.distortion[3];
+  const double k3 = model.distortion[4];
+  double x = x0;
+  double y = y0;
+  for (int i = 0; i < kUndistortIterations; ++i) {
+    double r2 = x * x + y * y;
+    double radial = 1 / (1 + ((k3 * r2 + k2) * r2 + k1) * r2);
+    double dx = 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+    double dy = p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+    x = (x0 - dx) * radial;
+    y = (y0 - dy) * radial;
+  }
+  return cv::Point2d(x, y);
+}
+
+cv::Point2d cameraProject(const CameraModel &model, cv::Point3d point) {
+  double x = point.x / point.z;
+  double y = point.y / point.z;
+  if (model.distorted) {
+    const double k1 = model.distortion[0];
+    const double k2 = model.distortion[1];
+    const double p1 = model.distortion[2];
+    const double p2 = model.distortion[3];
+    const double k3 = model.distortion[4];
+    double r2 = x * x + y * y;
+    double radial = 1 + ((k3 * r2 + k2) * r2 + k1) * r2;
+    double dx = 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+    double dy = p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+    x = x * radial + dx;
+    y = y * radial + dy;
+  }
+  return cv::Point2d(model.fx * x + model.cx, model.fy * y + model.cy);
+}
+
+void cameraTargetAngles(const CameraModel &model, const TargetInfo &target,
+                        TargetAngles *angles) {
+  cv::Point2d corners[4];
+  size_t num_corners = std::min<size_t>(target.points.size(), 4);
+  if (num_corners == 0) {
+    // No outline, fall back to the bounding box
+    cv::Point2d centre(target.centroid_x, target.centroid_y);
+    cv::Point2d half(target.width / 2, target.height / 2);
+    corners[0] = centre - half;
+    corners[1] = centre + cv::Point2d(half.x, -half.y);
+    corners[2] = centre + half;
+    corners[3] = centre + cv::Point2d(-half.x, half.y);
+    num_corners = 4;
+  } else {
+    for (size_t i = 0; i < num_corners; ++i) {
+      corners[i] = target.points[i];
+    }
+  }
+
+  cv::Point2d sum(0, 0);
+  double min_x = std::numeric_limits<double>::max();
+  double max_x = -std::numeric_limits<double>::max();
+  double min_y = std::numeric_limits<double>::max();
+  double max_y = -std::numeric_limits<double>::max();
+  for (size_t i = 0; i < num_corners; ++i) {
+    cv::Point2d p = cameraNormalize(model, corners[i]);
+    sum += p;
+    min_x = std::min(min_x, p.x);
+    max_x = std::max(max_x, p.x);
+    min_y = std::min(min_y, p.y);
+    max_y = std::max(max_y, p.y);
+  }
+  angles->h_angle = -std::atan(sum.x / num_corners);
+  angles->v_angle = -std::atan(sum.y / num_corners);
+  angles->h_width = std::atan(max_x) - std::atan(min_x);
+  angles->v_width = std::atan(max_y) - std::atan(min_y);
+}
+
+void cameraPointAngles(const CameraModel &model, cv::Point2d pixel,
+                       PointAngles *angles) {
+  cv::Point2d p = cameraNormalize(model, pixel);
+  angles->h_angle = -std::atan(p.x);
+  angles->v_angle = -std::atan(p.y);
+  // Central differences, so distortion is accounted for
+  cv::Point2d left = cameraNormalize(model, pixel - cv::Point2d(.5, 0));
+  cv::Point2d right = cameraNormalize(model, pixel + cv::Point2d(.5, 0));
+  cv::Point2d up = cameraNormalize(model, pixel - cv::Point2d(0, .5));
+  cv::Point2d down = cameraNormalize(model, pixel + cv::Point2d(0, .5));
+  angles->h_scale = std::atan(left.x) - std::atan(right.x);
+  angles->v_scale = std::atan(up.y) - std::atan(down.y);
+}
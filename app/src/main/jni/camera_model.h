@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Distortion-free model of a width x height image from the focal length
+// that Camera2 reports. Replaces any loaded calibration.
+void cameraSetPinhole(int width, int height, double focal_length_pixels);
+
+// Loads intrinsics and distortion coefficients from an OpenCV calibration
+// file (YAML or XML as written by the calibration sample: camera_matrix,
+// distortion_coefficients, image_width, image_height). Returns 0 on success;
+// on failure the current model is kept.
+int cameraLoadCalibration(const char *path);
+
+#ifdef __cplusplus
+}
+
+#include <opencv2/core.hpp>
+
+#include "target_info.h"
+
+// Pinhole camera with OpenCV's 5 coefficient radial/tangential distortion.
+struct CameraModel {
+  int width;
+  int height;
+  double fx;
+  double fy;
+  double cx;
+  double cy;
+  // k1, k2, p1, p2, k3
+  double distortion[5];
+  bool distorted;
+};
+
+// Target position and size as seen from the camera, in radians. +h is to
+// the left of the image and +v to the top, as CameraTargetInfo expects.
+struct TargetAngles {
+  double h_angle;
+  double v_angle;
+  double h_width;
+  double v_width;
+};
+
+// Angles of a single pixel, and d(angle)/d(pixel) there for mapping the
+// tracker's velocity and variance
+struct PointAngles {
+  double h_angle;
+  double v_angle;
+  double h_scale;
+  double v_scale;
+};
+
+// What cameraSetPinhole() installs
+CameraModel pinholeCameraModel(int width, int height,
+                               double focal_length_pixels);
+
+// Copy of the current model, scaled to a w x h image. An image of another
+// aspect ratio is taken to be a centred crop, so it sees a narrower field
+// of view along one axis rather than a stretched one.
+CameraModel cameraModel(int w, int h);
+
+// Image pixel -> undistorted normalized coordinates (x / z, y / z). Only
+// individual points are undistorted; the image itself never is.
+cv::Point2d cameraNormalize(const CameraModel &model, cv::Point2d pixel);
+
+// Camera-frame point (x right, y down, z forward) -> distorted image pixel;
+// the inverse of cameraNormalize for points in front of the camera.
+cv::Point2d cameraProject(const CameraModel &model, cv::Point3d point);
+
+// Angles of the target from its undistorted corners: the centre is the mean
+// of the corners and the widths their angular extent.
+void cameraTargetAngles(const CameraModel &model, const TargetInfo &target,
+                        TargetAngles *angles);
+
+void cameraPointAngles(const CameraModel &model, cv::Point2d pixel,
+                       PointAngles *angles);
+#endif
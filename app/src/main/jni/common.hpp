@@ -1,13 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __ANDROID__
 #include <android/log.h>
+#define LOG_PRINT(prio, ...) __android_log_print(prio, LOG_TAG, __VA_ARGS__)
+#define LOG_WRITE(prio, text) __android_log_write(prio, LOG_TAG, text)
+#else
+// Host builds (replay, benchmarks): same priorities, printed to stderr
+#include <stdio.h>
+enum {
+  ANDROID_LOG_VERBOSE = 2,
+  ANDROID_LOG_DEBUG = 3,
+  ANDROID_LOG_INFO = 4,
+  ANDROID_LOG_WARN = 5,
+  ANDROID_LOG_ERROR = 6
+};
+#define LOG_PRINT(prio, ...)                                                   \
+  (fprintf(stderr, LOG_TAG ": " __VA_ARGS__), fputc('\n', stderr))
+#define LOG_WRITE(prio, text) fprintf(stderr, LOG_TAG ": %s\n", text)
+#endif
+
 #define LOG_TAG "JNIpart"
+
+// Compile-time log level gate, e.g. -DLOG_MIN_LEVEL=ANDROID_LOG_INFO in
+// Android.mk. Calls below it compile to nothing and their arguments are not
+// evaluated.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL ANDROID_LOG_VERBOSE
+#endif
+#define LOG_ENABLED(prio) ((prio) >= LOG_MIN_LEVEL)
+
 #define LOGV(...)                                                              \
-  ((void)__android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__))
+  ((void)(LOG_ENABLED(ANDROID_LOG_VERBOSE) &&                                  \
+          LOG_PRINT(ANDROID_LOG_VERBOSE, __VA_ARGS__)))
 #define LOGD(...)                                                              \
-  ((void)__android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__))
+  ((void)(LOG_ENABLED(ANDROID_LOG_DEBUG) &&                                    \
+          LOG_PRINT(ANDROID_LOG_DEBUG, __VA_ARGS__)))
 #define LOGI(...)                                                              \
-  ((void)__android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__))
+  ((void)(LOG_ENABLED(ANDROID_LOG_INFO) &&                                     \
+          LOG_PRINT(ANDROID_LOG_INFO, __VA_ARGS__)))
 #define LOGE(...)                                                              \
-  ((void)__android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__))
+  ((void)(LOG_ENABLED(ANDROID_LOG_ERROR) &&                                    \
+          LOG_PRINT(ANDROID_LOG_ERROR, __VA_ARGS__)))
 
 #include <time.h> // clock_gettime
 
@@ -17,6 +52,12 @@ static inline int64_t getTimeMs() {
   return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
 
+static inline int64_t getTimeNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
 static inline int getTimeInterval(int64_t startTime) {
   return int(getTimeMs() - startTime);
 }
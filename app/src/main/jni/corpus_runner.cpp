@@ -0,0 +1,240 @@
+#include "corpus_runner.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "common.hpp"
+#include "cpu_topology.h"
+#include "recording_reader.h"
+
+namespace {
+
+const size_t kReportedWorstFrames = 20;
+
+} // namespace
+
+const size_t CorpusRunner::kShardFrames;
+
+CorpusRunner::CorpusRunner(const std::vector<GoldenEntry> &entries)
+    : entries_(entries), next_shard_(0), failed_(false), num_workers_(0),
+      wall_ns_(0) {}
+
+bool CorpusRunner::run(int num_workers) {
+  offsets_.clear();
+  shards_.clear();
+  size_t total = 0;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    offsets_.push_back(total);
+    size_t count;
+    if (entries_[i].synthetic) {
+      count = entries_[i].frames;
+      Shard shard = {i, 0, count};
+      shards_.push_back(shard);
+    } else {
+      RecordingReader reader;
+      if (!reader.open(entries_[i].path.c_str())) {
+        return false;
+      }
+      count = reader.size();
+      for (size_t begin = 0; begin < count; begin += kShardFrames) {
+        Shard shard = {i, begin, std::min(count, begin + kShardFrames)};
+        shards_.push_back(shard);
+      }
+    }
+    total += count;
+  }
+  offsets_.push_back(total);
+  frames_.assign(total, CorpusFrame());
+
+  if (num_workers <= 0) {
+    num_workers = threadRoleCoreCount(THREAD_WORKER);
+  }
+  num_workers_ = std::max(
+      1, std::min(num_workers, static_cast<int>(shards_.size())));
+  next_shard_ = 0;
+  failed_ = false;
+  int64_t start = getTimeNs();
+  std::vector<pthread_t> threads;
+  // The calling thread is worker 0
+  for (int i = 1; i < num_workers_; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workerMain, this) == 0) {
+      threads.push_back(thread);
+    }
+  }
+  work();
+  for (auto thread : threads) {
+    pthread_join(thread, NULL);
+  }
+  wall_ns_ = getTimeNs() - start;
+  return !failed_;
+}
+
+void *CorpusRunner::workerMain(void *runner) {
+  static_cast<CorpusRunner *>(runner)->work();
+  return NULL;
+}
+
+void CorpusRunner::work() {
+  uint32_t placement_generation = 0;
+  placeCurrentThread(THREAD_WORKER, &placement_generation);
+  GoldenDetector detector;
+  for (;;) {
+    size_t index = next_shard_.fetch_add(1);
+    if (index >= shards_.size() || failed_) {
+      return;
+    }
+    const Shard &shard = shards_[index];
+    detector.setPipeline(entries_[shard.entry]);
+    if (entries_[shard.entry].synthetic) {
+      runSyntheticShard(shard, &detector);
+    } else {
+      runRecordingShard(shard, &detector);
+    }
+  }
+}
+
+void CorpusRunner::runRecordingShard(const Shard &shard,
+                                     GoldenDetector *detector) {
+  const GoldenEntry &entry = entries_[shard.entry];
+  RecordingReader reader;
+  if (!reader.open(entry.path.c_str())) {
+    failed_ = true;
+    return;
+  }
+  RecordedFrame frame;
+  DetectionResult detection;
+  for (size_t i = shard.begin; i < shard.end && i < reader.size(); ++i) {
+    CorpusFrame &result = frames_[offsets_[shard.entry] + i];
+    if (!reader.read(i, &frame)) {
+      continue;
+    }
+    result.time_ns = detector->detect(frame, &detection);
+    double error;
+    result.valid = true;
+    result.sequence = frame.sequence;
+    result.targets = detection.targets.size();
+    result.expected_targets = frame.targets.size();
+    result.diverged = !targetsMatch(frame.targets, detection.targets,
+                                    entry.tolerance, &error);
+  }
+}
+
+void CorpusRunner::runSyntheticShard(const Shard &shard,
+                                     GoldenDetector *detector) {
+  const GoldenEntry &entry = entries_[shard.entry];
+  SyntheticFrames frames(entry);
+  cv::Mat rgba;
+  std::vector<TargetInfo> expected;
+  DetectionResult detection;
+  for (size_t i = shard.begin; i < shard.end; ++i) {
+    if (!frames.next(&rgba, &expected)) {
+      continue;
+    }
+    CorpusFrame &result = frames_[offsets_[shard.entry] + i];
+    result.time_ns =
+        detector->detect(rgba, frames.threshold(), i, &detection);
+    double error;
+    result.valid = true;
+    result.sequence = i;
+    result.targets = detection.targets.size();
+    result.expected_targets = expected.size();
+    result.diverged =
+        !targetsMatch(expected, detection.targets, entry.tolerance, &error);
+  }
+}
+
+int CorpusRunner::validFrames() const {
+  int frames = 0;
+  for (auto &frame : frames_) {
+    frames += frame.valid ? 1 : 0;
+  }
+  return frames;
+}
+
+double CorpusRunner::framesPerSecond() const {
+  return wall_ns_ > 0 ? validFrames() * 1e9 / wall_ns_ : 0;
+}
+
+CorpusStats CorpusRunner::stats(size_t entry) const {
+  CorpusStats stats;
+  memset(&stats, 0, sizeof(stats));
+  int64_t total_ns = 0;
+  for (size_t i = offsets_[entry]; i < offsets_[entry + 1]; ++i) {
+    const CorpusFrame &frame = frames_[i];
+    if (!frame.valid) {
+      continue;
+    }
+    stats.frames++;
+    stats.frames_with_targets += frame.targets > 0 ? 1 : 0;
+    stats.targets += frame.targets;
+    stats.diverged += frame.diverged ? 1 : 0;
+    total_ns += frame.time_ns;
+    stats.max_ms = std::max(stats.max_ms, frame.time_ns / 1e6);
+  }
+  if (stats.frames > 0) {
+    stats.mean_ms = total_ns / 1e6 / stats.frames;
+  }
+  return stats;
+}
+
+void CorpusRunner::writeReport(FILE *report, size_t num_worst) const {
+  fprintf(report, "%d frames in %.3f s on %d workers: %.1f frames/s\n",
+          validFrames(), wall_ns_ / 1e9, num_workers_, framesPerSecond());
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    CorpusStats s = stats(i);
+    fprintf(report,
+            "%s: %d frames, %d with targets, %.2f targets/frame, "
+            "%d diverged, mean %.3f ms, max %.3f ms\n",
+            entries_[i].path.c_str(), s.frames, s.frames_with_targets,
+            s.frames > 0 ? static_cast<double>(s.targets) / s.frames : 0.0,
+            s.diverged, s.mean_ms, s.max_ms);
+  }
+
+  std::vector<size_t> order;
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (frames_[i].valid) {
+      order.push_back(i);
+    }
+  }
+  num_worst = std::min(num_worst, order.size());
+  std::partial_sort(order.begin(), order.begin() + num_worst, order.end(),
+                    [this](size_t a, size_t b) {
+                      return frames_[a].time_ns > frames_[b].time_ns;
+                    });
+  fprintf(report, "Slowest frames:\n");
+  for (size_t i = 0; i < num_worst; ++i) {
+    size_t entry = std::upper_bound(offsets_.begin(), offsets_.end(),
+                                    order[i]) -
+                   offsets_.begin() - 1;
+    const CorpusFrame &frame = frames_[order[i]];
+    fprintf(report, "  %s frame %llu: %.3f ms, %d targets\n",
+            entries_[entry].path.c_str(),
+            static_cast<unsigned long long>(frame.sequence),
+            frame.time_ns / 1e6, frame.targets);
+  }
+}
+
+extern "C" double corpusEvaluate(const char *manifest_path,
+                                 const char *report_path, int num_workers) {
+  std::vector<GoldenEntry> entries;
+  if (!loadGoldenManifest(manifest_path, &entries)) {
+    return -1;
+  }
+  CorpusRunner runner(entries);
+  if (!runner.run(num_workers)) {
+    return -1;
+  }
+  FILE *report = fopen(report_path, "w");
+  if (report == NULL) {
+    LOGE("Cannot write corpus report %s", report_path);
+    return -1;
+  }
+  runner.writeReport(report, kReportedWorstFrames);
+  fclose(report);
+  LOGI("Corpus of %d frames evaluated at %.1f frames/s",
+       runner.validFrames(), runner.framesPerSecond());
+  return runner.framesPerSecond();
+}
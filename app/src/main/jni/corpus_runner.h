@@ -0,0 +1,92 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runs every frame listed in a golden manifest (see golden_corpus.h)
+// through the detector on num_workers threads, or for 0 one per core the
+// worker placement allows (see cpu_topology.h), and writes per-recording
+// target statistics and the slowest frames to report_path. Returns the
+// aggregate frames per second, or -1 if the manifest or a recording cannot
+// be read.
+double corpusEvaluate(const char *manifest_path, const char *report_path,
+                      int num_workers);
+
+#ifdef __cplusplus
+}
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <vector>
+
+#include "golden_corpus.h"
+
+struct CorpusFrame {
+  // False for ring slots that could not be read and synthetic frames that
+  // were skipped
+  bool valid;
+  uint64_t sequence;
+  int targets;
+  int expected_targets;
+  bool diverged;
+  int64_t time_ns;
+};
+
+struct CorpusStats {
+  int frames;
+  int frames_with_targets;
+  int64_t targets;
+  int diverged;
+  double mean_ms;
+  double max_ms;
+};
+
+// Shards recordings into runs of kShardFrames frames and hands the shards
+// to worker threads as they come free. Each worker owns a GoldenDetector,
+// so nothing is shared but the shard counter, and every frame's result
+// goes to its own slot, so the results come out in frame order whatever
+// order the shards finished in. A synthetic entry is one shard because its
+// frames come from one random sequence.
+class CorpusRunner {
+ public:
+  static const size_t kShardFrames = 256;
+
+  explicit CorpusRunner(const std::vector<GoldenEntry> &entries);
+
+  // Returns false if a recording could not be read
+  bool run(int num_workers);
+
+  // Frame slots, one per recorded or synthetic frame, in manifest order
+  const std::vector<CorpusFrame> &frames() const { return frames_; }
+  // The slots that were read and detected; what framesPerSecond() counts
+  int validFrames() const;
+  double framesPerSecond() const;
+  CorpusStats stats(size_t entry) const;
+  void writeReport(FILE *report, size_t num_worst) const;
+
+ private:
+  struct Shard {
+    size_t entry;
+    size_t begin;
+    size_t end;
+  };
+
+  static void *workerMain(void *runner);
+  void work();
+  void runRecordingShard(const Shard &shard, GoldenDetector *detector);
+  void runSyntheticShard(const Shard &shard, GoldenDetector *detector);
+
+  std::vector<GoldenEntry> entries_;
+  // First slot of each entry in frames_, plus the total at the end
+  std::vector<size_t> offsets_;
+  std::vector<Shard> shards_;
+  std::vector<CorpusFrame> frames_;
+  std::atomic<size_t> next_shard_;
+  std::atomic<bool> failed_;
+  int num_workers_;
+  int64_t wall_ns_;
+};
+#endif
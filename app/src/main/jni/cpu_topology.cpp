@@ -0,0 +1,325 @@
+#include "cpu_topology.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+
+#include "common.hpp"
+
+namespace {
+
+const char kSysfsCpuRoot[] = "/sys/devices/system/cpu";
+// Cores at least this fast relative to the fastest count as big, so a
+// prime core does not leave its cluster out
+const double kBigCapacityRatio = 0.75;
+
+const char *kRoleNames[THREAD_NUM_ROLES] = {"vision", "worker", "background"};
+
+pthread_once_t sTopologyOnce = PTHREAD_ONCE_INIT;
+CpuTopology sTopology;
+
+pthread_mutex_t sPlacementLock = PTHREAD_MUTEX_INITIALIZER;
+bool sPlacementSet = false;
+ThreadPlacement sPlacement;
+// Bumped on every change; starts at 1 so the defaults apply once
+std::atomic<uint32_t> sGeneration(1);
+
+// With sPlacementLock held
+ThreadPlacement &placement() {
+  if (!sPlacementSet) {
+    sPlacement = defaultThreadPlacement(cpuTopology());
+    sPlacementSet = true;
+  }
+  return sPlacement;
+}
+
+std::string formatCpuList(const std::vector<int> &cpus) {
+  std::ostringstream out;
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    size_t end = i;
+    while (end + 1 < cpus.size() && cpus[end + 1] == cpus[end] + 1) {
+      ++end;
+    }
+    out << (i > 0 ? "," : "") << cpus[i];
+    if (end > i) {
+      out << "-" << cpus[end];
+    }
+    i = end;
+  }
+  return out.str();
+}
+
+void loadTopology() {
+  if (!sTopology.load(kSysfsCpuRoot)) {
+    LOGE("Could not read the CPU topology from %s", kSysfsCpuRoot);
+  } else {
+    LOGI("CPU topology: %s", sTopology.describe().c_str());
+  }
+}
+
+bool parsePlacementValue(const std::string &value,
+                         const CpuTopology &topology, std::vector<int> *cpus) {
+  if (value == "big") {
+    *cpus = topology.bigCores();
+  } else if (value == "little") {
+    *cpus = topology.littleCores();
+  } else if (value == "any") {
+    cpus->clear();
+  } else {
+    return parseCpuList(value.c_str(), cpus);
+  }
+  return true;
+}
+
+void applyPlacement(ThreadRole role, const std::vector<int> &cpus,
+                    bool set_nice, int nice) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  if (cpus.empty()) {
+    for (auto &cpu : cpuTopology().cpus()) {
+      CPU_SET(cpu.id, &set);
+    }
+  }
+  // pid 0 is the calling thread, not the process. An empty set means the
+  // topology could not be read, so the thread stays where it is.
+  if (CPU_COUNT(&set) > 0 && sched_setaffinity(0, sizeof(set), &set) != 0) {
+    LOGE("Could not move the %s thread to cores %s", kRoleNames[role],
+         formatCpuList(cpus).c_str());
+  }
+  if (set_nice && setpriority(PRIO_PROCESS, gettid(), nice) != 0) {
+    LOGE("Could not set the %s thread's nice value to %d", kRoleNames[role],
+         nice);
+  }
+}
+
+} // namespace
+
+bool CpuTopology::load(const std::string &root) {
+  cpus_.clear();
+  big_.clear();
+  little_.clear();
+  DIR *dir = opendir(root.c_str());
+  if (dir == NULL) {
+    return false;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char *end;
+    const char *name = entry->d_name;
+    if (strncmp(name, "cpu", 3) != 0 || name[3] < '0' || name[3] > '9') {
+      continue;
+    }
+    long id = strtol(name + 3, &end, 10);
+    if (*end != '\0') {
+      continue;
+    }
+    std::string path = root + "/" + name;
+    CpuInfo cpu;
+    cpu.id = static_cast<int>(id);
+    // cpu0 usually has no online file: it cannot be taken offline
+    cpu.online = readSysfsNumber(path + "/online") != 0;
+    cpu.capacity = readSysfsNumber(path + "/cpu_capacity");
+    if (cpu.capacity <= 0) {
+      cpu.capacity = std::max<int64_t>(
+          readSysfsNumber(path + "/cpufreq/cpuinfo_max_freq"), 0);
+    }
+    cpus_.push_back(cpu);
+  }
+  closedir(dir);
+  std::sort(cpus_.begin(), cpus_.end(),
+            [](const CpuInfo &a, const CpuInfo &b) { return a.id < b.id; });
+
+  int64_t fastest = 0;
+  int64_t slowest = -1;
+  for (auto &cpu : cpus_) {
+    if (cpu.online) {
+      fastest = std::max(fastest, cpu.capacity);
+      slowest = slowest < 0 ? cpu.capacity : std::min(slowest, cpu.capacity);
+    }
+  }
+  for (auto &cpu : cpus_) {
+    if (!cpu.online) {
+      continue;
+    }
+    if (cpu.capacity >= fastest * kBigCapacityRatio) {
+      big_.push_back(cpu.id);
+    }
+    if (cpu.capacity == slowest) {
+      little_.push_back(cpu.id);
+    }
+  }
+  return !big_.empty();
+}
+
+std::string CpuTopology::describe() const {
+  std::ostringstream out;
+  out << cpus_.size() << " cores, big " << formatCpuList(big_) << ", little "
+      << formatCpuList(little_) << ", capacity";
+  for (auto &cpu : cpus_) {
+    out << " " << cpu.id << ":" << (cpu.online ? "" : "off/") << cpu.capacity;
+  }
+  return out.str();
+}
+
+int64_t readSysfsNumber(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == NULL) {
+    return -1;
+  }
+  long long value;
+  int count = fscanf(file, "%lld", &value);
+  fclose(file);
+  return count == 1 ? value : -1;
+}
+
+bool parseCpuList(const char *text, std::vector<int> *cpus) {
+  std::vector<int> parsed;
+  const char *p = text;
+  while (*p != '\0') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0 || first >= CPU_SETSIZE) {
+      return false;
+    }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first || last >= CPU_SETSIZE) {
+        return false;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      parsed.push_back(static_cast<int>(cpu));
+    }
+    if (*p == ',') {
+      ++p;
+    } else if (*p != '\0') {
+      return false;
+    }
+  }
+  if (parsed.empty()) {
+    return false;
+  }
+  std::sort(parsed.begin(), parsed.end());
+  parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+  cpus->swap(parsed);
+  return true;
+}
+
+ThreadPlacement defaultThreadPlacement(const CpuTopology &topology) {
+  ThreadPlacement placement;
+  placement.cpus[THREAD_VISION] = topology.bigCores();
+  // Offline pools stay off the vision thread's cores where the SoC has any
+  // others
+  const std::vector<int> &big = topology.bigCores();
+  for (auto &cpu : topology.cpus()) {
+    if (cpu.online && std::find(big.begin(), big.end(), cpu.id) == big.end()) {
+      placement.cpus[THREAD_WORKER].push_back(cpu.id);
+    }
+  }
+  if (placement.cpus[THREAD_WORKER].empty()) {
+    placement.cpus[THREAD_WORKER] = topology.littleCores();
+  }
+  placement.cpus[THREAD_BACKGROUND] = topology.littleCores();
+  for (int role = 0; role < THREAD_NUM_ROLES; ++role) {
+    placement.set_nice[role] = false;
+    placement.nice[role] = 0;
+  }
+  return placement;
+}
+
+bool parseThreadPlacement(const char *spec, const CpuTopology &topology,
+                          ThreadPlacement *placement) {
+  ThreadPlacement parsed = *placement;
+  std::istringstream lines(spec);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::istringstream tokens(line.substr(0, line.find('#')));
+    std::string token;
+    while (tokens >> token) {
+      size_t equals = token.find('=');
+      if (equals == std::string::npos) {
+        LOGE("Bad thread placement: %s", token.c_str());
+        return false;
+      }
+      std::string key = token.substr(0, equals);
+      std::string value = token.substr(equals + 1);
+      bool known = false;
+      for (int role = 0; role < THREAD_NUM_ROLES && !known; ++role) {
+        if (key == kRoleNames[role]) {
+          known = parsePlacementValue(value, topology, &parsed.cpus[role]);
+        } else if (key == std::string(kRoleNames[role]) + "_nice") {
+          char *end;
+          long nice = strtol(value.c_str(), &end, 10);
+          known = !value.empty() && *end == '\0' && nice >= -20 && nice <= 19;
+          parsed.set_nice[role] = true;
+          parsed.nice[role] = static_cast<int>(nice);
+        }
+      }
+      if (!known) {
+        LOGE("Bad thread placement: %s", token.c_str());
+        return false;
+      }
+    }
+  }
+  *placement = parsed;
+  return true;
+}
+
+const CpuTopology &cpuTopology() {
+  pthread_once(&sTopologyOnce, loadTopology);
+  return sTopology;
+}
+
+void placeCurrentThread(ThreadRole role, uint32_t *generation) {
+  uint32_t current = sGeneration.load(std::memory_order_acquire);
+  if (*generation == current) {
+    return;
+  }
+  // The vision thread must not wait on a reconfiguration; it retries next
+  // frame
+  if (pthread_mutex_trylock(&sPlacementLock) != 0) {
+    return;
+  }
+  std::vector<int> cpus = placement().cpus[role];
+  bool set_nice = placement().set_nice[role];
+  int nice = placement().nice[role];
+  current = sGeneration.load(std::memory_order_relaxed);
+  pthread_mutex_unlock(&sPlacementLock);
+  applyPlacement(role, cpus, set_nice, nice);
+  *generation = current;
+}
+
+int threadRoleCoreCount(ThreadRole role) {
+  pthread_mutex_lock(&sPlacementLock);
+  int count = static_cast<int>(placement().cpus[role].size());
+  pthread_mutex_unlock(&sPlacementLock);
+  if (count == 0) {
+    count = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  return std::max(count, 1);
+}
+
+extern "C" int threadPlacementConfigure(const char *spec) {
+  pthread_mutex_lock(&sPlacementLock);
+  bool ok = parseThreadPlacement(spec, cpuTopology(), &placement());
+  if (ok) {
+    sGeneration.fetch_add(1);
+  }
+  pthread_mutex_unlock(&sPlacementLock);
+  return ok ? 0 : -1;
+}
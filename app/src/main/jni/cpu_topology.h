@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sets where each kind of thread runs, as space or newline separated
+// key=value pairs:
+//   vision=PLACEMENT      the GL thread running processFrame()
+//   worker=PLACEMENT      offline pools such as the corpus runner
+//   background=PLACEMENT  recorder writer and log drain
+//   vision_nice=N worker_nice=N background_nice=N
+// PLACEMENT is big (the fastest cores), little (the slowest), any, or a
+// CPU list such as 0-3,6. Roles that are left out keep their placement;
+// the defaults are vision=big, worker on every online core that is not
+// big (all of them on a homogeneous SoC) and background=little, with nice
+// values left alone. '#' starts a comment. Threads pick the change up at
+// their next frame or loop. Returns 0 on success; on an invalid spec
+// nothing changes.
+int threadPlacementConfigure(const char *spec);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+#include <vector>
+
+enum ThreadRole { THREAD_VISION, THREAD_WORKER, THREAD_BACKGROUND,
+                  THREAD_NUM_ROLES };
+
+struct CpuInfo {
+  int id;
+  bool online;
+  // cpu_capacity (1024 for the fastest core) where the kernel exports it,
+  // otherwise cpuinfo_max_freq in kHz; 0 if neither is readable
+  int64_t capacity;
+};
+
+// Cores and their relative speed, from the cpufreq and capacity files
+// under a sysfs CPU directory, normally /sys/devices/system/cpu. Tests
+// point it at a fake tree.
+class CpuTopology {
+ public:
+  bool load(const std::string &root);
+
+  const std::vector<CpuInfo> &cpus() const { return cpus_; }
+  // Online cores within kBigCapacityRatio of the fastest, and the online
+  // cores of the slowest capacity. On a homogeneous SoC both are all cores.
+  const std::vector<int> &bigCores() const { return big_; }
+  const std::vector<int> &littleCores() const { return little_; }
+  std::string describe() const;
+
+ private:
+  std::vector<CpuInfo> cpus_;
+  std::vector<int> big_;
+  std::vector<int> little_;
+};
+
+struct ThreadPlacement {
+  // Empty for any core
+  std::vector<int> cpus[THREAD_NUM_ROLES];
+  bool set_nice[THREAD_NUM_ROLES];
+  int nice[THREAD_NUM_ROLES];
+};
+
+ThreadPlacement defaultThreadPlacement(const CpuTopology &topology);
+
+// Applies spec on top of placement; false (placement unchanged) on errors
+bool parseThreadPlacement(const char *spec, const CpuTopology &topology,
+                          ThreadPlacement *placement);
+
+// First number in a sysfs file, or -1
+int64_t readSysfsNumber(const std::string &path);
+
+// "0-3,6" to {0, 1, 2, 3, 6}; false on malformed lists
+bool parseCpuList(const char *text, std::vector<int> *cpus);
+
+// The device's topology, read once
+const CpuTopology &cpuTopology();
+
+// Moves the calling thread to its role's cores and nice value if the
+// placement changed since *generation (0 before the first call). Costs one
+// atomic load when nothing changed, so loops call it every iteration. Never
+// waits on threadPlacementConfigure().
+void placeCurrentThread(ThreadRole role, uint32_t *generation);
+
+// Cores the role's threads may run on, for sizing a pool
+int threadRoleCoreCount(ThreadRole role);
+#endif
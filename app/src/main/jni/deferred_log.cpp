@@ -0,0 +1,217 @@
+#include "deferred_log.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "cpu_topology.h"
+
+namespace {
+
+const useconds_t kDrainPeriodUs = 10000;
+
+pthread_once_t sOnce = PTHREAD_ONCE_INIT;
+pthread_key_t sRingKey;
+pthread_mutex_t sMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void *drainThread(void *);
+void retireRing(void *ring);
+
+void initOnce() {
+  pthread_key_create(&sRingKey, retireRing);
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, drainThread, NULL) == 0) {
+    pthread_detach(thread);
+  }
+}
+
+// Renders a single conversion `spec` (e.g. "%.2lf") with the argument type
+// recorded at the call site.
+int formatArg(char *out, size_t size, const char *spec, uint8_t type,
+              const LogArg &arg) {
+  switch (type) {
+  case LOG_ARG_INT:
+    return snprintf(out, size, spec, static_cast<int>(arg.i));
+  case LOG_ARG_UINT:
+    return snprintf(out, size, spec, static_cast<unsigned>(arg.u));
+  case LOG_ARG_LONG:
+    return snprintf(out, size, spec, static_cast<long>(arg.i));
+  case LOG_ARG_ULONG:
+    return snprintf(out, size, spec, static_cast<unsigned long>(arg.u));
+  case LOG_ARG_LONG_LONG:
+    return snprintf(out, size, spec, static_cast<long long>(arg.i));
+  case LOG_ARG_ULONG_LONG:
+    return snprintf(out, size, spec, static_cast<unsigned long long>(arg.u));
+  case LOG_ARG_DOUBLE:
+    return snprintf(out, size, spec, arg.d);
+  case LOG_ARG_STRING:
+    return snprintf(out, size, spec, arg.s);
+  }
+  return 0;
+}
+
+} // namespace
+
+class LogDrain {
+ public:
+  static LogDrain &instance() {
+    static LogDrain drain;
+    return drain;
+  }
+
+  void add(LogRing *ring) {
+    pthread_mutex_lock(&sMutex);
+    rings_.push_back(ring);
+    pthread_mutex_unlock(&sMutex);
+  }
+
+  bool setFile(const char *path) {
+    pthread_mutex_lock(&sMutex);
+    if (file_ != NULL) {
+      fclose(file_);
+      file_ = NULL;
+    }
+    if (path != NULL) {
+      file_ = fopen(path, "a");
+    }
+    bool ok = path == NULL || file_ != NULL;
+    pthread_mutex_unlock(&sMutex);
+    return ok;
+  }
+
+  void drain() {
+    pthread_mutex_lock(&sMutex);
+    for (size_t i = 0; i < rings_.size();) {
+      LogRing *ring = rings_[i];
+      drainRing(ring);
+      if (ring->retired_.load(std::memory_order_acquire)) {
+        drainRing(ring);
+        delete ring;
+        rings_[i] = rings_.back();
+        rings_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+    if (file_ != NULL) {
+      fflush(file_);
+    }
+    pthread_mutex_unlock(&sMutex);
+  }
+
+ private:
+  LogDrain() : file_(NULL) {}
+
+  void drainRing(LogRing *ring) {
+    char line[512];
+    uint32_t tail = ring->tail_.load(std::memory_order_relaxed);
+    uint32_t head = ring->head_.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      const LogRecord &record = ring->records_[tail & (LogRing::kCapacity - 1)];
+      deferredLogFormat(record, line, sizeof(line));
+      emit(record.site->level, record.time_ns, line);
+    }
+    ring->tail_.store(tail, std::memory_order_release);
+    uint32_t dropped = ring->dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+      snprintf(line, sizeof(line), "deferred log dropped %u records",
+               dropped);
+      emit(ANDROID_LOG_ERROR, getTimeNs(), line);
+    }
+  }
+
+  void emit(int level, int64_t time_ns, const char *text) {
+    LOG_WRITE(level, text);
+    if (file_ != NULL) {
+      fprintf(file_, "%lld.%06lld %d %s\n", (long long)(time_ns / 1000000000),
+              (long long)(time_ns % 1000000000 / 1000), level, text);
+    }
+  }
+
+  std::vector<LogRing *> rings_;
+  FILE *file_;
+};
+
+namespace {
+
+void *drainThread(void *) {
+  uint32_t placement_generation = 0;
+  while (true) {
+    usleep(kDrainPeriodUs);
+    placeCurrentThread(THREAD_BACKGROUND, &placement_generation);
+    LogDrain::instance().drain();
+  }
+  return NULL;
+}
+
+void retireRing(void *ring) {
+  static_cast<LogRing *>(ring)->retire();
+}
+
+} // namespace
+
+LogRing::LogRing() : head_(0), tail_(0), dropped_(0), retired_(false) {}
+
+LogRing *deferredLogRing() {
+  pthread_once(&sOnce, initOnce);
+  LogRing *ring = static_cast<LogRing *>(pthread_getspecific(sRingKey));
+  if (ring == NULL) {
+    ring = new LogRing();
+    pthread_setspecific(sRingKey, ring);
+    LogDrain::instance().add(ring);
+  }
+  return ring;
+}
+
+void deferredLogFlush() {
+  pthread_once(&sOnce, initOnce);
+  LogDrain::instance().drain();
+}
+
+bool deferredLogSetFile(const char *path) {
+  return LogDrain::instance().setFile(path);
+}
+
+int deferredLogFormat(const LogRecord &record, char *buffer, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  const char *format = record.site->format;
+  size_t length = 0;
+  int arg = 0;
+  char spec[32];
+  while (*format != '\0' && length + 1 < size) {
+    if (*format != '%') {
+      buffer[length++] = *format++;
+      continue;
+    }
+    if (format[1] == '%') {
+      buffer[length++] = '%';
+      format += 2;
+      continue;
+    }
+    // Copy one conversion specification, up to and including its type
+    size_t spec_length = 0;
+    do {
+      spec[spec_length++] = *format++;
+    } while (*format != '\0' && spec_length + 1 < sizeof(spec) &&
+             strchr("diouxXeEfFgGaAcsp", format[-1]) == NULL);
+    spec[spec_length] = '\0';
+    if (arg >= record.num_args) {
+      break; // malformed format; -Wformat at the call site catches this
+    }
+    int written = formatArg(buffer + length, size - length, spec,
+                            record.types[arg], record.args[arg]);
+    arg++;
+    if (written > 0) {
+      length += static_cast<size_t>(written);
+      if (length >= size) {
+        length = size - 1;
+      }
+    }
+  }
+  buffer[length] = '\0';
+  return static_cast<int>(length);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#include "common.hpp"
+
+// Deferred logging for the frame thread. DLOGD("x=%.2lf", x) copies a
+// pointer to the call site's static format and the raw argument bytes into
+// a per-thread lock-free ring; a background thread formats the records and
+// writes them to logcat (stderr on a host) and optionally to a file. The
+// same LOG_MIN_LEVEL gate as LOGx applies at compile time.
+//
+// Supported arguments are arithmetic values and string literals (only the
+// pointer is stored, so never pass a buffer that may change or be freed).
+
+struct LogSite {
+  int level;
+  const char *format;
+};
+
+enum LogArgType {
+  LOG_ARG_INT,
+  LOG_ARG_UINT,
+  LOG_ARG_LONG,
+  LOG_ARG_ULONG,
+  LOG_ARG_LONG_LONG,
+  LOG_ARG_ULONG_LONG,
+  LOG_ARG_DOUBLE,
+  LOG_ARG_STRING
+};
+
+union LogArg {
+  int64_t i;
+  uint64_t u;
+  double d;
+  const char *s;
+};
+
+const int kMaxLogArgs = 6;
+
+struct LogRecord {
+  const LogSite *site;
+  int64_t time_ns;
+  uint8_t num_args;
+  uint8_t types[kMaxLogArgs];
+  LogArg args[kMaxLogArgs];
+};
+
+// Single-producer (the owning thread) single-consumer (the drain) ring.
+class LogRing {
+ public:
+  static const uint32_t kCapacity = 1024; // power of two
+
+  LogRing();
+
+  // Returns the next free record, or NULL (and counts a drop) when full.
+  LogRecord *reserve() {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= kCapacity) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return NULL;
+    }
+    return &records_[head & (kCapacity - 1)];
+  }
+
+  void commit() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Called when the owning thread exits; the drain frees the ring after
+  // emitting what is left in it.
+  void retire() { retired_.store(true, std::memory_order_release); }
+
+ private:
+  friend class LogDrain;
+
+  LogRecord records_[kCapacity];
+  std::atomic<uint32_t> head_;
+  std::atomic<uint32_t> tail_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<bool> retired_;
+};
+
+// The calling thread's ring, created and registered on first use.
+LogRing *deferredLogRing();
+
+// Formats all pending records on the calling thread. The background thread
+// does this periodically; call it before exit or from host tools.
+void deferredLogFlush();
+
+// Also append formatted records to `path` (NULL to stop).
+bool deferredLogSetFile(const char *path);
+
+// Renders one record into `buffer` and returns its length.
+int deferredLogFormat(const LogRecord &record, char *buffer, size_t size);
+
+namespace deferred_log_detail {
+
+inline void packArg(LogRecord *r, int i, int v) {
+  r->types[i] = LOG_ARG_INT;
+  r->args[i].i = v;
+}
+inline void packArg(LogRecord *r, int i, unsigned v) {
+  r->types[i] = LOG_ARG_UINT;
+  r->args[i].u = v;
+}
+inline void packArg(LogRecord *r, int i, long v) {
+  r->types[i] = LOG_ARG_LONG;
+  r->args[i].i = v;
+}
+inline void packArg(LogRecord *r, int i, unsigned long v) {
+  r->types[i] = LOG_ARG_ULONG;
+  r->args[i].u = v;
+}
+inline void packArg(LogRecord *r, int i, long long v) {
+  r->types[i] = LOG_ARG_LONG_LONG;
+  r->args[i].i = v;
+}
+inline void packArg(LogRecord *r, int i, unsigned long long v) {
+  r->types[i] = LOG_ARG_ULONG_LONG;
+  r->args[i].u = v;
+}
+inline void packArg(LogRecord *r, int i, double v) {
+  r->types[i] = LOG_ARG_DOUBLE;
+  r->args[i].d = v;
+}
+inline void packArg(LogRecord *r, int i, const char *v) {
+  r->types[i] = LOG_ARG_STRING;
+  r->args[i].s = v;
+}
+
+inline void pack(LogRecord *, int) {}
+
+template <typename T, typename... Rest>
+inline void pack(LogRecord *r, int i, T value, Rest... rest) {
+  packArg(r, i, value);
+  pack(r, i + 1, rest...);
+}
+
+} // namespace deferred_log_detail
+
+template <typename... Args>
+inline void deferredLog(const LogSite *site, Args... args) {
+  static_assert(sizeof...(Args) <= kMaxLogArgs,
+                "too many arguments for a deferred log call");
+  LogRing *ring = deferredLogRing();
+  LogRecord *record = ring->reserve();
+  if (record == NULL) {
+    return;
+  }
+  record->site = site;
+  record->time_ns = getTimeNs();
+  record->num_args = sizeof...(Args);
+  deferred_log_detail::pack(record, 0, args...);
+  ring->commit();
+}
+
+// The unevaluated printf keeps -Wformat checking of the call sites.
+#define DLOG_AT(prio, fmt, ...)                                                \
+  do {                                                                         \
+    if (LOG_ENABLED(prio)) {                                                   \
+      static const LogSite kLogSite = {prio, fmt};                             \
+      (void)sizeof(printf(fmt, ##__VA_ARGS__));                                \
+      deferredLog(&kLogSite, ##__VA_ARGS__);                                   \
+    }                                                                          \
+  } while (0)
+
+#define DLOGV(...) DLOG_AT(ANDROID_LOG_VERBOSE, __VA_ARGS__)
+#define DLOGD(...) DLOG_AT(ANDROID_LOG_DEBUG, __VA_ARGS__)
+#define DLOGI(...) DLOG_AT(ANDROID_LOG_INFO, __VA_ARGS__)
+#define DLOGE(...) DLOG_AT(ANDROID_LOG_ERROR, __VA_ARGS__)
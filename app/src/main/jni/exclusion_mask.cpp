@@ -0,0 +1,206 @@
+#include "exclusion_mask.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "common.hpp"
+
+namespace {
+
+pthread_mutex_t sPendingLock = PTHREAD_MUTEX_INITIALIZER;
+bool sPendingChanged = false;
+ExclusionMask sPending;
+
+bool readPgmNumber(FILE *file, int *value) {
+  int c = fgetc(file);
+  while (c == '#' || (c != EOF && strchr(" \t\r\n", c) != NULL)) {
+    if (c == '#') {
+      while (c != EOF && c != '\n') {
+        c = fgetc(file);
+      }
+    }
+    c = fgetc(file);
+  }
+  *value = 0;
+  int digits = 0;
+  for (; c >= '0' && c <= '9' && digits < 6; c = fgetc(file), ++digits) {
+    *value = *value * 10 + (c - '0');
+  }
+  // The single whitespace after the header's last number goes with it
+  return digits > 0 && c != EOF && strchr(" \t\r\n", c) != NULL;
+}
+
+bool readPgm(const std::string &path, ExclusionMask *mask) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    LOGE("Cannot open exclusion bitmap %s", path.c_str());
+    return false;
+  }
+  int width, height, max_value;
+  bool ok = fgetc(file) == 'P' && fgetc(file) == '5' &&
+            readPgmNumber(file, &width) && readPgmNumber(file, &height) &&
+            readPgmNumber(file, &max_value) && width > 0 && height > 0 &&
+            max_value > 0 && max_value < 256;
+  if (ok) {
+    mask->bitmap.resize(static_cast<size_t>(width) * height);
+    ok = fread(&mask->bitmap[0], 1, mask->bitmap.size(), file) ==
+         mask->bitmap.size();
+    mask->bitmap_width = width;
+    mask->bitmap_height = height;
+  }
+  fclose(file);
+  if (!ok) {
+    LOGE("Exclusion bitmap %s is not an 8-bit binary PGM", path.c_str());
+  }
+  return ok;
+}
+
+bool parseRegionLine(const std::string &line, ExclusionMask *mask) {
+  std::istringstream tokens(line);
+  std::string kind;
+  tokens >> kind;
+  if (kind != "rect" && kind != "bitmap") {
+    return false;
+  }
+  cv::Rect2d rect(-1, -1, -1, -1);
+  double *fields[] = {&rect.x, &rect.y, &rect.width, &rect.height};
+  const char *keys[] = {"x", "y", "width", "height"};
+  std::string path;
+  std::string token;
+  while (tokens >> token) {
+    size_t equals = token.find('=');
+    if (equals == std::string::npos) {
+      return false;
+    }
+    std::string key = token.substr(0, equals);
+    std::string value = token.substr(equals + 1);
+    if (kind == "bitmap") {
+      if (key != "path" || value.empty()) {
+        return false;
+      }
+      path = value;
+      continue;
+    }
+    bool known = false;
+    for (int i = 0; i < 4 && !known; ++i) {
+      if (key == keys[i]) {
+        char *end;
+        *fields[i] = strtod(value.c_str(), &end);
+        known = !value.empty() && *end == '\0' && *fields[i] >= 0 &&
+                *fields[i] <= 1;
+      }
+    }
+    if (!known) {
+      return false;
+    }
+  }
+  if (kind == "bitmap") {
+    return !path.empty() && mask->bitmap.empty() && readPgm(path, mask);
+  }
+  if (rect.x < 0 || rect.y < 0 || rect.width < 0 || rect.height < 0) {
+    return false;
+  }
+  mask->rects.push_back(rect);
+  return true;
+}
+
+} // namespace
+
+bool ExclusionMask::excludes(double x, double y) const {
+  for (auto &rect : rects) {
+    if (rect.contains(cv::Point2d(x, y))) {
+      return true;
+    }
+  }
+  if (bitmap.empty()) {
+    return false;
+  }
+  int bx = std::min(static_cast<int>(x * bitmap_width), bitmap_width - 1);
+  int by = std::min(static_cast<int>(y * bitmap_height), bitmap_height - 1);
+  return bitmap[by * bitmap_width + bx] != 0;
+}
+
+bool parseExclusionMask(const char *spec, ExclusionMask *mask) {
+  ExclusionMask parsed;
+  std::istringstream lines(spec);
+  std::string line;
+  while (std::getline(lines, line)) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") != std::string::npos &&
+        !parseRegionLine(line, &parsed)) {
+      LOGE("Bad exclusion region: %s", line.c_str());
+      return false;
+    }
+  }
+  *mask = parsed;
+  return true;
+}
+
+bool takeExclusionMask(ExclusionMask *mask) {
+  // Polled every frame, so never wait on a writer
+  if (pthread_mutex_trylock(&sPendingLock) != 0) {
+    return false;
+  }
+  bool changed = sPendingChanged;
+  if (changed) {
+    *mask = sPending;
+    sPendingChanged = false;
+  }
+  pthread_mutex_unlock(&sPendingLock);
+  return changed;
+}
+
+void exclusionSpans(const ExclusionMask &mask, const cv::Size &size,
+                    std::vector<int> *first, std::vector<cv::Range> *spans) {
+  first->assign(1, 0);
+  spans->clear();
+  for (int y = 0; y < size.height; ++y) {
+    double fy = (y + 0.5) / size.height;
+    int start = -1;
+    for (int x = 0; x <= size.width; ++x) {
+      bool included =
+          x < size.width && !mask.excludes((x + 0.5) / size.width, fy);
+      if (included && start < 0) {
+        start = x;
+      } else if (!included && start >= 0) {
+        spans->push_back(cv::Range(start, x));
+        start = -1;
+      }
+    }
+    first->push_back(static_cast<int>(spans->size()));
+  }
+}
+
+extern "C" int exclusionMaskConfigure(const char *spec) {
+  ExclusionMask mask;
+  if (!parseExclusionMask(spec, &mask)) {
+    return -1;
+  }
+  pthread_mutex_lock(&sPendingLock);
+  sPending = mask;
+  sPendingChanged = true;
+  pthread_mutex_unlock(&sPendingLock);
+  return 0;
+}
+
+extern "C" int exclusionMaskLoad(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    LOGE("Cannot open exclusion mask %s", path);
+    return -1;
+  }
+  std::string spec;
+  char buffer[1024];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    spec.append(buffer, count);
+  }
+  fclose(file);
+  return exclusionMaskConfigure(spec.c_str());
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replaces the camera's exclusion mask, the parts of the frame that never
+// hold a target (arena lights, the robot's own bumpers), one region per
+// line:
+//   rect x=X y=Y width=W height=H   fractions of the frame from its top-left
+//   bitmap path=PATH                binary PGM (P5) stretched over the
+//                                   frame; nonzero pixels are excluded
+// '#' starts a comment; an empty spec excludes nothing. The threshold pass
+// skips excluded rows and spans, so their mask pixels stay 0. Takes effect
+// on the next frame. Returns 0 on success; on an invalid spec or unreadable
+// bitmap nothing changes.
+int exclusionMaskConfigure(const char *spec);
+
+// exclusionMaskConfigure() with the contents of a file, one per camera
+int exclusionMaskLoad(const char *path);
+
+#ifdef __cplusplus
+}
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+struct ExclusionMask {
+  ExclusionMask() : bitmap_width(0), bitmap_height(0) {}
+
+  bool empty() const { return rects.empty() && bitmap.empty(); }
+  // Whether the point at fractions x, y of the frame is excluded
+  bool excludes(double x, double y) const;
+
+  std::vector<cv::Rect2d> rects;
+  int bitmap_width;
+  int bitmap_height;
+  std::vector<uint8_t> bitmap;
+};
+
+// Parses the exclusionMaskConfigure() format, reading any bitmap
+bool parseExclusionMask(const char *spec, ExclusionMask *mask);
+
+// Takes the mask from the last exclusionMaskConfigure() call, if there was
+// one since the previous call.
+bool takeExclusionMask(ExclusionMask *mask);
+
+// The columns of each row of a size mask that are not excluded, judged at
+// the centre of the part of the frame each mask pixel covers: row y's
+// spans are spans[first[y]] up to spans[first[y + 1]].
+void exclusionSpans(const ExclusionMask &mask, const cv::Size &size,
+                    std::vector<int> *first, std::vector<cv::Range> *spans);
+#endif
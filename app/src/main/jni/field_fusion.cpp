@@ -0,0 +1,76 @@
+#include "field_fusion.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "quad_fit.h"
+#include "target_filter.h"
+
+namespace {
+
+// Index of the previous target whose corners all lie within half a field
+// row of the current one's, which is as far as sampling alone moves them,
+// or -1
+int findMatch(const TargetInfo &target, const std::vector<TargetInfo> &last,
+              const std::vector<bool> &used, int row_step) {
+  int best = -1;
+  double best_distance = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < last.size(); ++i) {
+    if (used[i] || last[i].points.size() != target.points.size()) {
+      continue;
+    }
+    bool close = true;
+    for (size_t corner = 0; corner < target.points.size() && close;
+         ++corner) {
+      cv::Point d = target.points[corner] - last[i].points[corner];
+      close = abs(d.x) <= row_step / 2 && abs(d.y) <= row_step / 2;
+    }
+    double dx = target.centroid_x - last[i].centroid_x;
+    double dy = target.centroid_y - last[i].centroid_y;
+    double distance = dx * dx + dy * dy;
+    if (close && distance < best_distance) {
+      best = static_cast<int>(i);
+      best_distance = distance;
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+FieldFusion::FieldFusion() : last_field_(-1) {}
+
+void FieldFusion::reset() {
+  last_field_ = -1;
+  last_targets_.clear();
+}
+
+void FieldFusion::fuse(int field, int row_step,
+                       std::vector<TargetInfo> *targets) {
+  std::vector<TargetInfo> current = *targets;
+  if (last_field_ >= 0 && last_field_ != field) {
+    std::vector<bool> used(last_targets_.size(), false);
+    for (auto &target : *targets) {
+      int match = findMatch(target, last_targets_, used, row_step);
+      if (match < 0 || target.points.size() != 4) {
+        continue;
+      }
+      used[match] = true;
+      QuadFit quad;
+      for (int corner = 0; corner < 4; ++corner) {
+        // A field finds the first of its rows inside the target, so the
+        // outermost of the two is the closer to the true edge
+        cv::Point point = target.points[corner];
+        int last_y = last_targets_[match].points[corner].y;
+        point.y = point.y < target.centroid_y ? std::min(point.y, last_y)
+                                              : std::max(point.y, last_y);
+        quad.corners[corner] = point;
+      }
+      makeTarget(quad, 1, &target);
+    }
+  }
+  last_field_ = field;
+  last_targets_.swap(current);
+}
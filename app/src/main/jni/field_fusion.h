@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "target_info.h"
+
+// Combines the targets of consecutive fields from an interlaced plan. A
+// field only sees every other row, so it places a target's top and bottom
+// edges up to a field row inside the true ones, and the previous field
+// sampled the rows in between. When every corner of a target is within half
+// a field row of the previous field's, which is all that sampling alone
+// explains, each corner takes the outer of the two rows: for a still
+// target that is the full frame's answer. Farther apart the target has
+// moved and the current field stands alone, so fusion adds no lag.
+class FieldFusion {
+ public:
+  FieldFusion();
+
+  // targets come from field (0 or 1), whose rows are row_step camera rows
+  // apart; they are fused in place with the previous call's
+  void fuse(int field, int row_step, std::vector<TargetInfo> *targets);
+
+  // Forgets the previous field, e.g. when the plan stops interlacing
+  void reset();
+
+ private:
+  int last_field_;
+  // Unfused, so errors do not carry over from field to field
+  std::vector<TargetInfo> last_targets_;
+};
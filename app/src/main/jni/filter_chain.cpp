@@ -0,0 +1,47 @@
+#include "filter_chain.h"
+
+#include <cmath>
+
+namespace {
+
+bool sameChecks(const TargetFilter &a, const TargetFilter &b) {
+  return a.min_width == b.min_width && a.max_width == b.max_width &&
+         a.min_height == b.min_height && a.max_height == b.max_height &&
+         a.min_fullness == b.min_fullness &&
+         a.max_fullness == b.max_fullness &&
+         a.horizontal_slope == b.horizontal_slope &&
+         a.vertical_slope == b.vertical_slope;
+}
+
+bool checksSize(const TargetFilter &filter) {
+  return filter.min_width > 0 || filter.min_height > 0 ||
+         !std::isinf(filter.max_width) || !std::isinf(filter.max_height);
+}
+
+bool checksFullness(const TargetFilter &filter) {
+  return filter.min_fullness > 0 || !std::isinf(filter.max_fullness);
+}
+
+} // namespace
+
+TargetFilterChain::TargetFilterChain(const TargetFilter &filter)
+    : filter_(filter), num_checks_(0) {
+  bool size = checksSize(filter);
+  bool fullness = checksFullness(filter);
+  if (sameChecks(filter, defaultTargetFilter())) {
+    variant_ = VARIANT_DEFAULT;
+  } else if (size && fullness) {
+    variant_ = VARIANT_TUNED;
+  } else {
+    variant_ = VARIANT_RUNTIME;
+    if (size) {
+      checks_[num_checks_++] = FilterChain<SizePolicy<FilterLimits>>::reject;
+    }
+    checks_[num_checks_++] =
+        FilterChain<EdgeOrientationPolicy<FilterLimits>>::reject;
+    if (fullness) {
+      checks_[num_checks_++] =
+          FilterChain<FullnessPolicy<FilterLimits>>::reject;
+    }
+  }
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include "target_detector.h"
+#include "target_filter.h"
+#include "target_info.h"
+
+// What the final filters look at: the target in camera pixels, and the blob
+// and quad areas in the same (possibly decimated) units.
+struct FilterCandidate {
+  const TargetInfo *target;
+  double area;
+  double quad_area;
+};
+
+// Thresholds read from the TargetFilter at run time
+struct FilterLimits {
+  static double minWidth(const TargetFilter &f) { return f.min_width; }
+  static double maxWidth(const TargetFilter &f) { return f.max_width; }
+  static double minHeight(const TargetFilter &f) { return f.min_height; }
+  static double maxHeight(const TargetFilter &f) { return f.max_height; }
+  static double minFullness(const TargetFilter &f) { return f.min_fullness; }
+  static double maxFullness(const TargetFilter &f) { return f.max_fullness; }
+  // |dy / dx| against the slope without dividing; dx == 0 is vertical
+  static bool nearlyHorizontal(const TargetFilter &f, int dx, int dy) {
+    return dx != 0 && abs(dy) <= f.horizontal_slope * abs(dx);
+  }
+  static bool nearlyVertical(const TargetFilter &f, int dx, int dy) {
+    return dx == 0 || abs(dy) >= f.vertical_slope * abs(dx);
+  }
+};
+
+// defaultTargetFilter() as constants the compiler folds into the chain
+struct DefaultFilterLimits {
+  static double minWidth(const TargetFilter &) { return kDefaultMinWidth; }
+  static double maxWidth(const TargetFilter &) { return kDefaultMaxWidth; }
+  static double minHeight(const TargetFilter &) { return kDefaultMinHeight; }
+  static double maxHeight(const TargetFilter &) { return kDefaultMaxHeight; }
+  static double minFullness(const TargetFilter &) {
+    return kDefaultMinFullness;
+  }
+  static double maxFullness(const TargetFilter &) {
+    return kDefaultMaxFullness;
+  }
+  static bool nearlyHorizontal(const TargetFilter &, int dx, int dy) {
+    return dx != 0 && 5 * abs(dy) <= 4 * abs(dx);
+  }
+  static bool nearlyVertical(const TargetFilter &, int dx, int dy) {
+    return dx == 0 || 4 * abs(dy) >= 5 * abs(dx);
+  }
+};
+static_assert(kDefaultHorizontalSlope == 4.0 / 5 &&
+                  kDefaultVerticalSlope == 5.0 / 4,
+              "DefaultFilterLimits slopes are out of date");
+
+template <typename Limits> struct SizePolicy {
+  static const CascadeStage kStage = CASCADE_SIZE;
+
+  static bool accept(const TargetFilter &filter,
+                     const FilterCandidate &candidate) {
+    const TargetInfo &target = *candidate.target;
+    return target.width >= Limits::minWidth(filter) &&
+           target.width <= Limits::maxWidth(filter) &&
+           target.height >= Limits::minHeight(filter) &&
+           target.height <= Limits::maxHeight(filter);
+  }
+};
+
+// Two nearly horizontal and two nearly vertical edges, alternating
+template <typename Limits> struct EdgeOrientationPolicy {
+  static const CascadeStage kStage = CASCADE_SHAPE;
+
+  static bool accept(const TargetFilter &filter,
+                     const FilterCandidate &candidate) {
+    const std::vector<cv::Point> &points = candidate.target->points;
+    int num_horizontal = 0;
+    int num_vertical = 0;
+    bool last_edge_vertical = false;
+    for (size_t i = 0; i < 4; ++i) {
+      int dx = points[i].x - points[(i + 1) % 4].x;
+      int dy = points[i].y - points[(i + 1) % 4].y;
+      if (Limits::nearlyHorizontal(filter, dx, dy) &&
+          (i == 0 || last_edge_vertical)) {
+        last_edge_vertical = false;
+        num_horizontal++;
+      } else if (Limits::nearlyVertical(filter, dx, dy) &&
+                 (i == 0 || !last_edge_vertical)) {
+        last_edge_vertical = true;
+        num_vertical++;
+      } else {
+        break;
+      }
+    }
+    return num_horizontal == 2 || num_vertical == 2;
+  }
+};
+
+// Blob area / quad area
+template <typename Limits> struct FullnessPolicy {
+  static const CascadeStage kStage = CASCADE_FULLNESS;
+
+  static bool accept(const TargetFilter &filter,
+                     const FilterCandidate &candidate) {
+    double fullness = candidate.area / candidate.quad_area;
+    return fullness >= Limits::minFullness(filter) &&
+           fullness <= Limits::maxFullness(filter);
+  }
+};
+
+// Policies applied in order. reject() returns the stage of the first policy
+// that turns the candidate down, or CASCADE_NUM_STAGES if none does; every
+// call in the chain inlines into one function.
+template <typename... Policies> struct FilterChain;
+
+template <> struct FilterChain<> {
+  static CascadeStage reject(const TargetFilter &, const FilterCandidate &) {
+    return CASCADE_NUM_STAGES;
+  }
+};
+
+template <typename Policy, typename... Rest>
+struct FilterChain<Policy, Rest...> {
+  static CascadeStage reject(const TargetFilter &filter,
+                             const FilterCandidate &candidate) {
+    if (!Policy::accept(filter, candidate)) {
+      return Policy::kStage;
+    }
+    return FilterChain<Rest...>::reject(filter, candidate);
+  }
+};
+
+typedef FilterChain<SizePolicy<DefaultFilterLimits>,
+                    EdgeOrientationPolicy<DefaultFilterLimits>,
+                    FullnessPolicy<DefaultFilterLimits>>
+    DefaultFilterChain;
+
+typedef FilterChain<SizePolicy<FilterLimits>,
+                    EdgeOrientationPolicy<FilterLimits>,
+                    FullnessPolicy<FilterLimits>>
+    TunedFilterChain;
+
+// The final size, edge and fullness checks for one TargetFilter. The
+// default filter gets DefaultFilterChain with its thresholds compiled in,
+// any other filter that uses all three checks gets TunedFilterChain, and a
+// filter that switches a check off (sizes 0 to inf, or fullness 0 to inf)
+// runs the remaining checks through function pointers.
+class TargetFilterChain {
+ public:
+  explicit TargetFilterChain(const TargetFilter &filter);
+
+  CascadeStage reject(const FilterCandidate &candidate) const {
+    switch (variant_) {
+    case VARIANT_DEFAULT:
+      return DefaultFilterChain::reject(filter_, candidate);
+    case VARIANT_TUNED:
+      return TunedFilterChain::reject(filter_, candidate);
+    default:
+      for (int i = 0; i < num_checks_; ++i) {
+        CascadeStage stage = checks_[i](filter_, candidate);
+        if (stage != CASCADE_NUM_STAGES) {
+          return stage;
+        }
+      }
+      return CASCADE_NUM_STAGES;
+    }
+  }
+
+ private:
+  enum Variant { VARIANT_DEFAULT, VARIANT_TUNED, VARIANT_RUNTIME };
+  typedef CascadeStage (*Check)(const TargetFilter &, const FilterCandidate &);
+
+  TargetFilter filter_;
+  Variant variant_;
+  Check checks_[3];
+  int num_checks_;
+};
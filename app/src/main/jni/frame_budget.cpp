@@ -0,0 +1,97 @@
+#include "frame_budget.h"
+
+#include "common.hpp"
+#include "deferred_log.h"
+
+namespace {
+
+const int64_t kFrameBudgetNs = FrameBudget::kBudgetNs;
+// A frame picked up this much later than the baseline, about two frame
+// periods, has frames queued behind it and is shed without processing
+const int64_t kMaxBacklogNs = 66000000LL;
+// The baseline follows a lower latency at once and a higher one by this
+// fraction of the difference per frame, so a backlog barely moves it but a
+// camera that settles slower recalibrates within a few seconds
+const int kBaselineRise = 64;
+// Consecutive overruns before the level rises
+const int kOverFramesToEscalate = 2;
+// Consecutive frames under half the budget before the level falls
+const int kCalmFramesToRelax = 30;
+
+int plannedDegradations(int level, uint32_t frame_index) {
+  int degradations = DEGRADE_NONE;
+  if (level >= 1)
+    degradations |= DEGRADE_SKIP_VISUALIZE;
+  if (level >= 2)
+    degradations |= DEGRADE_CAP_CANDIDATES;
+  if (level >= 3)
+    degradations |= DEGRADE_DECIMATE;
+  if (level >= 4 && (frame_index & 1) != 0)
+    degradations |= DEGRADE_SKIP_FRAME;
+  return degradations;
+}
+
+} // namespace
+
+FrameBudget::FrameBudget()
+    : level_(0), floor_(0), over_frames_(0), calm_frames_(0), frame_index_(0),
+      queue_baseline_ns_(-1), start_ns_(0), deadline_ns_(0), processing_ns_(0),
+      degradations_(DEGRADE_NONE) {}
+
+int FrameBudget::begin(int64_t capture_time_ns, int64_t start_ns) {
+  start_ns_ = start_ns;
+  deadline_ns_ = start_ns + kFrameBudgetNs;
+  degradations_ = plannedDegradations(level(), frame_index_++);
+  if (floor_ > level_) {
+    degradations_ |= DEGRADE_THERMAL;
+  }
+  int64_t queue_ns = start_ns - capture_time_ns;
+  if (queue_baseline_ns_ < 0 || queue_ns < queue_baseline_ns_) {
+    queue_baseline_ns_ = queue_ns;
+  } else {
+    queue_baseline_ns_ += (queue_ns - queue_baseline_ns_) / kBaselineRise;
+  }
+  if (queue_ns - queue_baseline_ns_ > kMaxBacklogNs) {
+    degradations_ |= DEGRADE_SKIP_FRAME;
+    DLOGD("Shedding frame queued for %lld us, usually %lld us",
+          (long long)(queue_ns / 1000),
+          (long long)(queue_baseline_ns_ / 1000));
+    // Falling behind the camera is an overrun like any other
+    adapt(true, false);
+  }
+  return degradations_;
+}
+
+bool FrameBudget::expired() const {
+  return getTimeNs() > deadline_ns_;
+}
+
+void FrameBudget::end(int64_t end_ns) {
+  processing_ns_ = end_ns - start_ns_;
+  adapt(processing_ns_ > kFrameBudgetNs,
+        processing_ns_ < kFrameBudgetNs / 2);
+}
+
+void FrameBudget::adapt(bool over, bool calm) {
+  int old_level = level_;
+  if (over) {
+    calm_frames_ = 0;
+    if (++over_frames_ >= kOverFramesToEscalate && level_ < kMaxLevel) {
+      level_++;
+      over_frames_ = 0;
+    }
+  } else if (calm) {
+    over_frames_ = 0;
+    if (++calm_frames_ >= kCalmFramesToRelax && level_ > 0) {
+      level_--;
+      calm_frames_ = 0;
+    }
+  } else {
+    over_frames_ = 0;
+    calm_frames_ = 0;
+  }
+  if (level_ != old_level) {
+    DLOGI("Frame budget level %d -> %d, last processing %lld us", old_level,
+          level_, (long long)(processing_ns_ / 1000));
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+// Load shedding applied to a frame, reported to Java as
+// TargetsInfo.degradation. Must match the DEGRADE_* constants in NativePart.
+enum Degradation {
+  DEGRADE_NONE = 0,
+  // No visualization or texture upload; Java shows the camera image
+  DEGRADE_SKIP_VISUALIZE = 1 << 0,
+  // Fewer contours allowed into geometric analysis
+  DEGRADE_CAP_CANDIDATES = 1 << 1,
+  // Detection ran on a half resolution image
+  DEGRADE_DECIMATE = 1 << 2,
+  // Not processed at all, no targets reported
+  DEGRADE_SKIP_FRAME = 1 << 3,
+  // Detection stopped at a checkpoint and dropped the remaining candidates
+  DEGRADE_DEADLINE = 1 << 4,
+  // The thermal governor holds the level up; the shared memory frame export
+  // also drops to every other frame
+  DEGRADE_THERMAL = 1 << 5,
+};
+
+// Per-frame deadline and the degradation level that keeps processing inside
+// it. Each level adds one measure to those of the levels below it (skip
+// visualization, cap candidates, decimate, skip every other frame). The
+// level rises after consecutive frames overrun the budget and falls again
+// only after a run of frames well inside it, so it does not oscillate.
+// A floor, set by the thermal governor, keeps the level from falling below
+// what the phone can sustain.
+// Capture to pickup latency is judged against a baseline calibrated from
+// the frames themselves, since it includes the camera's own pipeline and
+// differs between phones: a frame picked up a couple of frame periods later
+// than usual has frames queued behind it and is shed, and counts as an
+// overrun.
+class FrameBudget {
+ public:
+  static const int kMaxLevel = 4;
+  // Processing budget of one frame, leaving some of the 33 ms frame period
+  // for the Java side and the robot message
+  static const int64_t kBudgetNs = 25000000LL;
+
+  FrameBudget();
+
+  // Starts the frame picked up at start_ns and returns the degradations
+  // planned for it. Frames queued behind a backlog are shed here.
+  int begin(int64_t capture_time_ns, int64_t start_ns);
+
+  // Records a degradation decided while the frame runs
+  void degrade(int degradation) { degradations_ |= degradation; }
+
+  int64_t deadline() const { return deadline_ns_; }
+  bool expired() const;
+  int degradations() const { return degradations_; }
+  int level() const { return level_ > floor_ ? level_ : floor_; }
+  // Processing time of the last frame that end() was called for
+  int64_t processingNs() const { return processing_ns_; }
+
+  // Lowest level for the frames begun from now on
+  void setFloor(int floor) { floor_ = floor; }
+
+  // Ends a processed frame and adapts the level for the next ones. Skipped
+  // frames do not end(): begin() already counted a shed frame as an
+  // overrun, and one skipped by the level is no sign of headroom.
+  void end(int64_t end_ns);
+
+ private:
+  void adapt(bool over, bool calm);
+
+  int level_;
+  int floor_;
+  int over_frames_;
+  int calm_frames_;
+  uint32_t frame_index_;
+  // Usual capture to pickup latency; -1 until the first frame
+  int64_t queue_baseline_ns_;
+  int64_t start_ns_;
+  int64_t deadline_ns_;
+  int64_t processing_ns_;
+  int degradations_;
+};
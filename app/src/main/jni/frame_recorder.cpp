@@ -0,0 +1,302 @@
+#include "frame_recorder.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "cpu_topology.h"
+#include "deferred_log.h"
+
+namespace {
+
+// Budget for the vision thread's share of recording a frame
+const int64_t kRecordBudgetNs = 1000000;
+
+void encodeMaskRle(const cv::Mat &mask, uint16_t *out, uint32_t *bytes) {
+  uint16_t *start = out;
+  for (int y = 0; y < mask.rows; ++y) {
+    const uint8_t *row = mask.ptr<uint8_t>(y);
+    bool value = false;
+    int x = 0;
+    while (x < mask.cols) {
+      int run_start = x;
+      while (x < mask.cols && (row[x] != 0) == value) {
+        ++x;
+      }
+      *out++ = static_cast<uint16_t>(x - run_start);
+      value = !value;
+    }
+  }
+  *bytes = static_cast<uint32_t>((out - start) * sizeof(uint16_t));
+}
+
+void recordTarget(const TargetInfo &target, RecordedTarget *out) {
+  out->centroid_x = target.centroid_x;
+  out->centroid_y = target.centroid_y;
+  out->width = target.width;
+  out->height = target.height;
+  out->num_points = std::min<size_t>(target.points.size(), 4);
+  for (int p = 0; p < out->num_points; ++p) {
+    out->points[p][0] = target.points[p].x;
+    out->points[p][1] = target.points[p].y;
+  }
+}
+
+} // namespace
+
+FrameRecorder::FrameRecorder()
+    : running_(false), slot_count_(0), format_(RECORDING_MASK_RLE),
+      produce_index_(0), consume_index_(0), dropped_(0), stopping_(false),
+      fd_(-1), map_(NULL), map_size_(0), header_(NULL) {
+  for (int i = 0; i < kStagingBuffers; ++i) {
+    staged_[i].full.store(false);
+    staged_[i].num_targets = 0;
+  }
+  pthread_mutex_init(&control_, NULL);
+}
+
+FrameRecorder::~FrameRecorder() {
+  stop();
+  pthread_mutex_destroy(&control_);
+}
+
+bool FrameRecorder::start(const char *path, int slot_count,
+                          RecordingFormat format) {
+  stop();
+  pthread_mutex_lock(&control_);
+  path_ = path;
+  slot_count_ = std::max(slot_count, 1);
+  format_ = format;
+  produce_index_ = 0;
+  consume_index_ = 0;
+  dropped_ = 0;
+  for (int i = 0; i < kStagingBuffers; ++i) {
+    staged_[i].full.store(false);
+  }
+  stopping_.store(false);
+  sem_init(&pending_, 0, 0);
+  bool ok = pthread_create(&writer_, NULL, writerMain, this) == 0;
+  running_ = ok;
+  if (!ok) {
+    sem_destroy(&pending_);
+    LOGE("Could not start the recording writer thread");
+  }
+  pthread_mutex_unlock(&control_);
+  return ok;
+}
+
+void FrameRecorder::stop() {
+  pthread_mutex_lock(&control_);
+  if (running_) {
+    running_ = false;
+    stopping_.store(true);
+    sem_post(&pending_);
+    pthread_join(writer_, NULL);
+    sem_destroy(&pending_);
+    closeFile();
+    LOGI("Recording to %s stopped, %u frames dropped", path_.c_str(),
+         dropped_);
+  }
+  pthread_mutex_unlock(&control_);
+}
+
+bool FrameRecorder::record(int64_t capture_time_ns, cv::Mat *rgba,
+                           const cv::Mat &mask, int mask_scale,
+                           const HsvThreshold &hsv,
+                           const std::vector<TargetInfo> &targets) {
+  // Never wait on start()/stop(); losing a frame while they run is fine
+  if (pthread_mutex_trylock(&control_) != 0) {
+    return false;
+  }
+  if (!running_) {
+    pthread_mutex_unlock(&control_);
+    return false;
+  }
+  int64_t t = getTimeNs();
+  Staged &staged = staged_[produce_index_];
+  bool queued = !staged.full.load(std::memory_order_acquire);
+  if (!queued) {
+    dropped_++;
+  } else {
+    staged.capture_time_ns = capture_time_ns;
+    staged.hsv = hsv;
+    staged.mask_scale = mask_scale;
+    staged.num_targets =
+        std::min<size_t>(targets.size(), kMaxRecordedTargets);
+    for (uint32_t i = 0; i < staged.num_targets; ++i) {
+      recordTarget(targets[i], &staged.targets[i]);
+    }
+    // The writer is done with the staging buffer, so it becomes the
+    // caller's next frame buffer
+    std::swap(*rgba, staged.rgba);
+    if (format_ == RECORDING_MASK_RLE) {
+      mask.copyTo(staged.mask);
+    }
+    staged.full.store(true, std::memory_order_release);
+    produce_index_ = (produce_index_ + 1) % kStagingBuffers;
+    sem_post(&pending_);
+  }
+  int64_t elapsed_ns = getTimeNs() - t;
+  if (elapsed_ns > kRecordBudgetNs) {
+    DLOGE("Recording a frame took %lld us on the vision thread",
+          (long long)(elapsed_ns / 1000));
+  }
+  pthread_mutex_unlock(&control_);
+  return queued;
+}
+
+void *FrameRecorder::writerMain(void *self) {
+  static_cast<FrameRecorder *>(self)->writerLoop();
+  return NULL;
+}
+
+void FrameRecorder::writerLoop() {
+  uint32_t placement_generation = 0;
+  while (true) {
+    sem_wait(&pending_);
+    placeCurrentThread(THREAD_BACKGROUND, &placement_generation);
+    Staged &staged = staged_[consume_index_];
+    if (!staged.full.load(std::memory_order_acquire)) {
+      if (stopping_.load()) {
+        break;
+      }
+      continue;
+    }
+    write(staged);
+    staged.full.store(false, std::memory_order_release);
+    consume_index_ = (consume_index_ + 1) % kStagingBuffers;
+  }
+}
+
+bool FrameRecorder::ensureFile(int width, int height) {
+  if (map_ != NULL) {
+    return static_cast<int>(header_->width) == width &&
+           static_cast<int>(header_->height) == height;
+  }
+  uint32_t slot_size = recordingSlotSize(format_, width, height);
+  map_size_ =
+      kRecordingHeaderSize + static_cast<size_t>(slot_size) * slot_count_;
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0 || ftruncate(fd_, map_size_) != 0) {
+    LOGE("Could not create recording %s", path_.c_str());
+    closeFile();
+    return false;
+  }
+  void *map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    LOGE("Could not map recording %s", path_.c_str());
+    closeFile();
+    return false;
+  }
+  map_ = static_cast<uint8_t *>(map);
+  header_ = reinterpret_cast<RecordingFileHeader *>(map_);
+  memcpy(header_->magic, kRecordingMagic, sizeof(kRecordingMagic));
+  header_->version = kRecordingVersion;
+  header_->format = format_;
+  header_->width = width;
+  header_->height = height;
+  header_->slot_count = slot_count_;
+  header_->slot_size = slot_size;
+  header_->next_sequence = 0;
+  LOGI("Recording %dx%d frames to %s, %d slots of %u bytes", width, height,
+       path_.c_str(), slot_count_, slot_size);
+  return true;
+}
+
+void FrameRecorder::write(const Staged &staged) {
+  if (!ensureFile(staged.rgba.cols, staged.rgba.rows)) {
+    return;
+  }
+  // The slot only has room for a mask up to the frame's size
+  if (format_ == RECORDING_MASK_RLE &&
+      (staged.mask_scale < 1 ||
+       staged.mask.cols != staged.rgba.cols / staged.mask_scale ||
+       staged.mask.rows != staged.rgba.rows / staged.mask_scale)) {
+    DLOGE("Not recording a %dx%d mask at scale %d for a %dx%d frame",
+          staged.mask.cols, staged.mask.rows, staged.mask_scale,
+          staged.rgba.cols, staged.rgba.rows);
+    return;
+  }
+  uint64_t sequence = header_->next_sequence;
+  uint8_t *slot = map_ + kRecordingHeaderSize +
+                  (sequence % header_->slot_count) * header_->slot_size;
+  RecordHeader *record = reinterpret_cast<RecordHeader *>(slot);
+  __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+  // Keeps the cleared sequence ahead of every write below, so a reader that
+  // sees any of them also sees the slot as incomplete
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  uint8_t *payload = slot + sizeof(RecordHeader);
+  if (format_ == RECORDING_RAW_RGBA) {
+    size_t row_bytes = staged.rgba.cols * 4;
+    for (int y = 0; y < staged.rgba.rows; ++y) {
+      memcpy(payload + y * row_bytes, staged.rgba.ptr(y), row_bytes);
+    }
+    record->payload_size = row_bytes * staged.rgba.rows;
+  } else {
+    uint32_t mask_bytes = 0;
+    encodeMaskRle(staged.mask,
+                  reinterpret_cast<uint16_t *>(payload + sizeof(uint32_t)),
+                  &mask_bytes);
+    memcpy(payload, &mask_bytes, sizeof(mask_bytes));
+    cv::resize(staged.rgba, color_,
+               cv::Size(staged.rgba.cols / kColorSubsample,
+                        staged.rgba.rows / kColorSubsample),
+               0, 0, cv::INTER_AREA);
+    uint8_t *color = payload + sizeof(uint32_t) + mask_bytes;
+    size_t row_bytes = color_.cols * 4;
+    for (int y = 0; y < color_.rows; ++y) {
+      memcpy(color + y * row_bytes, color_.ptr(y), row_bytes);
+    }
+    record->payload_size =
+        sizeof(uint32_t) + mask_bytes + row_bytes * color_.rows;
+  }
+
+  record->capture_time_ns = staged.capture_time_ns;
+  record->hsv = staged.hsv;
+  record->mask_scale = staged.mask_scale;
+  record->reserved = 0;
+  record->num_targets = staged.num_targets;
+  memcpy(record->targets, staged.targets,
+         staged.num_targets * sizeof(RecordedTarget));
+  __atomic_store_n(&record->sequence, sequence + 1, __ATOMIC_RELEASE);
+  header_->next_sequence = sequence + 1;
+}
+
+void FrameRecorder::closeFile() {
+  if (map_ != NULL) {
+    msync(map_, map_size_, MS_ASYNC);
+    munmap(map_, map_size_);
+    map_ = NULL;
+    header_ = NULL;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+FrameRecorder &frameRecorder() {
+  static FrameRecorder recorder;
+  return recorder;
+}
+
+extern "C" int recordingStart(const char *path, int slot_count,
+                              int raw_frames) {
+  return frameRecorder().start(path, slot_count,
+                               raw_frames ? RECORDING_RAW_RGBA
+                                          : RECORDING_MASK_RLE)
+             ? 0
+             : -1;
+}
+
+extern "C" void recordingStop(void) {
+  frameRecorder().stop();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Starts recording every processed frame into a ring of `slot_count` frames
+// at `path` (see recording_format.h). With raw_frames == 0 the threshold
+// mask is stored losslessly together with a sub-sampled colour image, which
+// is roughly 10x smaller than raw RGBA. Returns 0 on success.
+int recordingStart(const char *path, int slot_count, int raw_frames);
+
+void recordingStop(void);
+
+#ifdef __cplusplus
+}
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "recording_format.h"
+
+// Appends frames to a memory-mapped recording. record() takes the frame's
+// buffer rather than copying it and never touches the file; encoding and
+// the writes into the mapping happen on a background thread. When every
+// staging buffer is still queued the frame is dropped (and counted) rather
+// than waiting.
+class FrameRecorder {
+ public:
+  FrameRecorder();
+  ~FrameRecorder();
+
+  bool start(const char *path, int slot_count, RecordingFormat format);
+  void stop();
+  bool running() const { return running_.load(); }
+
+  // Queues the frame by swapping *rgba with a staging buffer the writer has
+  // finished with, so the caller gets back a buffer to read its next frame
+  // into (empty for the first few frames) and must not write to the one it
+  // handed over. mask is mask_scale times smaller than the frame in each
+  // direction; only mask recordings copy it. Returns false, leaving *rgba
+  // alone, if the frame was not queued.
+  bool record(int64_t capture_time_ns, cv::Mat *rgba, const cv::Mat &mask,
+              int mask_scale, const HsvThreshold &hsv,
+              const std::vector<TargetInfo> &targets);
+
+ private:
+  static const int kStagingBuffers = 3;
+
+  struct Staged {
+    std::atomic<bool> full;
+    int64_t capture_time_ns;
+    HsvThreshold hsv;
+    int mask_scale;
+    // Converted on the vision thread, which costs less than copying the
+    // TargetInfo vectors and never allocates
+    uint32_t num_targets;
+    RecordedTarget targets[kMaxRecordedTargets];
+    cv::Mat rgba;
+    cv::Mat mask;
+  };
+
+  static void *writerMain(void *self);
+  void writerLoop();
+  bool ensureFile(int width, int height);
+  void write(const Staged &staged);
+  void closeFile();
+
+  // Held by start()/stop(); record() only ever try-locks it
+  pthread_mutex_t control_;
+  std::atomic<bool> running_;
+  std::string path_;
+  int slot_count_;
+  RecordingFormat format_;
+
+  Staged staged_[kStagingBuffers];
+  int produce_index_;
+  int consume_index_;
+  uint32_t dropped_;
+  sem_t pending_;
+  pthread_t writer_;
+  std::atomic<bool> stopping_;
+
+  int fd_;
+  uint8_t *map_;
+  size_t map_size_;
+  RecordingFileHeader *header_;
+  cv::Mat color_;
+};
+
+// The recorder behind recordingStart(); processImpl feeds it.
+FrameRecorder &frameRecorder();
+#endif
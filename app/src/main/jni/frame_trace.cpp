@@ -0,0 +1,107 @@
+#include "frame_trace.h"
+
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "common.hpp"
+
+namespace {
+
+const char *const kStageNames[TRACE_NUM_STAGES] = {
+    "capture_to_process", "processFrame", "glReadPixels", "cvtColor",
+    "inRange",            "contours",     "visualize",    "glTexSubImage2D",
+    "tracker",            "jni_return",   "angles",       "send_queue",
+    "serialize",          "socket_write", "record",       "pose",
+    "morphology"};
+
+// Must be a power of two. ~14 spans per frame keeps the last ~35 s at 30 fps.
+const uint64_t kRingSize = 16384;
+
+// Each slot is a tiny seqlock: `seq` is odd while a writer is filling the
+// slot and equals 2 * (ring index + 1) once the span is complete, so a
+// reader can tell both torn slots and slots from an older lap apart.
+struct Slot {
+  std::atomic<uint64_t> seq;
+  std::atomic<int64_t> trace_id;
+  std::atomic<int64_t> start_ns;
+  std::atomic<int64_t> end_ns;
+  std::atomic<int32_t> stage;
+  std::atomic<int32_t> tid;
+};
+
+Slot sRing[kRingSize];
+std::atomic<uint64_t> sHead(0);
+
+} // namespace
+
+extern "C" void traceSpan(int64_t trace_id, int stage, int64_t start_ns,
+                          int64_t end_ns) {
+  if (stage < 0 || stage >= TRACE_NUM_STAGES) {
+    return;
+  }
+  uint64_t index = sHead.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = sRing[index & (kRingSize - 1)];
+  slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.trace_id.store(trace_id, std::memory_order_relaxed);
+  slot.start_ns.store(start_ns, std::memory_order_relaxed);
+  slot.end_ns.store(end_ns, std::memory_order_relaxed);
+  slot.stage.store(stage, std::memory_order_relaxed);
+  slot.tid.store(static_cast<int32_t>(syscall(__NR_gettid)),
+                 std::memory_order_relaxed);
+  slot.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+int traceStage(int64_t trace_id, TraceStage stage, int64_t start_ns) {
+  int64_t end_ns = getTimeNs();
+  traceSpan(trace_id, stage, start_ns, end_ns);
+  return static_cast<int>((end_ns - start_ns) / 1000000);
+}
+
+const char *traceStageName(int stage) {
+  if (stage < 0 || stage >= TRACE_NUM_STAGES) {
+    return "unknown";
+  }
+  return kStageNames[stage];
+}
+
+extern "C" int traceDumpChromeJson(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    LOGE("Could not open %s for trace dump", path);
+    return -1;
+  }
+  uint64_t head = sHead.load(std::memory_order_acquire);
+  uint64_t first = head > kRingSize ? head - kRingSize : 0;
+  int written = 0;
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (uint64_t index = first; index < head; ++index) {
+    const Slot &slot = sRing[index & (kRingSize - 1)];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    int64_t trace_id = slot.trace_id.load(std::memory_order_relaxed);
+    int64_t start_ns = slot.start_ns.load(std::memory_order_relaxed);
+    int64_t end_ns = slot.end_ns.load(std::memory_order_relaxed);
+    int32_t stage = slot.stage.load(std::memory_order_relaxed);
+    int32_t tid = slot.tid.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq != 2 * index + 2 ||
+        slot.seq.load(std::memory_order_relaxed) != seq) {
+      continue; // still being written, or overwritten by a newer lap
+    }
+    fprintf(out,
+            "%s\n{\"name\":\"%s\",\"cat\":\"vision\",\"ph\":\"X\","
+            "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"frame\":%lld}}",
+            written == 0 ? "" : ",", kStageNames[stage], start_ns / 1e3,
+            (end_ns - start_ns) / 1e3, tid, (long long)trace_id);
+    written++;
+  }
+  fprintf(out, "\n]}\n");
+  int result = ferror(out) ? -1 : 0;
+  fclose(out);
+  LOGI("Dumped %d trace spans to %s", written, path);
+  return result;
+}
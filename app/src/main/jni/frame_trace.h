@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keep in sync with the TRACE_* constants in NativePart.java
+enum TraceStage {
+  TRACE_CAPTURE_TO_PROCESS = 0, // onCaptureStarted -> onCameraTexture
+  TRACE_PROCESS_FRAME = 1,      // whole JNI call
+  TRACE_READ_PIXELS = 2,
+  TRACE_CVT_COLOR = 3,
+  TRACE_IN_RANGE = 4,
+  TRACE_CONTOURS = 5,
+  TRACE_VISUALIZE = 6,
+  TRACE_UPLOAD = 7,
+  TRACE_TRACKER = 8,
+  TRACE_JNI_RETURN = 9, // copying results into the Java objects
+  TRACE_ANGLES = 10,
+  TRACE_SEND_QUEUE = 11, // RobotConnection.send() -> write thread
+  TRACE_SERIALIZE = 12,
+  TRACE_SOCKET_WRITE = 13,
+  TRACE_RECORD = 14,
+  TRACE_POSE = 15,
+  TRACE_MORPHOLOGY = 16, // mask stages between threshold and contours
+  TRACE_NUM_STAGES
+};
+
+// Records one span of frame `trace_id` into the global ring. Safe to call
+// concurrently from any thread; never blocks or allocates.
+void traceSpan(int64_t trace_id, int stage, int64_t start_ns, int64_t end_ns);
+
+// Writes the spans currently held in the ring to `path` in Chrome
+// trace_event JSON format (load in chrome://tracing or Perfetto). Returns 0
+// on success.
+int traceDumpChromeJson(const char *path);
+
+#ifdef __cplusplus
+}
+
+// Records [start_ns, now] and returns its duration in milliseconds, for the
+// existing per-stage log lines.
+int traceStage(int64_t trace_id, TraceStage stage, int64_t start_ns);
+
+const char *traceStageName(int stage);
+#endif
@@ -0,0 +1,408 @@
+#include "golden_corpus.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+#include "common.hpp"
+#include "pipeline_plan.h"
+#include "recording_reader.h"
+#include "target_detector.h"
+
+namespace {
+
+const double kDefaultTolerance = 0.5;
+// Quad corners land on whole pixels inside a rasterized outline, up to a
+// pixel and a half from the true corners, so widths can be 3 off; sensor
+// noise moves an edge pixel more
+const double kDefaultSyntheticTolerance = 4.0;
+const double kDefaultMaxSlowdown = 1.25;
+// Poses tried for a synthetic frame before it is skipped
+const int kMaxPoseTries = 16;
+
+// Whether the default filter's size check takes a target however far
+// within margin pixels of it the detector reports it
+bool withinSizeLimits(const TargetInfo &target, double margin) {
+  const TargetFilter filter = defaultTargetFilter();
+  return target.width - margin >= filter.min_width &&
+         target.width + margin <= filter.max_width &&
+         target.height - margin >= filter.min_height &&
+         target.height + margin <= filter.max_height;
+}
+
+// Largest difference between two targets in any reported quantity
+double targetError(const TargetInfo &expected, const TargetInfo &actual) {
+  if (expected.points.size() != actual.points.size()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double error = std::max(std::abs(expected.centroid_x - actual.centroid_x),
+                          std::abs(expected.centroid_y - actual.centroid_y));
+  error = std::max(error, std::abs(expected.width - actual.width));
+  error = std::max(error, std::abs(expected.height - actual.height));
+  for (size_t i = 0; i < expected.points.size(); ++i) {
+    cv::Point d = expected.points[i] - actual.points[i];
+    error = std::max(error, static_cast<double>(std::max(abs(d.x), abs(d.y))));
+  }
+  return error;
+}
+
+bool setSceneParameter(const std::string &key, double value,
+                       GoldenEntry *entry) {
+  SceneParams &scene = entry->scene;
+  if (key == "seed") {
+    entry->seed = static_cast<uint64_t>(value);
+  } else if (key == "frames") {
+    entry->frames = static_cast<int>(value);
+  } else if (key == "width") {
+    scene.width = static_cast<int>(value);
+  } else if (key == "height") {
+    scene.height = static_cast<int>(value);
+  } else if (key == "exposure") {
+    scene.exposure = value;
+  } else if (key == "blur") {
+    scene.blur = value;
+  } else if (key == "noise") {
+    scene.noise = value;
+  } else if (key == "distractors") {
+    scene.distractors = static_cast<int>(value);
+  } else if (key == "clutter") {
+    scene.clutter = value;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool parseEntryLine(const std::string &line, const std::string &base_dir,
+                    GoldenEntry *entry) {
+  std::istringstream tokens(line);
+  tokens >> entry->path;
+  entry->synthetic = entry->path == "synthetic";
+  if (!entry->synthetic && entry->path[0] != '/') {
+    entry->path = base_dir + "/" + entry->path;
+  }
+  entry->seed = 1;
+  entry->frames = 100;
+  entry->scene = SceneParams();
+  entry->tolerance =
+      entry->synthetic ? kDefaultSyntheticTolerance : kDefaultTolerance;
+  entry->baseline_ms = 0;
+  entry->max_slowdown = kDefaultMaxSlowdown;
+  entry->interlace = false;
+  entry->tiles = -1;
+  std::string token;
+  while (tokens >> token) {
+    size_t equals = token.find('=');
+    if (equals == std::string::npos) {
+      return false;
+    }
+    std::string key = token.substr(0, equals);
+    const char *text = token.c_str() + equals + 1;
+    char *end;
+    double value = strtod(text, &end);
+    if (*text == '\0' || *end != '\0' || value < 0) {
+      return false;
+    }
+    if (key == "tolerance") {
+      entry->tolerance = value;
+    } else if (key == "baseline_ms") {
+      entry->baseline_ms = value;
+    } else if (key == "max_slowdown") {
+      entry->max_slowdown = value;
+    } else if (key == "interlace" && (value == 0 || value == 1)) {
+      entry->interlace = value == 1;
+    } else if (key == "tiles" && value <= 255 && value == std::floor(value)) {
+      entry->tiles = static_cast<int>(value);
+    } else if (!entry->synthetic || !setSceneParameter(key, value, entry)) {
+      return false;
+    }
+  }
+  return !entry->synthetic ||
+         (entry->scene.width > 0 && entry->scene.height > 0);
+}
+
+// Compares one frame, reports it and counts it into result
+void checkFrame(const GoldenEntry &entry, uint64_t sequence,
+                const std::vector<TargetInfo> &expected,
+                const std::vector<TargetInfo> &actual, int64_t time_ns,
+                FILE *report, GoldenResult *result) {
+  double error;
+  bool match = targetsMatch(expected, actual, entry.tolerance, &error);
+  result->frames++;
+  if (!match) {
+    result->diverged++;
+  }
+  fprintf(report, "%s frame %llu expected %d actual %d error %.3f %.3f ms%s\n",
+          entry.path.c_str(), static_cast<unsigned long long>(sequence),
+          static_cast<int>(expected.size()), static_cast<int>(actual.size()),
+          error, time_ns / 1e6, match ? "" : " DIVERGED");
+}
+
+void summarize(const GoldenEntry &entry, std::vector<int64_t> *times_ns,
+               FILE *report, GoldenResult *result) {
+  if (!times_ns->empty()) {
+    int64_t total = 0;
+    for (auto time : *times_ns) {
+      total += time;
+    }
+    result->mean_ms = total / 1e6 / times_ns->size();
+    size_t p95 = times_ns->size() * 95 / 100;
+    std::nth_element(times_ns->begin(), times_ns->begin() + p95,
+                     times_ns->end());
+    result->p95_ms = (*times_ns)[p95] / 1e6;
+  }
+  result->slow = entry.baseline_ms > 0 &&
+                 result->mean_ms > entry.baseline_ms * entry.max_slowdown;
+  fprintf(report, "%s: %d frames, %d diverged, mean %.3f ms, p95 %.3f ms%s\n",
+          entry.path.c_str(), result->frames, result->diverged,
+          result->mean_ms, result->p95_ms, result->slow ? " SLOW" : "");
+}
+
+bool readFile(const char *path, std::string *contents) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  char buffer[1024];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->append(buffer, count);
+  }
+  fclose(file);
+  return true;
+}
+
+} // namespace
+
+bool parseGoldenManifest(const char *spec, const std::string &base_dir,
+                         std::vector<GoldenEntry> *entries) {
+  entries->clear();
+  std::istringstream lines(spec);
+  std::string line;
+  while (std::getline(lines, line)) {
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    GoldenEntry entry;
+    if (!parseEntryLine(line, base_dir, &entry)) {
+      LOGE("Bad golden manifest line: %s", line.c_str());
+      return false;
+    }
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+bool targetsMatch(const std::vector<TargetInfo> &expected,
+                  const std::vector<TargetInfo> &actual, double tolerance,
+                  double *worst_error) {
+  *worst_error = 0;
+  if (expected.size() != actual.size()) {
+    *worst_error = std::numeric_limits<double>::infinity();
+    return false;
+  }
+  std::vector<bool> used(actual.size(), false);
+  for (auto &target : expected) {
+    size_t nearest = actual.size();
+    double nearest_distance = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < actual.size(); ++i) {
+      double dx = actual[i].centroid_x - target.centroid_x;
+      double dy = actual[i].centroid_y - target.centroid_y;
+      double distance = dx * dx + dy * dy;
+      if (!used[i] && distance < nearest_distance) {
+        nearest = i;
+        nearest_distance = distance;
+      }
+    }
+    used[nearest] = true;
+    *worst_error = std::max(*worst_error, targetError(target, actual[nearest]));
+  }
+  return *worst_error <= tolerance;
+}
+
+GoldenDetector::GoldenDetector() {
+  options_.filter = plan_.filter();
+  options_.max_candidates = plan_.maxCandidates();
+}
+
+void GoldenDetector::setPipeline(const GoldenEntry &entry) {
+  PipelineConfig config = defaultPipelineConfig();
+  // Both go in front of hsv, which the default pipeline starts with
+  PipelineStage stage = config.stages[0];
+  if (entry.tiles >= 0) {
+    stage.kind = PIPELINE_TILES;
+    stage.size = entry.tiles;
+    config.stages.insert(config.stages.begin(), stage);
+  }
+  if (entry.interlace) {
+    stage.kind = PIPELINE_INTERLACE;
+    config.stages.insert(config.stages.begin(), stage);
+  }
+  plan_.compile(config);
+  options_.field = entry.interlace ? 0 : -1;
+  fusion_.reset();
+}
+
+int64_t GoldenDetector::detect(const RecordedFrame &frame,
+                               DetectionResult *result) {
+  // At the decimation the device used, so the targets can match
+  DetectionOptions options = options_;
+  options.decimation = frame.mask_scale;
+  if (frame.mask.empty()) {
+    return detect(frame.rgba, frame.hsv, options, frame.capture_time_ns,
+                  result);
+  }
+  // A recorded mask is always full height; interlacing only applies to
+  // frames thresholded here
+  options.field = -1;
+  int64_t start = getTimeNs();
+  detectTargetsInMask(frame.mask, options, frame.capture_time_ns,
+                      &contour_input_, result);
+  return getTimeNs() - start;
+}
+
+int64_t GoldenDetector::detect(const cv::Mat &rgba,
+                               const HsvThreshold &threshold,
+                               int64_t trace_id, DetectionResult *result) {
+  return detect(rgba, threshold, options_, trace_id, result);
+}
+
+int64_t GoldenDetector::detect(const cv::Mat &rgba,
+                               const HsvThreshold &threshold,
+                               const DetectionOptions &options,
+                               int64_t trace_id, DetectionResult *result) {
+  int64_t start = getTimeNs();
+  detectTargets(rgba, threshold, options, &plan_, trace_id, &mask_, result);
+  if (options.field >= 0) {
+    fusion_.fuse(options.field, 2 * options.decimation * plan_.scale(),
+                 &result->targets);
+    options_.field ^= 1;
+  }
+  return getTimeNs() - start;
+}
+
+SyntheticFrames::SyntheticFrames(const GoldenEntry &entry)
+    : generator_(entry.seed), scene_(entry.scene),
+      camera_(pinholeCameraModel(entry.scene.width, entry.scene.height,
+                                 520.0 * entry.scene.width / 640)),
+      threshold_(sceneThreshold()), size_margin_(entry.tolerance) {
+  scene_.format = SCENE_RGBA;
+}
+
+bool SyntheticFrames::next(cv::Mat *rgba, std::vector<TargetInfo> *expected) {
+  SceneTruth truth;
+  expected->resize(1);
+  TargetInfo &target = (*expected)[0];
+  for (int tries = 0; tries < kMaxPoseTries; ++tries) {
+    generator_.randomizePose(&scene_);
+    generator_.render(scene_, camera_, rgba, &truth);
+    if (!truth.visible) {
+      continue;
+    }
+    // The detector reports corners on whole pixels
+    QuadFit quad;
+    for (int corner = 0; corner < 4; ++corner) {
+      quad.corners[corner] = cv::Point(cvRound(truth.corners[corner].x),
+                                       cvRound(truth.corners[corner].y));
+    }
+    makeTarget(quad, 1, &target);
+    if (withinSizeLimits(target, size_margin_)) {
+      return true;
+    }
+  }
+  expected->clear();
+  return false;
+}
+
+bool verifyRecording(const GoldenEntry &entry, FILE *report,
+                     GoldenResult *result) {
+  RecordingReader reader;
+  if (!reader.open(entry.path.c_str())) {
+    return false;
+  }
+  // Own buffers, so a replay can run beside the camera pipeline
+  GoldenDetector detector;
+  detector.setPipeline(entry);
+  DetectionResult detection;
+  std::vector<int64_t> times_ns;
+  memset(result, 0, sizeof(*result));
+  RecordedFrame frame;
+  for (size_t i = 0; i < reader.size(); ++i) {
+    if (!reader.read(i, &frame)) {
+      continue;
+    }
+    times_ns.push_back(detector.detect(frame, &detection));
+    checkFrame(entry, frame.sequence, frame.targets, detection.targets,
+               times_ns.back(), report, result);
+  }
+  summarize(entry, &times_ns, report, result);
+  return true;
+}
+
+void verifySynthetic(const GoldenEntry &entry, FILE *report,
+                     GoldenResult *result) {
+  SyntheticFrames frames(entry);
+  GoldenDetector detector;
+  detector.setPipeline(entry);
+  cv::Mat frame;
+  DetectionResult detection;
+  std::vector<TargetInfo> expected;
+  std::vector<int64_t> times_ns;
+  memset(result, 0, sizeof(*result));
+  for (int i = 0; i < entry.frames; ++i) {
+    if (!frames.next(&frame, &expected)) {
+      continue;
+    }
+    times_ns.push_back(
+        detector.detect(frame, frames.threshold(), i, &detection));
+    checkFrame(entry, i, expected, detection.targets, times_ns.back(), report,
+               result);
+  }
+  summarize(entry, &times_ns, report, result);
+}
+
+bool loadGoldenManifest(const char *path, std::vector<GoldenEntry> *entries) {
+  std::string spec;
+  if (!readFile(path, &spec)) {
+    LOGE("Cannot read golden manifest %s", path);
+    return false;
+  }
+  std::string base_dir(path);
+  size_t slash = base_dir.rfind('/');
+  base_dir = slash == std::string::npos ? "." : base_dir.substr(0, slash);
+  return parseGoldenManifest(spec.c_str(), base_dir, entries);
+}
+
+extern "C" int goldenVerify(const char *manifest_path,
+                            const char *report_path) {
+  std::vector<GoldenEntry> entries;
+  if (!loadGoldenManifest(manifest_path, &entries)) {
+    return -1;
+  }
+  FILE *report = fopen(report_path, "w");
+  if (report == NULL) {
+    LOGE("Cannot write golden report %s", report_path);
+    return -1;
+  }
+  int failures = 0;
+  for (auto &entry : entries) {
+    GoldenResult result;
+    if (entry.synthetic) {
+      verifySynthetic(entry, report, &result);
+    } else if (!verifyRecording(entry, report, &result)) {
+      fclose(report);
+      return -1;
+    }
+    failures += result.diverged + (result.slow ? 1 : 0);
+    LOGI("Golden %s: %d/%d frames diverged, mean %.3f ms%s",
+         entry.path.c_str(), result.diverged, result.frames, result.mean_ms,
+         result.slow ? " (slow)" : "");
+  }
+  fclose(report);
+  return failures;
+}
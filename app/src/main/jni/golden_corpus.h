@@ -0,0 +1,141 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replays every recording listed in the manifest at manifest_path through
+// the default detection pipeline and compares the targets with the ones
+// recorded, frame by frame. One recording per line:
+//   path [tolerance=PX] [baseline_ms=MS] [max_slowdown=RATIO]
+// or a run of SceneGenerator frames checked against their ground truth:
+//   synthetic [seed=N frames=N width=N height=N exposure=X blur=X noise=X
+//              distractors=N clutter=X] [tolerance=PX] [baseline_ms=MS] ...
+// Any entry may add interlace=1 to run an interlaced pipeline, alternating
+// fields and fusing them as processImpl does, or tiles=TOLERANCE to add
+// tile change detection, for comparing accuracy and time with the same
+// entry run in full; mask recordings are always run in full. Relative
+// paths are relative to the manifest. '#' starts a comment.
+// Targets have to match within tolerance pixels (default 0.5, 4 for
+// synthetic frames) in centroid, size and every corner. With baseline_ms
+// the mean detection time must also stay within max_slowdown (default
+// 1.25) of it. Writes a per-frame report to report_path and returns the
+// number of failures (diverging frames plus slow entries), or -1 if the
+// manifest or a recording cannot be read.
+int goldenVerify(const char *manifest_path, const char *report_path);
+
+#ifdef __cplusplus
+}
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "field_fusion.h"
+#include "pipeline_plan.h"
+#include "recording_reader.h"
+#include "scene_generator.h"
+#include "target_detector.h"
+#include "target_info.h"
+
+struct GoldenEntry {
+  std::string path;
+  // Rendered frames instead of a recording
+  bool synthetic;
+  uint64_t seed;
+  int frames;
+  SceneParams scene;
+  double tolerance;
+  double baseline_ms;
+  double max_slowdown;
+  bool interlace;
+  // Tile change tolerance, or -1
+  int tiles;
+};
+
+struct GoldenResult {
+  int frames;
+  int diverged;
+  double mean_ms;
+  double p95_ms;
+  bool slow;
+};
+
+// Detection as processImpl runs it with the default pipeline, optionally
+// interlaced or with tile change detection. Each instance has its own
+// buffers, so instances can run on different threads and beside the camera
+// pipeline. detect() returns the time it took.
+class GoldenDetector {
+ public:
+  GoldenDetector();
+
+  // Switches to the default pipeline with the entry's interlace and tiles
+  // stages, starting again from field 0 and an empty mask
+  void setPipeline(const GoldenEntry &entry);
+
+  // Raw recordings from RGBA, mask recordings from the recorded mask, both
+  // at the recorded mask scale
+  int64_t detect(const RecordedFrame &frame, DetectionResult *result);
+  int64_t detect(const cv::Mat &rgba, const HsvThreshold &threshold,
+                 int64_t trace_id, DetectionResult *result);
+
+ private:
+  int64_t detect(const cv::Mat &rgba, const HsvThreshold &threshold,
+                 const DetectionOptions &options, int64_t trace_id,
+                 DetectionResult *result);
+
+  PipelinePlan plan_;
+  DetectionOptions options_;
+  FieldFusion fusion_;
+  cv::Mat mask_;
+  cv::Mat contour_input_;
+};
+
+// The frames of a "synthetic" entry, in order
+class SyntheticFrames {
+ public:
+  explicit SyntheticFrames(const GoldenEntry &entry);
+
+  const HsvThreshold &threshold() const { return threshold_; }
+
+  // Renders the next frame and its target. Poses whose target the default
+  // filter's size check could reject within tolerance are drawn again.
+  // Returns false for a frame whose target could not be placed in view at
+  // such a size; it should be skipped.
+  bool next(cv::Mat *rgba, std::vector<TargetInfo> *expected);
+
+ private:
+  SceneGenerator generator_;
+  SceneParams scene_;
+  CameraModel camera_;
+  HsvThreshold threshold_;
+  double size_margin_;
+};
+
+bool parseGoldenManifest(const char *spec, const std::string &base_dir,
+                         std::vector<GoldenEntry> *entries);
+
+// parseGoldenManifest() on a file, with paths relative to its directory
+bool loadGoldenManifest(const char *path, std::vector<GoldenEntry> *entries);
+
+// Pairs each expected target with the nearest unused actual one by
+// centroid. Returns true when the counts agree and every pair is within
+// tolerance; worst_error receives the largest difference seen.
+bool targetsMatch(const std::vector<TargetInfo> &expected,
+                  const std::vector<TargetInfo> &actual, double tolerance,
+                  double *worst_error);
+
+// Runs one recording. Raw recordings go through the whole pipeline from
+// RGBA; mask recordings start from the recorded mask, so they only cover
+// the contour and candidate stages.
+bool verifyRecording(const GoldenEntry &entry, FILE *report,
+                     GoldenResult *result);
+
+// Runs entry.frames random poses from entry.seed; each frame has to give
+// exactly the rendered target.
+void verifySynthetic(const GoldenEntry &entry, FILE *report,
+                     GoldenResult *result);
+#endif
@@ -0,0 +1,349 @@
+#include "hsv_tuner.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "golden_corpus.h"
+#include "recording_reader.h"
+#include "scene_generator.h"
+
+namespace {
+
+const int kHueLevels = 2;
+const int kSatLevels = 4;
+const int kValLevels = 4;
+
+// Pixels either side of the tape's edge left unlabelled
+const int kEdgePixels = 2;
+
+// Bounds of each box dimension in bins, in HsvBox field order
+const int kBinLimits[6] = {HsvHistogram::kHueBins, HsvHistogram::kHueBins,
+                           HsvHistogram::kSatBins, HsvHistogram::kSatBins,
+                           HsvHistogram::kValBins, HsvHistogram::kValBins};
+
+int *boxBound(HsvBox *box, int dim) {
+  return &box->h_min + dim;
+}
+
+// Moves one bound at a time to its best value until no move helps.
+// Dimensions below first_dim stay fixed.
+void coordinateDescent(const HsvHistogram &histogram, int first_dim,
+                       HsvBox *box, double *best_score) {
+  bool improved = true;
+  while (improved) {
+    improved = false;
+    for (int dim = first_dim; dim < 6; ++dim) {
+      int *bound = boxBound(box, dim);
+      int original = *bound;
+      int best_value = original;
+      // A minimum cannot pass its maximum or the other way round
+      bool is_min = (dim & 1) == 0;
+      int low = is_min ? 0 : *boxBound(box, dim - 1);
+      int high = is_min ? *boxBound(box, dim + 1) : kBinLimits[dim] - 1;
+      for (int value = low; value <= high; ++value) {
+        *bound = value;
+        double score = histogram.score(*box).score;
+        if (score > *best_score) {
+          *best_score = score;
+          best_value = value;
+        }
+      }
+      *bound = best_value;
+      improved = improved || best_value != original;
+    }
+  }
+}
+
+void addFrame(const cv::Mat &rgba, const std::vector<TargetInfo> &targets,
+              HsvHistogram *histogram, cv::Mat *hsv, cv::Mat *label) {
+  cv::cvtColor(rgba, *hsv, CV_RGB2HSV);
+  labelTargets(targets, rgba.size(), kEdgePixels, label);
+  histogram->add(*hsv, *label);
+}
+
+// Adds every frame with a target; returns the number added, or -1
+int addEntry(const GoldenEntry &entry, HsvHistogram *histogram,
+             HsvThreshold *recorded) {
+  cv::Mat hsv, label, rgba;
+  int frames = 0;
+  if (entry.synthetic) {
+    SyntheticFrames synthetic(entry);
+    std::vector<TargetInfo> targets;
+    for (int i = 0; i < entry.frames; ++i) {
+      if (synthetic.next(&rgba, &targets)) {
+        addFrame(rgba, targets, histogram, &hsv, &label);
+        frames++;
+      }
+    }
+    return frames;
+  }
+  RecordingReader reader;
+  if (!reader.open(entry.path.c_str())) {
+    return -1;
+  }
+  RecordedFrame frame;
+  for (size_t i = 0; i < reader.size(); ++i) {
+    if (!reader.read(i, &frame) || frame.targets.empty() ||
+        frame.rgba.empty()) {
+      continue;
+    }
+    addFrame(frame.rgba, frame.targets, histogram, &hsv, &label);
+    *recorded = frame.hsv;
+    frames++;
+  }
+  return frames;
+}
+
+void reportThreshold(FILE *report, const char *name,
+                     const HsvHistogram &histogram,
+                     const HsvThreshold &threshold) {
+  HsvBox box = HsvHistogram::toBox(threshold);
+  HsvScore score = histogram.score(box);
+  HsvCounts counts = histogram.count(box);
+  fprintf(report,
+          "%s: h %d-%d s %d-%d v %d-%d precision %.4f recall %.4f "
+          "f1 %.4f (%lld target, %lld background pixels)\n",
+          name, threshold.h_min, threshold.h_max, threshold.s_min,
+          threshold.s_max, threshold.v_min, threshold.v_max, score.precision,
+          score.recall, score.score, static_cast<long long>(counts.target),
+          static_cast<long long>(counts.background));
+}
+
+} // namespace
+
+const int HsvHistogram::kHueBins;
+const int HsvHistogram::kSatBins;
+const int HsvHistogram::kValBins;
+
+HsvHistogram::HsvHistogram()
+    : sums_((kHueBins + 1) * (kSatBins + 1) * (kValBins + 1)) {
+  memset(&sums_[0], 0, sums_.size() * sizeof(HsvCounts));
+  memset(&total_, 0, sizeof(total_));
+}
+
+void HsvHistogram::add(const cv::Mat &hsv, const cv::Mat &label) {
+  for (int y = 0; y < hsv.rows; ++y) {
+    const uint8_t *pixel = hsv.ptr<uint8_t>(y);
+    const uint8_t *labels = label.ptr<uint8_t>(y);
+    for (int x = 0; x < hsv.cols; ++x, pixel += 3) {
+      if (labels[x] == kIgnoreLabel) {
+        continue;
+      }
+      // Counts go one past each bin, the layout integrate() sums in place
+      HsvCounts &counts = sums_[index(pixel[0] / kHueLevels + 1,
+                                      pixel[1] / kSatLevels + 1,
+                                      pixel[2] / kValLevels + 1)];
+      if (labels[x] == kTargetLabel) {
+        counts.target++;
+        total_.target++;
+      } else {
+        counts.background++;
+        total_.background++;
+      }
+    }
+  }
+}
+
+void HsvHistogram::integrate() {
+  // One running sum along each axis in turn
+  const int64_t strides[3] = {index(1, 0, 0), index(0, 1, 0), index(0, 0, 1)};
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int h = 0; h <= kHueBins; ++h) {
+      for (int s = 0; s <= kSatBins; ++s) {
+        for (int v = 0; v <= kValBins; ++v) {
+          int position[3] = {h, s, v};
+          if (position[axis] == 0) {
+            continue;
+          }
+          HsvCounts &counts = sums_[index(h, s, v)];
+          const HsvCounts &before = sums_[index(h, s, v) - strides[axis]];
+          counts.target += before.target;
+          counts.background += before.background;
+        }
+      }
+    }
+  }
+}
+
+HsvCounts HsvHistogram::count(const HsvBox &box) const {
+  const int h[2] = {box.h_min, box.h_max + 1};
+  const int s[2] = {box.s_min, box.s_max + 1};
+  const int v[2] = {box.v_min, box.v_max + 1};
+  HsvCounts counts = {0, 0};
+  // Inclusion-exclusion over the box's corners: + with an even number of
+  // lower bounds, - with an odd one
+  for (int corner = 0; corner < 8; ++corner) {
+    int hi = (corner >> 2) & 1;
+    int si = (corner >> 1) & 1;
+    int vi = corner & 1;
+    const HsvCounts &sum = sums_[index(h[hi], s[si], v[vi])];
+    int sign = ((hi + si + vi) & 1) == 1 ? 1 : -1;
+    counts.target += sign * sum.target;
+    counts.background += sign * sum.background;
+  }
+  return counts;
+}
+
+HsvScore HsvHistogram::score(const HsvBox &box) const {
+  HsvCounts counts = count(box);
+  HsvScore score = {0, 0, 0};
+  if (counts.target == 0) {
+    return score;
+  }
+  score.precision = static_cast<double>(counts.target) /
+                    (counts.target + counts.background);
+  score.recall = static_cast<double>(counts.target) / total_.target;
+  score.score = 2.0 * counts.target /
+                (total_.target + counts.target + counts.background);
+  return score;
+}
+
+HsvBox HsvHistogram::toBox(const HsvThreshold &threshold) {
+  HsvBox box = {std::max(threshold.h_min, 0) / kHueLevels,
+                std::min(threshold.h_max / kHueLevels, kHueBins - 1),
+                std::max(threshold.s_min, 0) / kSatLevels,
+                std::min(threshold.s_max / kSatLevels, kSatBins - 1),
+                std::max(threshold.v_min, 0) / kValLevels,
+                std::min(threshold.v_max / kValLevels, kValBins - 1)};
+  return box;
+}
+
+HsvThreshold HsvHistogram::toThreshold(const HsvBox &box) {
+  HsvThreshold threshold = {box.h_min * kHueLevels,
+                            box.h_max * kHueLevels + kHueLevels - 1,
+                            box.s_min * kSatLevels,
+                            box.s_max * kSatLevels + kSatLevels - 1,
+                            box.v_min * kValLevels,
+                            box.v_max * kValLevels + kValLevels - 1};
+  return threshold;
+}
+
+void labelTargets(const std::vector<TargetInfo> &targets, cv::Size size,
+                  int edge_pixels, cv::Mat *label) {
+  cv::Mat tape(size, CV_8UC1, cv::Scalar(0));
+  cv::Point3d outline[kTargetOutlinePoints];
+  targetOutline(outline);
+  std::vector<cv::Point2f> plane(kTargetOutlinePoints);
+  for (int i = 0; i < kTargetOutlinePoints; ++i) {
+    plane[i] = cv::Point2f(static_cast<float>(outline[i].x),
+                           static_cast<float>(outline[i].y));
+  }
+  std::vector<cv::Point2f> projected;
+  std::vector<cv::Point> polygon(kTargetOutlinePoints);
+  for (auto &target : targets) {
+    if (target.points.size() != 4) {
+      continue;
+    }
+    cv::Point2f from[4], to[4];
+    for (int i = 0; i < 4; ++i) {
+      from[i] = plane[kTargetOuterCorners[i]];
+      to[i] = cv::Point2f(static_cast<float>(target.points[i].x),
+                          static_cast<float>(target.points[i].y));
+    }
+    cv::perspectiveTransform(plane, projected,
+                             cv::getPerspectiveTransform(from, to));
+    for (int i = 0; i < kTargetOutlinePoints; ++i) {
+      polygon[i] = cv::Point(cvRound(projected[i].x), cvRound(projected[i].y));
+    }
+    cv::fillPoly(tape, std::vector<std::vector<cv::Point> >(1, polygon),
+                 cv::Scalar(255));
+  }
+  label->create(size, CV_8UC1);
+  label->setTo(cv::Scalar(kBackgroundLabel));
+  if (edge_pixels <= 0) {
+    label->setTo(cv::Scalar(kTargetLabel), tape);
+    return;
+  }
+  cv::Mat kernel = cv::getStructuringElement(
+      cv::MORPH_RECT, cv::Size(2 * edge_pixels + 1, 2 * edge_pixels + 1));
+  cv::Mat band;
+  cv::dilate(tape, band, kernel);
+  label->setTo(cv::Scalar(kIgnoreLabel), band);
+  cv::erode(tape, band, kernel);
+  label->setTo(cv::Scalar(kTargetLabel), band);
+}
+
+HsvBox searchHsvBox(const HsvHistogram &histogram) {
+  HsvBox best = {0, HsvHistogram::kHueBins - 1, 0,
+                 HsvHistogram::kSatBins - 1, 0, HsvHistogram::kValBins - 1};
+  double best_score = histogram.score(best).score;
+  for (int h_min = 0; h_min < HsvHistogram::kHueBins; ++h_min) {
+    for (int h_max = h_min; h_max < HsvHistogram::kHueBins; ++h_max) {
+      HsvBox box = {h_min, h_max, 0, HsvHistogram::kSatBins - 1,
+                    0, HsvHistogram::kValBins - 1};
+      double score = histogram.score(box).score;
+      // The S and V bounds can only drop pixels; with no target pixels in
+      // the hue range there is nothing to fit
+      if (score == 0) {
+        continue;
+      }
+      coordinateDescent(histogram, 2, &box, &score);
+      if (score > best_score) {
+        best = box;
+        best_score = score;
+      }
+    }
+  }
+  coordinateDescent(histogram, 0, &best, &best_score);
+  return best;
+}
+
+extern "C" int hsvTune(const char *manifest_path, const char *report_path,
+                       int *hsv) {
+  std::vector<GoldenEntry> entries;
+  if (!loadGoldenManifest(manifest_path, &entries)) {
+    return -1;
+  }
+  int64_t start = getTimeNs();
+  // Large enough that it should not live on the stack
+  std::unique_ptr<HsvHistogram> histogram(new HsvHistogram());
+  HsvThreshold recorded = sceneThreshold();
+  bool have_recorded = false;
+  int frames = 0;
+  for (auto &entry : entries) {
+    int added = addEntry(entry, histogram.get(), &recorded);
+    if (added < 0) {
+      return -1;
+    }
+    have_recorded = have_recorded || (!entry.synthetic && added > 0);
+    frames += added;
+  }
+  histogram->integrate();
+  if (histogram->total().target == 0) {
+    LOGE("No labelled target pixels in %s", manifest_path);
+    return -1;
+  }
+  int64_t built = getTimeNs();
+  HsvThreshold best = HsvHistogram::toThreshold(searchHsvBox(*histogram));
+  int64_t searched = getTimeNs();
+
+  FILE *report = fopen(report_path, "w");
+  if (report == NULL) {
+    LOGE("Cannot write tuning report %s", report_path);
+    return -1;
+  }
+  fprintf(report,
+          "%d frames, %lld target and %lld background pixels; histogram "
+          "%.1f ms, search %.1f ms\n",
+          frames, static_cast<long long>(histogram->total().target),
+          static_cast<long long>(histogram->total().background),
+          (built - start) / 1e6, (searched - built) / 1e6);
+  reportThreshold(report, "best", *histogram, best);
+  reportThreshold(report, have_recorded ? "recorded" : "synthetic default",
+                  *histogram, recorded);
+  fclose(report);
+
+  HsvScore score = histogram->score(HsvHistogram::toBox(best));
+  LOGI("HSV tuned over %d frames: h %d-%d s %d-%d v %d-%d, precision %.3f "
+       "recall %.3f",
+       frames, best.h_min, best.h_max, best.s_min, best.s_max, best.v_min,
+       best.v_max, score.precision, score.recall);
+  memcpy(hsv, &best, sizeof(best));
+  return 0;
+}
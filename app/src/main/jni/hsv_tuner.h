@@ -0,0 +1,100 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Searches for the HSV threshold that best separates target pixels from
+// background over every labelled frame of a golden manifest (see
+// golden_corpus.h). A frame's labels come from its targets: the U of tape
+// fitted into each target's corners. Recorded frames without targets are
+// left out, since the detector may simply have missed one. Writes the
+// search result to report_path and the best bounds to hsv as h_min, h_max,
+// s_min, s_max, v_min, v_max. Returns 0, or -1 if the manifest or a
+// recording cannot be read or no frame has a target.
+int hsvTune(const char *manifest_path, const char *report_path, int *hsv);
+
+#ifdef __cplusplus
+}
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "target_detector.h"
+#include "target_info.h"
+
+struct HsvCounts {
+  int64_t target;
+  int64_t background;
+};
+
+// Inclusive bin bounds; HsvThreshold divided by the bin widths
+struct HsvBox {
+  int h_min;
+  int h_max;
+  int s_min;
+  int s_max;
+  int v_min;
+  int v_max;
+};
+
+struct HsvScore {
+  double precision;
+  double recall;
+  // F1 of precision and recall
+  double score;
+};
+
+// Target and background pixel counts per HSV bin, kept as 3D prefix sums
+// once integrate() has run, so the pixels inside any box come from eight
+// lookups whatever its size. Bins are 2 levels of H (0-179, as
+// CV_RGB2HSV gives it) and 4 levels of S and V, so a box converts back to
+// a threshold that takes exactly the pixels counted.
+class HsvHistogram {
+ public:
+  static const int kHueBins = 90;
+  static const int kSatBins = 64;
+  static const int kValBins = 64;
+
+  HsvHistogram();
+
+  // hsv is CV_8UC3, label CV_8UC1 with kTargetLabel, kBackgroundLabel or
+  // kIgnoreLabel per pixel. Only before integrate().
+  void add(const cv::Mat &hsv, const cv::Mat &label);
+  void integrate();
+
+  HsvCounts total() const { return total_; }
+  HsvCounts count(const HsvBox &box) const;
+  HsvScore score(const HsvBox &box) const;
+
+  static HsvBox toBox(const HsvThreshold &threshold);
+  static HsvThreshold toThreshold(const HsvBox &box);
+
+ private:
+  int64_t index(int h, int s, int v) const {
+    return (static_cast<int64_t>(h) * (kSatBins + 1) + s) * (kValBins + 1) + v;
+  }
+
+  // Entry (h, s, v) holds the pixels of every bin below h, s and v
+  std::vector<HsvCounts> sums_;
+  HsvCounts total_;
+};
+
+const uint8_t kBackgroundLabel = 0;
+const uint8_t kIgnoreLabel = 128;
+const uint8_t kTargetLabel = 255;
+
+// Fits the U into each target's four corners and labels the tape, the
+// background, and a band of edge_pixels either side of the tape's edge
+// that is mixed in a real image and is left out.
+void labelTargets(const std::vector<TargetInfo> &targets, cv::Size size,
+                  int edge_pixels, cv::Mat *label);
+
+// Tries every hue range, fitting the S and V bounds to each by coordinate
+// descent, then refines all six bounds together. A few million boxes,
+// well under a second once the histogram is built.
+HsvBox searchHsvBox(const HsvHistogram &histogram);
+#endif
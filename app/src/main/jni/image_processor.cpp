@@ -1,6 +1,8 @@
 #include "image_processor.h"
 
 #include <algorithm>
+#include <atomic>
+#include <utility>
 
 #include <GLES2/gl2.h>
 #include <EGL/egl.h>
@@ -9,7 +11,28 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core/ocl.hpp>
 
+#include "camera_model.h"
 #include "common.hpp"
+#include "cpu_topology.h"
+#include "deferred_log.h"
+#include "exclusion_mask.h"
+#include "field_fusion.h"
+#include "frame_budget.h"
+#include "frame_recorder.h"
+#include "frame_trace.h"
+#include "multi_detector.h"
+#include "perf_counters.h"
+#include "pipeline_plan.h"
+#include "pose_estimator.h"
+#include "shared_export.h"
+#include "target_detector.h"
+#include "target_info.h"
+#include "target_results.h"
+#include "target_tracker.h"
+#include "thermal_governor.h"
+
+// Candidates allowed into geometric analysis under DEGRADE_CAP_CANDIDATES
+static const size_t kDegradedMaxCandidates = 8;
 
 enum DisplayMode {
   DISP_MODE_RAW = 0,
@@ -18,197 +41,259 @@ enum DisplayMode {
   DISP_MODE_TARGETS_PLUS = 3
 };
 
-struct TargetInfo {
-  double centroid_x;
-  double centroid_y;
-  double width;
-  double height;
-  std::vector<cv::Point> points;
-};
+// Outline colour of each output channel's targets, channel 0 first
+static const cv::Scalar kChannelColors[] = {
+    cv::Scalar(0, 112, 255), cv::Scalar(255, 255, 0), cv::Scalar(255, 0, 255),
+    cv::Scalar(0, 255, 0)};
 
-std::vector<TargetInfo> processImpl(int w, int h, int texOut, DisplayMode mode,
-                                    int h_min, int h_max, int s_min, int s_max,
-                                    int v_min, int v_max) {
-  LOGD("Image is %d x %d", w, h);
-  LOGD("H %d-%d S %d-%d V %d-%d", h_min, h_max, s_min, s_max, v_min, v_max);
+std::vector<DetectorOutput> processImpl(int w, int h, int texOut,
+                                        DisplayMode mode, int h_min, int h_max,
+                                        int s_min, int s_max, int v_min,
+                                        int v_max, int64_t capture_time_ns,
+                                        FrameBudget *budget) {
+  // The capture start time doubles as the frame's trace id end to end
+  int64_t trace_id = capture_time_ns;
+  DLOGD("Image is %d x %d", w, h);
+  DLOGD("H %d-%d S %d-%d V %d-%d", h_min, h_max, s_min, s_max, v_min, v_max);
   int64_t t;
+  int elapsed_ms;
+  int64_t pixels = static_cast<int64_t>(w) * h;
 
-  static cv::Mat input;
-  input.create(h, w, CV_8UC4);
+  // Under thermal pressure consumers get every other frame
+  static bool skip_export = false;
+  skip_export = (budget->degradations() & DEGRADE_THERMAL) && !skip_export;
+  // An exported frame is read straight into its shared slot rather than
+  // copied there; everything after the read only looks at it
+  static cv::Mat read_buffer;
+  cv::Mat input;
+  if (!skip_export) {
+    input = sharedExport().beginFrameWrite(capture_time_ns, w, h);
+  }
+  const bool exported = !input.empty();
+  if (!exported) {
+    read_buffer.create(h, w, CV_8UC4);
+    input = read_buffer;
+  }
 
   // read
-  t = getTimeMs();
+  t = getTimeNs();
+  perfStageBegin();
   glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, input.data);
-  LOGD("glReadPixels() costs %d ms", getTimeInterval(t));
-
-  // modify
-  t = getTimeMs();
-  static cv::Mat hsv;
-  cv::cvtColor(input, hsv, CV_RGBA2RGB);
-  cv::cvtColor(hsv, hsv, CV_RGB2HSV);
-  LOGD("cvtColor() costs %d ms", getTimeInterval(t));
+  perfStageEnd(TRACE_READ_PIXELS, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_READ_PIXELS, t);
+  DLOGD("glReadPixels() costs %d ms", elapsed_ms);
+  if (exported) {
+    sharedExport().commitFrame();
+  }
 
-  t = getTimeMs();
   static cv::Mat thresh;
-  cv::inRange(hsv, cv::Scalar(h_min, s_min, v_min),
-              cv::Scalar(h_max, s_max, v_max), thresh);
-  LOGD("inRange() costs %d ms", getTimeInterval(t));
-
-  t = getTimeMs();
-  static cv::Mat contour_input;
-  contour_input = thresh.clone();
-  std::vector<std::vector<cv::Point>> contours;
-  std::vector<cv::Point> convex_contour;
-  std::vector<cv::Point> poly;
-  std::vector<TargetInfo> targets;
-  std::vector<TargetInfo> rejected_targets;
-  cv::findContours(contour_input, contours, cv::RETR_EXTERNAL,
-                   cv::CHAIN_APPROX_TC89_KCOS);
-  for (auto &contour : contours) {
-    convex_contour.clear();
-    cv::convexHull(contour, convex_contour, false);
-    poly.clear();
-    cv::approxPolyDP(convex_contour, poly, 20, true);
-    if (poly.size() == 4 && cv::isContourConvex(poly)) {
-      TargetInfo target;
-      int min_x = std::numeric_limits<int>::max();
-      int max_x = std::numeric_limits<int>::min();
-      int min_y = std::numeric_limits<int>::max();
-      int max_y = std::numeric_limits<int>::min();
-      target.centroid_x = 0;
-      target.centroid_y = 0;
-      for (auto point : poly) {
-        if (point.x < min_x)
-          min_x = point.x;
-        if (point.x > max_x)
-          max_x = point.x;
-        if (point.y < min_y)
-          min_y = point.y;
-        if (point.y > max_y)
-          max_y = point.y;
-        target.centroid_x += point.x;
-        target.centroid_y += point.y;
-      }
-      target.centroid_x /= 4;
-      target.centroid_y /= 4;
-      target.width = max_x - min_x;
-      target.height = max_y - min_y;
-      target.points = poly;
-
-      // Filter based on size
-      // Keep in mind width/height are in imager terms...
-      const double kMinTargetWidth = 20;
-      const double kMaxTargetWidth = 300;
-      const double kMinTargetHeight = 10;
-      const double kMaxTargetHeight = 100;
-      if (target.width < kMinTargetWidth || target.width > kMaxTargetWidth ||
-          target.height < kMinTargetHeight ||
-          target.height > kMaxTargetHeight) {
-        LOGD("Rejecting target due to size");
-        rejected_targets.push_back(std::move(target));
-        continue;
-      }
-      // Filter based on shape
-      const double kNearlyHorizontalSlope = 1 / 1.25;
-      const double kNearlyVerticalSlope = 1.25;
-      int num_nearly_horizontal_slope = 0;
-      int num_nearly_vertical_slope = 0;
-      bool last_edge_vertical = false;
-      for (size_t i = 0; i < 4; ++i) {
-        double dy = target.points[i].y - target.points[(i + 1) % 4].y;
-        double dx = target.points[i].x - target.points[(i + 1) % 4].x;
-        double slope = std::numeric_limits<double>::max();
-        if (dx != 0) {
-          slope = dy / dx;
-        }
-        if (std::abs(slope) <= kNearlyHorizontalSlope &&
-            (i == 0 || last_edge_vertical)) {
-          last_edge_vertical = false;
-          num_nearly_horizontal_slope++;
-        } else if (std::abs(slope) >= kNearlyVerticalSlope &&
-                   (i == 0 || !last_edge_vertical)) {
-          last_edge_vertical = true;
-          num_nearly_vertical_slope++;
-        } else {
-          break;
-        }
-      }
-      if (num_nearly_horizontal_slope != 2 && num_nearly_vertical_slope != 2) {
-        LOGD("Rejecting target due to shape");
-        rejected_targets.push_back(std::move(target));
-        continue;
-      }
-      // Filter based on fullness
-      const double kMinFullness = .2;
-      const double kMaxFullness = .5;
-      double original_contour_area = cv::contourArea(contour);
-      double poly_area = cv::contourArea(poly);
-      double fullness = original_contour_area / poly_area;
-      if (fullness < kMinFullness || fullness > kMaxFullness) {
-        LOGD("Rejected target due to fullness");
-        rejected_targets.push_back(std::move(target));
-        continue;
-      }
+  static MultiDetector multi_detector;
+  static std::vector<DetectorConfig> detector_configs;
+  if (takeDetectorConfigs(&detector_configs)) {
+    multi_detector.configure(detector_configs);
+  }
+  static PipelinePlan plan;
+  static PipelineConfig pipeline_config;
+  if (takePipelineConfig(&pipeline_config) && plan.compile(pipeline_config)) {
+    LOGI("Pipeline %s", plan.describe().c_str());
+  }
+  static ExclusionMask exclusion;
+  if (takeExclusionMask(&exclusion)) {
+    plan.setExclusion(exclusion);
+    LOGI("Pipeline %s", plan.describe().c_str());
+  }
+  std::vector<DetectorOutput> outputs;
+  HsvThreshold hsv_threshold = {h_min, h_max, s_min, s_max, v_min, v_max};
+  DetectionOptions options;
+  options.filter = plan.filter();
+  options.max_candidates = plan.maxCandidates();
+  options.deadline_ns = budget->deadline();
+  if (budget->degradations() & DEGRADE_CAP_CANDIDATES) {
+    options.max_candidates =
+        std::min(options.max_candidates, kDegradedMaxCandidates);
+  }
+  if (budget->degradations() & DEGRADE_DECIMATE) {
+    options.decimation = 2;
+  }
+  // Input pixels per mask pixel
+  int mask_scale = options.decimation;
+  static FieldFusion field_fusion;
+  if (multi_detector.empty()) {
+    mask_scale *= plan.scale();
+    static int next_field = 0;
+    if (plan.interlaced()) {
+      options.field = next_field;
+      next_field ^= 1;
+    } else {
+      field_fusion.reset();
+    }
+    DetectionResult result;
+    detectTargets(input, hsv_threshold, options, &plan, trace_id, &thresh,
+                  &result);
+    if (result.deadline_hit) {
+      budget->degrade(DEGRADE_DEADLINE);
+      DLOGD("Deadline dropped %d candidates", result.deadline_dropped);
+    }
+    if (options.field >= 0) {
+      field_fusion.fuse(options.field, 2 * mask_scale, &result.targets);
+    }
+    outputs.resize(1);
+    outputs[0].channel = 0;
+    outputs[0].targets = std::move(result.targets);
+    outputs[0].rejected_targets = std::move(result.rejected_targets);
+    outputs[0].blobs = result.cascade.contours;
+  } else if (!multi_detector.detect(input, options, trace_id, &thresh,
+                                    &outputs)) {
+    budget->degrade(DEGRADE_DEADLINE);
+  }
+  // Drawing only matters to whoever watches the screen, so it goes first
+  if (budget->expired()) {
+    budget->degrade(DEGRADE_SKIP_VISUALIZE);
+  }
 
-      // We found a target
-      LOGD("Found target at %.2lf, %.2lf...size %.2lf, %.2lf",
-           target.centroid_x, target.centroid_y, target.width, target.height);
-      targets.push_back(std::move(target));
+  // The recorder takes read_buffer's buffer and hands back another one, so
+  // from here on the frame is only read through `frame`
+  cv::Mat frame = input;
+  bool frame_recorded = false;
+  static bool field_skip_logged = false;
+  if (frameRecorder().running() && options.field >= 0) {
+    // A field's mask only turns into the reported targets together with
+    // the previous field's, which a record cannot replay
+    if (!field_skip_logged) {
+      LOGI("Not recording interlaced frames");
+      field_skip_logged = true;
     }
+  } else if (frameRecorder().running()) {
+    field_skip_logged = false;
+    t = getTimeNs();
+    // The shared slot is rewritten a few frames on and unmapped when the
+    // export stops, so the recorder gets a copy of an exported frame
+    if (exported) {
+      input.copyTo(read_buffer);
+    }
+    // With several detectors the mask holds every class
+    frame_recorded = frameRecorder().record(capture_time_ns, &read_buffer,
+                                            thresh, mask_scale,
+                                            hsv_threshold, outputs[0].targets);
+    traceStage(trace_id, TRACE_RECORD, t);
+  }
+
+  if (budget->degradations() & DEGRADE_SKIP_VISUALIZE) {
+    return outputs;
   }
-  LOGD("Contour analysis costs %d ms", getTimeInterval(t));
 
   // write back
-  t = getTimeMs();
+  t = getTimeNs();
+  perfStageBegin();
   static cv::Mat vis;
   if (mode == DISP_MODE_RAW) {
-    vis = input;
+    vis = frame;
   } else if (mode == DISP_MODE_THRESH) {
-    cv::cvtColor(thresh, vis, CV_GRAY2RGBA);
+    static cv::Mat foreground;
+    // Its own buffer: vis may still share a recorded frame's
+    static cv::Mat foreground_rgba;
+    cv::compare(thresh, 0, foreground, cv::CMP_NE);
+    if (foreground.size() != frame.size()) {
+      cv::resize(foreground, foreground, frame.size(), 0, 0,
+                 cv::INTER_NEAREST);
+    }
+    cv::cvtColor(foreground, foreground_rgba, CV_GRAY2RGBA);
+    vis = foreground_rgba;
+  } else if (frame_recorded || exported) {
+    // The writer may still be reading the recorded frame, and consumers
+    // the exported one, so the targets are drawn on a copy
+    static cv::Mat overlay;
+    frame.copyTo(overlay);
+    vis = overlay;
   } else {
-    vis = input;
+    vis = frame;
+  }
+  if (mode == DISP_MODE_TARGETS || mode == DISP_MODE_TARGETS_PLUS) {
     // Render the targets
-    for (auto &target : targets) {
-      cv::polylines(vis, target.points, true, cv::Scalar(0, 112, 255), 3);
-      cv::circle(vis, cv::Point(target.centroid_x, target.centroid_y), 5,
-                 cv::Scalar(0, 112, 255), 3);
+    for (auto &output : outputs) {
+      const cv::Scalar &color =
+          kChannelColors[output.channel % (sizeof(kChannelColors) /
+                                           sizeof(kChannelColors[0]))];
+      for (auto &target : output.targets) {
+        cv::polylines(vis, target.points, true, color, 3);
+        cv::circle(vis, cv::Point(target.centroid_x, target.centroid_y), 5,
+                   color, 3);
+      }
     }
   }
   if (mode == DISP_MODE_TARGETS_PLUS) {
-    for (auto &target : rejected_targets) {
-      cv::polylines(vis, target.points, true, cv::Scalar(255, 0, 0), 3);
+    for (auto &output : outputs) {
+      for (auto &target : output.rejected_targets) {
+        cv::polylines(vis, target.points, true, cv::Scalar(255, 0, 0), 3);
+      }
     }
   }
-  LOGD("Creating vis costs %d ms", getTimeInterval(t));
+  perfStageEnd(TRACE_VISUALIZE, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_VISUALIZE, t);
+  DLOGD("Creating vis costs %d ms", elapsed_ms);
 
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, texOut);
-  t = getTimeMs();
+  t = getTimeNs();
+  perfStageBegin();
   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
                   vis.data);
-  LOGD("glTexSubImage2D() costs %d ms", getTimeInterval(t));
+  perfStageEnd(TRACE_UPLOAD, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_UPLOAD, t);
+  DLOGD("glTexSubImage2D() costs %d ms", elapsed_ms);
 
-  return targets;
+  return outputs;
 }
 
-static bool sFieldsRegistered = false;
+// Readers of the latest results may race the GL thread to register;
+// both look up the same IDs
+static std::atomic<bool> sFieldsRegistered(false);
 
 static jfieldID sNumTargetsField;
 static jfieldID sTargetsField;
+static jfieldID sDegradationField;
+static jfieldID sDegradationLevelField;
+static jfieldID sCaptureTimeField;
 
 static jfieldID sCentroidXField;
 static jfieldID sCentroidYField;
 static jfieldID sWidthField;
 static jfieldID sHeightField;
+static jfieldID sChannelField;
+static jfieldID sIdField;
+static jfieldID sPredictedXField;
+static jfieldID sPredictedYField;
+static jfieldID sVelocityXField;
+static jfieldID sVelocityYField;
+static jfieldID sVarianceXField;
+static jfieldID sVarianceYField;
+static jfieldID sHAngleField;
+static jfieldID sVAngleField;
+static jfieldID sHWidthField;
+static jfieldID sVWidthField;
+static jfieldID sHAnglePredictedField;
+static jfieldID sVAnglePredictedField;
+static jfieldID sHAngleRateField;
+static jfieldID sVAngleRateField;
+static jfieldID sHAngleVarianceField;
+static jfieldID sVAngleVarianceField;
+static jfieldID sHasPoseField;
+static jfieldID sRangeField;
+static jfieldID sBearingField;
+static jfieldID sSkewField;
 
 static void ensureJniRegistered(JNIEnv *env) {
-  if (sFieldsRegistered) {
+  if (sFieldsRegistered.load(std::memory_order_acquire)) {
     return;
   }
-  sFieldsRegistered = true;
   jclass targetsInfoClass =
       env->FindClass("org/team686/droidvision2016/NativePart$TargetsInfo");
   sNumTargetsField = env->GetFieldID(targetsInfoClass, "numTargets", "I");
+  sDegradationField = env->GetFieldID(targetsInfoClass, "degradation", "I");
+  sDegradationLevelField =
+      env->GetFieldID(targetsInfoClass, "degradationLevel", "I");
+  sCaptureTimeField =
+      env->GetFieldID(targetsInfoClass, "captureTimeNs", "J");
   sTargetsField = env->GetFieldID(
       targetsInfoClass, "targets",
       "[Lorg/team686/droidvision2016/NativePart$TargetsInfo$Target;");
@@ -219,28 +304,226 @@ static void ensureJniRegistered(JNIEnv *env) {
   sCentroidYField = env->GetFieldID(targetClass, "centroidY", "D");
   sWidthField = env->GetFieldID(targetClass, "width", "D");
   sHeightField = env->GetFieldID(targetClass, "height", "D");
+  sChannelField = env->GetFieldID(targetClass, "channel", "I");
+  sIdField = env->GetFieldID(targetClass, "id", "I");
+  sPredictedXField = env->GetFieldID(targetClass, "predictedX", "D");
+  sPredictedYField = env->GetFieldID(targetClass, "predictedY", "D");
+  sVelocityXField = env->GetFieldID(targetClass, "velocityX", "D");
+  sVelocityYField = env->GetFieldID(targetClass, "velocityY", "D");
+  sVarianceXField = env->GetFieldID(targetClass, "varianceX", "D");
+  sVarianceYField = env->GetFieldID(targetClass, "varianceY", "D");
+  sHAngleField = env->GetFieldID(targetClass, "hAngle", "D");
+  sVAngleField = env->GetFieldID(targetClass, "vAngle", "D");
+  sHWidthField = env->GetFieldID(targetClass, "hWidth", "D");
+  sVWidthField = env->GetFieldID(targetClass, "vWidth", "D");
+  sHAnglePredictedField =
+      env->GetFieldID(targetClass, "hAnglePredicted", "D");
+  sVAnglePredictedField =
+      env->GetFieldID(targetClass, "vAnglePredicted", "D");
+  sHAngleRateField = env->GetFieldID(targetClass, "hAngleRate", "D");
+  sVAngleRateField = env->GetFieldID(targetClass, "vAngleRate", "D");
+  sHAngleVarianceField = env->GetFieldID(targetClass, "hAngleVariance", "D");
+  sVAngleVarianceField = env->GetFieldID(targetClass, "vAngleVariance", "D");
+  sHasPoseField = env->GetFieldID(targetClass, "hasPose", "Z");
+  sRangeField = env->GetFieldID(targetClass, "range", "D");
+  sBearingField = env->GetFieldID(targetClass, "bearing", "D");
+  sSkewField = env->GetFieldID(targetClass, "skew", "D");
+  sFieldsRegistered.store(true, std::memory_order_release);
 }
 
-extern "C" void processFrame(JNIEnv *env, int tex1, int tex2, int w, int h,
-                             int mode, int h_min, int h_max, int s_min,
-                             int s_max, int v_min, int v_max,
+static void writeTargetsInfo(JNIEnv *env, const TargetResults &results,
                              jobject destTargetInfo) {
-  auto targets = processImpl(w, h, tex2, static_cast<DisplayMode>(mode), h_min,
-                             h_max, s_min, s_max, v_min, v_max);
-  int numTargets = targets.size();
   ensureJniRegistered(env);
-  env->SetIntField(destTargetInfo, sNumTargetsField, numTargets);
-  if (numTargets == 0) {
+  env->SetLongField(destTargetInfo, sCaptureTimeField, results.capture_time_ns);
+  env->SetIntField(destTargetInfo, sDegradationField, results.degradation);
+  env->SetIntField(destTargetInfo, sDegradationLevelField,
+                   results.degradation_level);
+  env->SetIntField(destTargetInfo, sNumTargetsField, results.num_targets);
+  if (results.num_targets == 0) {
     return;
   }
   jobjectArray targetsArray = static_cast<jobjectArray>(
       env->GetObjectField(destTargetInfo, sTargetsField));
-  for (int i = 0; i < std::min(numTargets, 3); ++i) {
+  for (int i = 0; i < results.num_targets; ++i) {
     jobject targetObject = env->GetObjectArrayElement(targetsArray, i);
-    const auto &target = targets[i];
+    const ReportedTarget &target = results.targets[i];
     env->SetDoubleField(targetObject, sCentroidXField, target.centroid_x);
     env->SetDoubleField(targetObject, sCentroidYField, target.centroid_y);
     env->SetDoubleField(targetObject, sWidthField, target.width);
     env->SetDoubleField(targetObject, sHeightField, target.height);
+    env->SetIntField(targetObject, sChannelField, target.channel);
+    env->SetIntField(targetObject, sIdField, target.id);
+    env->SetDoubleField(targetObject, sPredictedXField, target.predicted_x);
+    env->SetDoubleField(targetObject, sPredictedYField, target.predicted_y);
+    env->SetDoubleField(targetObject, sVelocityXField, target.velocity_x);
+    env->SetDoubleField(targetObject, sVelocityYField, target.velocity_y);
+    env->SetDoubleField(targetObject, sVarianceXField, target.variance_x);
+    env->SetDoubleField(targetObject, sVarianceYField, target.variance_y);
+
+    env->SetDoubleField(targetObject, sHAngleField, target.h_angle);
+    env->SetDoubleField(targetObject, sVAngleField, target.v_angle);
+    env->SetDoubleField(targetObject, sHWidthField, target.h_width);
+    env->SetDoubleField(targetObject, sVWidthField, target.v_width);
+    env->SetDoubleField(targetObject, sHAnglePredictedField,
+                        target.h_angle_predicted);
+    env->SetDoubleField(targetObject, sVAnglePredictedField,
+                        target.v_angle_predicted);
+    env->SetDoubleField(targetObject, sHAngleRateField, target.h_angle_rate);
+    env->SetDoubleField(targetObject, sVAngleRateField, target.v_angle_rate);
+    env->SetDoubleField(targetObject, sHAngleVarianceField,
+                        target.h_angle_variance);
+    env->SetDoubleField(targetObject, sVAngleVarianceField,
+                        target.v_angle_variance);
+    env->SetBooleanField(targetObject, sHasPoseField, target.has_pose);
+    if (target.has_pose) {
+      env->SetDoubleField(targetObject, sRangeField, target.range);
+      env->SetDoubleField(targetObject, sBearingField, target.bearing);
+      env->SetDoubleField(targetObject, sSkewField, target.skew);
+    }
+    env->DeleteLocalRef(targetObject);
+  }
+}
+
+extern "C" void processFrame(JNIEnv *env, int tex1, int tex2, int w, int h,
+                             int mode, int h_min, int h_max, int s_min,
+                             int s_max, int v_min, int v_max,
+                             int64_t capture_time_ns, jobject destTargetInfo) {
+  int64_t trace_id = capture_time_ns;
+  int64_t start_ns = getTimeNs();
+  traceSpan(trace_id, TRACE_CAPTURE_TO_PROCESS, capture_time_ns, start_ns);
+
+  static uint32_t placement_generation = 0;
+  placeCurrentThread(THREAD_VISION, &placement_generation);
+  sharedExport().beginFrame(w, h);
+  static FrameBudget budget;
+  static ThermalGovernor thermal_governor;
+  budget.setFloor(thermal_governor.poll());
+  static TargetTracker tracker;
+  static std::vector<int> track_ids;
+  // Channel 0 targets first; only those are tracked
+  std::vector<TargetInfo> targets;
+  std::vector<int> channels;
+  size_t num_primary = 0;
+  int64_t t;
+  if (!(budget.begin(capture_time_ns, start_ns) & DEGRADE_SKIP_FRAME)) {
+    auto outputs = processImpl(w, h, tex2, static_cast<DisplayMode>(mode),
+                               h_min, h_max, s_min, s_max, v_min, v_max,
+                               capture_time_ns, &budget);
+    for (int pass = 0; pass < 2; ++pass) {
+      for (auto &output : outputs) {
+        if ((output.channel == 0) != (pass == 0)) {
+          continue;
+        }
+        for (auto &target : output.targets) {
+          targets.push_back(std::move(target));
+          channels.push_back(output.channel);
+        }
+      }
+      if (pass == 0) {
+        num_primary = targets.size();
+      }
+    }
+    t = getTimeNs();
+    std::vector<TargetInfo> primary(targets.begin(),
+                                    targets.begin() + num_primary);
+    tracker.update(primary, capture_time_ns, &track_ids);
+    traceStage(trace_id, TRACE_TRACKER, t);
+    budget.end(getTimeNs());
+    thermal_governor.addFrameCost(budget.processingNs());
+  }
+  // Extrapolate to now, which is when the caller builds the robot message
+  int64_t predict_time_ns = getTimeNs();
+  static TargetResults results;
+  results.capture_time_ns = capture_time_ns;
+  results.degradation = budget.degradations();
+  results.degradation_level = budget.level();
+  results.num_targets = std::min<int>(targets.size(), kMaxReportedTargets);
+  int num_reported = results.num_targets;
+  if (num_reported > 0) {
+    // Angles from undistorted corner points
+    t = getTimeNs();
+    CameraModel camera = cameraModel(w, h);
+    for (int i = 0; i < num_reported; ++i) {
+      const auto &target = targets[i];
+      ReportedTarget &reported = results.targets[i];
+      TrackedTarget tracked;
+      if (static_cast<size_t>(i) >= num_primary ||
+          !tracker.predict(track_ids[i], predict_time_ns, &tracked)) {
+        tracked.id = -1;
+        tracked.centroid_x = target.centroid_x;
+        tracked.centroid_y = target.centroid_y;
+        tracked.velocity_x = tracked.velocity_y = 0;
+        tracked.variance_x = tracked.variance_y = 0;
+      }
+      TargetAngles angles;
+      PointAngles predicted;
+      cameraTargetAngles(camera, target, &angles);
+      cameraPointAngles(camera,
+                        cv::Point2d(tracked.centroid_x, tracked.centroid_y),
+                        &predicted);
+      reported.centroid_x = target.centroid_x;
+      reported.centroid_y = target.centroid_y;
+      reported.width = target.width;
+      reported.height = target.height;
+      reported.channel = channels[i];
+      reported.id = tracked.id;
+      reported.predicted_x = tracked.centroid_x;
+      reported.predicted_y = tracked.centroid_y;
+      reported.velocity_x = tracked.velocity_x;
+      reported.velocity_y = tracked.velocity_y;
+      reported.variance_x = tracked.variance_x;
+      reported.variance_y = tracked.variance_y;
+      reported.h_angle = angles.h_angle;
+      reported.v_angle = angles.v_angle;
+      reported.h_width = angles.h_width;
+      reported.v_width = angles.v_width;
+      double h_scale = predicted.h_scale;
+      double v_scale = predicted.v_scale;
+      reported.h_angle_predicted = predicted.h_angle;
+      reported.v_angle_predicted = predicted.v_angle;
+      reported.h_angle_rate = h_scale * tracked.velocity_x;
+      reported.v_angle_rate = v_scale * tracked.velocity_y;
+      reported.h_angle_variance = h_scale * h_scale * tracked.variance_x;
+      reported.v_angle_variance = v_scale * v_scale * tracked.variance_y;
+      reported.has_pose = false;
+    }
+    traceStage(trace_id, TRACE_ANGLES, t);
+
+    static PoseEstimator pose_estimator;
+    if (poseEnabled()) {
+      t = getTimeNs();
+      // The target model describes the primary target only
+      for (int i = 0; i < std::min<int>(num_reported, num_primary); ++i) {
+        ReportedTarget &reported = results.targets[i];
+        TargetPose pose;
+        reported.has_pose = pose_estimator.estimate(reported.id, targets[i],
+                                                    camera, &pose);
+        if (reported.has_pose) {
+          reported.range = pose.range;
+          reported.bearing = pose.bearing;
+          reported.skew = pose.skew;
+          DLOGD("Target %d range %.3lf bearing %.3lf skew %.3lf error %.2lf",
+                reported.id, pose.range, pose.bearing, pose.skew, pose.error);
+        }
+      }
+      pose_estimator.retain(track_ids);
+      traceStage(trace_id, TRACE_POSE, t);
+    }
+  }
+  publishTargetResults(&results);
+  sharedExport().publishResults(results);
+
+  t = getTimeNs();
+  writeTargetsInfo(env, results, destTargetInfo);
+  traceStage(trace_id, TRACE_JNI_RETURN, t);
+  traceStage(trace_id, TRACE_PROCESS_FRAME, start_ns);
+}
+
+extern "C" int64_t readLatestTargets(JNIEnv *env, jobject destTargetInfo) {
+  TargetResults results;
+  uint32_t sequence = latestTargetResults(&results);
+  if (sequence != 0) {
+    writeTargetsInfo(env, results, destTargetInfo);
   }
+  return sequence;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <jni.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,8 +19,14 @@ extern "C" {
                     int s_max,
                     int v_min,
                     int v_max,
+                    int64_t capture_time_ns,
                     jobject destTargetInfo);
 
+  // Fills destTargetInfo with the newest frame's results from any thread,
+  // without waiting for or blocking the GL thread. Returns the frame's
+  // sequence number, or 0 (leaving destTargetInfo alone) before the first.
+  int64_t readLatestTargets(JNIEnv* env, jobject destTargetInfo);
+
 #ifdef __cplusplus
 }
 #endif
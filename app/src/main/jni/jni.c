@@ -1,4 +1,18 @@
+#include "camera_model.h"
 #include "image_processor.h"
+#include "frame_recorder.h"
+#include "frame_trace.h"
+#include "corpus_runner.h"
+#include "exclusion_mask.h"
+#include "cpu_topology.h"
+#include "golden_corpus.h"
+#include "hsv_tuner.h"
+#include "multi_detector.h"
+#include "perf_counters.h"
+#include "pipeline_plan.h"
+#include "pose_estimator.h"
+#include "shared_export.h"
+#include "thermal_governor.h"
 
 JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_processFrame(
     JNIEnv *env,
@@ -14,6 +28,241 @@ JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_processFrame(
     jint s_max,
     jint v_min,
     jint v_max,
+    jlong captureTimeNs,
     jobject destTargetInfo) {
-  processFrame(env, tex1, tex2, w, h, mode, h_min, h_max, s_min, s_max, v_min, v_max, destTargetInfo);
+  processFrame(env, tex1, tex2, w, h, mode, h_min, h_max, s_min, s_max, v_min, v_max, captureTimeNs, destTargetInfo);
+}
+
+JNIEXPORT jlong JNICALL Java_org_team686_droidvision2016_NativePart_readLatestTargets(
+    JNIEnv *env,
+    jclass cls,
+    jobject destTargetInfo) {
+  return readLatestTargets(env, destTargetInfo);
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_traceSpan(
+    JNIEnv *env,
+    jclass cls,
+    jlong traceId,
+    jint stage,
+    jlong startNs,
+    jlong endNs) {
+  traceSpan(traceId, stage, startNs, endNs);
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_dumpTrace(
+    JNIEnv *env,
+    jclass cls,
+    jstring path) {
+  const char *pathChars = (*env)->GetStringUTFChars(env, path, NULL);
+  int result = traceDumpChromeJson(pathChars);
+  (*env)->ReleaseStringUTFChars(env, path, pathChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_setPerfProfiling(
+    JNIEnv *env,
+    jclass cls,
+    jboolean enabled) {
+  perfReset();
+  perfSetEnabled(enabled);
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_logPerfSummary(
+    JNIEnv *env,
+    jclass cls) {
+  perfLogSummary();
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_startRecording(
+    JNIEnv *env,
+    jclass cls,
+    jstring path,
+    jint numFrames,
+    jboolean rawFrames) {
+  const char *pathChars = (*env)->GetStringUTFChars(env, path, NULL);
+  int result = recordingStart(pathChars, numFrames, rawFrames);
+  (*env)->ReleaseStringUTFChars(env, path, pathChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_stopRecording(
+    JNIEnv *env,
+    jclass cls) {
+  recordingStop();
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_setCameraPinhole(
+    JNIEnv *env,
+    jclass cls,
+    jint width,
+    jint height,
+    jdouble focalLengthPixels) {
+  cameraSetPinhole(width, height, focalLengthPixels);
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_loadCameraCalibration(
+    JNIEnv *env,
+    jclass cls,
+    jstring path) {
+  const char *pathChars = (*env)->GetStringUTFChars(env, path, NULL);
+  int result = cameraLoadCalibration(pathChars);
+  (*env)->ReleaseStringUTFChars(env, path, pathChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_setPoseEstimation(
+    JNIEnv *env,
+    jclass cls,
+    jboolean enabled) {
+  poseSetEnabled(enabled);
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_setTargetModel(
+    JNIEnv *env,
+    jclass cls,
+    jdoubleArray corners) {
+  if ((*env)->GetArrayLength(env, corners) != 12) {
+    return JNI_FALSE;
+  }
+  jdouble *cornerValues = (*env)->GetDoubleArrayElements(env, corners, NULL);
+  int result = poseSetTargetModel(cornerValues);
+  (*env)->ReleaseDoubleArrayElements(env, corners, cornerValues, JNI_ABORT);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_setDetectors(
+    JNIEnv *env,
+    jclass cls,
+    jstring spec) {
+  const char *specChars = (*env)->GetStringUTFChars(env, spec, NULL);
+  int result = detectorsConfigure(specChars);
+  (*env)->ReleaseStringUTFChars(env, spec, specChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_setPipeline(
+    JNIEnv *env,
+    jclass cls,
+    jstring spec) {
+  const char *specChars = (*env)->GetStringUTFChars(env, spec, NULL);
+  int result = pipelineConfigure(specChars);
+  (*env)->ReleaseStringUTFChars(env, spec, specChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_loadPipeline(
+    JNIEnv *env,
+    jclass cls,
+    jstring path) {
+  const char *pathChars = (*env)->GetStringUTFChars(env, path, NULL);
+  int result = pipelineLoad(pathChars);
+  (*env)->ReleaseStringUTFChars(env, path, pathChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jint JNICALL Java_org_team686_droidvision2016_NativePart_verifyGolden(
+    JNIEnv *env,
+    jclass cls,
+    jstring manifestPath,
+    jstring reportPath) {
+  const char *manifestChars = (*env)->GetStringUTFChars(env, manifestPath, NULL);
+  const char *reportChars = (*env)->GetStringUTFChars(env, reportPath, NULL);
+  int result = goldenVerify(manifestChars, reportChars);
+  (*env)->ReleaseStringUTFChars(env, reportPath, reportChars);
+  (*env)->ReleaseStringUTFChars(env, manifestPath, manifestChars);
+  return result;
+}
+
+JNIEXPORT jdouble JNICALL Java_org_team686_droidvision2016_NativePart_evaluateCorpus(
+    JNIEnv *env,
+    jclass cls,
+    jstring manifestPath,
+    jstring reportPath,
+    jint numWorkers) {
+  const char *manifestChars = (*env)->GetStringUTFChars(env, manifestPath, NULL);
+  const char *reportChars = (*env)->GetStringUTFChars(env, reportPath, NULL);
+  double result = corpusEvaluate(manifestChars, reportChars, numWorkers);
+  (*env)->ReleaseStringUTFChars(env, reportPath, reportChars);
+  (*env)->ReleaseStringUTFChars(env, manifestPath, manifestChars);
+  return result;
+}
+
+JNIEXPORT jintArray JNICALL Java_org_team686_droidvision2016_NativePart_tuneThreshold(
+    JNIEnv *env,
+    jclass cls,
+    jstring manifestPath,
+    jstring reportPath) {
+  const char *manifestChars = (*env)->GetStringUTFChars(env, manifestPath, NULL);
+  const char *reportChars = (*env)->GetStringUTFChars(env, reportPath, NULL);
+  int hsv[6];
+  int result = hsvTune(manifestChars, reportChars, hsv);
+  (*env)->ReleaseStringUTFChars(env, reportPath, reportChars);
+  (*env)->ReleaseStringUTFChars(env, manifestPath, manifestChars);
+  if (result != 0) {
+    return NULL;
+  }
+  jintArray bounds = (*env)->NewIntArray(env, 6);
+  (*env)->SetIntArrayRegion(env, bounds, 0, 6, hsv);
+  return bounds;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_startSharedExport(
+    JNIEnv *env,
+    jclass cls,
+    jstring path,
+    jint resultSlots,
+    jboolean exportFrames) {
+  const char *pathChars = path != NULL ? (*env)->GetStringUTFChars(env, path, NULL) : NULL;
+  int result = sharedExportStart(pathChars, resultSlots, exportFrames);
+  if (pathChars != NULL) {
+    (*env)->ReleaseStringUTFChars(env, path, pathChars);
+  }
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL Java_org_team686_droidvision2016_NativePart_stopSharedExport(
+    JNIEnv *env,
+    jclass cls) {
+  sharedExportStop();
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_setThreadPlacement(
+    JNIEnv *env,
+    jclass cls,
+    jstring spec) {
+  const char *specChars = (*env)->GetStringUTFChars(env, spec, NULL);
+  int result = threadPlacementConfigure(specChars);
+  (*env)->ReleaseStringUTFChars(env, spec, specChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_setThermalGovernor(
+    JNIEnv *env,
+    jclass cls,
+    jstring spec) {
+  const char *specChars = (*env)->GetStringUTFChars(env, spec, NULL);
+  int result = thermalGovernorConfigure(specChars);
+  (*env)->ReleaseStringUTFChars(env, spec, specChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_setExclusionMask(
+    JNIEnv *env,
+    jclass cls,
+    jstring spec) {
+  const char *specChars = (*env)->GetStringUTFChars(env, spec, NULL);
+  int result = exclusionMaskConfigure(specChars);
+  (*env)->ReleaseStringUTFChars(env, spec, specChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL Java_org_team686_droidvision2016_NativePart_loadExclusionMask(
+    JNIEnv *env,
+    jclass cls,
+    jstring path) {
+  const char *pathChars = (*env)->GetStringUTFChars(env, path, NULL);
+  int result = exclusionMaskLoad(pathChars);
+  (*env)->ReleaseStringUTFChars(env, path, pathChars);
+  return result == 0 ? JNI_TRUE : JNI_FALSE;
 }
@@ -0,0 +1,398 @@
+#include "multi_detector.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "deferred_log.h"
+#include "filter_chain.h"
+#include "frame_trace.h"
+#include "perf_counters.h"
+
+namespace {
+
+pthread_mutex_t sPendingLock = PTHREAD_MUTEX_INITIALIZER;
+bool sPendingChanged = false;
+std::vector<DetectorConfig> sPending;
+
+bool largerBlob(const std::pair<double, size_t> &a,
+                const std::pair<double, size_t> &b) {
+  return a.first > b.first;
+}
+
+bool parseDetectorLine(const std::string &line, DetectorConfig *config) {
+  char name[64];
+  HsvThreshold &hsv = config->hsv;
+  TargetFilter &filter = config->filter;
+  filter = defaultTargetFilter();
+  int fields = sscanf(
+      line.c_str(), "%63s %d %d %d %d %d %d %d %lf %lf %lf %lf %lf %lf", name,
+      &config->channel, &hsv.h_min, &hsv.h_max, &hsv.s_min, &hsv.s_max,
+      &hsv.v_min, &hsv.v_max, &filter.min_width, &filter.max_width,
+      &filter.min_height, &filter.max_height, &filter.min_fullness,
+      &filter.max_fullness);
+  if (fields != 8 && fields != 14) {
+    return false;
+  }
+  config->name = name;
+  return true;
+}
+
+} // namespace
+
+bool parseDetectorConfigs(const char *spec,
+                          std::vector<DetectorConfig> *configs) {
+  configs->clear();
+  const char *line_start = spec;
+  while (*line_start != '\0') {
+    const char *line_end = strchr(line_start, '\n');
+    if (line_end == NULL) {
+      line_end = line_start + strlen(line_start);
+    }
+    std::string line(line_start, line_end);
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first != std::string::npos && line[first] != '#') {
+      DetectorConfig config;
+      if (!parseDetectorLine(line, &config)) {
+        LOGE("Bad detector config line: %s", line.c_str());
+        return false;
+      }
+      configs->push_back(config);
+    }
+    line_start = *line_end == '\n' ? line_end + 1 : line_end;
+  }
+  return true;
+}
+
+extern "C" int detectorsConfigure(const char *spec) {
+  std::vector<DetectorConfig> configs;
+  if (!parseDetectorConfigs(spec, &configs)) {
+    return -1;
+  }
+  if (configs.size() > static_cast<size_t>(kMaxDetectors)) {
+    LOGE("At most %d detectors share a frame, got %d", kMaxDetectors,
+         static_cast<int>(configs.size()));
+    return -1;
+  }
+  pthread_mutex_lock(&sPendingLock);
+  sPending.swap(configs);
+  sPendingChanged = true;
+  pthread_mutex_unlock(&sPendingLock);
+  return 0;
+}
+
+bool takeDetectorConfigs(std::vector<DetectorConfig> *configs) {
+  // Polled every frame, so never wait on a writer
+  if (pthread_mutex_trylock(&sPendingLock) != 0) {
+    return false;
+  }
+  bool changed = sPendingChanged;
+  if (changed) {
+    configs->swap(sPending);
+    sPending.clear();
+    sPendingChanged = false;
+  }
+  pthread_mutex_unlock(&sPendingLock);
+  return changed;
+}
+
+double runsContourArea(const std::vector<RowRun> &runs) {
+  // Pixels whose four neighbours are all in the blob; the rest are border
+  int64_t pixels = 0;
+  int64_t interior = 0;
+  size_t above_begin = 0;
+  size_t above_end = 0;
+  size_t begin = 0;
+  while (begin < runs.size()) {
+    const int y = runs[begin].y;
+    size_t end = begin;
+    while (end < runs.size() && runs[end].y == y) {
+      ++end;
+    }
+    size_t below_end = end;
+    while (below_end < runs.size() && runs[below_end].y == y + 1) {
+      ++below_end;
+    }
+    bool above = above_end > above_begin && runs[above_begin].y == y - 1;
+    for (size_t i = begin; i < end; ++i) {
+      const RowRun &run = runs[i];
+      pixels += run.x_end - run.x_begin;
+      for (size_t a = above_begin; above && a < above_end; ++a) {
+        for (size_t b = end; b < below_end; ++b) {
+          // The run's own end pixels are always border
+          int lo = std::max(run.x_begin + 1,
+                            std::max(runs[a].x_begin, runs[b].x_begin));
+          int hi = std::min(run.x_end - 1,
+                            std::min(runs[a].x_end, runs[b].x_end));
+          interior += std::max(0, hi - lo);
+        }
+      }
+    }
+    above_begin = begin;
+    above_end = end;
+    begin = end;
+  }
+  // N - B / 2 - 1 with B = N - interior; a lone pixel's contour encloses
+  // nothing
+  return std::max(0.0, (pixels + interior) / 2.0 - 1);
+}
+
+bool MultiDetector::configure(const std::vector<DetectorConfig> &configs) {
+  if (configs.size() > static_cast<size_t>(kMaxDetectors)) {
+    return false;
+  }
+  configs_ = configs;
+  memset(lut_h_, 0, sizeof(lut_h_));
+  memset(lut_s_, 0, sizeof(lut_s_));
+  memset(lut_v_, 0, sizeof(lut_v_));
+  for (size_t i = 0; i < configs_.size(); ++i) {
+    const HsvThreshold &hsv = configs_[i].hsv;
+    uint8_t bit = 1 << i;
+    for (int value = 0; value < 256; ++value) {
+      if (value >= hsv.h_min && value <= hsv.h_max)
+        lut_h_[value] |= bit;
+      if (value >= hsv.s_min && value <= hsv.s_max)
+        lut_s_[value] |= bit;
+      if (value >= hsv.v_min && value <= hsv.v_max)
+        lut_v_[value] |= bit;
+    }
+    LOGI("Detector %d '%s' channel %d H %d-%d S %d-%d V %d-%d", (int)i,
+         configs_[i].name.c_str(), configs_[i].channel, hsv.h_min, hsv.h_max,
+         hsv.s_min, hsv.s_max, hsv.v_min, hsv.v_max);
+  }
+  return true;
+}
+
+void MultiDetector::classify(const cv::Mat &hsv, cv::Mat *class_mask) {
+  class_mask->create(hsv.rows, hsv.cols, CV_8UC1);
+  for (int y = 0; y < hsv.rows; ++y) {
+    const uint8_t *in = hsv.ptr<uint8_t>(y);
+    uint8_t *out = class_mask->ptr<uint8_t>(y);
+    for (int x = 0; x < hsv.cols; ++x, in += 3) {
+      out[x] = lut_h_[in[0]] & lut_s_[in[1]] & lut_v_[in[2]];
+    }
+  }
+}
+
+int MultiDetector::find(int bit, int run) {
+  std::vector<Run> &runs = runs_[bit];
+  while (runs[run].parent != run) {
+    runs[run].parent = runs[runs[run].parent].parent;
+    run = runs[run].parent;
+  }
+  return run;
+}
+
+void MultiDetector::addRun(int bit, int y, int x_begin, int x_end) {
+  std::vector<Run> &runs = runs_[bit];
+  int index = runs.size();
+  Run run = {{y, x_begin, x_end}, index};
+  runs.push_back(run);
+  // Runs of the previous row that end left of this one cannot touch it or
+  // any later run of this row
+  size_t k = scan_[bit];
+  while (k < row_begin_[bit] && runs[k].run.x_end < x_begin) {
+    ++k;
+  }
+  scan_[bit] = k;
+  // 8-connected: touching diagonally is enough
+  for (; k < row_begin_[bit] && runs[k].run.x_begin <= x_end; ++k) {
+    int a = find(bit, index);
+    int b = find(bit, k);
+    if (a != b) {
+      runs[std::max(a, b)].parent = std::min(a, b);
+    }
+  }
+}
+
+void MultiDetector::extractRuns(const cv::Mat &class_mask) {
+  const int num_bits = configs_.size();
+  for (int bit = 0; bit < num_bits; ++bit) {
+    runs_[bit].clear();
+    row_begin_[bit] = 0;
+  }
+  int start[kMaxDetectors] = {0};
+  for (int y = 0; y < class_mask.rows; ++y) {
+    for (int bit = 0; bit < num_bits; ++bit) {
+      prev_row_begin_[bit] = row_begin_[bit];
+      row_begin_[bit] = runs_[bit].size();
+      scan_[bit] = prev_row_begin_[bit];
+    }
+    const uint8_t *row = class_mask.ptr<uint8_t>(y);
+    uint8_t prev = 0;
+    int x = 0;
+    while (x < class_mask.cols) {
+      if (prev == 0) {
+        // Background dominates: skip it a word at a time
+        uint64_t word;
+        while (x + 8 <= class_mask.cols &&
+               (memcpy(&word, row + x, sizeof(word)), word == 0)) {
+          x += 8;
+        }
+        if (x >= class_mask.cols) {
+          break;
+        }
+      }
+      uint8_t current = row[x];
+      uint8_t changed = current ^ prev;
+      while (changed != 0) {
+        int bit = __builtin_ctz(changed);
+        changed &= changed - 1;
+        if (current & (1 << bit)) {
+          start[bit] = x;
+        } else {
+          addRun(bit, y, start[bit], x);
+        }
+      }
+      prev = current;
+      ++x;
+    }
+    while (prev != 0) {
+      int bit = __builtin_ctz(prev);
+      prev &= prev - 1;
+      addRun(bit, y, start[bit], class_mask.cols);
+    }
+  }
+}
+
+void MultiDetector::collectBlobs(int bit, std::vector<Blob> *blobs) {
+  std::vector<Run> &runs = runs_[bit];
+  blobs->clear();
+  std::vector<int> label(runs.size(), -1);
+  for (size_t i = 0; i < runs.size(); ++i) {
+    int root = find(bit, i);
+    if (label[root] < 0) {
+      label[root] = blobs->size();
+      Blob blob;
+      blob.area = 0;
+      blob.min_x = blob.min_y = std::numeric_limits<int>::max();
+      blob.max_x = blob.max_y = std::numeric_limits<int>::min();
+      blobs->push_back(std::move(blob));
+    }
+    Blob &blob = (*blobs)[label[root]];
+    const RowRun &run = runs[i].run;
+    blob.runs.push_back(run);
+    blob.area += run.x_end - run.x_begin;
+    blob.min_x = std::min(blob.min_x, run.x_begin);
+    blob.max_x = std::max(blob.max_x, run.x_end - 1);
+    blob.min_y = std::min(blob.min_y, run.y);
+    blob.max_y = std::max(blob.max_y, run.y);
+  }
+}
+
+void MultiDetector::filterBlobs(const DetectorConfig &config,
+                                const DetectionOptions &options,
+                                std::vector<Blob> *blobs,
+                                DetectorOutput *output) {
+  const TargetFilter &filter = config.filter;
+  const int scale = options.decimation;
+  const double min_area = minBlobArea(filter);
+  TargetFilterChain chain(filter);
+  // Cheap checks first, as in detectTargets(), and the same contour area
+  // the thresholds were tuned on rather than the pixel count
+  std::vector<std::pair<double, size_t>> candidates;
+  for (size_t i = 0; i < blobs->size(); ++i) {
+    const Blob &blob = (*blobs)[i];
+    if ((blob.max_x - blob.min_x + 1) * scale < filter.min_width ||
+        (blob.max_y - blob.min_y + 1) * scale < filter.min_height) {
+      continue;
+    }
+    double area = runsContourArea(blob.runs);
+    if (area * scale * scale >= min_area) {
+      candidates.push_back(std::make_pair(area, i));
+    }
+  }
+  if (candidates.size() > options.max_candidates) {
+    std::nth_element(candidates.begin(),
+                     candidates.begin() + options.max_candidates,
+                     candidates.end(), largerBlob);
+    candidates.resize(options.max_candidates);
+  }
+  for (const auto &candidate : candidates) {
+    const Blob &blob = (*blobs)[candidate.second];
+    QuadFit quad;
+    if (!fitQuad(blob.runs, &quad) ||
+        quad.residual > quadTolerance(filter, quad)) {
+      continue;
+    }
+    TargetInfo target;
+    makeTarget(quad, scale, &target);
+    FilterCandidate checked = {&target, candidate.first, quad.area};
+    if (chain.reject(checked) != CASCADE_NUM_STAGES) {
+      output->rejected_targets.push_back(std::move(target));
+      continue;
+    }
+    DLOGD("%s found target at %.2lf, %.2lf...size %.2lf, %.2lf",
+          config.name.c_str(), target.centroid_x, target.centroid_y,
+          target.width, target.height);
+    output->targets.push_back(std::move(target));
+  }
+}
+
+void MultiDetector::findBlobs(const cv::Mat &class_mask, int bit,
+                              std::vector<Blob> *blobs) {
+  extractRuns(class_mask);
+  collectBlobs(bit, blobs);
+}
+
+bool MultiDetector::detect(const cv::Mat &rgba, const DetectionOptions &options,
+                           int64_t trace_id, cv::Mat *class_mask,
+                           std::vector<DetectorOutput> *outputs) {
+  bool completed = true;
+  int64_t t;
+  int elapsed_ms;
+  outputs->resize(configs_.size());
+
+  t = getTimeNs();
+  perfStageBegin();
+  const cv::Mat *source = &rgba;
+  if (options.decimation > 1) {
+    cv::resize(rgba, decimated_,
+               cv::Size(rgba.cols / options.decimation,
+                        rgba.rows / options.decimation),
+               0, 0, cv::INTER_NEAREST);
+    source = &decimated_;
+  }
+  int64_t pixels = static_cast<int64_t>(source->cols) * source->rows;
+  // RGB2HSV takes the alpha channel in its stride, no RGBA2RGB pass needed
+  cv::cvtColor(*source, hsv_, CV_RGB2HSV);
+  perfStageEnd(TRACE_CVT_COLOR, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_CVT_COLOR, t);
+  DLOGD("Shared cvtColor() costs %d ms", elapsed_ms);
+
+  t = getTimeNs();
+  perfStageBegin();
+  classify(hsv_, class_mask);
+  perfStageEnd(TRACE_IN_RANGE, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_IN_RANGE, t);
+  DLOGD("Classifying %d detectors costs %d ms", (int)configs_.size(),
+        elapsed_ms);
+
+  t = getTimeNs();
+  perfStageBegin();
+  extractRuns(*class_mask);
+  for (size_t i = 0; i < configs_.size(); ++i) {
+    DetectorOutput &output = (*outputs)[i];
+    output.channel = configs_[i].channel;
+    output.targets.clear();
+    output.rejected_targets.clear();
+    output.blobs = 0;
+    if (options.deadline_ns != 0 && getTimeNs() > options.deadline_ns) {
+      completed = false;
+      continue;
+    }
+    collectBlobs(i, &blobs_);
+    output.blobs = blobs_.size();
+    filterBlobs(configs_[i], options, &blobs_, &output);
+  }
+  perfStageEnd(TRACE_CONTOURS, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_CONTOURS, t);
+  DLOGD("Blob analysis costs %d ms", elapsed_ms);
+  return completed;
+}
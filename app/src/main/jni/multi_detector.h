@@ -0,0 +1,128 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replaces the detector list, one detector per line:
+//   name channel h_min h_max s_min s_max v_min v_max
+//        [min_width max_width min_height max_height min_fullness max_fullness]
+// Blank lines and lines starting with '#' are ignored. An empty spec goes
+// back to the single slider-driven detector. Takes effect on the next
+// frame. Returns 0 on success; on a parse error nothing changes.
+int detectorsConfigure(const char *spec);
+
+#ifdef __cplusplus
+}
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "quad_fit.h"
+#include "target_detector.h"
+#include "target_filter.h"
+#include "target_info.h"
+
+// One bit of the class mask, so at most 8 detectors share a colour pass
+const int kMaxDetectors = 8;
+
+struct DetectorConfig {
+  std::string name;
+  // Reported with each target so the robot can tell the detectors apart;
+  // channel 0 is the tracked primary target
+  int channel;
+  HsvThreshold hsv;
+  TargetFilter filter;
+};
+
+struct DetectorOutput {
+  int channel;
+  std::vector<TargetInfo> targets;
+  std::vector<TargetInfo> rejected_targets;
+  int blobs;
+};
+
+// Parses the detectorsConfigure() format. Returns false on a malformed line.
+bool parseDetectorConfigs(const char *spec,
+                          std::vector<DetectorConfig> *configs);
+
+// Takes the list from the last detectorsConfigure() call, if there was one
+// since the previous call.
+bool takeDetectorConfigs(std::vector<DetectorConfig> *configs);
+
+// What cv::contourArea() gives for the outer contour of the blob made of
+// runs, which are in row order and left to right within a row, as
+// detectTargets() measures its blobs. By Pick's theorem the contour
+// through the centres of B border pixels around N pixels encloses
+// N - B / 2 - 1; exact for blobs without holes or one-pixel-wide parts.
+double runsContourArea(const std::vector<RowRun> &runs);
+
+// Several colour detectors over one frame. A single HSV conversion feeds
+// per-channel lookup tables that classify every pixel into a class mask
+// with one bit per detector; one scan of that mask then collects the
+// foreground runs of every bit and joins them into blobs. The cost of an
+// extra detector is a bit in the tables plus its own blobs, not another
+// pipeline.
+class MultiDetector {
+ public:
+  struct Blob {
+    std::vector<RowRun> runs;
+    // Pixels
+    int area;
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+  };
+
+  bool configure(const std::vector<DetectorConfig> &configs);
+  bool empty() const { return configs_.empty(); }
+
+  // class_mask receives one bit per detector, at the decimated size.
+  // options.filter is unused; every detector brings its own. Returns false
+  // when options.deadline_ns passed before every detector had its blobs
+  // analysed.
+  bool detect(const cv::Mat &rgba, const DetectionOptions &options,
+              int64_t trace_id, cv::Mat *class_mask,
+              std::vector<DetectorOutput> *outputs);
+
+  // The 8-connected blobs of detector `bit` in a class mask, as detect()
+  // joins them
+  void findBlobs(const cv::Mat &class_mask, int bit,
+                 std::vector<Blob> *blobs);
+
+ private:
+  struct Run {
+    RowRun run;
+    int parent;
+  };
+
+  void classify(const cv::Mat &hsv, cv::Mat *class_mask);
+  void extractRuns(const cv::Mat &class_mask);
+  void addRun(int bit, int y, int x_begin, int x_end);
+  int find(int bit, int run);
+  void collectBlobs(int bit, std::vector<Blob> *blobs);
+  void filterBlobs(const DetectorConfig &config,
+                   const DetectionOptions &options, std::vector<Blob> *blobs,
+                   DetectorOutput *output);
+
+  std::vector<DetectorConfig> configs_;
+  // Bit i set where detector i accepts the value
+  uint8_t lut_h_[256];
+  uint8_t lut_s_[256];
+  uint8_t lut_v_[256];
+
+  cv::Mat decimated_;
+  cv::Mat hsv_;
+  // Runs per bit in row order, with union-find parents for 8-connectivity
+  std::vector<Run> runs_[kMaxDetectors];
+  size_t prev_row_begin_[kMaxDetectors];
+  size_t row_begin_[kMaxDetectors];
+  size_t scan_[kMaxDetectors];
+  std::vector<Blob> blobs_;
+};
+#endif
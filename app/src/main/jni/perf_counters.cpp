@@ -0,0 +1,212 @@
+#include "perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "common.hpp"
+
+namespace {
+
+enum Counter {
+  COUNTER_CYCLES = 0,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_CACHE_MISSES,
+  COUNTER_BRANCH_MISSES,
+  NUM_COUNTERS
+};
+
+const uint64_t kCounterConfigs[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+const int kCacheLineBytes = 64;
+
+struct StageTotals {
+  int64_t samples;
+  int64_t pixels;
+  uint64_t counts[NUM_COUNTERS];
+};
+
+// Posted by the C API from any thread, applied by the profiled thread
+enum Request {
+  REQUEST_ENABLE = 1 << 0,
+  REQUEST_RESET = 1 << 1,
+  REQUEST_SUMMARY = 1 << 2,
+};
+
+std::atomic<int> sRequests(0);
+// The state REQUEST_ENABLE applies
+std::atomic<bool> sRequestedEnabled(false);
+// Set while a thread owns the counters; the state below is only touched by
+// that thread, or with none, by the thread that claims it next
+std::atomic<bool> sClaimed(false);
+thread_local bool tOwner = false;
+
+bool sEnabled = false;
+bool sOpenFailed = false;
+int sFds[NUM_COUNTERS] = {-1, -1, -1, -1};
+uint64_t sBegin[NUM_COUNTERS];
+// False when the last begin read failed, so the end has nothing to subtract
+bool sBeginValid = false;
+StageTotals sTotals[TRACE_NUM_STAGES];
+
+int openCounter(uint64_t config, int group_fd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group_fd == -1 ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  // pid 0, cpu -1: the calling thread on whichever core it runs
+  return static_cast<int>(
+      syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+void closeCounters() {
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    if (sFds[i] >= 0) {
+      close(sFds[i]);
+      sFds[i] = -1;
+    }
+  }
+}
+
+bool ensureOpen() {
+  if (sFds[0] >= 0) {
+    return true;
+  }
+  if (sOpenFailed) {
+    return false;
+  }
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    sFds[i] = openCounter(kCounterConfigs[i], i == 0 ? -1 : sFds[0]);
+    if (sFds[i] < 0) {
+      // Typically perf_event_paranoid forbids it, or the PMU lacks the event
+      LOGE("perf_event_open failed for counter %d, profiling disabled", i);
+      closeCounters();
+      sOpenFailed = true;
+      return false;
+    }
+  }
+  ioctl(sFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(sFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+bool readCounters(uint64_t *values) {
+  // PERF_FORMAT_GROUP layout: { u64 nr; u64 values[nr]; }
+  uint64_t buffer[1 + NUM_COUNTERS];
+  ssize_t size = read(sFds[0], buffer, sizeof(buffer));
+  if (size != static_cast<ssize_t>(sizeof(buffer)) ||
+      buffer[0] != NUM_COUNTERS) {
+    return false;
+  }
+  memcpy(values, buffer + 1, sizeof(uint64_t) * NUM_COUNTERS);
+  return true;
+}
+
+void logSummary() {
+  for (int stage = 0; stage < TRACE_NUM_STAGES; ++stage) {
+    const StageTotals &totals = sTotals[stage];
+    if (totals.samples == 0 || totals.pixels == 0) {
+      continue;
+    }
+    double pixels = static_cast<double>(totals.pixels);
+    double cycles = static_cast<double>(totals.counts[COUNTER_CYCLES]);
+    double instructions =
+        static_cast<double>(totals.counts[COUNTER_INSTRUCTIONS]);
+    double cache_misses =
+        static_cast<double>(totals.counts[COUNTER_CACHE_MISSES]);
+    double branch_misses =
+        static_cast<double>(totals.counts[COUNTER_BRANCH_MISSES]);
+    LOGI("perf stage=%s samples=%lld cycles/px=%.3f instr/px=%.3f ipc=%.2f "
+         "cache_miss/px=%.4f bytes/px=%.2f branch_miss/px=%.4f",
+         traceStageName(stage), (long long)totals.samples, cycles / pixels,
+         instructions / pixels, cycles > 0 ? instructions / cycles : 0.0,
+         cache_misses / pixels, cache_misses * kCacheLineBytes / pixels,
+         branch_misses / pixels);
+  }
+}
+
+void applyRequests() {
+  if (sRequests.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  if (!tOwner) {
+    bool expected = false;
+    if (!sClaimed.compare_exchange_strong(expected, true,
+                                          std::memory_order_acquire)) {
+      return;
+    }
+    tOwner = true;
+  }
+  int requests = sRequests.exchange(0, std::memory_order_acquire);
+  if (requests & REQUEST_SUMMARY) {
+    logSummary();
+  }
+  if (requests & REQUEST_RESET) {
+    memset(sTotals, 0, sizeof(sTotals));
+  }
+  if (requests & REQUEST_ENABLE) {
+    sEnabled = sRequestedEnabled.load(std::memory_order_relaxed);
+    sOpenFailed = false;
+    sBeginValid = false;
+    if (!sEnabled) {
+      closeCounters();
+    }
+  }
+  if (!sEnabled) {
+    // Counters follow the thread that opened them; the next enable may be
+    // picked up by another one
+    tOwner = false;
+    sClaimed.store(false, std::memory_order_release);
+  }
+}
+
+} // namespace
+
+extern "C" void perfSetEnabled(int enabled) {
+  sRequestedEnabled.store(enabled != 0, std::memory_order_relaxed);
+  sRequests.fetch_or(REQUEST_ENABLE, std::memory_order_release);
+}
+
+extern "C" void perfReset(void) {
+  sRequests.fetch_or(REQUEST_RESET, std::memory_order_release);
+}
+
+extern "C" void perfLogSummary(void) {
+  sRequests.fetch_or(REQUEST_SUMMARY, std::memory_order_release);
+}
+
+void perfStageBegin() {
+  applyRequests();
+  if (!tOwner || !sEnabled || !ensureOpen()) {
+    return;
+  }
+  sBeginValid = readCounters(sBegin);
+}
+
+void perfStageEnd(TraceStage stage, int64_t pixels) {
+  if (!tOwner || !sBeginValid) {
+    return;
+  }
+  sBeginValid = false;
+  uint64_t end[NUM_COUNTERS];
+  if (!readCounters(end)) {
+    return;
+  }
+  StageTotals &totals = sTotals[stage];
+  totals.samples++;
+  totals.pixels += pixels;
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    totals.counts[i] += end[i] - sBegin[i];
+  }
+}
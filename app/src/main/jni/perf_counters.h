@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Optional hardware counter profiling of the pipeline stages through
+// perf_event_open. Counters are opened lazily for the thread that first calls
+// perfStageBegin() after profiling is enabled (the GL thread on device, the
+// replay thread on a host); stages on any other thread are a no-op, as is
+// everything while disabled. The calls below may come from any thread: they
+// are posted to the profiled thread and take effect at its next
+// perfStageBegin().
+void perfSetEnabled(int enabled);
+
+// Logs one line per stage with cycles, instructions, cache and branch misses
+// normalized per pixel, IPC and the estimated memory traffic per pixel
+// (cache misses * cache line size). The format is stable so summaries from
+// different builds can be diffed directly. Logged by the thread that calls
+// perfStageBegin() next.
+void perfLogSummary(void);
+
+void perfReset(void);
+
+#ifdef __cplusplus
+}
+
+#include "frame_trace.h"
+
+// Brackets one stage. `pixels` is the number of image pixels the stage
+// touched, used to normalize the counts.
+void perfStageBegin();
+void perfStageEnd(TraceStage stage, int64_t pixels);
+#endif
@@ -0,0 +1,805 @@
+#include "pipeline_plan.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "deferred_log.h"
+#include "frame_trace.h"
+#include "perf_counters.h"
+
+namespace {
+
+// Rows converted per step of the fused front pass; 16 rows of 640 pixels
+// of HSV are 30 KB, so the threshold reads them back from cache
+const int kStripRows = 16;
+
+const int kMaxDecimation = 8;
+const int kMaxKernelSize = 15;
+// Far more contours than a frame with any sensible threshold has
+const int kMaxCandidateCap = 4096;
+
+// Change detection tiles are a strip tall and as wide, in mask pixels. A
+// tile is compared through a 4 x 4 grid of samples, one every 4 pixels.
+const int kTileSize = kStripRows;
+const int kTileSampleStep = 4;
+const int kTileSamples =
+    (kTileSize / kTileSampleStep) * (kTileSize / kTileSampleStep);
+// Largest change of any colour channel of a sample that still counts as
+// sensor noise
+const int kDefaultTileTolerance = 8;
+
+// What flows between stages, for type-checking a pipeline
+enum PipelineData {
+  DATA_RGBA,
+  DATA_HSV,
+  DATA_MASK,
+  DATA_CONTOURS,
+  DATA_TARGETS
+};
+
+struct StageInfo {
+  const char *name;
+  PipelineStageKind kind;
+  PipelineData input;
+  PipelineData output;
+};
+
+// decimate takes and gives any image and is checked separately
+const StageInfo kStages[] = {
+    {"decimate", PIPELINE_DECIMATE, DATA_RGBA, DATA_RGBA},
+    {"interlace", PIPELINE_INTERLACE, DATA_RGBA, DATA_RGBA},
+    {"tiles", PIPELINE_TILES, DATA_RGBA, DATA_RGBA},
+    {"hsv", PIPELINE_HSV, DATA_RGBA, DATA_HSV},
+    {"threshold", PIPELINE_THRESHOLD, DATA_HSV, DATA_MASK},
+    {"erode", PIPELINE_ERODE, DATA_MASK, DATA_MASK},
+    {"dilate", PIPELINE_DILATE, DATA_MASK, DATA_MASK},
+    {"open", PIPELINE_OPEN, DATA_MASK, DATA_MASK},
+    {"close", PIPELINE_CLOSE, DATA_MASK, DATA_MASK},
+    {"median", PIPELINE_MEDIAN, DATA_MASK, DATA_MASK},
+    {"contours", PIPELINE_CONTOURS, DATA_MASK, DATA_CONTOURS},
+    {"filter", PIPELINE_FILTER, DATA_CONTOURS, DATA_TARGETS}};
+
+const char *const kThresholdKeys[6] = {"h_min", "h_max", "s_min",
+                                       "s_max", "v_min", "v_max"};
+
+pthread_mutex_t sPendingLock = PTHREAD_MUTEX_INITIALIZER;
+bool sPendingChanged = false;
+PipelineConfig sPending;
+
+// Compares the samples of the tile starting at column x0 of strip with
+// those kept in reference, and keeps the new ones there if any channel of
+// any sample moved by more than tolerance; a tolerance of -1 always keeps
+// them
+bool tileChanged(const cv::Mat &strip, int x0, int tolerance,
+                 uint32_t *reference) {
+  uint32_t samples[kTileSamples];
+  int count = 0;
+  bool changed = false;
+  int x_end = std::min(x0 + kTileSize, strip.cols);
+  for (int y = kTileSampleStep / 2; y < strip.rows; y += kTileSampleStep) {
+    const uint32_t *row = strip.ptr<uint32_t>(y);
+    for (int x = x0 + kTileSampleStep / 2; x < x_end; x += kTileSampleStep) {
+      uint32_t sample = row[x];
+      uint32_t old = reference[count];
+      // RGB; alpha is always opaque
+      for (int shift = 0; shift < 24 && !changed; shift += 8) {
+        int delta = static_cast<int>((sample >> shift) & 0xff) -
+                    static_cast<int>((old >> shift) & 0xff);
+        changed = abs(delta) > tolerance;
+      }
+      samples[count++] = sample;
+    }
+  }
+  if (changed) {
+    memcpy(reference, samples, count * sizeof(uint32_t));
+  }
+  return changed;
+}
+
+const StageInfo *findStage(const std::string &name) {
+  for (auto &info : kStages) {
+    if (name == info.name) {
+      return &info;
+    }
+  }
+  return NULL;
+}
+
+// Finite numbers only: strtod also takes "nan" and "inf"
+bool parseNumber(const std::string &text, double *value) {
+  char *end;
+  *value = strtod(text.c_str(), &end);
+  return !text.empty() && *end == '\0' && std::isfinite(*value);
+}
+
+// Whole numbers from low to high. Checked before any cast, since casting an
+// out-of-range double is undefined.
+bool wholeNumberIn(double value, double low, double high) {
+  return value >= low && value <= high && value == std::floor(value);
+}
+
+double *filterParameter(const std::string &key, TargetFilter *filter) {
+  if (key == "min_width")
+    return &filter->min_width;
+  if (key == "max_width")
+    return &filter->max_width;
+  if (key == "min_height")
+    return &filter->min_height;
+  if (key == "max_height")
+    return &filter->max_height;
+  if (key == "min_fullness")
+    return &filter->min_fullness;
+  if (key == "max_fullness")
+    return &filter->max_fullness;
+  if (key == "horizontal_slope")
+    return &filter->horizontal_slope;
+  if (key == "vertical_slope")
+    return &filter->vertical_slope;
+  if (key == "quad_tolerance")
+    return &filter->quad_tolerance_fraction;
+  if (key == "min_quad_tolerance")
+    return &filter->min_quad_tolerance;
+  return NULL;
+}
+
+bool setParameter(const std::string &key, double value, PipelineStage *stage,
+                  PipelineConfig *config) {
+  switch (stage->kind) {
+  case PIPELINE_DECIMATE:
+    if (key != "factor" || !wholeNumberIn(value, 1, kMaxDecimation)) {
+      return false;
+    }
+    stage->size = static_cast<int>(value);
+    return true;
+  case PIPELINE_ERODE:
+  case PIPELINE_DILATE:
+  case PIPELINE_OPEN:
+  case PIPELINE_CLOSE:
+  case PIPELINE_MEDIAN:
+    if (key != "size" || !wholeNumberIn(value, 1, kMaxKernelSize)) {
+      return false;
+    }
+    stage->size = static_cast<int>(value);
+    // medianBlur only takes odd apertures of at least 3
+    return stage->kind != PIPELINE_MEDIAN ||
+           (stage->size >= 3 && stage->size % 2 == 1);
+  case PIPELINE_TILES:
+    if (key != "tolerance" || !wholeNumberIn(value, 0, 255)) {
+      return false;
+    }
+    stage->size = static_cast<int>(value);
+    return true;
+  case PIPELINE_THRESHOLD:
+    for (int i = 0; i < 6; ++i) {
+      if (key == kThresholdKeys[i]) {
+        if (!wholeNumberIn(value, 0, 255)) {
+          return false;
+        }
+        stage->threshold[i] = static_cast<int>(value);
+        return true;
+      }
+    }
+    return false;
+  case PIPELINE_FILTER: {
+    if (key == "max_candidates") {
+      if (!wholeNumberIn(value, 1, kMaxCandidateCap)) {
+        return false;
+      }
+      config->max_candidates = static_cast<size_t>(value);
+      return true;
+    }
+    // Sizes, fullness, slopes and tolerances are all non-negative
+    double *parameter = filterParameter(key, &config->filter);
+    if (parameter == NULL || value < 0) {
+      return false;
+    }
+    *parameter = value;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool parseStageLine(const std::string &line, PipelineData *data,
+                    PipelineConfig *config) {
+  std::istringstream tokens(line);
+  std::string name;
+  tokens >> name;
+  const StageInfo *info = findStage(name);
+  if (info == NULL) {
+    return false;
+  }
+  if (info->kind == PIPELINE_DECIMATE) {
+    if (*data != DATA_RGBA && *data != DATA_HSV && *data != DATA_MASK) {
+      return false;
+    }
+  } else if (*data != info->input) {
+    return false;
+  } else {
+    *data = info->output;
+  }
+  PipelineStage stage;
+  stage.kind = info->kind;
+  stage.size = info->kind == PIPELINE_MEDIAN
+                   ? 3
+                   : info->kind == PIPELINE_TILES ? kDefaultTileTolerance : 1;
+  std::fill(stage.threshold, stage.threshold + 6, -1);
+  std::string token;
+  while (tokens >> token) {
+    size_t equals = token.find('=');
+    double value;
+    if (equals == std::string::npos ||
+        !parseNumber(token.substr(equals + 1), &value) ||
+        !setParameter(token.substr(0, equals), value, &stage, config)) {
+      return false;
+    }
+  }
+  config->stages.push_back(stage);
+  return true;
+}
+
+} // namespace
+
+PipelineConfig defaultPipelineConfig() {
+  PipelineConfig config;
+  config.filter = defaultTargetFilter();
+  config.max_candidates = kMaxGeometryCandidates;
+  const PipelineStageKind kinds[] = {PIPELINE_HSV, PIPELINE_THRESHOLD,
+                                     PIPELINE_CONTOURS, PIPELINE_FILTER};
+  for (auto kind : kinds) {
+    PipelineStage stage;
+    stage.kind = kind;
+    stage.size = 1;
+    std::fill(stage.threshold, stage.threshold + 6, -1);
+    config.stages.push_back(stage);
+  }
+  return config;
+}
+
+bool parsePipelineConfig(const char *spec, PipelineConfig *config) {
+  config->stages.clear();
+  config->filter = defaultTargetFilter();
+  config->max_candidates = kMaxGeometryCandidates;
+  PipelineData data = DATA_RGBA;
+  const char *line_start = spec;
+  while (*line_start != '\0') {
+    const char *line_end = strchr(line_start, '\n');
+    if (line_end == NULL) {
+      line_end = line_start + strlen(line_start);
+    }
+    std::string line(line_start, line_end);
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") != std::string::npos &&
+        !parseStageLine(line, &data, config)) {
+      LOGE("Bad pipeline stage: %s", line.c_str());
+      return false;
+    }
+    line_start = *line_end == '\n' ? line_end + 1 : line_end;
+  }
+  if (data != DATA_TARGETS) {
+    LOGE("Pipeline has to end in contours, filter");
+    return false;
+  }
+  return true;
+}
+
+extern "C" int pipelineConfigure(const char *spec) {
+  PipelineConfig config;
+  if (!parsePipelineConfig(spec, &config)) {
+    return -1;
+  }
+  pthread_mutex_lock(&sPendingLock);
+  std::swap(sPending, config);
+  sPendingChanged = true;
+  pthread_mutex_unlock(&sPendingLock);
+  return 0;
+}
+
+extern "C" int pipelineLoad(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    LOGE("Cannot open pipeline %s", path);
+    return -1;
+  }
+  std::string spec;
+  char buffer[1024];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    spec.append(buffer, count);
+  }
+  fclose(file);
+  return pipelineConfigure(spec.c_str());
+}
+
+bool takePipelineConfig(PipelineConfig *config) {
+  // Polled every frame, so never wait on a writer
+  if (pthread_mutex_trylock(&sPendingLock) != 0) {
+    return false;
+  }
+  bool changed = sPendingChanged;
+  if (changed) {
+    std::swap(*config, sPending);
+    sPendingChanged = false;
+  }
+  pthread_mutex_unlock(&sPendingLock);
+  return changed;
+}
+
+PipelinePlan::PipelinePlan() { compile(defaultPipelineConfig()); }
+
+bool PipelinePlan::compile(const PipelineConfig &config) {
+  pixel_decimation_ = 1;
+  interlaced_ = false;
+  tile_tolerance_ = -1;
+  std::fill(threshold_, threshold_ + 6, -1);
+  steps_.clear();
+  scale_ = 1;
+  bool front = true;
+  for (auto &stage : config.stages) {
+    StepKind kinds[2];
+    int count = 1;
+    switch (stage.kind) {
+    case PIPELINE_DECIMATE:
+      scale_ *= stage.size;
+      if (front) {
+        pixel_decimation_ *= stage.size;
+      } else if (steps_.back().kind == STEP_DECIMATE) {
+        steps_.back().size *= stage.size;
+      } else {
+        Step step;
+        step.kind = STEP_DECIMATE;
+        step.size = stage.size;
+        steps_.push_back(step);
+      }
+      continue;
+    case PIPELINE_INTERLACE:
+      // Only parses on RGBA, so always part of the front pass
+      interlaced_ = true;
+      continue;
+    case PIPELINE_TILES:
+      tile_tolerance_ = stage.size;
+      continue;
+    case PIPELINE_THRESHOLD:
+      std::copy(stage.threshold, stage.threshold + 6, threshold_);
+      continue;
+    case PIPELINE_ERODE:
+      kinds[0] = STEP_ERODE;
+      break;
+    case PIPELINE_DILATE:
+      kinds[0] = STEP_DILATE;
+      break;
+    case PIPELINE_OPEN:
+      kinds[0] = STEP_ERODE;
+      kinds[1] = STEP_DILATE;
+      count = 2;
+      break;
+    case PIPELINE_CLOSE:
+      kinds[0] = STEP_DILATE;
+      kinds[1] = STEP_ERODE;
+      count = 2;
+      break;
+    case PIPELINE_MEDIAN:
+      kinds[0] = STEP_MEDIAN;
+      break;
+    default:
+      continue;
+    }
+    front = false;
+    for (int i = 0; i < count; ++i) {
+      StepKind kind = kinds[i];
+      // Two rectangle erosions (dilations) are one with the summed extent,
+      // as far as the bit-packed kernels reach. An even kernel's anchor is
+      // off centre, so two even ones would shift the result by a pixel;
+      // merging is exact when either is odd.
+      if (kind != STEP_MEDIAN && !steps_.empty() &&
+          steps_.back().kind == kind &&
+          ((steps_.back().size & 1) || (stage.size & 1)) &&
+          steps_.back().size + stage.size - 1 <= kMaxBitKernel) {
+        steps_.back().size += stage.size - 1;
+        continue;
+      }
+      Step step;
+      step.kind = kind;
+      step.size = stage.size;
+      steps_.push_back(step);
+    }
+  }
+  for (size_t i = 0; i < steps_.size(); ++i) {
+    steps_[i].unpack = i + 1 == steps_.size() ||
+                       (steps_[i + 1].kind != STEP_ERODE &&
+                        steps_[i + 1].kind != STEP_DILATE);
+  }
+  filter_ = config.filter;
+  max_candidates_ = config.max_candidates;
+  prepared_size_ = cv::Size();
+  prepared_field_ = false;
+  tiles_valid_ = false;
+  mask_changed_ = true;
+  last_result_valid_ = false;
+  last_max_candidates_ = 0;
+  lut_threshold_.h_min = -1;
+  return true;
+}
+
+void PipelinePlan::setExclusion(const ExclusionMask &mask) {
+  exclusion_ = mask;
+  // The spans are made for the frame size
+  prepared_size_ = cv::Size();
+}
+
+std::string PipelinePlan::describe() const {
+  std::string description;
+  char part[64];
+  snprintf(part, sizeof(part), "fused[decimate %d,%s%s%s hsv, threshold]",
+           pixel_decimation_, interlaced_ ? " interlace," : "",
+           tile_tolerance_ >= 0 ? " tiles," : "",
+           exclusion_.empty() ? "" : " exclude,");
+  description += part;
+  for (auto &step : steps_) {
+    const char *name = step.kind == STEP_ERODE
+                           ? "erode"
+                           : step.kind == STEP_DILATE
+                                 ? "dilate"
+                                 : step.kind == STEP_MEDIAN ? "median"
+                                                            : "decimate";
+    snprintf(part, sizeof(part), " -> %s %d", name, step.size);
+    description += part;
+  }
+  snprintf(part, sizeof(part), " -> contours -> filter, scale %d", scale_);
+  description += part;
+  return description;
+}
+
+void PipelinePlan::prepare(const cv::Size &input_size, int extra_decimation,
+                           bool field) {
+  int decimation = extra_decimation * pixel_decimation_;
+  cv::Size size(input_size.width / decimation,
+                input_size.height / decimation / (field ? 2 : 1));
+  pixels_.create(size, CV_8UC1);
+  strip_hsv_.create(kStripRows, size.width, CV_8UC3);
+  if (decimation > 1 || field) {
+    strip_rgba_.create(kStripRows, size.width, CV_8UC4);
+  }
+  for (auto &step : steps_) {
+    if (step.kind == STEP_DECIMATE) {
+      size = cv::Size(size.width / step.size, size.height / step.size);
+    }
+    // Erodes and dilates inside a run stay packed
+    if (step.unpack || step.kind == STEP_MEDIAN ||
+        step.kind == STEP_DECIMATE) {
+      step.output.create(size, CV_8UC1);
+    }
+  }
+  tiles_per_row_ = (pixels_.cols + kTileSize - 1) / kTileSize;
+  if (tile_tolerance_ >= 0) {
+    int tiles = tiles_per_row_ * ((pixels_.rows + kTileSize - 1) / kTileSize);
+    tile_samples_.assign(tiles * kTileSamples, 0);
+    tile_dirty_.resize(tiles_per_row_);
+  }
+  prepareExclusion();
+  tiles_valid_ = false;
+  last_result_valid_ = false;
+  prepared_size_ = input_size;
+  prepared_decimation_ = extra_decimation;
+  prepared_field_ = field;
+}
+
+void PipelinePlan::prepareExclusion() {
+  const int rows = pixels_.rows;
+  const int cols = pixels_.cols;
+  strips_.clear();
+  strip_spans_.clear();
+  if (exclusion_.empty()) {
+    row_first_span_.clear();
+    row_spans_.clear();
+    for (int y0 = 0; y0 < rows; y0 += kStripRows) {
+      StripSpans strip = {cv::Range(y0, std::min(y0 + kStripRows, rows)),
+                          static_cast<int>(strip_spans_.size()),
+                          static_cast<int>(strip_spans_.size()) + 1, true};
+      strips_.push_back(strip);
+      strip_spans_.push_back(cv::Range(0, cols));
+    }
+    return;
+  }
+  exclusionSpans(exclusion_, pixels_.size(), &row_first_span_, &row_spans_);
+  // Excluded pixels are never written after this
+  pixels_ = cv::Scalar(0);
+  std::vector<uint8_t> columns(cols);
+  for (int y0 = 0; y0 < rows; y0 += kStripRows) {
+    int y1 = std::min(y0 + kStripRows, rows);
+    StripSpans strip = {cv::Range(y0, y0), 0, 0, true};
+    std::fill(columns.begin(), columns.end(), 0);
+    for (int y = y0; y < y1; ++y) {
+      if (row_first_span_[y] == row_first_span_[y + 1]) {
+        continue;
+      }
+      if (strip.rows.empty()) {
+        strip.rows.start = y;
+      }
+      strip.rows.end = y + 1;
+      for (int i = row_first_span_[y]; i < row_first_span_[y + 1]; ++i) {
+        std::fill(columns.begin() + row_spans_[i].start,
+                  columns.begin() + row_spans_[i].end, 1);
+      }
+    }
+    int first = row_first_span_[strip.rows.start];
+    int count = row_first_span_[strip.rows.start + 1] - first;
+    for (int y = strip.rows.start; y < strip.rows.end; ++y) {
+      strip.uniform =
+          strip.uniform &&
+          row_first_span_[y + 1] - row_first_span_[y] == count &&
+          std::equal(row_spans_.begin() + row_first_span_[y],
+                     row_spans_.begin() + row_first_span_[y + 1],
+                     row_spans_.begin() + first);
+    }
+    strip.first_span = static_cast<int>(strip_spans_.size());
+    for (int x = 0; x < cols;) {
+      if (!columns[x]) {
+        ++x;
+        continue;
+      }
+      int end = x;
+      while (end < cols && columns[end]) {
+        ++end;
+      }
+      strip_spans_.push_back(cv::Range(x, end));
+      x = end;
+    }
+    strip.end_span = static_cast<int>(strip_spans_.size());
+    strips_.push_back(strip);
+  }
+}
+
+void PipelinePlan::updateLut(const HsvThreshold &threshold) {
+  if (memcmp(&threshold, &lut_threshold_, sizeof(threshold)) == 0) {
+    return;
+  }
+  // Every kept mask tile was thresholded with the old bounds
+  tiles_valid_ = false;
+  for (int value = 0; value < 256; ++value) {
+    lut_h_[value] =
+        value >= threshold.h_min && value <= threshold.h_max ? 255 : 0;
+    lut_s_[value] =
+        value >= threshold.s_min && value <= threshold.s_max ? 255 : 0;
+    lut_v_[value] =
+        value >= threshold.v_min && value <= threshold.v_max ? 255 : 0;
+  }
+  lut_threshold_ = threshold;
+}
+
+void PipelinePlan::thresholdColumns(const cv::Mat &strip, int y0, int x0,
+                                    int x1, bool exact) {
+  // Same size and type, so this writes into the preallocated strip
+  cv::Mat hsv = strip_hsv_.rowRange(0, strip.rows).colRange(x0, x1);
+  cv::cvtColor(strip.colRange(x0, x1), hsv, CV_RGB2HSV);
+  for (int y = 0; y < strip.rows; ++y) {
+    const uint8_t *in = hsv.ptr<uint8_t>(y);
+    uint8_t *out = pixels_.ptr<uint8_t>(y0 + y);
+    if (!exact) {
+      for (int x = x0; x < x1; ++x, in += 3) {
+        out[x] = lut_h_[in[0]] & lut_s_[in[1]] & lut_v_[in[2]];
+      }
+      continue;
+    }
+    for (int i = row_first_span_[y0 + y]; i < row_first_span_[y0 + y + 1];
+         ++i) {
+      int start = std::max(row_spans_[i].start, x0);
+      int end = std::min(row_spans_[i].end, x1);
+      const uint8_t *pixel = in + (start - x0) * 3;
+      for (int x = start; x < end; ++x, pixel += 3) {
+        out[x] = lut_h_[pixel[0]] & lut_s_[pixel[1]] & lut_v_[pixel[2]];
+      }
+    }
+  }
+}
+
+int PipelinePlan::runPixels(const cv::Mat &rgba, int decimation, int field) {
+  // Decimated rows per mask row, and the first one
+  const int row_step = field >= 0 ? 2 : 1;
+  const int row_offset = std::max(field, 0);
+  // Consecutive fields sample different rows, so their tiles never match
+  const bool tiles = tile_tolerance_ >= 0 && field < 0;
+  int dirty_tiles = 0;
+  for (size_t s = 0; s < strips_.size(); ++s) {
+    const StripSpans &spans = strips_[s];
+    // Wholly excluded
+    if (spans.first_span == spans.end_span) {
+      continue;
+    }
+    int y0 = static_cast<int>(s) * kStripRows;
+    int rows = std::min(kStripRows, pixels_.rows - y0);
+    // Rows and columns that convert anything; change detection samples
+    // every row of the tiles they touch
+    cv::Range convert_rows(spans.rows.start - y0, spans.rows.end - y0);
+    cv::Range copy_rows = tiles ? cv::Range(0, rows) : convert_rows;
+    int copy_x0 = strip_spans_[spans.first_span].start;
+    int copy_x1 = strip_spans_[spans.end_span - 1].end;
+    if (tiles) {
+      copy_x0 = copy_x0 / kTileSize * kTileSize;
+      copy_x1 = std::min((copy_x1 + kTileSize - 1) / kTileSize * kTileSize,
+                         pixels_.cols);
+    }
+    cv::Mat strip;
+    if (decimation == 1 && field < 0) {
+      strip = rgba.rowRange(y0, y0 + rows);
+    } else {
+      // Same samples as cv::resize(INTER_NEAREST) by an integer factor
+      strip = strip_rgba_.rowRange(0, rows);
+      for (int y = copy_rows.start; y < copy_rows.end; ++y) {
+        const uint32_t *in = rgba.ptr<uint32_t>(
+            ((y0 + y) * row_step + row_offset) * decimation);
+        uint32_t *out = strip.ptr<uint32_t>(y);
+        if (decimation == 1) {
+          memcpy(out + copy_x0, in + copy_x0,
+                 (copy_x1 - copy_x0) * sizeof(uint32_t));
+          continue;
+        }
+        for (int x = copy_x0; x < copy_x1; ++x) {
+          out[x] = in[x * decimation];
+        }
+      }
+    }
+    cv::Mat convert = strip.rowRange(convert_rows);
+    if (!tiles) {
+      for (int i = spans.first_span; i < spans.end_span; ++i) {
+        thresholdColumns(convert, spans.rows.start, strip_spans_[i].start,
+                         strip_spans_[i].end, !spans.uniform);
+      }
+      dirty_tiles += tiles_per_row_;
+      continue;
+    }
+    uint32_t *reference =
+        &tile_samples_[(y0 / kTileSize) * tiles_per_row_ * kTileSamples];
+    int span = spans.first_span;
+    for (int tile = 0; tile < tiles_per_row_; ++tile) {
+      while (span < spans.end_span &&
+             strip_spans_[span].end <= tile * kTileSize) {
+        ++span;
+      }
+      // Tiles that are wholly excluded are never looked at. Without a
+      // valid mask every other tile counts as changed, which also
+      // refreshes its reference.
+      tile_dirty_[tile] =
+          span < spans.end_span &&
+          strip_spans_[span].start < (tile + 1) * kTileSize &&
+          tileChanged(strip, tile * kTileSize,
+                      tiles_valid_ ? tile_tolerance_ : -1,
+                      reference + tile * kTileSamples);
+    }
+    // Convert the spans of runs of dirty tiles in one call each
+    for (int tile = 0; tile < tiles_per_row_;) {
+      if (!tile_dirty_[tile]) {
+        ++tile;
+        continue;
+      }
+      int end = tile;
+      while (end < tiles_per_row_ && tile_dirty_[end]) {
+        ++end;
+      }
+      for (int i = spans.first_span; i < spans.end_span; ++i) {
+        int x0 = std::max(strip_spans_[i].start, tile * kTileSize);
+        int x1 = std::min(strip_spans_[i].end, end * kTileSize);
+        if (x0 < x1) {
+          thresholdColumns(convert, spans.rows.start, x0, x1,
+                           !spans.uniform);
+        }
+      }
+      dirty_tiles += end - tile;
+      tile = end;
+    }
+  }
+  tiles_valid_ = tiles;
+  return dirty_tiles;
+}
+
+bool PipelinePlan::lastResult(size_t max_candidates,
+                              DetectionResult *result) const {
+  if (mask_changed_ || !last_result_valid_ ||
+      max_candidates != last_max_candidates_) {
+    return false;
+  }
+  *result = last_result_;
+  return true;
+}
+
+void PipelinePlan::keepResult(size_t max_candidates,
+                              const DetectionResult &result) {
+  // A result cut short by the deadline is not worth repeating
+  last_result_valid_ = tile_tolerance_ >= 0 && !result.deadline_hit;
+  if (last_result_valid_) {
+    last_result_ = result;
+    last_max_candidates_ = max_candidates;
+  }
+}
+
+void PipelinePlan::buildMask(const cv::Mat &rgba,
+                             const HsvThreshold &slider_threshold,
+                             int extra_decimation, int field,
+                             int64_t trace_id, cv::Mat *mask) {
+  int64_t t;
+  int elapsed_ms;
+  if (rgba.size() != prepared_size_ ||
+      extra_decimation != prepared_decimation_ ||
+      (field >= 0) != prepared_field_) {
+    prepare(rgba.size(), extra_decimation, field >= 0);
+  }
+  HsvThreshold threshold = slider_threshold;
+  int *bounds = &threshold.h_min;
+  for (int i = 0; i < 6; ++i) {
+    if (threshold_[i] >= 0) {
+      bounds[i] = threshold_[i];
+    }
+  }
+
+  // The conversion and threshold are one pass, traced as the conversion
+  t = getTimeNs();
+  perfStageBegin();
+  updateLut(threshold);
+  int dirty_tiles =
+      runPixels(rgba, extra_decimation * pixel_decimation_, field);
+  perfStageEnd(TRACE_CVT_COLOR, pixels_.total());
+  elapsed_ms = traceStage(trace_id, TRACE_CVT_COLOR, t);
+  DLOGD("Fused cvtColor() and threshold cost %d ms", elapsed_ms);
+  if (tile_tolerance_ >= 0) {
+    DLOGD("Re-thresholded %d of %d tiles", dirty_tiles,
+          static_cast<int>(tile_samples_.size() / kTileSamples));
+  }
+  mask_changed_ = tile_tolerance_ < 0 || field >= 0 || dirty_tiles > 0;
+
+  // With no tile changed every step would give its last output again, so
+  // the last step's output from the previous frame is the mask
+  const cv::Mat *current = &pixels_;
+  if (!mask_changed_ && !steps_.empty()) {
+    current = &steps_.back().output;
+  } else if (!steps_.empty()) {
+    t = getTimeNs();
+    perfStageBegin();
+    // The run of erodes and dilates in progress, if any
+    const BitMask *packed = NULL;
+    for (auto &step : steps_) {
+      switch (step.kind) {
+      case STEP_ERODE:
+      case STEP_DILATE: {
+        if (packed == NULL) {
+          bits_[0].fromMat(*current);
+          packed = &bits_[0];
+        }
+        BitMask *out = packed == &bits_[0] ? &bits_[1] : &bits_[0];
+        if (step.kind == STEP_ERODE) {
+          erodeBits(*packed, step.size, out);
+        } else {
+          dilateBits(*packed, step.size, out);
+        }
+        packed = out;
+        if (step.unpack) {
+          packed->toMat(&step.output);
+          packed = NULL;
+        }
+        break;
+      }
+      case STEP_MEDIAN:
+        cv::medianBlur(*current, step.output, step.size);
+        break;
+      case STEP_DECIMATE:
+        cv::resize(*current, step.output, step.output.size(), 0, 0,
+                   cv::INTER_NEAREST);
+        break;
+      }
+      current = &step.output;
+    }
+    perfStageEnd(TRACE_MORPHOLOGY, pixels_.total());
+    elapsed_ms = traceStage(trace_id, TRACE_MORPHOLOGY, t);
+    DLOGD("Mask stages cost %d ms", elapsed_ms);
+  }
+  *mask = *current;
+}
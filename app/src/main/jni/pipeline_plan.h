@@ -0,0 +1,224 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replaces the detection pipeline, one stage per line in order:
+//   decimate factor=N
+//   interlace
+//   tiles [tolerance=N]
+//   hsv
+//   threshold [h_min=N h_max=N s_min=N s_max=N v_min=N v_max=N]
+//   erode size=N | dilate size=N | open size=N | close size=N
+//   median size=N
+//   contours
+//   filter [min_width=X max_width=X min_height=X max_height=X
+//           min_fullness=X max_fullness=X horizontal_slope=X
+//           vertical_slope=X quad_tolerance=X min_quad_tolerance=X
+//           max_candidates=N]
+// Threshold bounds that are left out follow the HSV sliders; filter
+// parameters that are left out keep defaultTargetFilter(). interlace
+// thresholds the even rows on one frame and the odd rows on the next, for
+// half the per-pixel work at the full frame rate; it has to come before
+// hsv. tiles keeps the mask of every 16 x 16 tile whose colours moved by
+// no more than tolerance (default 8) since it was last thresholded, and
+// repeats the previous targets when no tile changed; it has to come before
+// hsv too and does nothing on interlaced frames. open is an erode then a
+// dilate of the same size, close the reverse. '#' starts a comment. Takes
+// effect on the next frame. Returns 0 on success; on an invalid pipeline
+// nothing changes.
+int pipelineConfigure(const char *spec);
+
+// pipelineConfigure() with the contents of a file
+int pipelineLoad(const char *path);
+
+#ifdef __cplusplus
+}
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "bit_mask.h"
+#include "exclusion_mask.h"
+#include "target_detector.h"
+#include "target_filter.h"
+
+enum PipelineStageKind {
+  PIPELINE_DECIMATE,
+  PIPELINE_INTERLACE,
+  PIPELINE_TILES,
+  PIPELINE_HSV,
+  PIPELINE_THRESHOLD,
+  PIPELINE_ERODE,
+  PIPELINE_DILATE,
+  PIPELINE_OPEN,
+  PIPELINE_CLOSE,
+  PIPELINE_MEDIAN,
+  PIPELINE_CONTOURS,
+  PIPELINE_FILTER
+};
+
+struct PipelineStage {
+  PipelineStageKind kind;
+  // Decimation factor, kernel size or tile tolerance
+  int size;
+  // Fixed threshold bounds; -1 follows the slider
+  int threshold[6];
+};
+
+struct PipelineConfig {
+  std::vector<PipelineStage> stages;
+  TargetFilter filter;
+  size_t max_candidates;
+};
+
+// The pipeline processImpl always ran: hsv, threshold, contours, filter
+PipelineConfig defaultPipelineConfig();
+
+// Parses and type-checks the pipelineConfigure() format: it has to turn
+// RGBA into a mask and end in contours, filter.
+bool parsePipelineConfig(const char *spec, PipelineConfig *config);
+
+// Takes the pipeline from the last pipelineConfigure() call, if there was
+// one since the previous call.
+bool takePipelineConfig(PipelineConfig *config);
+
+// A PipelineConfig compiled for execution. The leading run of per-pixel
+// stages (decimate, hsv, threshold) becomes one pass over strips of rows,
+// so the HSV image never leaves the cache; nearest-neighbour decimation
+// commutes with per-pixel stages and is always done first. open and close
+// become an erode and a dilate; adjacent erodes or dilates merge into one
+// larger kernel unless both are even, and adjacent decimations into one. A
+// run of erodes and dilates works on a BitMask, packed once at its start
+// and unpacked once at its end. An interlaced plan's front pass only visits
+// the rows of the requested field, so everything after it works on a
+// half-height mask.
+// With tiles, the front pass compares a sparse grid of samples in each tile
+// with the ones its mask was made from and only converts the tiles that
+// changed; a frame with no changed tile skips the rest of the pipeline.
+// An exclusion mask is turned into the columns each mask row converts, so
+// the front pass skips strips, rows and spans that are wholly excluded and
+// never visits an excluded pixel; their mask pixels stay 0.
+// Every buffer is allocated when the frame size is first seen,
+// so steady-state frames do not allocate.
+class PipelinePlan {
+ public:
+  PipelinePlan();
+
+  bool compile(const PipelineConfig &config);
+  // Kept across compile()
+  void setExclusion(const ExclusionMask &mask);
+
+  // Mask pixels per input pixel in each direction, not counting the extra
+  // decimation passed to buildMask()
+  int scale() const { return scale_; }
+  bool interlaced() const { return interlaced_; }
+  // Camera rows from the top of the image to the first row of field, with
+  // the same extra decimation as buildMask()
+  int fieldOffset(int field, int extra_decimation) const {
+    return field > 0 ? field * extra_decimation * pixel_decimation_ : 0;
+  }
+  const TargetFilter &filter() const { return filter_; }
+  size_t maxCandidates() const { return max_candidates_; }
+  std::string describe() const;
+
+  // Runs every stage before contours, after decimating the input by
+  // extra_decimation and, for field 0 or 1, keeping only that field's rows.
+  // mask refers to a buffer owned by the plan and stays valid until the
+  // next call.
+  void buildMask(const cv::Mat &rgba, const HsvThreshold &slider_threshold,
+                 int extra_decimation, int field, int64_t trace_id,
+                 cv::Mat *mask);
+
+  // findContours' writable copy of the mask
+  cv::Mat *contourInput() { return &contour_input_; }
+
+  // False when tile change detection found no tile to redo, so the mask is
+  // the same as the previous frame's
+  bool maskChanged() const { return mask_changed_; }
+  // The targets found in the unchanged mask last time, if they were found
+  // with the same candidate cap; only kept with tiles
+  bool lastResult(size_t max_candidates, DetectionResult *result) const;
+  void keepResult(size_t max_candidates, const DetectionResult &result);
+
+ private:
+  enum StepKind { STEP_ERODE, STEP_DILATE, STEP_MEDIAN, STEP_DECIMATE };
+
+  struct Step {
+    StepKind kind;
+    int size;
+    // Last of a run of erodes and dilates, so the BitMask goes back to
+    // output
+    bool unpack;
+    cv::Mat output;
+  };
+
+  void prepare(const cv::Size &input_size, int extra_decimation,
+               bool field);
+  void updateLut(const HsvThreshold &threshold);
+  // Returns the number of tiles converted
+  int runPixels(const cv::Mat &rgba, int decimation, int field);
+  // Converts columns x0 to x1 of strip into mask rows from y0; with exact
+  // set, each row only writes its own spans of them
+  void thresholdColumns(const cv::Mat &strip, int y0, int x0, int x1,
+                        bool exact);
+  void prepareExclusion();
+
+  // Fused front pass
+  int pixel_decimation_;
+  bool interlaced_;
+  // -1 without change detection
+  int tile_tolerance_;
+  int threshold_[6];
+  // Everything between the front pass and contours, in order
+  std::vector<Step> steps_;
+  int scale_;
+  TargetFilter filter_;
+  size_t max_candidates_;
+
+  cv::Size prepared_size_;
+  int prepared_decimation_;
+  bool prepared_field_;
+  cv::Mat strip_rgba_;
+  cv::Mat strip_hsv_;
+  cv::Mat pixels_;
+  cv::Mat contour_input_;
+  // Erodes and dilates ping-pong between these
+  BitMask bits_[2];
+  // Change detection: the samples each tile's mask was made from, row by
+  // row of tiles, and the current strip's dirty tiles
+  int tiles_per_row_;
+  std::vector<uint32_t> tile_samples_;
+  std::vector<uint8_t> tile_dirty_;
+  bool tiles_valid_;
+  bool mask_changed_;
+  DetectionResult last_result_;
+  bool last_result_valid_;
+  size_t last_max_candidates_;
+  // Exclusion, as the spans each mask row converts (row y's are
+  // row_spans_[row_first_span_[y]] up to row_first_span_[y + 1]) and, for
+  // each strip, the range of its mask rows that convert anything and the
+  // union of their spans. uniform is set when every one of those rows has
+  // the same spans.
+  struct StripSpans {
+    cv::Range rows;
+    int first_span;
+    int end_span;
+    bool uniform;
+  };
+  ExclusionMask exclusion_;
+  std::vector<int> row_first_span_;
+  std::vector<cv::Range> row_spans_;
+  std::vector<StripSpans> strips_;
+  std::vector<cv::Range> strip_spans_;
+  HsvThreshold lut_threshold_;
+  uint8_t lut_h_[256];
+  uint8_t lut_s_[256];
+  uint8_t lut_v_[256];
+};
+#endif
@@ -0,0 +1,161 @@
+#include "pose_estimator.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include <opencv2/calib3d.hpp>
+
+#include "common.hpp"
+
+namespace {
+
+// 2016 high goal: 20 x 14 inch outline of the U, x right, y down, z away
+// from the camera
+const double kDefaultHalfWidth = 0.254;
+const double kDefaultHalfHeight = 0.1778;
+
+// A pose that reprojects worse than this (pixels) is not believed
+const double kMaxReprojectionError = 4.0;
+
+std::atomic<bool> sEnabled(false);
+pthread_mutex_t sModelLock = PTHREAD_MUTEX_INITIALIZER;
+cv::Point3d sModel[4] = {
+    cv::Point3d(-kDefaultHalfWidth, -kDefaultHalfHeight, 0),
+    cv::Point3d(kDefaultHalfWidth, -kDefaultHalfHeight, 0),
+    cv::Point3d(kDefaultHalfWidth, kDefaultHalfHeight, 0),
+    cv::Point3d(-kDefaultHalfWidth, kDefaultHalfHeight, 0)};
+
+std::vector<cv::Point3d> targetModel() {
+  pthread_mutex_lock(&sModelLock);
+  std::vector<cv::Point3d> model(sModel, sModel + 4);
+  pthread_mutex_unlock(&sModelLock);
+  return model;
+}
+
+double wrapAngle(double angle) {
+  return std::atan2(std::sin(angle), std::cos(angle));
+}
+
+} // namespace
+
+extern "C" void poseSetEnabled(int enabled) {
+  sEnabled = enabled != 0;
+}
+
+extern "C" int poseSetTargetModel(const double *corners) {
+  for (int i = 0; i < 12; ++i) {
+    if (!std::isfinite(corners[i])) {
+      LOGE("Ignoring target model with a non-finite coordinate");
+      return -1;
+    }
+  }
+  pthread_mutex_lock(&sModelLock);
+  for (int i = 0; i < 4; ++i) {
+    sModel[i] = cv::Point3d(corners[3 * i], corners[3 * i + 1],
+                            corners[3 * i + 2]);
+  }
+  pthread_mutex_unlock(&sModelLock);
+  return 0;
+}
+
+bool poseEnabled() {
+  return sEnabled.load(std::memory_order_relaxed);
+}
+
+PoseEstimator::PoseEstimator() {}
+
+bool PoseEstimator::solve(const std::vector<cv::Point2d> &image_points,
+                          const CameraModel &camera, bool use_guess,
+                          cv::Mat *rvec, cv::Mat *tvec, double *error) {
+  std::vector<cv::Point3d> model = targetModel();
+  // Points are already undistorted and normalized: identity intrinsics
+  cv::Mat identity = cv::Mat::eye(3, 3, CV_64F);
+  if (!cv::solvePnP(model, image_points, identity, cv::noArray(), *rvec, *tvec,
+                    use_guess, cv::SOLVEPNP_ITERATIVE) ||
+      tvec->at<double>(2) <= 0) {
+    return false;
+  }
+  std::vector<cv::Point2d> projected;
+  cv::projectPoints(model, *rvec, *tvec, identity, cv::noArray(), projected);
+  double sum = 0;
+  for (size_t i = 0; i < projected.size(); ++i) {
+    cv::Point2d d = projected[i] - image_points[i];
+    sum += std::sqrt(d.dot(d));
+  }
+  *error = sum / projected.size() * camera.fx;
+  return *error <= kMaxReprojectionError;
+}
+
+bool PoseEstimator::estimate(int track_id, const TargetInfo &target,
+                             const CameraModel &camera, TargetPose *pose) {
+  if (target.points.size() != 4) {
+    return false;
+  }
+  std::vector<cv::Point2d> image_points(4);
+  for (int i = 0; i < 4; ++i) {
+    image_points[i] = cameraNormalize(camera, target.points[i]);
+  }
+
+  auto previous = previous_.end();
+  if (track_id >= 0) {
+    previous = std::find_if(previous_.begin(), previous_.end(),
+                            [track_id](const Previous &p) {
+                              return p.track_id == track_id;
+                            });
+  }
+  cv::Mat rvec;
+  cv::Mat tvec;
+  double error = 0;
+  bool solved = false;
+  pose->warm_started = false;
+  if (previous != previous_.end()) {
+    // Iterative refinement from last frame's pose converges in a few steps
+    previous->rvec.copyTo(rvec);
+    previous->tvec.copyTo(tvec);
+    solved = solve(image_points, camera, true, &rvec, &tvec, &error);
+    pose->warm_started = solved;
+  }
+  if (!solved) {
+    solved = solve(image_points, camera, false, &rvec, &tvec, &error);
+  }
+  if (!solved) {
+    if (previous != previous_.end()) {
+      previous_.erase(previous);
+    }
+    return false;
+  }
+  if (track_id >= 0) {
+    if (previous == previous_.end()) {
+      previous_.push_back(Previous());
+      previous = previous_.end() - 1;
+      previous->track_id = track_id;
+    }
+    previous->rvec = rvec;
+    previous->tvec = tvec;
+  }
+
+  cv::Point3d t(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+  cv::Mat rotation;
+  cv::Rodrigues(rvec, rotation);
+  // Target +z (into the target) in camera coordinates
+  cv::Point3d normal(rotation.at<double>(0, 2), rotation.at<double>(1, 2),
+                     rotation.at<double>(2, 2));
+  pose->range = std::sqrt(t.dot(t));
+  pose->bearing = std::atan2(-t.x, t.z);
+  pose->skew = wrapAngle(std::atan2(normal.x, normal.z) - std::atan2(t.x, t.z));
+  pose->error = error;
+  return true;
+}
+
+void PoseEstimator::retain(const std::vector<int> &track_ids) {
+  previous_.erase(
+      std::remove_if(previous_.begin(), previous_.end(),
+                     [&track_ids](const Previous &p) {
+                       return std::find(track_ids.begin(), track_ids.end(),
+                                        p.track_id) == track_ids.end();
+                     }),
+      previous_.end());
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Turns the pose stage of processFrame on or off. Off by default.
+void poseSetEnabled(int enabled);
+
+// Sets the 3D target model: four corners (x, y, z in metres, 12 doubles) in
+// the order fitQuad reports them, clockwise from the top-left as seen from
+// the camera. Returns 0 on success.
+int poseSetTargetModel(const double *corners);
+
+#ifdef __cplusplus
+}
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "camera_model.h"
+#include "target_info.h"
+
+bool poseEnabled();
+
+// Target pose relative to the camera. +bearing is to the left, as hAngle.
+struct TargetPose {
+  // Distance to the model origin (metres)
+  double range;
+  double bearing;
+  // Rotation of the target plane about its vertical axis away from facing
+  // the camera squarely (radians)
+  double skew;
+  // Mean corner reprojection error in pixels
+  double error;
+  bool warm_started;
+};
+
+// solvePnP on the four quad corners, warm-started from the pose of the same
+// tracked target in the previous frame. Corners are undistorted with the
+// camera model first, so the solver works on an ideal pinhole camera.
+class PoseEstimator {
+ public:
+  PoseEstimator();
+
+  // Returns false when no plausible pose was found. track_id < 0 always
+  // solves from scratch.
+  bool estimate(int track_id, const TargetInfo &target,
+                const CameraModel &camera, TargetPose *pose);
+
+  // Forgets the poses of tracks not in `track_ids`
+  void retain(const std::vector<int> &track_ids);
+
+ private:
+  struct Previous {
+    int track_id;
+    cv::Mat rvec;
+    cv::Mat tvec;
+  };
+
+  bool solve(const std::vector<cv::Point2d> &image_points,
+             const CameraModel &camera, bool use_guess, cv::Mat *rvec,
+             cv::Mat *tvec, double *error);
+
+  std::vector<Previous> previous_;
+};
+#endif
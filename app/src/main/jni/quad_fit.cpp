@@ -0,0 +1,139 @@
+#include "quad_fit.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct Extremes {
+  cv::Point min_sum, max_sum, min_diff, max_diff;
+  cv::Point min_x, max_x, min_y, max_y;
+  bool empty;
+
+  Extremes() : empty(true) {}
+
+  void add(const cv::Point &p) {
+    if (empty) {
+      min_sum = max_sum = min_diff = max_diff = p;
+      min_x = max_x = min_y = max_y = p;
+      empty = false;
+      return;
+    }
+    int sum = p.x + p.y;
+    int diff = p.x - p.y;
+    if (sum < min_sum.x + min_sum.y)
+      min_sum = p;
+    if (sum > max_sum.x + max_sum.y)
+      max_sum = p;
+    if (diff < min_diff.x - min_diff.y)
+      min_diff = p;
+    if (diff > max_diff.x - max_diff.y)
+      max_diff = p;
+    if (p.x < min_x.x)
+      min_x = p;
+    if (p.x > max_x.x)
+      max_x = p;
+    if (p.y < min_y.y)
+      min_y = p;
+    if (p.y > max_y.y)
+      max_y = p;
+  }
+};
+
+double signedArea(const cv::Point *corners) {
+  double twice_area = 0;
+  for (int i = 0; i < 4; ++i) {
+    const cv::Point &a = corners[i];
+    const cv::Point &b = corners[(i + 1) % 4];
+    twice_area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+  }
+  return twice_area / 2;
+}
+
+bool chooseCorners(const Extremes &extremes, QuadFit *fit) {
+  if (extremes.empty) {
+    return false;
+  }
+  const cv::Point diagonal[4] = {extremes.min_sum, extremes.max_diff,
+                                 extremes.max_sum, extremes.min_diff};
+  const cv::Point axis[4] = {extremes.min_y, extremes.max_x, extremes.max_y,
+                             extremes.min_x};
+  double diagonal_area = std::abs(signedArea(diagonal));
+  double axis_area = std::abs(signedArea(axis));
+  const cv::Point *best = axis_area > diagonal_area ? axis : diagonal;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = i + 1; j < 4; ++j) {
+      if (best[i] == best[j]) {
+        return false;
+      }
+    }
+    fit->corners[i] = best[i];
+  }
+  fit->area = std::max(diagonal_area, axis_area);
+  fit->residual = 0;
+  return fit->area >= 1;
+}
+
+// Outward edge normals of the fitted quad, so that a point's distance
+// outside edge i is normal[i].dot(p - corner[i]).
+struct Edges {
+  cv::Point2d origin[4];
+  cv::Point2d normal[4];
+
+  explicit Edges(const QuadFit &fit) {
+    // Interior lies on the side of each edge given by the winding sign
+    double winding = signedArea(fit.corners) > 0 ? 1 : -1;
+    for (int i = 0; i < 4; ++i) {
+      cv::Point2d a = fit.corners[i];
+      cv::Point2d b = fit.corners[(i + 1) % 4];
+      cv::Point2d edge = b - a;
+      double length = std::sqrt(edge.dot(edge));
+      origin[i] = a;
+      normal[i] = cv::Point2d(edge.y, -edge.x) * (winding / length);
+    }
+  }
+
+  double outside(const cv::Point &p) const {
+    double distance = 0;
+    for (int i = 0; i < 4; ++i) {
+      distance = std::max(distance, normal[i].dot(cv::Point2d(p) - origin[i]));
+    }
+    return distance;
+  }
+};
+
+} // namespace
+
+bool fitQuad(const std::vector<cv::Point> &points, QuadFit *fit) {
+  Extremes extremes;
+  for (const auto &p : points) {
+    extremes.add(p);
+  }
+  if (!chooseCorners(extremes, fit)) {
+    return false;
+  }
+  Edges edges(*fit);
+  for (const auto &p : points) {
+    fit->residual = std::max(fit->residual, edges.outside(p));
+  }
+  return true;
+}
+
+bool fitQuad(const std::vector<RowRun> &runs, QuadFit *fit) {
+  Extremes extremes;
+  for (const auto &run : runs) {
+    extremes.add(cv::Point(run.x_begin, run.y));
+    extremes.add(cv::Point(run.x_end - 1, run.y));
+  }
+  if (!chooseCorners(extremes, fit)) {
+    return false;
+  }
+  Edges edges(*fit);
+  for (const auto &run : runs) {
+    fit->residual =
+        std::max(fit->residual, edges.outside(cv::Point(run.x_begin, run.y)));
+    fit->residual =
+        std::max(fit->residual, edges.outside(cv::Point(run.x_end - 1, run.y)));
+  }
+  return true;
+}
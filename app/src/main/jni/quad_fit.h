@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// One horizontal run of foreground pixels, [x_begin, x_end) on row y.
+struct RowRun {
+  int y;
+  int x_begin;
+  int x_end;
+};
+
+struct QuadFit {
+  // Clockwise in image coordinates, starting from the top-left corner, so
+  // edges alternate top, right, bottom, left for an upright target.
+  cv::Point corners[4];
+  double area;
+  // Largest distance (pixels) of any input point outside the quad. Points
+  // inside are ignored so concave shapes such as the U target fit cleanly.
+  double residual;
+};
+
+// Fits a quadrilateral to a blob in two linear passes, with no hull or
+// polygon simplification. The corners are the extreme points along the
+// diagonals (x + y, x - y) or, if that encloses more area, along the axes,
+// which covers targets rotated either way by up to 45 degrees. Returns false
+// for degenerate blobs.
+bool fitQuad(const std::vector<cv::Point> &points, QuadFit *fit);
+
+// Same fit from run-length blob data; only the run end points can be
+// extreme, so the cost is linear in the number of runs, not pixels.
+bool fitQuad(const std::vector<RowRun> &runs, QuadFit *fit);
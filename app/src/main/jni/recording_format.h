@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "target_detector.h"
+
+// On-disk layout of a frame recording, shared by FrameRecorder and
+// RecordingReader. A recording is a preallocated ring of fixed-size slots:
+//
+//   [RecordingFileHeader, padded to kRecordingHeaderSize]
+//   [slot 0][slot 1]...[slot slot_count - 1]
+//
+// Record n (0-based) lives in slot n % slot_count. Each slot starts with a
+// RecordHeader followed by the frame payload:
+//
+//   RECORDING_RAW_RGBA:  width * height * 4 bytes of RGBA.
+//   RECORDING_MASK_RLE:  uint32 mask byte count, the threshold mask
+//                        (width / mask_scale by height / mask_scale) as
+//                        uint16 run lengths (per row, alternating zero and
+//                        non-zero runs, starting with a possibly empty zero
+//                        run), then the frame sub-sampled by
+//                        kColorSubsample in each direction as RGBA.
+//
+// The frame is always recorded at full size, whatever decimation the mask
+// was made with.
+//
+// RecordHeader::sequence is cleared before a slot is rewritten and set to
+// n + 1 last, so a reader never mistakes a partially written slot for a
+// complete one. A reader of a live file checks the sequence again after
+// copying a record, as with a seqlock, in case the slot was rewritten
+// meanwhile. All integers are little-endian (every supported ABI is).
+// Version 1 records end before RecordHeader::mask_scale, which is 1 for
+// them.
+
+const char kRecordingMagic[8] = {'D', 'V', 'R', 'E', 'C', 'O', 'R', 'D'};
+const uint32_t kRecordingVersion = 2;
+const uint32_t kRecordingHeaderSize = 4096;
+const int kMaxRecordedTargets = 8;
+const int kColorSubsample = 4;
+
+enum RecordingFormat { RECORDING_RAW_RGBA = 0, RECORDING_MASK_RLE = 1 };
+
+struct RecordingFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t slot_count;
+  uint32_t slot_size;
+  // Number of records written so far (the next record's index)
+  uint64_t next_sequence;
+};
+
+struct RecordedTarget {
+  float centroid_x;
+  float centroid_y;
+  float width;
+  float height;
+  int32_t num_points;
+  int32_t points[4][2];
+};
+
+struct RecordHeader {
+  uint64_t sequence;
+  int64_t capture_time_ns;
+  HsvThreshold hsv;
+  uint32_t num_targets;
+  uint32_t payload_size;
+  RecordedTarget targets[kMaxRecordedTargets];
+  // Input pixels per mask pixel in each direction
+  uint32_t mask_scale;
+  // Written as 0, so no padding bytes are left unwritten
+  uint32_t reserved;
+};
+
+// Bytes before the payload in each slot of a recording of `version`
+inline size_t recordHeaderSize(uint32_t version) {
+  return version < 2 ? offsetof(RecordHeader, mask_scale)
+                     : sizeof(RecordHeader);
+}
+
+// Largest payload a frame of the given size can need in `format`.
+inline uint32_t recordingMaxPayload(RecordingFormat format, int width,
+                                    int height) {
+  if (format == RECORDING_RAW_RGBA) {
+    return static_cast<uint32_t>(width) * height * 4;
+  }
+  uint32_t mask = static_cast<uint32_t>(width + 1) * height * 2;
+  uint32_t color = static_cast<uint32_t>(width / kColorSubsample) *
+                   (height / kColorSubsample) * 4;
+  return sizeof(uint32_t) + mask + color;
+}
+
+inline uint32_t recordingSlotSize(RecordingFormat format, int width,
+                                  int height) {
+  uint32_t size = sizeof(RecordHeader) +
+                  recordingMaxPayload(format, width, height);
+  return (size + 4095) & ~4095u; // page aligned slots
+}
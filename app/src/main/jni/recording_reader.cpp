@@ -0,0 +1,210 @@
+#include "recording_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+
+namespace {
+
+bool decodeMaskRle(const uint16_t *runs, size_t num_runs, cv::Mat *mask) {
+  size_t run = 0;
+  for (int y = 0; y < mask->rows; ++y) {
+    uint8_t *row = mask->ptr<uint8_t>(y);
+    int x = 0;
+    bool value = false;
+    while (x < mask->cols) {
+      if (run >= num_runs) {
+        return false;
+      }
+      int length = runs[run++];
+      if (x + length > mask->cols) {
+        return false;
+      }
+      memset(row + x, value ? 255 : 0, length);
+      x += length;
+      value = !value;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+RecordingReader::RecordingReader()
+    : fd_(-1), map_(NULL), map_size_(0), header_(NULL) {}
+
+RecordingReader::~RecordingReader() {
+  close();
+}
+
+bool RecordingReader::open(const char *path) {
+  close();
+  fd_ = ::open(path, O_RDONLY);
+  struct stat st;
+  if (fd_ < 0 || fstat(fd_, &st) != 0 ||
+      st.st_size < static_cast<off_t>(kRecordingHeaderSize)) {
+    LOGE("Could not open recording %s", path);
+    close();
+    return false;
+  }
+  map_size_ = st.st_size;
+  void *map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    LOGE("Could not map recording %s", path);
+    close();
+    return false;
+  }
+  map_ = static_cast<const uint8_t *>(map);
+  header_ = reinterpret_cast<const RecordingFileHeader *>(map_);
+  if (memcmp(header_->magic, kRecordingMagic, sizeof(kRecordingMagic)) != 0 ||
+      header_->version < 1 || header_->version > kRecordingVersion ||
+      header_->slot_size < recordHeaderSize(header_->version) ||
+      kRecordingHeaderSize +
+              static_cast<size_t>(header_->slot_size) * header_->slot_count >
+          map_size_) {
+    LOGE("%s is not a valid recording", path);
+    close();
+    return false;
+  }
+
+  std::vector<std::pair<uint64_t, uint32_t>> complete;
+  for (uint32_t slot = 0; slot < header_->slot_count; ++slot) {
+    const RecordHeader *record = reinterpret_cast<const RecordHeader *>(
+        map_ + kRecordingHeaderSize +
+        static_cast<size_t>(slot) * header_->slot_size);
+    uint64_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+    if (sequence != 0) {
+      complete.push_back(std::make_pair(sequence, slot));
+    }
+  }
+  std::sort(complete.begin(), complete.end());
+  slots_.clear();
+  sequences_.clear();
+  for (const auto &entry : complete) {
+    slots_.push_back(entry.second);
+    sequences_.push_back(entry.first);
+  }
+  return true;
+}
+
+void RecordingReader::close() {
+  if (map_ != NULL) {
+    munmap(const_cast<uint8_t *>(map_), map_size_);
+    map_ = NULL;
+    header_ = NULL;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  slots_.clear();
+  sequences_.clear();
+}
+
+int RecordingReader::width() const {
+  return header_ != NULL ? header_->width : 0;
+}
+
+int RecordingReader::height() const {
+  return header_ != NULL ? header_->height : 0;
+}
+
+RecordingFormat RecordingReader::format() const {
+  return header_ != NULL ? static_cast<RecordingFormat>(header_->format)
+                         : RECORDING_RAW_RGBA;
+}
+
+bool RecordingReader::read(size_t index, RecordedFrame *frame) const {
+  if (header_ == NULL || index >= slots_.size()) {
+    return false;
+  }
+  const uint8_t *slot = map_ + kRecordingHeaderSize +
+                        static_cast<size_t>(slots_[index]) * header_->slot_size;
+  const RecordHeader *record = reinterpret_cast<const RecordHeader *>(slot);
+  // A seqlock read: the copy only counts if the sequence is the one seen at
+  // open() both before and after it
+  uint64_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+  if (sequence != sequences_[index]) {
+    return false;
+  }
+  frame->sequence = sequence;
+  bool copied = copyRecord(slot, frame);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return copied &&
+         __atomic_load_n(&record->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+bool RecordingReader::copyRecord(const uint8_t *slot,
+                                 RecordedFrame *frame) const {
+  const RecordHeader *record = reinterpret_cast<const RecordHeader *>(slot);
+  size_t header_size = recordHeaderSize(header_->version);
+  const uint8_t *payload = slot + header_size;
+  size_t max_payload = header_->slot_size - header_size;
+  int w = header_->width;
+  int h = header_->height;
+  int mask_scale = header_->version < 2 ? 1 : record->mask_scale;
+  if (mask_scale < 1 || mask_scale > std::min(w, h)) {
+    return false;
+  }
+  // Read once: the recorder may be changing it
+  uint32_t payload_size = record->payload_size;
+  if (payload_size > max_payload) {
+    return false;
+  }
+
+  frame->capture_time_ns = record->capture_time_ns;
+  frame->hsv = record->hsv;
+  frame->mask_scale = mask_scale;
+  frame->targets.clear();
+  uint32_t num_targets =
+      std::min<uint32_t>(record->num_targets, kMaxRecordedTargets);
+  for (uint32_t i = 0; i < num_targets; ++i) {
+    const RecordedTarget &in = record->targets[i];
+    TargetInfo target;
+    target.centroid_x = in.centroid_x;
+    target.centroid_y = in.centroid_y;
+    target.width = in.width;
+    target.height = in.height;
+    for (int p = 0; p < std::min(in.num_points, 4); ++p) {
+      target.points.push_back(cv::Point(in.points[p][0], in.points[p][1]));
+    }
+    frame->targets.push_back(std::move(target));
+  }
+
+  if (format() == RECORDING_RAW_RGBA) {
+    if (payload_size < static_cast<uint32_t>(w) * h * 4) {
+      return false;
+    }
+    cv::Mat(h, w, CV_8UC4, const_cast<uint8_t *>(payload)).copyTo(frame->rgba);
+    frame->mask.release();
+    return true;
+  }
+
+  uint32_t mask_bytes;
+  memcpy(&mask_bytes, payload, sizeof(mask_bytes));
+  int color_w = w / kColorSubsample;
+  int color_h = h / kColorSubsample;
+  size_t color_bytes = static_cast<size_t>(color_w) * color_h * 4;
+  if (sizeof(uint32_t) + mask_bytes + color_bytes > payload_size) {
+    return false;
+  }
+  frame->mask.create(h / mask_scale, w / mask_scale, CV_8UC1);
+  if (!decodeMaskRle(
+          reinterpret_cast<const uint16_t *>(payload + sizeof(uint32_t)),
+          mask_bytes / sizeof(uint16_t), &frame->mask)) {
+    return false;
+  }
+  cv::Mat color(color_h, color_w, CV_8UC4,
+                const_cast<uint8_t *>(payload + sizeof(uint32_t) + mask_bytes));
+  cv::resize(color, frame->rgba, cv::Size(w, h), 0, 0, cv::INTER_LINEAR);
+  return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "recording_format.h"
+
+struct RecordedFrame {
+  uint64_t sequence;
+  int64_t capture_time_ns;
+  HsvThreshold hsv;
+  std::vector<TargetInfo> targets;
+  // Full resolution RGBA. For RECORDING_MASK_RLE recordings this is the
+  // sub-sampled colour image scaled back up.
+  cv::Mat rgba;
+  // Threshold mask as produced on the device; empty for raw recordings.
+  cv::Mat mask;
+  // Input pixels per mask pixel in each direction, as the device detected
+  // the frame; the mask is this many times smaller than rgba
+  int mask_scale;
+};
+
+// Read-only view of a recording written by FrameRecorder, for replay and
+// offline tools. The file is mapped, not copied, so opening a long recording
+// is cheap; frames are decoded on demand.
+class RecordingReader {
+ public:
+  RecordingReader();
+  ~RecordingReader();
+
+  bool open(const char *path);
+  void close();
+
+  int width() const;
+  int height() const;
+  RecordingFormat format() const;
+
+  // Complete records still held in the ring, oldest first.
+  size_t size() const { return slots_.size(); }
+  // False if the record is malformed, or if the recorder has started
+  // rewriting its slot since open(), even while it was being copied
+  bool read(size_t index, RecordedFrame *frame) const;
+
+ private:
+  RecordingReader(const RecordingReader &);
+  RecordingReader &operator=(const RecordingReader &);
+
+  int fd_;
+  const uint8_t *map_;
+  size_t map_size_;
+  const RecordingFileHeader *header_;
+  // Copies a record whose sequence has already been checked
+  bool copyRecord(const uint8_t *slot, RecordedFrame *frame) const;
+
+  // Slot index and sequence of each complete record, in sequence order
+  std::vector<uint32_t> slots_;
+  std::vector<uint64_t> sequences_;
+};
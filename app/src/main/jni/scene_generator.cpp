@@ -0,0 +1,216 @@
+#include "scene_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+
+// 2016 high goal: 20 x 14 inch outline of 2 inch tape, open at the top
+const double kHalfWidth = 0.254;
+const double kHalfHeight = 0.1778;
+const double kTape = 0.0508;
+
+const double kPi = 3.14159265358979323846;
+
+// Green LED ring reflected by the tape at exposure 1
+const double kTapeRgb[3] = {40, 255, 120};
+
+// Lowest channel of a clutter colour as a fraction of its level, which
+// keeps its saturation below sceneThreshold()'s
+const double kClutterTint = 0.75;
+
+// fillPoly fractional bits, so sub-pixel corners are not rounded away
+const int kShift = 4;
+
+// Distinct from any seed a caller is likely to pass
+const uint64_t kGaussianSeed = 0x9e3779b97f4a7c15ull;
+
+uint64_t xorshift(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545f4914f6cdd1dull;
+}
+
+cv::Point3d poseTransform(const SceneParams &params, cv::Point3d point) {
+  // Skew about the target's vertical axis, then roll about the optical axis
+  double x = point.x * std::cos(params.skew) + point.z * std::sin(params.skew);
+  double z = -point.x * std::sin(params.skew) + point.z * std::cos(params.skew);
+  double y = point.y;
+  double rolled_x = x * std::cos(params.roll) - y * std::sin(params.roll);
+  double rolled_y = x * std::sin(params.roll) + y * std::cos(params.roll);
+  cv::Point3d centre(
+      -params.range * std::sin(params.bearing) * std::cos(params.elevation),
+      -params.range * std::sin(params.elevation),
+      params.range * std::cos(params.bearing) * std::cos(params.elevation));
+  return centre + cv::Point3d(rolled_x, rolled_y, z);
+}
+
+cv::Point fixedPoint(cv::Point2d pixel) {
+  return cv::Point(cvRound(pixel.x * (1 << kShift)),
+                   cvRound(pixel.y * (1 << kShift)));
+}
+
+} // namespace
+
+SceneParams::SceneParams()
+    : width(640), height(480), format(SCENE_RGBA), range(3), bearing(0),
+      elevation(0), skew(0), roll(0), exposure(1), blur(0), noise(2),
+      distractors(4), clutter(1) {}
+
+HsvThreshold sceneThreshold() {
+  HsvThreshold threshold = {55, 95, 100, 255, 100, 255};
+  return threshold;
+}
+
+const int kTargetOuterCorners[4] = {0, 5, 6, 7};
+
+void targetOutline(cv::Point3d outline[kTargetOutlinePoints]) {
+  outline[0] = cv::Point3d(-kHalfWidth, -kHalfHeight, 0);
+  outline[1] = cv::Point3d(-kHalfWidth + kTape, -kHalfHeight, 0);
+  outline[2] = cv::Point3d(-kHalfWidth + kTape, kHalfHeight - kTape, 0);
+  outline[3] = cv::Point3d(kHalfWidth - kTape, kHalfHeight - kTape, 0);
+  outline[4] = cv::Point3d(kHalfWidth - kTape, -kHalfHeight, 0);
+  outline[5] = cv::Point3d(kHalfWidth, -kHalfHeight, 0);
+  outline[6] = cv::Point3d(kHalfWidth, kHalfHeight, 0);
+  outline[7] = cv::Point3d(-kHalfWidth, kHalfHeight, 0);
+}
+
+SceneGenerator::SceneGenerator(uint64_t seed)
+    : state_(seed ? seed : 1), noise_sigma_(-1) {
+  // Box-Muller from a fixed stream: the table is the same for every seed
+  uint64_t state = kGaussianSeed;
+  for (int i = 0; i < 256; i += 2) {
+    double u1 = ((xorshift(&state) >> 11) + 1) * (1.0 / 9007199254740993.0);
+    double u2 = (xorshift(&state) >> 11) * (1.0 / 9007199254740992.0);
+    double radius = std::sqrt(-2 * std::log(u1));
+    gaussian_[i] = static_cast<float>(radius * std::cos(2 * kPi * u2));
+    gaussian_[i + 1] = static_cast<float>(radius * std::sin(2 * kPi * u2));
+  }
+}
+
+uint64_t SceneGenerator::next() {
+  return xorshift(&state_);
+}
+
+double SceneGenerator::uniform(double low, double high) {
+  return low + (high - low) * ((next() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+void SceneGenerator::randomizePose(SceneParams *params) {
+  params->range = uniform(1.5, 6);
+  params->bearing = uniform(-20, 20) * kPi / 180;
+  params->elevation = uniform(-10, 10) * kPi / 180;
+  params->skew = uniform(-35, 35) * kPi / 180;
+  params->roll = uniform(-5, 5) * kPi / 180;
+}
+
+void SceneGenerator::addNoise(double sigma, cv::Mat *rgba) {
+  if (sigma != noise_sigma_) {
+    for (int i = 0; i < 256; ++i) {
+      noise_[i] = static_cast<int16_t>(cvRound(gaussian_[i] * sigma));
+    }
+    noise_sigma_ = sigma;
+  }
+  for (int y = 0; y < rgba->rows; ++y) {
+    uint8_t *row = rgba->ptr<uint8_t>(y);
+    uint64_t bits = 0;
+    int bits_left = 0;
+    for (int x = 0; x < rgba->cols * 4; ++x) {
+      if ((x & 3) == 3) {
+        continue; // alpha
+      }
+      if (bits_left == 0) {
+        bits = next();
+        bits_left = 8;
+      }
+      row[x] = cv::saturate_cast<uint8_t>(row[x] + noise_[bits & 0xff]);
+      bits >>= 8;
+      bits_left--;
+    }
+  }
+}
+
+void SceneGenerator::render(const SceneParams &params,
+                            const CameraModel &camera, cv::Mat *frame,
+                            SceneTruth *truth) {
+  cv::Mat *rgba = params.format == SCENE_RGBA ? frame : &rgba_;
+  rgba->create(params.height, params.width, CV_8UC4);
+  const double exposure = params.exposure;
+
+  // Dim gym: lighter towards the ceiling
+  for (int y = 0; y < rgba->rows; ++y) {
+    double level = (50 - 25.0 * y / rgba->rows) * exposure;
+    rgba->row(y).setTo(cv::Scalar(level, level, level * 1.1, 255));
+  }
+
+  int num_clutter = cvRound(params.clutter * params.width * params.height / 1e4);
+  for (int i = 0; i < num_clutter; ++i) {
+    cv::Point corner(static_cast<int>(uniform(0, params.width)),
+                     static_cast<int>(uniform(0, params.height)));
+    cv::Size size(static_cast<int>(uniform(4, 60)),
+                  static_cast<int>(uniform(4, 60)));
+    // Painted surfaces, never as saturated as the tape
+    double level = uniform(0, 160) * exposure;
+    cv::Scalar color(level * uniform(kClutterTint, 1),
+                     level * uniform(kClutterTint, 1),
+                     level * uniform(kClutterTint, 1), 255);
+    cv::rectangle(*rgba, cv::Rect(corner, size), color, cv::FILLED);
+  }
+
+  for (int i = 0; i < params.distractors; ++i) {
+    cv::Point centre(static_cast<int>(uniform(0, params.width)),
+                     static_cast<int>(uniform(0, params.height)));
+    int radius = static_cast<int>(uniform(2, 25));
+    cv::Scalar color(uniform(180, 255), uniform(180, 255), uniform(180, 255),
+                     255);
+    cv::circle(*rgba, centre, radius, color, cv::FILLED);
+  }
+
+  cv::Point3d outline[kTargetOutlinePoints];
+  targetOutline(outline);
+  bool in_front = true;
+  cv::Point2d projected[kTargetOutlinePoints];
+  for (int i = 0; i < kTargetOutlinePoints; ++i) {
+    cv::Point3d point = poseTransform(params, outline[i]);
+    in_front = in_front && point.z > 0;
+    projected[i] = cameraProject(camera, point);
+  }
+  truth->visible = in_front;
+  truth->centroid = cv::Point2d(0, 0);
+  for (int i = 0; i < 4; ++i) {
+    truth->corners[i] = projected[kTargetOuterCorners[i]];
+    truth->centroid += truth->corners[i] * 0.25;
+    truth->visible = truth->visible && truth->corners[i].x >= 0 &&
+                     truth->corners[i].x < params.width &&
+                     truth->corners[i].y >= 0 &&
+                     truth->corners[i].y < params.height;
+  }
+  if (in_front) {
+    cv::Point polygon[kTargetOutlinePoints];
+    for (int i = 0; i < kTargetOutlinePoints; ++i) {
+      polygon[i] = fixedPoint(projected[i]);
+    }
+    const cv::Point *polygons[1] = {polygon};
+    const int counts[1] = {kTargetOutlinePoints};
+    cv::Scalar color(std::min(255.0, kTapeRgb[0] * exposure),
+                     std::min(255.0, kTapeRgb[1] * exposure),
+                     std::min(255.0, kTapeRgb[2] * exposure), 255);
+    cv::fillPoly(*rgba, polygons, counts, 1, color, cv::LINE_8, kShift);
+  }
+
+  int kernel = cvRound(params.blur);
+  if (kernel >= 2) {
+    cv::blur(*rgba, *rgba, cv::Size(kernel, kernel));
+  }
+  if (params.noise > 0) {
+    addNoise(params.noise, rgba);
+  }
+  if (params.format == SCENE_YUV_I420) {
+    cv::cvtColor(*rgba, *frame, cv::COLOR_RGBA2YUV_I420);
+  }
+}
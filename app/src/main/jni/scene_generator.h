@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <opencv2/core.hpp>
+
+#include "camera_model.h"
+#include "target_detector.h"
+
+enum SceneFormat { SCENE_RGBA, SCENE_YUV_I420 };
+
+struct SceneParams {
+  SceneParams();
+
+  int width;
+  int height;
+  SceneFormat format;
+  // Centre of the target from the camera: range in metres, bearing and
+  // elevation in radians (+ to the left and up, as CameraTargetInfo)
+  double range;
+  double bearing;
+  double elevation;
+  // Rotation of the target about its vertical axis and about the optical
+  // axis, radians
+  double skew;
+  double roll;
+  // 1 leaves the LED-lit tape just saturating green
+  double exposure;
+  // Box blur kernel size in pixels; below 2 the frame stays sharp
+  double blur;
+  // Standard deviation of the sensor noise, 8-bit levels
+  double noise;
+  // Bright lights of random colour
+  int distractors;
+  // Random greyish rectangles per 10000 pixels, which the scene threshold
+  // never takes
+  double clutter;
+};
+
+// Where the target ended up. Corners are the outer corners of the U,
+// clockwise from the top-left as QuadFit orders them, in image pixels.
+struct SceneTruth {
+  // All four corners in front of the camera and inside the image
+  bool visible;
+  cv::Point2d corners[4];
+  cv::Point2d centroid;
+};
+
+// HSV bounds that take the rendered tape at exposures from about 0.5 up
+HsvThreshold sceneThreshold();
+
+// The U in target-plane metres (x right, y down), clockwise from the outer
+// top-left corner. kTargetOuterCorners picks out the four SceneTruth
+// corners.
+const int kTargetOutlinePoints = 8;
+extern const int kTargetOuterCorners[4];
+void targetOutline(cv::Point3d outline[kTargetOutlinePoints]);
+
+// Renders the 2016 goal's U of retroreflective tape into synthetic frames:
+// background, clutter, distractor lights, the target projected through a
+// CameraModel, then blur and sensor noise. Everything random comes from one
+// xorshift generator, so a seed and a sequence of calls give the same
+// frames on every machine. Buffers are reused, so a 640x480 frame costs
+// a few hundred microseconds.
+class SceneGenerator {
+ public:
+  explicit SceneGenerator(uint64_t seed);
+
+  // Pose within what a robot sees on the field: 1.5 to 6 m, +-20 degrees
+  // bearing, +-10 degrees elevation, +-35 degrees skew, +-5 degrees roll
+  void randomizePose(SceneParams *params);
+
+  // frame is CV_8UC4 RGBA or, for SCENE_YUV_I420, CV_8UC1 with height * 3/2
+  // rows
+  void render(const SceneParams &params, const CameraModel &camera,
+              cv::Mat *frame, SceneTruth *truth);
+
+ private:
+  uint64_t next();
+  double uniform(double low, double high);
+  void addNoise(double sigma, cv::Mat *rgba);
+
+  uint64_t state_;
+  // Standard normal samples, indexed by random bytes
+  float gaussian_[256];
+  double noise_sigma_;
+  int16_t noise_[256];
+  cv::Mat rgba_;
+};
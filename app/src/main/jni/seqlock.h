@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+// Latest-value channel: one writer replaces the value, any number of readers
+// copy out whatever is newest, at their own rate. Neither side blocks or
+// allocates. The writer makes the sequence odd, writes, then makes it even
+// again; a reader retries if the sequence was odd or changed while it
+// copied. The value lives in relaxed atomic words rather than plain memory,
+// so the readers' racing copies are well defined.
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivial<T>::value, "Seqlock copies values bytewise");
+
+ public:
+  Seqlock() : sequence_(0) {
+    for (auto &word : words_) {
+      word.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Single writer only
+  void store(const T &value) {
+    uint32_t buffer[kWords];
+    buffer[kWords - 1] = 0;
+    memcpy(buffer, &value, sizeof(T));
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) {
+      words_[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Returns how many values have been stored, 0 if none yet, in which case
+  // value is all zero bytes
+  uint32_t load(T *value) const {
+    uint32_t buffer[kWords];
+    for (;;) {
+      uint32_t before = sequence_.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;
+      }
+      for (size_t i = 0; i < kWords; ++i) {
+        buffer[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before) {
+        memcpy(value, buffer, sizeof(T));
+        return before / 2;
+      }
+    }
+  }
+
+ private:
+  // 32-bit atomics are lock-free and cheap on both ABIs we build for
+  static const size_t kWords = (sizeof(T) + 3) / 4;
+
+  std::atomic<uint32_t> sequence_;
+  std::atomic<uint32_t> words_[kWords];
+};
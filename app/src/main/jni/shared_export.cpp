@@ -0,0 +1,229 @@
+#include "shared_export.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "common.hpp"
+
+namespace {
+
+// MFD_CLOEXEC; the NDK headers for our platform level predate memfd
+const unsigned int kMemfdCloexec = 1;
+
+int createMemfd(const char *name) {
+#ifdef __NR_memfd_create
+  return static_cast<int>(syscall(__NR_memfd_create, name, kMemfdCloexec));
+#else
+  (void)name;
+  return -1;
+#endif
+}
+
+// Marks a slot as being rewritten for record n; its data follows
+void beginWrite(uint32_t *sequence, uint64_t n) {
+  __atomic_store_n(sequence, static_cast<uint32_t>(2 * n + 1),
+                   __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void endWrite(uint32_t *sequence, uint64_t n, uint64_t *written) {
+  __atomic_store_n(sequence, static_cast<uint32_t>(2 * n + 2),
+                   __ATOMIC_RELEASE);
+  __atomic_store_n(written, n + 1, __ATOMIC_RELEASE);
+}
+
+} // namespace
+
+SharedExport::SharedExport()
+    : pending_changed_(false), create_failed_(false), export_frames_(false),
+      frame_size_logged_(false), frame_in_write_(NULL), fd_(-1), map_(NULL),
+      map_size_(0), header_(NULL) {
+  pthread_mutex_init(&pending_lock_, NULL);
+  pending_.active = false;
+  pending_.result_slots = 0;
+  pending_.export_frames = false;
+  current_ = pending_;
+}
+
+SharedExport::~SharedExport() {
+  close();
+  pthread_mutex_destroy(&pending_lock_);
+}
+
+void SharedExport::start(const char *path, int result_slots,
+                         bool export_frames) {
+  pthread_mutex_lock(&pending_lock_);
+  pending_.active = true;
+  pending_.path = path != NULL ? path : "";
+  pending_.result_slots = std::max(result_slots, 1);
+  pending_.export_frames = export_frames;
+  pending_changed_ = true;
+  pthread_mutex_unlock(&pending_lock_);
+}
+
+void SharedExport::stop() {
+  pthread_mutex_lock(&pending_lock_);
+  pending_.active = false;
+  pending_changed_ = true;
+  pthread_mutex_unlock(&pending_lock_);
+}
+
+void SharedExport::beginFrame(int width, int height) {
+  // Polled every frame, so never wait on the control thread
+  if (pthread_mutex_trylock(&pending_lock_) == 0) {
+    if (pending_changed_) {
+      current_ = pending_;
+      pending_changed_ = false;
+      close();
+      create_failed_ = false;
+    }
+    pthread_mutex_unlock(&pending_lock_);
+  }
+  if (current_.active && header_ == NULL && !create_failed_) {
+    create_failed_ = !create(width, height);
+  }
+}
+
+bool SharedExport::create(int width, int height) {
+  SharedExportHeader layout;
+  memset(&layout, 0, sizeof(layout));
+  layout.version = kSharedExportVersion;
+  layout.result_slots = current_.result_slots;
+  layout.result_slot_size = sharedResultSlotSize();
+  if (current_.export_frames) {
+    layout.frame_slot_size = sharedFrameSlotSize(width, height);
+    layout.frame_width = width;
+    layout.frame_height = height;
+  }
+  map_size_ = sharedFrameOffset(layout) +
+              static_cast<size_t>(layout.frame_slot_size) * kSharedFrameSlots;
+
+  const char *path = current_.path.c_str();
+  fd_ = current_.path.empty()
+            ? createMemfd("droidvision")
+            : open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0 || ftruncate(fd_, map_size_) != 0) {
+    LOGE("Could not create shared export %s", path);
+    close();
+    return false;
+  }
+  void *map = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    LOGE("Could not map shared export %s", path);
+    close();
+    return false;
+  }
+  // ftruncate() zero-fills, so every slot starts out never written
+  map_ = static_cast<uint8_t *>(map);
+  header_ = reinterpret_cast<SharedExportHeader *>(map_);
+  memcpy(header_, &layout, sizeof(layout));
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(header_->magic, kSharedExportMagic, sizeof(kSharedExportMagic));
+  export_frames_ = current_.export_frames;
+  frame_size_logged_ = false;
+  if (current_.path.empty()) {
+    LOGI("Shared export on memfd: /proc/%d/fd/%d, %u bytes",
+         static_cast<int>(getpid()), fd_, static_cast<unsigned>(map_size_));
+  } else {
+    LOGI("Shared export to %s, %u bytes", path,
+         static_cast<unsigned>(map_size_));
+  }
+  return true;
+}
+
+void SharedExport::close() {
+  if (map_ != NULL) {
+    munmap(map_, map_size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  map_ = NULL;
+  map_size_ = 0;
+  header_ = NULL;
+  frame_in_write_ = NULL;
+}
+
+void SharedExport::publishFrame(int64_t capture_time_ns, const cv::Mat &rgba) {
+  cv::Mat slot = beginFrameWrite(capture_time_ns, rgba.cols, rgba.rows);
+  if (slot.empty()) {
+    return;
+  }
+  size_t row_bytes = rgba.cols * 4;
+  for (int y = 0; y < rgba.rows; ++y) {
+    memcpy(slot.ptr(y), rgba.ptr(y), row_bytes);
+  }
+  commitFrame();
+}
+
+cv::Mat SharedExport::beginFrameWrite(int64_t capture_time_ns, int width,
+                                      int height) {
+  if (!exportingFrames()) {
+    return cv::Mat();
+  }
+  if (width != static_cast<int>(header_->frame_width) ||
+      height != static_cast<int>(header_->frame_height)) {
+    if (!frame_size_logged_) {
+      LOGE("Frame size changed to %dx%d, no longer exporting frames", width,
+           height);
+      frame_size_logged_ = true;
+    }
+    return cv::Mat();
+  }
+  uint64_t n = header_->frames_written;
+  uint8_t *slot = map_ + sharedFrameOffset(*header_) +
+                  (n % kSharedFrameSlots) * header_->frame_slot_size;
+  SharedFrameHeader *frame = reinterpret_cast<SharedFrameHeader *>(slot);
+  beginWrite(&frame->sequence, n);
+  frame->width = width;
+  frame->height = height;
+  frame->capture_time_ns = capture_time_ns;
+  frame_in_write_ = frame;
+  return cv::Mat(height, width, CV_8UC4, slot + sizeof(SharedFrameHeader));
+}
+
+void SharedExport::commitFrame() {
+  if (frame_in_write_ == NULL) {
+    return;
+  }
+  endWrite(&frame_in_write_->sequence, header_->frames_written,
+           &header_->frames_written);
+  frame_in_write_ = NULL;
+}
+
+void SharedExport::publishResults(const TargetResults &results) {
+  if (header_ == NULL) {
+    return;
+  }
+  uint64_t n = header_->results_written;
+  SharedResultSlot *slot = reinterpret_cast<SharedResultSlot *>(
+      map_ + kSharedExportHeaderSize +
+      (n % header_->result_slots) * header_->result_slot_size);
+  beginWrite(&slot->sequence, n);
+  memcpy(&slot->results, &results, sizeof(results));
+  endWrite(&slot->sequence, n, &header_->results_written);
+}
+
+SharedExport &sharedExport() {
+  static SharedExport shared_export;
+  return shared_export;
+}
+
+extern "C" int sharedExportStart(const char *path, int result_slots,
+                                 int export_frames) {
+  if (result_slots <= 0) {
+    return -1;
+  }
+  sharedExport().start(path, result_slots, export_frames != 0);
+  return 0;
+}
+
+extern "C" void sharedExportStop(void) {
+  sharedExport().stop();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Publishes every frame's results, and with export_frames the RGBA frame
+// too, to a shared-memory region for processes on the same device (see
+// shared_export_format.h). path names a file to create; NULL or "" uses a
+// memfd, logged as pid and fd. The region is created on the GL thread at
+// the next frame, since the frame size is only known there. Returns 0 if
+// the request was queued.
+int sharedExportStart(const char *path, int result_slots, int export_frames);
+
+void sharedExportStop(void);
+
+#ifdef __cplusplus
+}
+
+#include <pthread.h>
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "shared_export_format.h"
+#include "target_results.h"
+
+// Owns the shared region. start() and stop() only leave a request under a
+// mutex; the GL thread picks it up with a trylock in beginFrame(), so the
+// mapping is only ever created, written and removed on that thread and
+// publishing never waits on the control thread.
+class SharedExport {
+ public:
+  SharedExport();
+  ~SharedExport();
+
+  void start(const char *path, int result_slots, bool export_frames);
+  void stop();
+
+  // GL thread only, in this order for each frame. A consumer that sees a
+  // frame's results can then find the frame too.
+  void beginFrame(int width, int height);
+  void publishFrame(int64_t capture_time_ns, const cv::Mat &rgba);
+  void publishResults(const TargetResults &results);
+
+  // publishFrame() without the copy: the next frame slot, marked as being
+  // written, as a continuous width x height RGBA Mat for the frame to be
+  // read straight into. Empty when frames are not exported at that size.
+  // commitFrame() publishes it; the caller may keep reading the Mat until
+  // the next beginFrame() but must not write to it after the commit.
+  cv::Mat beginFrameWrite(int64_t capture_time_ns, int width, int height);
+  void commitFrame();
+
+  bool exportingFrames() const { return header_ != NULL && export_frames_; }
+
+ private:
+  struct Request {
+    bool active;
+    std::string path;
+    int result_slots;
+    bool export_frames;
+  };
+
+  bool create(int width, int height);
+  void close();
+
+  pthread_mutex_t pending_lock_;
+  bool pending_changed_;
+  Request pending_;
+
+  // GL thread state
+  Request current_;
+  bool create_failed_;
+  bool export_frames_;
+  bool frame_size_logged_;
+  // Frame slot handed out by beginFrameWrite(), or NULL
+  SharedFrameHeader *frame_in_write_;
+  int fd_;
+  uint8_t *map_;
+  size_t map_size_;
+  SharedExportHeader *header_;
+};
+
+SharedExport &sharedExport();
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "target_results.h"
+
+// Layout of the shared-memory region SharedExport publishes to local
+// processes. The region is a file (or a memfd, reachable on Linux as
+// /proc/<pid>/fd/<fd>) that consumers map read-only:
+//
+//   [SharedExportHeader, padded to kSharedExportHeaderSize]
+//   [result slot 0]...[result slot result_slots - 1], padded to a page
+//   [frame slot 0][frame slot 1]        only when frame_slot_size != 0
+//
+// Result n (0-based) lives in result slot n % result_slots, and frame n in
+// frame slot n % 2. Each slot starts with a uint32 sequence that is 2n + 1
+// while record n is being written and 2n + 2 once it is complete. A reader
+// loads the sequence (acquire), uses the slot in place, then loads it
+// again after an acquire fence: the data is good if both loads agree and
+// are even. The header's
+// counters are written last with release semantics, so the newest complete
+// result is slot (results_written - 1) % result_slots.
+//
+// magic is written last when the region is created; wait for it before
+// reading anything else. TargetResults (target_results.h) has the same
+// layout on both ABIs we build for. All integers are little-endian.
+
+const char kSharedExportMagic[8] = {'D', 'V', 'S', 'H', 'A', 'R', 'E', 'D'};
+const uint32_t kSharedExportVersion = 1;
+const uint32_t kSharedExportHeaderSize = 4096;
+const int kSharedFrameSlots = 2;
+
+struct SharedExportHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t result_slots;
+  uint32_t result_slot_size;
+  uint32_t frame_slot_size;
+  uint32_t frame_width;
+  uint32_t frame_height;
+  // Records published so far
+  uint64_t results_written;
+  uint64_t frames_written;
+};
+
+struct SharedResultSlot {
+  uint32_t sequence;
+  uint32_t reserved;
+  TargetResults results;
+};
+
+// Followed by width * height * 4 bytes of RGBA, rows bottom-up as
+// glReadPixels returns them
+struct SharedFrameHeader {
+  uint32_t sequence;
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved;
+  int64_t capture_time_ns;
+};
+
+inline uint32_t sharedResultSlotSize() {
+  return (sizeof(SharedResultSlot) + 63) & ~63u; // cache line aligned
+}
+
+inline uint32_t sharedFrameSlotSize(int width, int height) {
+  uint32_t size = sizeof(SharedFrameHeader) +
+                  static_cast<uint32_t>(width) * height * 4;
+  return (size + 4095) & ~4095u; // page aligned
+}
+
+inline uint32_t sharedFrameOffset(const SharedExportHeader &header) {
+  uint32_t results = header.result_slots * header.result_slot_size;
+  return kSharedExportHeaderSize + ((results + 4095) & ~4095u);
+}
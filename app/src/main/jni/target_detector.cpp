@@ -0,0 +1,239 @@
+#include "target_detector.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "deferred_log.h"
+#include "filter_chain.h"
+#include "frame_trace.h"
+#include "perf_counters.h"
+#include "pipeline_plan.h"
+#include "quad_fit.h"
+#include "target_filter.h"
+
+namespace {
+
+struct Candidate {
+  const std::vector<cv::Point> *contour;
+  double area;
+  QuadFit quad;
+  TargetInfo target;
+};
+
+bool largerArea(const Candidate &a, const Candidate &b) {
+  return a.area > b.area;
+}
+
+// Closes a cascade stage that shrank the candidate list from `before` to
+// `after`, and returns the start time of the next stage.
+int64_t endStage(CascadeCounters *cascade, CascadeStage stage, size_t before,
+                 size_t after, int64_t start_ns) {
+  int64_t now = getTimeNs();
+  cascade->rejected[stage] += static_cast<int>(before - after);
+  cascade->time_ns[stage] += now - start_ns;
+  return now;
+}
+
+bool expired(const DetectionOptions &options, int64_t now) {
+  return options.deadline_ns != 0 && now > options.deadline_ns;
+}
+
+// Checkpoint between cascade stages: once the deadline has passed every
+// remaining candidate is dropped.
+void checkDeadline(const DetectionOptions &options, int64_t now,
+                   std::vector<Candidate> *candidates,
+                   DetectionResult *result) {
+  if (expired(options, now) && !candidates->empty()) {
+    result->deadline_hit = true;
+    result->deadline_dropped += candidates->size();
+    candidates->clear();
+  }
+}
+
+// Runs the rejection cascade over contours found in the decimated image and
+// fills in result's targets, which are in input pixels.
+void filterCandidates(const std::vector<std::vector<cv::Point>> &contours,
+                      const DetectionOptions &options,
+                      DetectionResult *result) {
+  CascadeCounters *cascade = &result->cascade;
+  const TargetFilter &filter = options.filter;
+  const int scale = options.decimation;
+  // A field's rows are twice as far apart as its columns
+  const int row_scale = options.field >= 0 ? 2 * scale : scale;
+  std::vector<Candidate> candidates;
+  candidates.reserve(contours.size());
+
+  // Every stage filters the whole candidate list before the next one runs,
+  // so each is timed with two clock reads and the expensive geometry only
+  // ever sees what survived the cheap checks.
+  int64_t stage_start = getTimeNs();
+  for (auto &contour : contours) {
+    if (contour.size() < 4) {
+      continue;
+    }
+    // The quad's corners are contour points, so it is never larger than
+    // the contour's bounding rectangle.
+    cv::Rect bounds = cv::boundingRect(contour);
+    if (bounds.width * scale < filter.min_width ||
+        bounds.height * row_scale < filter.min_height) {
+      continue;
+    }
+    Candidate candidate = Candidate();
+    candidate.contour = &contour;
+    candidates.push_back(std::move(candidate));
+  }
+  stage_start = endStage(cascade, CASCADE_BOUNDS, contours.size(),
+                         candidates.size(), stage_start);
+  checkDeadline(options, stage_start, &candidates, result);
+
+  const double min_area = minBlobArea(filter);
+  size_t before = candidates.size();
+  size_t kept = 0;
+  for (size_t i = 0; i < before; ++i) {
+    candidates[i].area = cv::contourArea(*candidates[i].contour);
+    if (candidates[i].area * scale * row_scale >= min_area) {
+      std::swap(candidates[kept++], candidates[i]);
+    }
+  }
+  candidates.resize(kept);
+  stage_start = endStage(cascade, CASCADE_AREA, before, kept, stage_start);
+
+  before = candidates.size();
+  if (before > options.max_candidates) {
+    std::nth_element(candidates.begin(),
+                     candidates.begin() + options.max_candidates,
+                     candidates.end(), largerArea);
+    candidates.resize(options.max_candidates);
+  }
+  stage_start = endStage(cascade, CASCADE_BUDGET, before, candidates.size(),
+                         stage_start);
+  checkDeadline(options, stage_start, &candidates, result);
+
+  before = candidates.size();
+  kept = 0;
+  for (size_t i = 0; i < before; ++i) {
+    Candidate &candidate = candidates[i];
+    if (fitQuad(*candidate.contour, &candidate.quad) &&
+        candidate.quad.residual <= quadTolerance(filter, candidate.quad)) {
+      makeTarget(candidate.quad, scale, row_scale, &candidate.target);
+      std::swap(candidates[kept++], candidate);
+    }
+  }
+  candidates.resize(kept);
+  stage_start = endStage(cascade, CASCADE_QUAD, before, kept, stage_start);
+  checkDeadline(options, stage_start, &candidates, result);
+
+  // Size, edge orientation and fullness run as one specialized chain, which
+  // is timed as a whole into CASCADE_SIZE; see CascadeCounters::time_ns
+  TargetFilterChain chain(filter);
+  for (auto &candidate : candidates) {
+    TargetInfo &target = candidate.target;
+    FilterCandidate checked = {&target, candidate.area, candidate.quad.area};
+    CascadeStage rejected_by = chain.reject(checked);
+    if (rejected_by != CASCADE_NUM_STAGES) {
+      cascade->rejected[rejected_by]++;
+      result->rejected_targets.push_back(std::move(target));
+      continue;
+    }
+    // We found a target
+    DLOGD("Found target at %.2lf, %.2lf...size %.2lf, %.2lf",
+          target.centroid_x, target.centroid_y, target.width, target.height);
+    result->targets.push_back(std::move(target));
+  }
+  cascade->time_ns[CASCADE_SIZE] += getTimeNs() - stage_start;
+}
+
+void resetResult(DetectionResult *result) {
+  result->targets.clear();
+  result->rejected_targets.clear();
+  memset(&result->cascade, 0, sizeof(result->cascade));
+  result->deadline_dropped = 0;
+  result->deadline_hit = false;
+}
+
+void shiftTarget(int dy, TargetInfo *target) {
+  target->centroid_y += dy;
+  for (auto &point : target->points) {
+    point.y += dy;
+  }
+}
+
+} // namespace
+
+void detectTargets(const cv::Mat &input, const HsvThreshold &hsv_threshold,
+                   const DetectionOptions &options, PipelinePlan *plan,
+                   int64_t trace_id, cv::Mat *thresh, DetectionResult *result) {
+  DetectionOptions scaled_options = options;
+  scaled_options.field = plan->interlaced() ? options.field : -1;
+  plan->buildMask(input, hsv_threshold, options.decimation,
+                  scaled_options.field, trace_id, thresh);
+  scaled_options.decimation = options.decimation * plan->scale();
+  if (plan->lastResult(options.max_candidates, result)) {
+    DLOGD("Mask unchanged, repeating %d targets",
+          static_cast<int>(result->targets.size()));
+    return;
+  }
+  detectTargetsInMask(*thresh, scaled_options, trace_id, plan->contourInput(),
+                      result);
+  plan->keepResult(options.max_candidates, *result);
+  // The odd field's first row is one decimated row down
+  int offset = plan->fieldOffset(scaled_options.field, options.decimation);
+  if (offset != 0) {
+    for (auto &target : result->targets) {
+      shiftTarget(offset, &target);
+    }
+    for (auto &target : result->rejected_targets) {
+      shiftTarget(offset, &target);
+    }
+  }
+}
+
+void detectTargetsInMask(const cv::Mat &mask, const DetectionOptions &options,
+                         int64_t trace_id, cv::Mat *contour_input,
+                         DetectionResult *result) {
+  int64_t t;
+  int elapsed_ms;
+  int64_t pixels = static_cast<int64_t>(mask.cols) * mask.rows;
+
+  t = getTimeNs();
+  perfStageBegin();
+  mask.copyTo(*contour_input);
+  std::vector<std::vector<cv::Point>> contours;
+  resetResult(result);
+  const CascadeCounters &cascade = result->cascade;
+  // findContours cannot be interrupted, so this is the last chance to
+  // give up on a frame whose threshold and conversion ran long
+  if (expired(options, getTimeNs())) {
+    result->deadline_hit = true;
+  } else {
+    cv::findContours(*contour_input, contours, cv::RETR_EXTERNAL,
+                     cv::CHAIN_APPROX_TC89_KCOS);
+    filterContours(contours, options, result);
+  }
+
+  DLOGD("Cascade of %d contours rejected bounds %d area %d budget %d",
+        cascade.contours, cascade.rejected[CASCADE_BOUNDS],
+        cascade.rejected[CASCADE_AREA], cascade.rejected[CASCADE_BUDGET]);
+  DLOGD("...quad %d size %d shape %d fullness %d",
+        cascade.rejected[CASCADE_QUAD], cascade.rejected[CASCADE_SIZE],
+        cascade.rejected[CASCADE_SHAPE], cascade.rejected[CASCADE_FULLNESS]);
+  DLOGD("Cascade us: bounds %d area %d budget %d quad %d final checks %d",
+        static_cast<int>(cascade.time_ns[CASCADE_BOUNDS] / 1000),
+        static_cast<int>(cascade.time_ns[CASCADE_AREA] / 1000),
+        static_cast<int>(cascade.time_ns[CASCADE_BUDGET] / 1000),
+        static_cast<int>(cascade.time_ns[CASCADE_QUAD] / 1000),
+        static_cast<int>(cascade.time_ns[CASCADE_SIZE] / 1000));
+  perfStageEnd(TRACE_CONTOURS, pixels);
+  elapsed_ms = traceStage(trace_id, TRACE_CONTOURS, t);
+  DLOGD("Contour analysis costs %d ms", elapsed_ms);
+}
+
+void filterContours(const std::vector<std::vector<cv::Point>> &contours,
+                    const DetectionOptions &options, DetectionResult *result) {
+  resetResult(result);
+  result->cascade.contours = contours.size();
+  filterCandidates(contours, options, result);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "target_filter.h"
+#include "target_info.h"
+
+class PipelinePlan;
+
+struct HsvThreshold {
+  int h_min;
+  int h_max;
+  int s_min;
+  int s_max;
+  int v_min;
+  int v_max;
+};
+
+// Candidate filters in the order detectTargets() applies them, cheapest
+// first. Each stage only sees the survivors of the previous ones.
+enum CascadeStage {
+  CASCADE_BOUNDS = 0,   // point count and bounding rectangle
+  CASCADE_AREA = 1,     // contour area
+  CASCADE_BUDGET = 2,   // cap on candidates entering geometric analysis
+  CASCADE_QUAD = 3,     // quad fit and residual
+  CASCADE_SIZE = 4,     // quad width and height
+  CASCADE_SHAPE = 5,    // edge slopes
+  CASCADE_FULLNESS = 6, // contour area / quad area
+  CASCADE_NUM_STAGES
+};
+
+struct CascadeCounters {
+  int contours;
+  int rejected[CASCADE_NUM_STAGES];
+  // Time in each stage. Size, shape and fullness run as one chain over each
+  // candidate, so time_ns[CASCADE_SIZE] covers all three and the other two
+  // stay 0.
+  int64_t time_ns[CASCADE_NUM_STAGES];
+};
+
+// Candidates kept for geometric analysis when nothing else is asked for;
+// bounds the worst case when a bad threshold produces hundreds of blobs.
+const size_t kMaxGeometryCandidates = 32;
+
+struct DetectionOptions {
+  DetectionOptions()
+      : filter(defaultTargetFilter()), decimation(1), field(-1),
+        max_candidates(kMaxGeometryCandidates), deadline_ns(0) {}
+
+  TargetFilter filter;
+  // Detect on an image this many times smaller in each direction, on top of
+  // any decimation in the pipeline. Targets are still reported in input
+  // pixels.
+  int decimation;
+  // With an interlaced plan, 0 or 1 to threshold only the even or odd rows
+  // of the decimated image, so the mask is half as tall; -1 for every row
+  int field;
+  size_t max_candidates;
+  // getTimeNs() time after which the remaining candidates are dropped, or 0
+  int64_t deadline_ns;
+};
+
+struct DetectionResult {
+  std::vector<TargetInfo> targets;
+  // Candidates that got as far as a fitted quad, for DISP_MODE_TARGETS_PLUS
+  std::vector<TargetInfo> rejected_targets;
+  CascadeCounters cascade;
+  // Candidates dropped because options.deadline_ns passed
+  int deadline_dropped;
+  bool deadline_hit;
+};
+
+// Runs `plan`'s mask stages and the contour analysis over one RGBA frame:
+// all of processImpl between reading the camera texture and drawing the
+// result, with no GL dependency so host tools (replay, benchmarks) run the
+// exact on-device detection. `thresh` receives the binary mask, at the
+// decimated size (half height for a field); it refers to a buffer of the
+// plan.
+void detectTargets(const cv::Mat &input, const HsvThreshold &hsv_threshold,
+                   const DetectionOptions &options, PipelinePlan *plan,
+                   int64_t trace_id, cv::Mat *thresh, DetectionResult *result);
+
+// The contour and candidate stages of detectTargets() alone, for a mask
+// that is options.decimation times smaller than the camera image, such as
+// one read back from a recording; half as tall again when options.field is
+// set. findContours works on a copy of the mask in contour_input.
+void detectTargetsInMask(const cv::Mat &mask, const DetectionOptions &options,
+                         int64_t trace_id, cv::Mat *contour_input,
+                         DetectionResult *result);
+
+// The candidate cascade of detectTargetsInMask() alone, over contours found
+// in such a mask
+void filterContours(const std::vector<std::vector<cv::Point>> &contours,
+                    const DetectionOptions &options, DetectionResult *result);
@@ -0,0 +1,71 @@
+#include "target_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+TargetFilter defaultTargetFilter() {
+  TargetFilter filter;
+  filter.min_width = kDefaultMinWidth;
+  filter.max_width = kDefaultMaxWidth;
+  filter.min_height = kDefaultMinHeight;
+  filter.max_height = kDefaultMaxHeight;
+  filter.min_fullness = kDefaultMinFullness;
+  filter.max_fullness = kDefaultMaxFullness;
+  filter.horizontal_slope = kDefaultHorizontalSlope;
+  filter.vertical_slope = kDefaultVerticalSlope;
+  // A circle needs ~0.21. Unlike the old fixed approxPolyDP epsilon of 20
+  // pixels this scales down for small, distant targets.
+  filter.quad_tolerance_fraction = 0.15;
+  filter.min_quad_tolerance = 2.0;
+  return filter;
+}
+
+double minBlobArea(const TargetFilter &filter) {
+  return filter.min_fullness * filter.min_width * filter.min_height / 2;
+}
+
+double quadTolerance(const TargetFilter &filter, const QuadFit &quad) {
+  double shorter_side = std::numeric_limits<double>::max();
+  for (int i = 0; i < 4; ++i) {
+    cv::Point edge = quad.corners[(i + 1) % 4] - quad.corners[i];
+    shorter_side = std::min(shorter_side, std::sqrt(edge.ddot(edge)));
+  }
+  return std::max(filter.min_quad_tolerance,
+                  filter.quad_tolerance_fraction * shorter_side);
+}
+
+void makeTarget(const QuadFit &quad, int scale, TargetInfo *target) {
+  makeTarget(quad, scale, scale, target);
+}
+
+void makeTarget(const QuadFit &quad, int scale, int row_scale,
+                TargetInfo *target) {
+  int min_x = std::numeric_limits<int>::max();
+  int max_x = std::numeric_limits<int>::min();
+  int min_y = std::numeric_limits<int>::max();
+  int max_y = std::numeric_limits<int>::min();
+  target->centroid_x = 0;
+  target->centroid_y = 0;
+  for (auto corner : quad.corners) {
+    cv::Point point(corner.x * scale, corner.y * row_scale);
+    if (point.x < min_x)
+      min_x = point.x;
+    if (point.x > max_x)
+      max_x = point.x;
+    if (point.y < min_y)
+      min_y = point.y;
+    if (point.y > max_y)
+      max_y = point.y;
+    target->centroid_x += point.x;
+    target->centroid_y += point.y;
+  }
+  target->centroid_x /= 4;
+  target->centroid_y /= 4;
+  target->width = max_x - min_x;
+  target->height = max_y - min_y;
+  target->points.clear();
+  for (auto corner : quad.corners) {
+    target->points.push_back(cv::Point(corner.x * scale, corner.y * row_scale));
+  }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "quad_fit.h"
+#include "target_info.h"
+
+// Thresholds a candidate blob must pass to be reported as a target. Sizes
+// are in camera pixels (keep in mind width/height are in imager terms).
+struct TargetFilter {
+  double min_width;
+  double max_width;
+  double min_height;
+  double max_height;
+  // Blob area / quad area
+  double min_fullness;
+  double max_fullness;
+  // An edge counts as horizontal below horizontal_slope (|dy/dx|) and as
+  // vertical above vertical_slope
+  double horizontal_slope;
+  double vertical_slope;
+  // A fitted quad may leave blob points up to this fraction of its shorter
+  // side (and at least min_quad_tolerance pixels) outside it
+  double quad_tolerance_fraction;
+  double min_quad_tolerance;
+};
+
+// The thresholds tuned for the 2016 goal. Slopes are kept at ratios of
+// small integers so DefaultFilterLimits can test them exactly in integers.
+constexpr double kDefaultMinWidth = 20;
+constexpr double kDefaultMaxWidth = 300;
+constexpr double kDefaultMinHeight = 10;
+constexpr double kDefaultMaxHeight = 100;
+constexpr double kDefaultMinFullness = .2;
+constexpr double kDefaultMaxFullness = .5;
+constexpr double kDefaultHorizontalSlope = 1 / 1.25;
+constexpr double kDefaultVerticalSlope = 1.25;
+
+TargetFilter defaultTargetFilter();
+
+// Below this area (camera pixels^2) a blob cannot reach min_fullness of a
+// minimum size quad
+double minBlobArea(const TargetFilter &filter);
+
+double quadTolerance(const TargetFilter &filter, const QuadFit &quad);
+
+// Target from a quad fitted in an image `scale` times smaller than the
+// camera image
+void makeTarget(const QuadFit &quad, int scale, TargetInfo *target);
+
+// The same for an image `scale` times narrower and `row_scale` times
+// shorter, such as one field of an interlaced frame
+void makeTarget(const QuadFit &quad, int scale, int row_scale,
+                TargetInfo *target);
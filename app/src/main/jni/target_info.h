@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+struct TargetInfo {
+  double centroid_x;
+  double centroid_y;
+  double width;
+  double height;
+  std::vector<cv::Point> points;
+};
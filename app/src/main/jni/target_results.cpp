@@ -0,0 +1,20 @@
+#include "target_results.h"
+
+#include "seqlock.h"
+
+namespace {
+
+Seqlock<TargetResults> sLatest;
+uint32_t sPublished = 0;
+
+} // namespace
+
+void publishTargetResults(TargetResults *results) {
+  results->sequence = ++sPublished;
+  sLatest.store(*results);
+}
+
+uint32_t latestTargetResults(TargetResults *results) {
+  sLatest.load(results);
+  return results->sequence;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+// What processFrame() reports for one frame, as plain data so it can be
+// published to other threads by value
+const int kMaxReportedTargets = 8;
+
+struct ReportedTarget {
+  double centroid_x;
+  double centroid_y;
+  double width;
+  double height;
+  int channel;
+  // Tracker output, id -1 for untracked targets
+  int id;
+  double predicted_x;
+  double predicted_y;
+  double velocity_x;
+  double velocity_y;
+  double variance_x;
+  double variance_y;
+  // Camera model output, radians
+  double h_angle;
+  double v_angle;
+  double h_width;
+  double v_width;
+  double h_angle_predicted;
+  double v_angle_predicted;
+  double h_angle_rate;
+  double v_angle_rate;
+  double h_angle_variance;
+  double v_angle_variance;
+  bool has_pose;
+  double range;
+  double bearing;
+  double skew;
+};
+
+struct TargetResults {
+  // Frames published so far, this one included
+  uint32_t sequence;
+  int64_t capture_time_ns;
+  int degradation;
+  int degradation_level;
+  int num_targets;
+  ReportedTarget targets[kMaxReportedTargets];
+};
+
+// Replaces the latest results; vision thread only. Never blocks.
+void publishTargetResults(TargetResults *results);
+
+// Copies out the latest results from any thread without blocking the
+// publisher. Returns their sequence, or 0 before the first frame.
+uint32_t latestTargetResults(TargetResults *results);
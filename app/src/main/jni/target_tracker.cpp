@@ -0,0 +1,173 @@
+#include "target_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Measurement noise of a centroid (pixels^2)
+const double kMeasurementVariance = 4.0;
+// White acceleration noise spectral density (pixels^2 / s^3). Large enough
+// to follow the image motion of a robot that starts or stops turning.
+const double kAccelNoise = 2.0e5;
+// Velocity variance of a freshly created track ((pixels / s)^2)
+const double kInitialVelocityVariance = 4.0e4;
+// A detection further than this from a track's prediction (in pixels, or
+// kGateSigmas standard deviations if that is larger) starts a new track.
+const double kGatePixels = 40.0;
+const double kGateSigmas = 3.0;
+const int kMaxMissedFrames = 5;
+const int64_t kMaxTrackAgeNs = 500000000LL;
+
+void initState(TrackState *s, double pos) {
+  s->pos = pos;
+  s->vel = 0;
+  s->p00 = kMeasurementVariance;
+  s->p01 = 0;
+  s->p11 = kInitialVelocityVariance;
+}
+
+void predictState(TrackState *s, double dt) {
+  if (dt <= 0) {
+    return;
+  }
+  s->pos += s->vel * dt;
+  double dt2 = dt * dt;
+  double p00 = s->p00 + 2 * dt * s->p01 + dt2 * s->p11;
+  double p01 = s->p01 + dt * s->p11;
+  s->p00 = p00 + kAccelNoise * dt2 * dt / 3;
+  s->p01 = p01 + kAccelNoise * dt2 / 2;
+  s->p11 += kAccelNoise * dt;
+}
+
+void correctState(TrackState *s, double measured) {
+  double innovation = measured - s->pos;
+  double innovation_variance = s->p00 + kMeasurementVariance;
+  double k0 = s->p00 / innovation_variance;
+  double k1 = s->p01 / innovation_variance;
+  s->pos += k0 * innovation;
+  s->vel += k1 * innovation;
+  double p00 = (1 - k0) * s->p00;
+  double p01 = (1 - k0) * s->p01;
+  double p11 = s->p11 - k1 * s->p01;
+  s->p00 = p00;
+  s->p01 = p01;
+  s->p11 = p11;
+}
+
+struct Candidate {
+  double distance;
+  size_t track;
+  size_t detection;
+  bool operator<(const Candidate &other) const {
+    return distance < other.distance;
+  }
+};
+
+} // namespace
+
+TargetTracker::TargetTracker() : next_id_(0) {}
+
+void TargetTracker::reset() {
+  tracks_.clear();
+}
+
+void TargetTracker::update(const std::vector<TargetInfo> &detections,
+                           int64_t capture_time_ns,
+                           std::vector<int> *track_ids) {
+  // Retire tracks that have not been seen for a while
+  tracks_.erase(
+      std::remove_if(tracks_.begin(), tracks_.end(),
+                     [capture_time_ns](const Track &track) {
+                       return track.missed > kMaxMissedFrames ||
+                              capture_time_ns - track.last_update_ns >
+                                  kMaxTrackAgeNs;
+                     }),
+      tracks_.end());
+
+  for (auto &track : tracks_) {
+    double dt = (capture_time_ns - track.last_update_ns) * 1e-9;
+    predictState(&track.x, dt);
+    predictState(&track.y, dt);
+    track.last_update_ns = std::max(track.last_update_ns, capture_time_ns);
+  }
+
+  // Greedy nearest-neighbour association; with a handful of targets per
+  // frame this matches the optimal assignment in practice.
+  std::vector<Candidate> candidates;
+  for (size_t t = 0; t < tracks_.size(); ++t) {
+    const Track &track = tracks_[t];
+    double sigma = std::sqrt(std::max(track.x.p00, track.y.p00));
+    double gate = std::max(kGatePixels, kGateSigmas * sigma);
+    for (size_t d = 0; d < detections.size(); ++d) {
+      double dx = detections[d].centroid_x - track.x.pos;
+      double dy = detections[d].centroid_y - track.y.pos;
+      double distance = std::sqrt(dx * dx + dy * dy);
+      if (distance <= gate) {
+        candidates.push_back({distance, t, d});
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  track_ids->assign(detections.size(), -1);
+  std::vector<bool> track_matched(tracks_.size(), false);
+  for (const auto &candidate : candidates) {
+    if (track_matched[candidate.track] ||
+        (*track_ids)[candidate.detection] >= 0) {
+      continue;
+    }
+    track_matched[candidate.track] = true;
+    Track &track = tracks_[candidate.track];
+    const TargetInfo &detection = detections[candidate.detection];
+    correctState(&track.x, detection.centroid_x);
+    correctState(&track.y, detection.centroid_y);
+    track.age++;
+    track.missed = 0;
+    (*track_ids)[candidate.detection] = track.id;
+  }
+  for (size_t t = 0; t < track_matched.size(); ++t) {
+    if (!track_matched[t]) {
+      tracks_[t].missed++;
+    }
+  }
+
+  for (size_t d = 0; d < detections.size(); ++d) {
+    if ((*track_ids)[d] >= 0) {
+      continue;
+    }
+    Track track;
+    track.id = next_id_++;
+    initState(&track.x, detections[d].centroid_x);
+    initState(&track.y, detections[d].centroid_y);
+    track.last_update_ns = capture_time_ns;
+    track.age = 1;
+    track.missed = 0;
+    tracks_.push_back(track);
+    (*track_ids)[d] = track.id;
+  }
+}
+
+bool TargetTracker::predict(int id, int64_t time_ns,
+                            TrackedTarget *out) const {
+  for (const auto &track : tracks_) {
+    if (track.id != id) {
+      continue;
+    }
+    TrackState x = track.x;
+    TrackState y = track.y;
+    double dt = (time_ns - track.last_update_ns) * 1e-9;
+    predictState(&x, dt);
+    predictState(&y, dt);
+    out->id = id;
+    out->centroid_x = x.pos;
+    out->centroid_y = y.pos;
+    out->velocity_x = x.vel;
+    out->velocity_y = y.vel;
+    out->variance_x = x.p00;
+    out->variance_y = y.p00;
+    out->age = track.age;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "target_info.h"
+
+// Constant-velocity Kalman filter on the image-plane centroid, one
+// independent 2-state (position, velocity) filter per axis.
+struct TrackState {
+  double pos;
+  double vel;
+  // Covariance [p_pos_pos, p_pos_vel; p_pos_vel, p_vel_vel]
+  double p00;
+  double p01;
+  double p11;
+};
+
+struct TrackedTarget {
+  int id;
+  // Predicted centroid (pixels) and velocity (pixels / s)
+  double centroid_x;
+  double centroid_y;
+  double velocity_x;
+  double velocity_y;
+  // Position variance (pixels^2) at the prediction time
+  double variance_x;
+  double variance_y;
+  int age;
+};
+
+// Associates detections across frames and extrapolates them in time. All
+// timestamps are CLOCK_MONOTONIC nanoseconds (System.nanoTime() in Java).
+class TargetTracker {
+ public:
+  TargetTracker();
+
+  // Feeds one frame of detections captured at capture_time_ns. On return
+  // track_ids[i] is the stable id assigned to detections[i].
+  void update(const std::vector<TargetInfo> &detections,
+              int64_t capture_time_ns, std::vector<int> *track_ids);
+
+  // Extrapolates track `id` to time_ns. Returns false for an unknown id.
+  bool predict(int id, int64_t time_ns, TrackedTarget *out) const;
+
+  void reset();
+
+ private:
+  struct Track {
+    int id;
+    TrackState x;
+    TrackState y;
+    int64_t last_update_ns;
+    int age;
+    int missed;
+  };
+
+  std::vector<Track> tracks_;
+  int next_id_;
+};
@@ -0,0 +1,415 @@
+#include "thermal_governor.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+
+#include "common.hpp"
+#include "cpu_topology.h"
+#include "deferred_log.h"
+#include "frame_budget.h"
+#include "seqlock.h"
+
+namespace {
+
+// Opening a dozen sysfs files costs tens of microseconds, and temperatures
+// move over seconds
+const useconds_t kSampleIntervalUs = 500000;
+// Consecutive samples above a level before the governor enters it
+const int kRiseSamples = 2;
+// Calm time before the governor drops a level
+const int64_t kRelaxNs = 15000000000LL;
+// How far below a threshold the temperature, or above it the frequency
+// ratio, must fall before the threshold stops counting
+const double kTempHysteresisC = 3.0;
+const double kFreqHysteresis = 0.05;
+// With any thermal pressure, frames costing this much of the budget take
+// the governor a level further
+const double kCostEscalate = 0.8;
+// The governor only relaxes while frames leave this much of the budget
+// spare, so the level below has room to run in
+const double kCostRelax = 0.6;
+// Weight of the newest frame in the smoothed frame cost
+const double kCostSmoothing = 0.05;
+// Zones reading outside this range are broken or disconnected sensors
+const double kMaxSaneTempC = 150.0;
+
+const char *kTempKeys[3] = {"warm", "hot", "severe"};
+const char *kFreqKeys[3] = {"freq_warm", "freq_hot", "freq_severe"};
+
+pthread_mutex_t sConfigLock = PTHREAD_MUTEX_INITIALIZER;
+bool sConfigChanged = false;
+// Never freed, since the detached sampler thread may still read it while
+// the process exits
+ThermalConfig *sConfig = NULL;
+
+// The sampler thread reads sysfs and publishes here; the vision thread only
+// ever loads the latest sample
+pthread_once_t sSamplerOnce = PTHREAD_ONCE_INIT;
+Seqlock<ThermalSample> sLatestSample;
+// Smoothed frame cost from the vision thread, for the trace
+std::atomic<double> sFrameCost(0);
+
+// With sConfigLock held
+ThermalConfig &config() {
+  if (sConfig == NULL) {
+    sConfig = new ThermalConfig(defaultThermalConfig());
+  }
+  return *sConfig;
+}
+
+// Directories under path whose names are prefix followed by a number
+std::vector<std::string> numberedEntries(const std::string &path,
+                                         const char *prefix) {
+  std::vector<std::string> entries;
+  DIR *dir = opendir(path.c_str());
+  if (dir == NULL) {
+    return entries;
+  }
+  size_t length = strlen(prefix);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    if (strncmp(name, prefix, length) != 0 || name[length] < '0' ||
+        name[length] > '9') {
+      continue;
+    }
+    char *end;
+    strtol(name + length, &end, 10);
+    if (*end == '\0') {
+      entries.push_back(path + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(entries.begin(), entries.end());
+  return entries;
+}
+
+bool parseNumber(const std::string &text, double *value) {
+  char *end;
+  *value = strtod(text.c_str(), &end);
+  return !text.empty() && *end == '\0';
+}
+
+// Highest level whose threshold value has reached; thresholds at or below
+// the current level are widened by band so that they hold on a little
+// longer. lower_is_worse for frequency ratios.
+int thresholdLevel(double value, const double *thresholds, double band,
+                   int current, bool lower_is_worse) {
+  int level = 0;
+  for (int i = 0; i < ThermalGovernor::kMaxLevel; ++i) {
+    double margin = i < current ? band : 0;
+    bool reached = lower_is_worse ? value <= thresholds[i] + margin
+                                  : value >= thresholds[i] - margin;
+    if (reached) {
+      level = i + 1;
+    }
+  }
+  return level;
+}
+
+// Samples the sensors of the configured sysfs root every kSampleIntervalUs
+// while the governor is enabled, and appends each sample to the trace
+void *samplerThread(void *) {
+  uint32_t placement_generation = 0;
+  ThermalSensors sensors;
+  std::string sensors_root;
+  FILE *trace = NULL;
+  std::string trace_path;
+  while (true) {
+    placeCurrentThread(THREAD_BACKGROUND, &placement_generation);
+    pthread_mutex_lock(&sConfigLock);
+    ThermalConfig current = config();
+    pthread_mutex_unlock(&sConfigLock);
+
+    if (current.trace_path != trace_path) {
+      if (trace != NULL) {
+        fclose(trace);
+        trace = NULL;
+      }
+      trace_path = current.trace_path;
+      if (!trace_path.empty()) {
+        trace = fopen(trace_path.c_str(), "a");
+        if (trace == NULL) {
+          LOGE("Could not open thermal trace %s", trace_path.c_str());
+        }
+      }
+    }
+    if (current.enabled) {
+      if (current.sysfs_root != sensors_root) {
+        sensors_root = current.sysfs_root;
+        if (!sensors.open(sensors_root)) {
+          LOGE("No thermal zones or cpufreq files under %s",
+               sensors_root.c_str());
+        }
+      }
+      ThermalSample sample;
+      sample.time_ns = getTimeNs();
+      sample.frame_cost = sFrameCost.load(std::memory_order_relaxed);
+      sensors.read(&sample);
+      if (trace != NULL) {
+        fprintf(trace, "%lld %.1f %.3f %.3f\n",
+                (long long)(sample.time_ns / 1000000), sample.temp_c,
+                sample.freq_ratio, sample.frame_cost);
+        fflush(trace);
+      }
+      // Published once traced, so a trace holds every sample the
+      // governor has seen
+      sLatestSample.store(sample);
+    }
+    usleep(kSampleIntervalUs);
+  }
+  return NULL;
+}
+
+void startSampler() {
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, samplerThread, NULL) == 0) {
+    pthread_detach(thread);
+  } else {
+    LOGE("Could not start the thermal sampler thread");
+  }
+}
+
+} // namespace
+
+ThermalConfig defaultThermalConfig() {
+  ThermalConfig config;
+  config.enabled = true;
+  // Below where phone SoCs usually start capping frequencies
+  config.temp_c[0] = 55;
+  config.temp_c[1] = 65;
+  config.temp_c[2] = 75;
+  config.freq_ratio[0] = 0.85;
+  config.freq_ratio[1] = 0.7;
+  config.freq_ratio[2] = 0.55;
+  config.sysfs_root = "/sys";
+  return config;
+}
+
+bool parseThermalConfig(const char *spec, ThermalConfig *config) {
+  ThermalConfig parsed = *config;
+  std::istringstream lines(spec);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::istringstream tokens(line.substr(0, line.find('#')));
+    std::string token;
+    while (tokens >> token) {
+      size_t equals = token.find('=');
+      std::string key = token.substr(0, equals);
+      std::string value =
+          equals == std::string::npos ? "" : token.substr(equals + 1);
+      double number;
+      bool known = false;
+      if (key == "enabled") {
+        known = value == "0" || value == "1";
+        parsed.enabled = value == "1";
+      } else if (key == "trace") {
+        known = !value.empty();
+        parsed.trace_path = value == "off" ? "" : value;
+      } else if (key == "sysfs") {
+        known = !value.empty();
+        parsed.sysfs_root = value;
+      }
+      for (int i = 0; i < ThermalGovernor::kMaxLevel && !known; ++i) {
+        if (key == kTempKeys[i]) {
+          known = parseNumber(value, &number) && number > 0 &&
+                  number < kMaxSaneTempC;
+          parsed.temp_c[i] = number;
+        } else if (key == kFreqKeys[i]) {
+          known = parseNumber(value, &number) && number > 0 && number <= 1;
+          parsed.freq_ratio[i] = number;
+        }
+      }
+      if (!known) {
+        LOGE("Bad thermal governor setting: %s", token.c_str());
+        return false;
+      }
+    }
+  }
+  for (int i = 1; i < ThermalGovernor::kMaxLevel; ++i) {
+    if (parsed.temp_c[i] <= parsed.temp_c[i - 1] ||
+        parsed.freq_ratio[i] >= parsed.freq_ratio[i - 1]) {
+      LOGE("Thermal governor thresholds must get strictly more severe");
+      return false;
+    }
+  }
+  *config = parsed;
+  return true;
+}
+
+bool ThermalSensors::open(const std::string &root) {
+  zones_.clear();
+  cores_.clear();
+  for (auto &zone : numberedEntries(root + "/class/thermal", "thermal_zone")) {
+    if (readSysfsNumber(zone + "/temp") > 0) {
+      zones_.push_back(zone + "/temp");
+    }
+  }
+  // Only the big cores, where the vision thread runs by default: a little
+  // core at its full clock says nothing about how fast frames go
+  std::string cpu_root = root + "/devices/system/cpu";
+  CpuTopology topology;
+  topology.load(cpu_root);
+  for (int id : topology.bigCores()) {
+    std::string cpu = cpu_root + "/cpu" + std::to_string(id);
+    Core core;
+    core.cur_freq_path = cpu + "/cpufreq/scaling_cur_freq";
+    core.max_freq = readSysfsNumber(cpu + "/cpufreq/cpuinfo_max_freq");
+    if (core.max_freq > 0) {
+      cores_.push_back(core);
+    }
+  }
+  return !zones_.empty() || !cores_.empty();
+}
+
+void ThermalSensors::read(ThermalSample *sample) const {
+  sample->temp_c = 0;
+  for (auto &zone : zones_) {
+    int64_t temp = readSysfsNumber(zone);
+    // Most kernels report millidegrees, a few whole degrees
+    double temp_c = temp >= 1000 ? temp / 1000.0 : temp;
+    if (temp_c > 0 && temp_c < kMaxSaneTempC) {
+      sample->temp_c = std::max(sample->temp_c, temp_c);
+    }
+  }
+  // Offline cores have no readable frequency and are left out. The vision
+  // thread keeps its core busy, so a low maximum means a capped clock
+  // rather than an idle one.
+  double ratio = -1;
+  for (auto &core : cores_) {
+    int64_t freq = readSysfsNumber(core.cur_freq_path);
+    if (freq > 0) {
+      ratio = std::max(ratio, static_cast<double>(freq) / core.max_freq);
+    }
+  }
+  sample->freq_ratio = ratio < 0 ? 1 : std::min(ratio, 1.0);
+}
+
+ThermalGovernor::ThermalGovernor()
+    : config_(defaultThermalConfig()), level_(0), rise_samples_(0),
+      calm_since_ns_(-1), sample_sequence_(0), frame_cost_(0) {}
+
+void ThermalGovernor::configure(const ThermalConfig &config) {
+  config_ = config;
+}
+
+int ThermalGovernor::poll() {
+  // Polled every frame, so never wait on the control thread
+  if (pthread_mutex_trylock(&sConfigLock) == 0) {
+    if (sConfigChanged) {
+      configure(config());
+      sConfigChanged = false;
+    }
+    pthread_mutex_unlock(&sConfigLock);
+  }
+  if (!config_.enabled) {
+    return level();
+  }
+  pthread_once(&sSamplerOnce, startSampler);
+  ThermalSample sample;
+  uint32_t sequence = sLatestSample.load(&sample);
+  if (sequence == sample_sequence_) {
+    return level();
+  }
+  sample_sequence_ = sequence;
+  sample.frame_cost = frame_cost_;
+  return update(sample);
+}
+
+void ThermalGovernor::addFrameCost(int64_t processing_ns) {
+  double cost = static_cast<double>(processing_ns) / FrameBudget::kBudgetNs;
+  frame_cost_ += kCostSmoothing * (cost - frame_cost_);
+  sFrameCost.store(frame_cost_, std::memory_order_relaxed);
+}
+
+int ThermalGovernor::targetLevel(const ThermalSample &sample) const {
+  int level = std::max(
+      thresholdLevel(sample.temp_c, config_.temp_c, kTempHysteresisC, level_,
+                     false),
+      thresholdLevel(sample.freq_ratio, config_.freq_ratio, kFreqHysteresis,
+                     level_, true));
+  if (level > 0 && sample.frame_cost > kCostEscalate) {
+    level++;
+  }
+  return std::min(level, static_cast<int>(kMaxLevel));
+}
+
+int ThermalGovernor::update(const ThermalSample &sample) {
+  int target = targetLevel(sample);
+  int old_level = level_;
+  if (target > level_) {
+    calm_since_ns_ = -1;
+    if (++rise_samples_ >= kRiseSamples) {
+      level_ = target;
+      rise_samples_ = 0;
+    }
+  } else {
+    rise_samples_ = 0;
+    if (target == level_ || sample.frame_cost > kCostRelax) {
+      calm_since_ns_ = -1;
+    } else if (calm_since_ns_ < 0) {
+      calm_since_ns_ = sample.time_ns;
+    } else if (sample.time_ns - calm_since_ns_ >= kRelaxNs) {
+      level_--;
+      // The next level down has to earn its own calm spell
+      calm_since_ns_ = level_ > target ? sample.time_ns : -1;
+    }
+  }
+  if (level_ != old_level) {
+    DLOGI("Thermal level %d -> %d at %d.%d C, %d%% clock, %d%% frame cost",
+          old_level, level_, static_cast<int>(sample.temp_c),
+          static_cast<int>(sample.temp_c * 10) % 10,
+          static_cast<int>(sample.freq_ratio * 100),
+          static_cast<int>(sample.frame_cost * 100));
+  }
+  return level();
+}
+
+bool replayThermalTrace(const char *path, const ThermalConfig &config,
+                        std::vector<int> *levels) {
+  std::ifstream trace(path);
+  if (!trace) {
+    LOGE("Could not open thermal trace %s", path);
+    return false;
+  }
+  ThermalGovernor governor;
+  governor.configure(config);
+  levels->clear();
+  std::string line;
+  int line_number = 0;
+  while (std::getline(trace, line)) {
+    ++line_number;
+    std::istringstream fields(line.substr(0, line.find('#')));
+    double time_ms;
+    ThermalSample sample;
+    if (!(fields >> time_ms)) {
+      continue; // blank or comment
+    }
+    if (!(fields >> sample.temp_c >> sample.freq_ratio >> sample.frame_cost)) {
+      LOGE("Bad thermal trace line %d in %s", line_number, path);
+      return false;
+    }
+    sample.time_ns = static_cast<int64_t>(time_ms * 1000000);
+    levels->push_back(governor.update(sample));
+  }
+  return true;
+}
+
+extern "C" int thermalGovernorConfigure(const char *spec) {
+  pthread_mutex_lock(&sConfigLock);
+  bool ok = parseThermalConfig(spec, &config());
+  if (ok) {
+    sConfigChanged = true;
+  }
+  pthread_mutex_unlock(&sConfigLock);
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Configures the thermal governor, as space or newline separated key=value
+// pairs:
+//   enabled=0|1             on by default
+//   warm=C hot=C severe=C   hottest thermal zone, in degrees Celsius,
+//                           that raises the governor to level 1, 2 and 3
+//   freq_warm=R freq_hot=R freq_severe=R
+//                           fastest core's current frequency as a fraction
+//                           of its maximum at or below which the levels
+//                           apply
+//   trace=PATH|off          appends every sample to PATH in the format
+//                           replayThermalTrace() reads
+//   sysfs=PATH              sysfs root to sample, /sys by default; tests
+//                           point it at a fake tree
+// '#' starts a comment. Keys left out keep their value. The vision thread
+// picks up thresholds at its next frame, the sampler thread sysfs= and
+// trace= at its next sample. Returns 0 on success; on an invalid spec
+// nothing changes.
+int thermalGovernorConfigure(const char *spec);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+#include <vector>
+
+struct ThermalSample {
+  int64_t time_ns;
+  // Hottest thermal zone; 0 when none is readable
+  double temp_c;
+  // Highest scaling_cur_freq / cpuinfo_max_freq over the online cores; 1
+  // when cpufreq is not readable
+  double freq_ratio;
+  // Smoothed processing time per frame as a fraction of the frame budget
+  double frame_cost;
+};
+
+struct ThermalConfig {
+  bool enabled;
+  double temp_c[3];
+  double freq_ratio[3];
+  std::string trace_path;
+  std::string sysfs_root;
+};
+
+ThermalConfig defaultThermalConfig();
+
+// Applies spec on top of config; false (config unchanged) on errors
+bool parseThermalConfig(const char *spec, ThermalConfig *config);
+
+// Thermal zones and the big cores' cpufreq files under a sysfs root, found
+// once and read on every sample by the governor's background sampler thread
+class ThermalSensors {
+ public:
+  bool open(const std::string &root);
+  // Fills in temp_c and freq_ratio
+  void read(ThermalSample *sample) const;
+
+ private:
+  std::vector<std::string> zones_;
+  struct Core {
+    std::string cur_freq_path;
+    int64_t max_freq;
+  };
+  std::vector<Core> cores_;
+};
+
+// Lowers processing detail before the phone throttles hard, so the frame
+// rate holds at reduced detail instead of collapsing. The level is a floor
+// for the FrameBudget level: 1 skips visualization and halves the shared
+// frame export, 2 also caps candidates, 3 also decimates. It comes from the
+// hottest zone and the fastest big core's frequency, one level more if
+// frames already cost most of the budget. Each threshold must be clear by a
+// margin before it stops counting, a level is only entered after it is seen
+// on consecutive samples, and a level is only left after a long calm spell,
+// so the settings do not flap around a threshold.
+//
+// A background thread reads sysfs a few times a second and publishes each
+// sample through a Seqlock, so the vision thread never touches a file.
+class ThermalGovernor {
+ public:
+  static const int kMaxLevel = 3;
+
+  ThermalGovernor();
+
+  // Called at the start of every frame; moves the level once for each new
+  // sample and returns the level for the frame. Starts the sampler thread
+  // on first use.
+  int poll();
+
+  // Feeds the processing time of a frame into the smoothed frame cost
+  void addFrameCost(int64_t processing_ns);
+
+  // Moves the level for one sample and returns it. poll() calls this; trace
+  // replay calls it directly.
+  int update(const ThermalSample &sample);
+
+  void configure(const ThermalConfig &config);
+  int level() const { return config_.enabled ? level_ : 0; }
+
+ private:
+  int targetLevel(const ThermalSample &sample) const;
+
+  ThermalConfig config_;
+  int level_;
+  int rise_samples_;
+  // Start of the current run of samples calm enough to relax, or -1
+  int64_t calm_since_ns_;
+  // Sequence of the last sample poll() used
+  uint32_t sample_sequence_;
+  double frame_cost_;
+};
+
+// Runs a recorded trace through a governor with the given config. A trace
+// has one sample per line, "time_ms temp_c freq_ratio frame_cost" as
+// written by the trace= option; '#' starts a comment. levels gets the level
+// after each sample. Returns false if the trace cannot be read or has a
+// malformed line.
+bool replayThermalTrace(const char *path, const ThermalConfig &config,
+                        std::vector<int> *levels);
+#endif
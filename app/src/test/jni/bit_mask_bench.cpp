@@ -0,0 +1,58 @@
+// Times BitMask morphology against cv::morphologyEx on random VGA-sized
+// masks, one line per operation and kernel.
+
+#include <stdio.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "bit_mask.h"
+#include "common.hpp"
+
+int main() {
+  const cv::Size kSizes[] = {cv::Size(320, 240), cv::Size(640, 480)};
+  const double kDensities[] = {0.05, 0.5};
+  const int kMorphTypes[] = {cv::MORPH_ERODE, cv::MORPH_DILATE,
+                             cv::MORPH_OPEN, cv::MORPH_CLOSE};
+  const BitMorphOp kBitOps[] = {BIT_ERODE, BIT_DILATE, BIT_OPEN, BIT_CLOSE};
+  const char *kNames[] = {"erode", "dilate", "open", "close"};
+  const int kKernels[] = {3, 5, 7, 15};
+  const int kRepeats = 50;
+  cv::RNG rng(686);
+  cv::Mat noise, mask, expected, actual;
+  BitMask bits, temp, result;
+  int differing_cases = 0;
+  for (auto size : kSizes) {
+    for (auto density : kDensities) {
+      noise.create(size, CV_8UC1);
+      rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+      cv::compare(noise, 256 * density, mask, cv::CMP_LT);
+      bits.fromMat(mask);
+      for (int op = 0; op < 4; ++op) {
+        for (auto kernel_size : kKernels) {
+          cv::Mat kernel = cv::getStructuringElement(
+              cv::MORPH_RECT, cv::Size(kernel_size, kernel_size));
+          int64_t start = getTimeNs();
+          for (int i = 0; i < kRepeats; ++i) {
+            cv::morphologyEx(mask, expected, kMorphTypes[op], kernel);
+          }
+          int64_t opencv_ns = (getTimeNs() - start) / kRepeats;
+          start = getTimeNs();
+          for (int i = 0; i < kRepeats; ++i) {
+            morphBits(bits, kBitOps[op], kernel_size, &temp, &result);
+          }
+          int64_t bit_ns = (getTimeNs() - start) / kRepeats;
+          result.toMat(&actual);
+          bool differs = cv::countNonZero(expected != actual) != 0;
+          differing_cases += differs;
+          printf("%dx%d density %.2f %-6s %2d: opencv %.3f ms bits %.3f ms "
+                 "(%.1fx)%s\n",
+                 size.width, size.height, density, kNames[op], kernel_size,
+                 opencv_ns / 1e6, bit_ns / 1e6,
+                 bit_ns > 0 ? static_cast<double>(opencv_ns) / bit_ns : 0.0,
+                 differs ? " DIFFERS" : "");
+        }
+      }
+    }
+  }
+  return differing_cases == 0 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+// Checks BitMask packing, counting and morphology against byte-per-pixel
+// brute force and against cv::morphologyEx, on random masks of ragged
+// widths and a few densities.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "bit_mask.h"
+#include "test_util.h"
+
+namespace {
+
+struct Size {
+  int width;
+  int height;
+};
+
+const Size kSizes[] = {{1, 1}, {63, 5}, {64, 9}, {65, 17}, {200, 31},
+                       {637, 101}};
+const double kDensities[] = {0.05, 0.5, 0.95};
+const int kKernels[] = {1, 2, 3, 4, 5, 7, 15, 63};
+const BitMorphOp kOps[] = {BIT_ERODE, BIT_DILATE, BIT_OPEN, BIT_CLOSE};
+const int kMorphTypes[] = {cv::MORPH_ERODE, cv::MORPH_DILATE, cv::MORPH_OPEN,
+                           cv::MORPH_CLOSE};
+
+uint32_t sRandom = 686;
+
+double nextRandom() {
+  sRandom = sRandom * 1664525u + 1013904223u;
+  return (sRandom >> 8) / 16777216.0;
+}
+
+cv::Mat randomMask(const Size &size, double density) {
+  cv::Mat mask(size.height, size.width, CV_8UC1);
+  for (int y = 0; y < mask.rows; ++y) {
+    for (int x = 0; x < mask.cols; ++x) {
+      mask.at<uint8_t>(y, x) = nextRandom() < density ? 255 : 0;
+    }
+  }
+  return mask;
+}
+
+// Min or max over the size x size square anchored at its centre, skipping
+// pixels outside the mask as OpenCV's default border does
+cv::Mat bruteMorph(const cv::Mat &src, bool erode, int size) {
+  cv::Mat dst(src.rows, src.cols, CV_8UC1);
+  int first = -(size / 2);
+  for (int y = 0; y < src.rows; ++y) {
+    for (int x = 0; x < src.cols; ++x) {
+      uint8_t value = erode ? 255 : 0;
+      for (int dy = first; dy < first + size; ++dy) {
+        for (int dx = first; dx < first + size; ++dx) {
+          int sy = y + dy, sx = x + dx;
+          if (sy < 0 || sy >= src.rows || sx < 0 || sx >= src.cols) {
+            continue;
+          }
+          uint8_t pixel = src.at<uint8_t>(sy, sx);
+          value = erode ? std::min(value, pixel) : std::max(value, pixel);
+        }
+      }
+      dst.at<uint8_t>(y, x) = value;
+    }
+  }
+  return dst;
+}
+
+cv::Mat bruteMorph(const cv::Mat &src, BitMorphOp op, int size) {
+  switch (op) {
+  case BIT_ERODE:
+    return bruteMorph(src, true, size);
+  case BIT_DILATE:
+    return bruteMorph(src, false, size);
+  case BIT_OPEN:
+    return bruteMorph(bruteMorph(src, true, size), false, size);
+  case BIT_CLOSE:
+    break;
+  }
+  return bruteMorph(bruteMorph(src, false, size), true, size);
+}
+
+int differingPixels(const cv::Mat &a, const cv::Mat &b) {
+  int differing = 0;
+  for (int y = 0; y < a.rows; ++y) {
+    for (int x = 0; x < a.cols; ++x) {
+      differing += a.at<uint8_t>(y, x) != b.at<uint8_t>(y, x);
+    }
+  }
+  return differing;
+}
+
+void testPackAndCount() {
+  for (auto size : kSizes) {
+    cv::Mat mask = randomMask(size, 0.5);
+    BitMask bits;
+    bits.fromMat(mask);
+    cv::Mat unpacked;
+    bits.toMat(&unpacked);
+    CHECK(differingPixels(mask, unpacked) == 0);
+
+    int64_t total = 0;
+    for (int y = 0; y < mask.rows; ++y) {
+      for (int x = 0; x < mask.cols; ++x) {
+        total += mask.at<uint8_t>(y, x) != 0;
+      }
+      // Bits past the width stay clear
+      int tail = size.width % 64;
+      if (tail != 0) {
+        CHECK((bits.row(y)[bits.wordsPerRow() - 1] >> tail) == 0);
+      }
+    }
+    CHECK(bits.count() == total);
+
+    cv::Rect rect(size.width / 3, size.height / 4, size.width / 2 + 1,
+                  size.height / 2 + 1);
+    int64_t in_rect = 0;
+    for (int y = rect.y; y < std::min(rect.y + rect.height, size.height);
+         ++y) {
+      for (int x = rect.x; x < std::min(rect.x + rect.width, size.width);
+           ++x) {
+        in_rect += mask.at<uint8_t>(y, x) != 0;
+      }
+    }
+    CHECK(bits.count(rect) == in_rect);
+    CHECK(bits.count(cv::Rect(-10, -10, 5, 5)) == 0);
+  }
+}
+
+// Every operation, kernel, size and density against brute force, then
+// against OpenCV itself
+void testMorphology(bool against_opencv) {
+  BitMask bits, temp, result;
+  cv::Mat actual;
+  int cases = 0, failures = 0;
+  for (auto size : kSizes) {
+    for (auto density : kDensities) {
+      cv::Mat mask = randomMask(size, density);
+      bits.fromMat(mask);
+      for (int op = 0; op < 4; ++op) {
+        for (auto kernel_size : kKernels) {
+          // Brute force with the largest kernel is slow on the big mask
+          if (!against_opencv && kernel_size > 15 &&
+              size.width * size.height > 10000) {
+            continue;
+          }
+          cv::Mat expected;
+          if (against_opencv) {
+            cv::morphologyEx(mask, expected, kMorphTypes[op],
+                             cv::getStructuringElement(
+                                 cv::MORPH_RECT,
+                                 cv::Size(kernel_size, kernel_size)));
+          } else {
+            expected = bruteMorph(mask, kOps[op], kernel_size);
+          }
+          morphBits(bits, kOps[op], kernel_size, &temp, &result);
+          result.toMat(&actual);
+          cases++;
+          if (differingPixels(expected, actual) != 0) {
+            if (failures++ < 5) {
+              fprintf(stderr, "%dx%d density %.2f op %d kernel %d differs\n",
+                      size.width, size.height, density, op, kernel_size);
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("%s: %d of %d cases differ\n",
+         against_opencv ? "opencv" : "brute force", failures, cases);
+  CHECK(failures == 0);
+}
+
+} // namespace
+
+int main() {
+  testPackAndCount();
+  testMorphology(false);
+  testMorphology(true);
+  return testResult("bit_mask_test");
+}
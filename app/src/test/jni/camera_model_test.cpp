@@ -0,0 +1,142 @@
+// Checks cameraNormalize() against cv::undistortPoints() over the image,
+// that it inverts cameraProject(), and that cameraModel() keeps the
+// calibrated field of view at other resolutions and crops it at other
+// aspect ratios rather than stretching it.
+
+#include <math.h>
+
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "camera_model.h"
+#include "test_util.h"
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const double kFocalLength = 520;
+
+// A phone lens with some barrel distortion and a slightly off-centre axis
+CameraModel distortedModel() {
+  CameraModel model = pinholeCameraModel(kWidth, kHeight, kFocalLength);
+  model.fy = 524;
+  model.cx = 322.5;
+  model.cy = 236.0;
+  const double coefficients[5] = {-0.12, 0.05, 0.001, -0.0008, -0.01};
+  for (int i = 0; i < 5; ++i) {
+    model.distortion[i] = coefficients[i];
+  }
+  model.distorted = true;
+  return model;
+}
+
+// Pixels on a grid over the whole image, edges included
+std::vector<cv::Point2d> gridPixels() {
+  std::vector<cv::Point2d> pixels;
+  for (int y = 0; y <= 8; ++y) {
+    for (int x = 0; x <= 8; ++x) {
+      pixels.push_back(
+          cv::Point2d(x * (kWidth - 1) / 8.0, y * (kHeight - 1) / 8.0));
+    }
+  }
+  return pixels;
+}
+
+void testUndistortPoints() {
+  CameraModel model = distortedModel();
+  double camera_matrix[9] = {model.fx, 0, model.cx, 0, model.fy,
+                             model.cy, 0, 0,        1};
+  cv::Mat camera(3, 3, CV_64F, camera_matrix);
+  cv::Mat distortion(1, 5, CV_64F, model.distortion);
+  std::vector<cv::Point2d> pixels = gridPixels();
+  std::vector<cv::Point2d> expected;
+  cv::undistortPoints(pixels, expected, camera, distortion);
+  CHECK(expected.size() == pixels.size());
+  for (size_t i = 0; i < pixels.size() && i < expected.size(); ++i) {
+    cv::Point2d normalized = cameraNormalize(model, pixels[i]);
+    // OpenCV stops after fewer iterations, which leaves it this close
+    CHECK_NEAR(normalized.x, expected[i].x, 1e-4);
+    CHECK_NEAR(normalized.y, expected[i].y, 1e-4);
+    // and projecting the result gives the pixel back
+    cv::Point2d pixel = cameraProject(
+        model, cv::Point3d(normalized.x, normalized.y, 1));
+    CHECK_NEAR(pixel.x, pixels[i].x, 1e-3);
+    CHECK_NEAR(pixel.y, pixels[i].y, 1e-3);
+  }
+}
+
+// Angles from the optical axis to the outer edges of the image's first
+// column and row
+double horizontalEdge(const CameraModel &model) {
+  PointAngles angles;
+  cameraPointAngles(model, cv::Point2d(-.5, model.cy), &angles);
+  return angles.h_angle;
+}
+
+double verticalEdge(const CameraModel &model) {
+  PointAngles angles;
+  cameraPointAngles(model, cv::Point2d(model.cx, -.5), &angles);
+  return angles.v_angle;
+}
+
+void testFieldOfView() {
+  cameraSetPinhole(kWidth, kHeight, kFocalLength);
+  const double half_h = atan((kWidth / 2.0) / kFocalLength);
+  const double half_v = atan((kHeight / 2.0) / kFocalLength);
+
+  CameraModel model = cameraModel(kWidth, kHeight);
+  CHECK_NEAR(horizontalEdge(model), half_h, 1e-9);
+  CHECK_NEAR(verticalEdge(model), half_v, 1e-9);
+
+  // Same aspect ratio: the same field of view
+  const int same_aspect[][2] = {{320, 240}, {1280, 960}, {160, 120}};
+  for (auto &size : same_aspect) {
+    model = cameraModel(size[0], size[1]);
+    CHECK(model.width == size[0] && model.height == size[1]);
+    CHECK_NEAR(model.fx, model.fy, 1e-9);
+    CHECK_NEAR(horizontalEdge(model), half_h, 1e-9);
+    CHECK_NEAR(verticalEdge(model), half_v, 1e-9);
+  }
+
+  // 16:9 crops rows off the 4:3 image: the width still spans the whole
+  // field, the height three quarters of it
+  model = cameraModel(1280, 720);
+  CHECK_NEAR(model.fx, 2 * kFocalLength, 1e-9);
+  CHECK_NEAR(model.fy, 2 * kFocalLength, 1e-9);
+  CHECK_NEAR(model.cx, 639.5, 1e-9);
+  CHECK_NEAR(model.cy, 359.5, 1e-9);
+  CHECK_NEAR(horizontalEdge(model), half_h, 1e-9);
+  CHECK_NEAR(verticalEdge(model), atan(180 / kFocalLength), 1e-9);
+
+  // 1:1 crops columns instead
+  model = cameraModel(480, 480);
+  CHECK_NEAR(model.fx, kFocalLength, 1e-9);
+  CHECK_NEAR(horizontalEdge(model), atan(240 / kFocalLength), 1e-9);
+  CHECK_NEAR(verticalEdge(model), half_v, 1e-9);
+
+  // A target at the image centre stays at the centre of the crop
+  PointAngles angles;
+  cameraPointAngles(model, cv::Point2d(239.5, 239.5), &angles);
+  CHECK_NEAR(angles.h_angle, 0, 1e-9);
+  CHECK_NEAR(angles.v_angle, 0, 1e-9);
+}
+
+// With distortion the edge of the image is where the lens puts it, not
+// where the focal length alone would
+void testDistortedEdge() {
+  CameraModel model = distortedModel();
+  cv::Point2d edge = cameraNormalize(model, cv::Point2d(-.5, model.cy));
+  CHECK(fabs(edge.x) > (model.cx + .5) / model.fx);
+  CHECK_NEAR(horizontalEdge(model), atan(-edge.x), 1e-9);
+}
+
+} // namespace
+
+int main() {
+  testUndistortPoints();
+  testFieldOfView();
+  testDistortedEdge();
+  return testResult("camera_model_test");
+}
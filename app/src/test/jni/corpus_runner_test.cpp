@@ -0,0 +1,145 @@
+// Runs one manifest through CorpusRunner on one worker and on four and
+// checks that every frame slot comes out the same, whichever worker took
+// its shard: synthetic entries, one of them interlaced and one with tiles,
+// a mask recording long enough to be split into two shards, and an entry
+// whose target never fits in view so none of its frames count. The report
+// has to give the frames that were run, not the slots.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "corpus_runner.h"
+#include "frame_recorder.h"
+#include "pipeline_plan.h"
+#include "recording_reader.h"
+#include "test_util.h"
+
+namespace {
+
+// Over one shard, so the recording is split
+const int kRecordedFrames = CorpusRunner::kShardFrames + 40;
+// Gives the writer thread time to drain, so few frames are dropped
+const useconds_t kRecordIntervalUs = 2000;
+// Small frames keep the recording and the run short
+const char kSceneSize[] = "width=160 height=120";
+
+std::string tempDir() {
+  std::string dir = "/tmp/corpus_runner_test-" + std::to_string(getpid());
+  CHECK(system(("mkdir -p '" + dir + "'").c_str()) == 0);
+  return dir;
+}
+
+// Records seeded synthetic frames, with their masks and rendered targets.
+// Returns the number of records.
+size_t record(const std::string &path) {
+  std::vector<GoldenEntry> entries;
+  std::string spec = std::string("synthetic seed=41 ") + kSceneSize;
+  CHECK(parseGoldenManifest(spec.c_str(), ".", &entries));
+  SyntheticFrames frames(entries[0]);
+  PipelinePlan plan;
+  DetectionOptions options;
+  cv::Mat rgba, mask;
+  DetectionResult detection;
+  std::vector<TargetInfo> expected;
+
+  FrameRecorder recorder;
+  CHECK(recorder.start(path.c_str(), kRecordedFrames, RECORDING_MASK_RLE));
+  for (int i = 0; i < kRecordedFrames; ++i) {
+    if (!frames.next(&rgba, &expected)) {
+      continue;
+    }
+    detectTargets(rgba, frames.threshold(), options, &plan, i, &mask,
+                  &detection);
+    recorder.record(i, &rgba, mask, 1, frames.threshold(), expected);
+    usleep(kRecordIntervalUs);
+  }
+  recorder.stop();
+
+  RecordingReader reader;
+  CHECK(reader.open(path.c_str()));
+  return reader.size();
+}
+
+bool sameFrame(const CorpusFrame &a, const CorpusFrame &b) {
+  if (a.valid != b.valid) {
+    return false;
+  }
+  return !a.valid ||
+         (a.sequence == b.sequence && a.targets == b.targets &&
+          a.expected_targets == b.expected_targets &&
+          a.diverged == b.diverged);
+}
+
+std::string firstLine(const std::string &path) {
+  char line[256] = "";
+  FILE *file = fopen(path.c_str(), "r");
+  CHECK(file != NULL);
+  if (file != NULL) {
+    CHECK(fgets(line, sizeof(line), file) != NULL);
+    fclose(file);
+  }
+  return line;
+}
+
+void testWorkersAgree(const std::string &dir) {
+  std::string recording = dir + "/long_mask.rec";
+  size_t recorded = record(recording);
+  CHECK(recorded > CorpusRunner::kShardFrames);
+
+  std::string size = kSceneSize;
+  std::string manifest = "synthetic seed=1 frames=30 " + size + "\n" +
+                         "synthetic seed=2 frames=30 interlace=1 " + size +
+                         "\n" + "synthetic seed=3 frames=30 tiles=8 " +
+                         size + "\n" + "long_mask.rec tolerance=2\n" +
+                         // Too short a frame for the U at any range
+                         "synthetic seed=4 frames=10 width=640 height=8\n";
+  std::vector<GoldenEntry> entries;
+  CHECK(parseGoldenManifest(manifest.c_str(), dir.c_str(), &entries));
+  CHECK(entries.size() == 5);
+
+  CorpusRunner one(entries), four(entries);
+  CHECK(one.run(1));
+  CHECK(four.run(4));
+  const std::vector<CorpusFrame> &a = one.frames();
+  const std::vector<CorpusFrame> &b = four.frames();
+  CHECK(a.size() == 90 + recorded + 10);
+  CHECK(a.size() == b.size());
+  int mismatched = 0;
+  for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+    mismatched += sameFrame(a[i], b[i]) ? 0 : 1;
+  }
+  CHECK(mismatched == 0);
+
+  // Every recorded frame was read, in order across the shard boundary
+  const size_t first = 90;
+  for (size_t i = 1; i < recorded; ++i) {
+    CHECK(b[first + i].valid);
+    CHECK(b[first + i].sequence > b[first + i - 1].sequence);
+  }
+  CHECK(four.stats(4).frames == 0);
+  CHECK(one.validFrames() == four.validFrames());
+  CHECK(four.validFrames() <= static_cast<int>(b.size()) - 10);
+
+  std::string report = dir + "/report.txt";
+  FILE *file = fopen(report.c_str(), "w");
+  CHECK(file != NULL);
+  if (file != NULL) {
+    four.writeReport(file, 5);
+    fclose(file);
+  }
+  std::string expected = std::to_string(four.validFrames()) + " frames in ";
+  CHECK(firstLine(report).compare(0, expected.size(), expected) == 0);
+}
+
+} // namespace
+
+int main() {
+  std::string dir = tempDir();
+  testWorkersAgree(dir);
+  CHECK(system(("rm -rf '" + dir + "'").c_str()) == 0);
+  return testResult("corpus_runner_test");
+}
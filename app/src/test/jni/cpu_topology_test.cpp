@@ -0,0 +1,182 @@
+// Loads CpuTopology from fake sysfs CPU trees and checks the big and little
+// cores, the default placement and placement parsing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "cpu_topology.h"
+#include "test_util.h"
+
+namespace {
+
+struct FakeCpu {
+  int id;
+  // -1 leaves the online file out, as for cpu0
+  int online;
+  // 0 leaves cpu_capacity out
+  int capacity;
+  int max_freq_khz;
+};
+
+void writeFile(const std::string &path, const std::string &contents) {
+  FILE *file = fopen(path.c_str(), "w");
+  CHECK(file != NULL);
+  if (file != NULL) {
+    fputs(contents.c_str(), file);
+    fclose(file);
+  }
+}
+
+// A tree like /sys/devices/system/cpu, with the entries the loader has to
+// skip next to the cpuN directories
+std::string makeTree(const char *name, const std::vector<FakeCpu> &cpus) {
+  std::string root = std::string("/tmp/cpu_topology_test-") + name + "-" +
+                     std::to_string(getpid());
+  mkdir(root.c_str(), 0755);
+  mkdir((root + "/cpufreq").c_str(), 0755);
+  mkdir((root + "/cpuidle").c_str(), 0755);
+  writeFile(root + "/possible", "0-7\n");
+  writeFile(root + "/online", "0-7\n");
+  for (auto &cpu : cpus) {
+    std::string dir = root + "/cpu" + std::to_string(cpu.id);
+    mkdir(dir.c_str(), 0755);
+    if (cpu.online >= 0) {
+      writeFile(dir + "/online", std::to_string(cpu.online) + "\n");
+    }
+    if (cpu.capacity > 0) {
+      writeFile(dir + "/cpu_capacity", std::to_string(cpu.capacity) + "\n");
+    }
+    if (cpu.max_freq_khz > 0) {
+      mkdir((dir + "/cpufreq").c_str(), 0755);
+      writeFile(dir + "/cpufreq/cpuinfo_max_freq",
+                std::to_string(cpu.max_freq_khz) + "\n");
+    }
+  }
+  return root;
+}
+
+void removeTree(const std::string &root) {
+  std::string command = "rm -rf '" + root + "'";
+  CHECK(system(command.c_str()) == 0);
+}
+
+std::vector<int> cores(std::initializer_list<int> ids) {
+  return std::vector<int>(ids);
+}
+
+// Four little cores, three mid cores with one of them offline and a prime
+// core, described by cpu_capacity; the mid cores are close enough to the
+// prime to count as big
+void testCapacity() {
+  std::string root = makeTree(
+      "capacity", {{0, -1, 446, 1800000}, {1, 1, 446, 1800000},
+                   {2, 1, 446, 1800000}, {3, 1, 446, 1800000},
+                   {4, 1, 871, 2400000}, {5, 0, 871, 2400000},
+                   {6, 1, 871, 2400000}, {7, 1, 1024, 2840000}});
+  CpuTopology topology;
+  CHECK(topology.load(root));
+  CHECK(topology.cpus().size() == 8);
+  CHECK(topology.cpus()[0].id == 0 && topology.cpus()[0].online);
+  CHECK(!topology.cpus()[5].online);
+  CHECK(topology.cpus()[7].capacity == 1024);
+  CHECK(topology.bigCores() == cores({4, 6, 7}));
+  CHECK(topology.littleCores() == cores({0, 1, 2, 3}));
+
+  ThreadPlacement placement = defaultThreadPlacement(topology);
+  CHECK(placement.cpus[THREAD_VISION] == cores({4, 6, 7}));
+  CHECK(placement.cpus[THREAD_WORKER] == cores({0, 1, 2, 3}));
+  CHECK(placement.cpus[THREAD_BACKGROUND] == cores({0, 1, 2, 3}));
+  CHECK(!placement.set_nice[THREAD_VISION]);
+  removeTree(root);
+}
+
+// No cpu_capacity, so cpuinfo_max_freq ranks the cores; a third cluster
+// between the two keeps the worker off the big cores without being little
+void testFrequencyOnly() {
+  std::string root = makeTree(
+      "freq", {{0, -1, 0, 1000000}, {1, 1, 0, 1000000}, {2, 1, 0, 1500000},
+               {3, 1, 0, 1500000}, {4, 1, 0, 2200000}, {5, 1, 0, 2200000}});
+  CpuTopology topology;
+  CHECK(topology.load(root));
+  CHECK(topology.cpus()[2].capacity == 1500000);
+  CHECK(topology.bigCores() == cores({4, 5}));
+  CHECK(topology.littleCores() == cores({0, 1}));
+  ThreadPlacement placement = defaultThreadPlacement(topology);
+  CHECK(placement.cpus[THREAD_WORKER] == cores({0, 1, 2, 3}));
+  removeTree(root);
+}
+
+// Every core alike: all of them are both big and little, and the worker
+// shares them with the vision thread since there is nowhere else
+void testHomogeneous() {
+  std::string root = makeTree(
+      "same", {{0, -1, 0, 2000000}, {1, 1, 0, 2000000}, {2, 1, 0, 2000000},
+               {3, 1, 0, 2000000}});
+  CpuTopology topology;
+  CHECK(topology.load(root));
+  CHECK(topology.bigCores() == cores({0, 1, 2, 3}));
+  CHECK(topology.littleCores() == cores({0, 1, 2, 3}));
+  ThreadPlacement placement = defaultThreadPlacement(topology);
+  CHECK(placement.cpus[THREAD_WORKER] == cores({0, 1, 2, 3}));
+  removeTree(root);
+}
+
+void testMissingTree() {
+  CpuTopology topology;
+  CHECK(!topology.load("/tmp/cpu_topology_test-does-not-exist"));
+  CHECK(topology.cpus().empty());
+  CHECK(topology.bigCores().empty());
+}
+
+void testParsing() {
+  std::string root = makeTree(
+      "parse", {{0, -1, 446, 0}, {1, 1, 446, 0}, {2, 1, 1024, 0},
+                {3, 1, 1024, 0}});
+  CpuTopology topology;
+  CHECK(topology.load(root));
+  ThreadPlacement placement = defaultThreadPlacement(topology);
+  CHECK(parseThreadPlacement("vision=little # swap\n"
+                             "worker=any background=1,3 worker_nice=5",
+                             topology, &placement));
+  CHECK(placement.cpus[THREAD_VISION] == cores({0, 1}));
+  CHECK(placement.cpus[THREAD_WORKER].empty());
+  CHECK(placement.cpus[THREAD_BACKGROUND] == cores({1, 3}));
+  CHECK(placement.set_nice[THREAD_WORKER]);
+  CHECK(placement.nice[THREAD_WORKER] == 5);
+  CHECK(!placement.set_nice[THREAD_VISION]);
+
+  const char *bad[] = {"vision=fast",   "vision=3-1",    "cpu=big",
+                       "vision",        "vision=1,,2",   "vision=",
+                       "worker_nice=x", "vision_nice=40"};
+  for (auto spec : bad) {
+    ThreadPlacement unchanged = placement;
+    CHECK(!parseThreadPlacement(spec, topology, &unchanged));
+    CHECK(unchanged.cpus[THREAD_VISION] == cores({0, 1}));
+    CHECK(unchanged.nice[THREAD_WORKER] == 5);
+  }
+
+  std::vector<int> cpus;
+  CHECK(parseCpuList("6,0-2,1", &cpus));
+  CHECK(cpus == cores({0, 1, 2, 6}));
+  CHECK(!parseCpuList("2-", &cpus));
+  CHECK(!parseCpuList("a", &cpus));
+  CHECK(cpus == cores({0, 1, 2, 6}));
+  removeTree(root);
+}
+
+} // namespace
+
+int main() {
+  testCapacity();
+  testFrequencyOnly();
+  testHomogeneous();
+  testMissingTree();
+  testParsing();
+  return testResult("cpu_topology_test");
+}
@@ -0,0 +1,58 @@
+// Per-call cost on the calling thread of a deferred log call, next to
+// formatting the same line with snprintf as LOGD does before writing it.
+// The drained lines go to /dev/null while the bench runs, so the result is
+// not buried under them.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "deferred_log.h"
+
+namespace {
+
+const int kCalls = 1000;
+const int kRounds = 200;
+
+} // namespace
+
+int main() {
+  fflush(stderr);
+  int saved_stderr = dup(STDERR_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (saved_stderr < 0 || null_fd < 0 || dup2(null_fd, STDERR_FILENO) < 0) {
+    perror("deferred_log_bench: /dev/null");
+    return 1;
+  }
+  close(null_fd);
+
+  volatile double x = 1.2345;
+  char buffer[256];
+  int64_t deferred_ns = 0, snprintf_ns = 0;
+  for (int round = 0; round < kRounds; ++round) {
+    int64_t start = getTimeNs();
+    for (int i = 0; i < kCalls; ++i) {
+      DLOGD("Found target at %.2lf, %.2lf...size %.2lf, %.2lf", x, x + i,
+            x, x);
+    }
+    deferred_ns += getTimeNs() - start;
+    // Drained outside the timed loop, as the background thread would
+    deferredLogFlush();
+
+    start = getTimeNs();
+    for (int i = 0; i < kCalls; ++i) {
+      snprintf(buffer, sizeof(buffer),
+               "Found target at %.2lf, %.2lf...size %.2lf, %.2lf", x, x + i,
+               x, x);
+    }
+    snprintf_ns += getTimeNs() - start;
+  }
+  fflush(stderr);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(saved_stderr);
+
+  double calls = static_cast<double>(kCalls) * kRounds;
+  printf("deferred: %.1f ns per call\n", deferred_ns / calls);
+  printf("snprintf: %.1f ns per call\n", snprintf_ns / calls);
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Checks that deferred log records format as printf would have formatted
+// the call, and that DLOG calls reach the log file once drained.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "deferred_log.h"
+#include "test_util.h"
+
+namespace {
+
+// Packs the arguments as DLOG_AT does and formats the record both ways
+template <typename... Args>
+void checkFormat(const char *format, Args... args) {
+  static LogSite site;
+  site.level = ANDROID_LOG_DEBUG;
+  site.format = format;
+  LogRecord record;
+  record.site = &site;
+  record.time_ns = 0;
+  record.num_args = sizeof...(Args);
+  deferred_log_detail::pack(&record, 0, args...);
+  char actual[256], expected[256];
+  deferredLogFormat(record, actual, sizeof(actual));
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-security"
+  snprintf(expected, sizeof(expected), format, args...);
+#pragma GCC diagnostic pop
+  if (strcmp(actual, expected) != 0) {
+    fprintf(stderr, "  \"%s\" formatted as \"%s\"\n", expected, actual);
+  }
+  CHECK(strcmp(actual, expected) == 0);
+}
+
+void testFormat() {
+  checkFormat("plain");
+  checkFormat("100%% done");
+  checkFormat("Found target at %.2lf, %.2lf...size %.2lf", 1.2345, -2.5,
+              3.0);
+  checkFormat("%d %u %ld %lu %lld %llu", -7, 7u, -70000L, 70000UL,
+              -(1LL << 40), 1ULL << 63);
+  checkFormat("%5d|%-5d|%05.1f|%x|%X|%o", 42, 42, 3.14159, 255, 255, 8);
+  checkFormat("%s stage, %e s, %g", "cvtColor", 1.5e-6, 0.0001);
+  checkFormat("%.3s|%10s", "truncated", "right");
+  // The float promotes to double, as through printf's varargs
+  checkFormat("%f", static_cast<double>(2.5f));
+}
+
+// Longer than the buffer: cut off, never overrun
+void testTruncation() {
+  static const LogSite site = {ANDROID_LOG_DEBUG, "%s and %s"};
+  LogRecord record;
+  record.site = &site;
+  record.num_args = 2;
+  deferred_log_detail::pack(&record, 0, "0123456789", "abcdefghij");
+  char buffer[12];
+  memset(buffer, 'x', sizeof(buffer));
+  int length = deferredLogFormat(record, buffer, sizeof(buffer));
+  CHECK(length == 11);
+  CHECK(strcmp(buffer, "0123456789 ") == 0);
+  CHECK(deferredLogFormat(record, buffer, 0) == 0);
+}
+
+void testFile() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/deferred_log_test-%d.log",
+           static_cast<int>(getpid()));
+  CHECK(deferredLogSetFile(path));
+  for (int i = 0; i < 3; ++i) {
+    DLOGI("frame %d took %.1f ms", i, 12.5 + i);
+  }
+  deferredLogFlush();
+  CHECK(deferredLogSetFile(NULL));
+
+  FILE *file = fopen(path, "r");
+  CHECK(file != NULL);
+  if (file == NULL) {
+    return;
+  }
+  std::string contents;
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    contents += line;
+  }
+  fclose(file);
+  unlink(path);
+  CHECK(contents.find("frame 0 took 12.5 ms") != std::string::npos);
+  CHECK(contents.find("frame 2 took 14.5 ms") != std::string::npos);
+}
+
+} // namespace
+
+int main() {
+  testFormat();
+  testTruncation();
+  testFile();
+  return testResult("deferred_log_test");
+}
@@ -0,0 +1,93 @@
+// Times the default pipeline's mask on synthetic 640x480 frames without and
+// with an exclusion mask: the spec file given as the first argument, or the
+// lights above the goal and the bumpers below it.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "exclusion_mask.h"
+#include "pipeline_plan.h"
+#include "scene_generator.h"
+
+namespace {
+
+const char kDefaultSpec[] = "rect x=0 y=0 width=1 height=0.333\n"
+                            "rect x=0 y=0.833 width=1 height=0.167\n";
+const int kFrames = 8;
+const int kPasses = 20;
+
+bool readFile(const char *path, std::string *contents) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return false;
+  }
+  char buffer[1024];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->append(buffer, count);
+  }
+  fclose(file);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string spec;
+  if (argc < 2) {
+    spec = kDefaultSpec;
+  } else if (!readFile(argv[1], &spec)) {
+    fprintf(stderr, "Cannot read %s\n", argv[1]);
+    return 1;
+  }
+  ExclusionMask mask;
+  if (!parseExclusionMask(spec.c_str(), &mask)) {
+    return 1;
+  }
+
+  SceneParams params;
+  params.format = SCENE_RGBA;
+  SceneGenerator generator(686);
+  CameraModel camera = pinholeCameraModel(params.width, params.height,
+                                          520.0 * params.width / 640);
+  std::vector<cv::Mat> frames(kFrames);
+  for (auto &frame : frames) {
+    SceneTruth truth;
+    generator.randomizePose(&params);
+    generator.render(params, camera, &frame, &truth);
+  }
+
+  std::vector<int> first;
+  std::vector<cv::Range> spans;
+  exclusionSpans(mask, cv::Size(params.width, params.height), &first, &spans);
+  int64_t included = 0;
+  for (auto &span : spans) {
+    included += span.size();
+  }
+
+  HsvThreshold threshold = sceneThreshold();
+  PipelinePlan plans[2];
+  plans[1].setExclusion(mask);
+  double frame_ms[2];
+  cv::Mat out;
+  for (int i = 0; i < 2; ++i) {
+    // The first frame allocates
+    plans[i].buildMask(frames[0], threshold, 1, -1, 0, &out);
+    int64_t start = getTimeNs();
+    for (int pass = 0; pass < kPasses; ++pass) {
+      for (int f = 0; f < kFrames; ++f) {
+        plans[i].buildMask(frames[f], threshold, 1, -1, f, &out);
+      }
+    }
+    frame_ms[i] = (getTimeNs() - start) / 1e6 / (kPasses * kFrames);
+  }
+  printf("%dx%d frames, %.1f%% excluded\n", params.width, params.height,
+         100.0 - 100.0 * included / (params.width * params.height));
+  printf("no exclusion: %.3f ms per frame\n", frame_ms[0]);
+  printf("exclusion:    %.3f ms per frame (%.2fx)\n", frame_ms[1],
+         frame_ms[1] > 0 ? frame_ms[0] / frame_ms[1] : 0.0);
+  return 0;
+}
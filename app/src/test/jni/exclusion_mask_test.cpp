@@ -0,0 +1,110 @@
+// Checks exclusion mask parsing and the spans the threshold pass visits.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "exclusion_mask.h"
+#include "test_util.h"
+
+namespace {
+
+const char kBitmapPath[] = "/tmp/exclusion_mask_test.pgm";
+
+void testParse() {
+  ExclusionMask mask;
+  CHECK(parseExclusionMask("", &mask));
+  CHECK(mask.empty());
+  CHECK(parseExclusionMask("# lights\n"
+                           "rect x=0 y=0 width=1 height=0.25 # top\n"
+                           "\n"
+                           "rect x=0.5 y=0.5 width=0.25 height=0.25\n",
+                           &mask));
+  CHECK(mask.rects.size() == 2);
+  CHECK(mask.excludes(0.9, 0.1));
+  CHECK(mask.excludes(0.6, 0.6));
+  CHECK(!mask.excludes(0.2, 0.6));
+
+  const char *bad[] = {"rect x=0 y=0 width=1",
+                       "rect x=0 y=0 width=1.5 height=0.1",
+                       "rect x=-0.1 y=0 width=1 height=0.1",
+                       "rect x=0 y=0 width=1 height=0.1 depth=2",
+                       "rect x=0 y=0 width=1 height=nope",
+                       "circle x=0 y=0",
+                       "bitmap",
+                       "bitmap path=/nonexistent.pgm"};
+  for (auto spec : bad) {
+    ExclusionMask unchanged = mask;
+    CHECK(!parseExclusionMask(spec, &unchanged));
+    CHECK(unchanged.rects.size() == 2);
+  }
+}
+
+// A 4 x 2 bitmap with its top-right and bottom-left quarters set, stretched
+// over the frame
+void testBitmap() {
+  FILE *file = fopen(kBitmapPath, "wb");
+  CHECK(file != NULL);
+  if (file == NULL) {
+    return;
+  }
+  const unsigned char pixels[] = {0, 0, 255, 255, 255, 255, 0, 0};
+  fprintf(file, "P5\n# comment\n4 2\n255\n");
+  fwrite(pixels, 1, sizeof(pixels), file);
+  fclose(file);
+
+  ExclusionMask mask;
+  CHECK(parseExclusionMask("bitmap path=/tmp/exclusion_mask_test.pgm", &mask));
+  CHECK(mask.bitmap_width == 4 && mask.bitmap_height == 2);
+  CHECK(!mask.excludes(0.1, 0.1));
+  CHECK(mask.excludes(0.9, 0.1));
+  CHECK(mask.excludes(0.1, 0.9));
+  CHECK(!mask.excludes(0.9, 0.9));
+  // Two bitmaps are one too many
+  CHECK(!parseExclusionMask("bitmap path=/tmp/exclusion_mask_test.pgm\n"
+                            "bitmap path=/tmp/exclusion_mask_test.pgm",
+                            &mask));
+  remove(kBitmapPath);
+}
+
+// Each mask pixel is judged at its centre; spans cover exactly the pixels
+// that are not excluded
+void testSpans() {
+  ExclusionMask mask;
+  CHECK(parseExclusionMask("rect x=0 y=0 width=1 height=0.25\n"
+                           "rect x=0.25 y=0.5 width=0.5 height=0.5\n",
+                           &mask));
+  cv::Size size(16, 8);
+  std::vector<int> first;
+  std::vector<cv::Range> spans;
+  exclusionSpans(mask, size, &first, &spans);
+  CHECK(first.size() == 9);
+  for (int y = 0; y < size.height; ++y) {
+    for (int x = 0; x < size.width; ++x) {
+      bool in_span = false;
+      for (int i = first[y]; i < first[y + 1]; ++i) {
+        in_span |= x >= spans[i].start && x < spans[i].end;
+      }
+      bool excluded = mask.excludes((x + 0.5) / size.width,
+                                    (y + 0.5) / size.height);
+      CHECK(in_span != excluded);
+    }
+  }
+  // The top quarter has no spans, the bottom half two per row
+  CHECK(first[2] == 0);
+  CHECK(first[8] - first[4] == 8);
+
+  ExclusionMask none;
+  exclusionSpans(none, size, &first, &spans);
+  CHECK(spans.size() == 8);
+  CHECK(spans[0].start == 0 && spans[0].end == 16);
+}
+
+} // namespace
+
+int main() {
+  testParse();
+  testBitmap();
+  testSpans();
+  return testResult("exclusion_mask_test");
+}
@@ -0,0 +1,135 @@
+// Feeds FieldFusion the targets alternate fields find of a still target,
+// which have to fuse to the full frame's corners, and of targets that
+// moved, came from the same field twice or were reset, which must pass
+// through as the field found them.
+
+#include <vector>
+
+#include "field_fusion.h"
+#include "quad_fit.h"
+#include "target_filter.h"
+#include "test_util.h"
+
+namespace {
+
+// A target whose quad spans columns left..right and rows top..bottom
+TargetInfo target(int left, int top, int right, int bottom) {
+  QuadFit quad;
+  quad.corners[0] = cv::Point(left, top);
+  quad.corners[1] = cv::Point(right, top);
+  quad.corners[2] = cv::Point(right, bottom);
+  quad.corners[3] = cv::Point(left, bottom);
+  TargetInfo info;
+  makeTarget(quad, 1, &info);
+  return info;
+}
+
+bool sameCorners(const TargetInfo &a, const TargetInfo &b) {
+  return a.points == b.points && a.centroid_x == b.centroid_x &&
+         a.centroid_y == b.centroid_y && a.width == b.width &&
+         a.height == b.height;
+}
+
+// The target covers rows 101 to 140. The even field first meets it on
+// row 102 and last on 140, the odd one on 101 and 139; fused, the outer
+// rows of the two are the full frame's
+void testStillTargetFuses() {
+  const TargetInfo full = target(200, 101, 260, 140);
+  const TargetInfo even = target(200, 102, 260, 140);
+  const TargetInfo odd = target(200, 101, 260, 139);
+  FieldFusion fusion;
+
+  // Nothing to fuse with yet
+  std::vector<TargetInfo> targets(1, even);
+  fusion.fuse(0, 2, &targets);
+  CHECK(targets.size() == 1 && sameCorners(targets[0], even));
+
+  targets.assign(1, odd);
+  fusion.fuse(1, 2, &targets);
+  CHECK(targets.size() == 1 && sameCorners(targets[0], full));
+
+  // Fused against the previous field as found, not as fused
+  targets.assign(1, even);
+  fusion.fuse(0, 2, &targets);
+  CHECK(targets.size() == 1 && sameCorners(targets[0], full));
+}
+
+// Two targets, listed in a different order by each field, each fuse with
+// their own counterpart
+void testTargetsPairUp() {
+  FieldFusion fusion;
+  std::vector<TargetInfo> targets = {target(40, 50, 90, 80),
+                                     target(300, 61, 360, 100)};
+  fusion.fuse(0, 2, &targets);
+  targets = {target(300, 60, 360, 101), target(40, 51, 90, 81)};
+  fusion.fuse(1, 2, &targets);
+  CHECK(targets.size() == 2);
+  CHECK(sameCorners(targets[0], target(300, 60, 360, 101)));
+  CHECK(sameCorners(targets[1], target(40, 50, 90, 81)));
+}
+
+// Corners further apart than half a field row mean the target moved
+// between fields; its field's own corners are the latest answer
+void testMovingTargetStandsAlone() {
+  FieldFusion fusion;
+  std::vector<TargetInfo> targets(1, target(200, 102, 260, 140));
+  fusion.fuse(0, 2, &targets);
+  const TargetInfo moved_down = target(200, 105, 260, 143);
+  targets.assign(1, moved_down);
+  fusion.fuse(1, 2, &targets);
+  CHECK(sameCorners(targets[0], moved_down));
+
+  // Sideways by two columns is as much a move
+  const TargetInfo moved_right = target(202, 106, 262, 142);
+  targets.assign(1, moved_right);
+  fusion.fuse(0, 2, &targets);
+  CHECK(sameCorners(targets[0], moved_right));
+
+  // With decimation a field row is four camera rows, so a corner may be
+  // two rows off and still be the same target
+  FieldFusion decimated;
+  targets.assign(1, target(200, 104, 260, 140));
+  decimated.fuse(0, 4, &targets);
+  targets.assign(1, target(200, 102, 260, 138));
+  decimated.fuse(1, 4, &targets);
+  CHECK(sameCorners(targets[0], target(200, 102, 260, 140)));
+  targets.assign(1, target(200, 107, 260, 143));
+  decimated.fuse(0, 4, &targets);
+  CHECK(sameCorners(targets[0], target(200, 107, 260, 143)));
+}
+
+// The same field twice, as after a dropped frame, or a reset in between:
+// the previous targets sampled the same rows or are gone
+void testNoFusionAcrossSameFieldOrReset() {
+  const TargetInfo even = target(200, 102, 260, 140);
+  const TargetInfo odd = target(200, 101, 260, 139);
+  FieldFusion fusion;
+  std::vector<TargetInfo> targets(1, odd);
+  fusion.fuse(1, 2, &targets);
+  targets.assign(1, even);
+  fusion.fuse(1, 2, &targets);
+  CHECK(sameCorners(targets[0], even));
+
+  fusion.reset();
+  targets.assign(1, odd);
+  fusion.fuse(0, 2, &targets);
+  CHECK(sameCorners(targets[0], odd));
+
+  // A field with no targets leaves nothing to fuse with
+  targets.clear();
+  fusion.fuse(1, 2, &targets);
+  CHECK(targets.empty());
+  targets.assign(1, even);
+  fusion.fuse(0, 2, &targets);
+  CHECK(sameCorners(targets[0], even));
+}
+
+} // namespace
+
+int main() {
+  testStillTargetFuses();
+  testTargetsPairUp();
+  testMovingTargetStandsAlone();
+  testNoFusionAcrossSameFieldOrReset();
+  return testResult("field_fusion_test");
+}
@@ -0,0 +1,208 @@
+// Candidates per second through the final size, edge orientation and
+// fullness checks: the out-of-line if-block helpers they replaced, the
+// default chain with its thresholds compiled in, the tuned chain reading
+// them from the filter, and the checks called through function pointers.
+// Exits non-zero if any path disagrees with the old helpers.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "common.hpp"
+#include "filter_chain.h"
+
+namespace {
+
+const int kCandidates = 4096;
+const int kRounds = 500;
+
+// The helpers as they were in target_filter.cpp, kept out of line as they
+// were in their own translation unit
+__attribute__((noinline)) bool hasTargetSize(const TargetFilter &filter,
+                                             const TargetInfo &target) {
+  return target.width >= filter.min_width &&
+         target.width <= filter.max_width &&
+         target.height >= filter.min_height &&
+         target.height <= filter.max_height;
+}
+
+__attribute__((noinline)) bool
+hasTargetShape(const TargetFilter &filter,
+               const std::vector<cv::Point> &points) {
+  int num_nearly_horizontal_slope = 0;
+  int num_nearly_vertical_slope = 0;
+  bool last_edge_vertical = false;
+  for (size_t i = 0; i < 4; ++i) {
+    double dy = points[i].y - points[(i + 1) % 4].y;
+    double dx = points[i].x - points[(i + 1) % 4].x;
+    double slope = std::numeric_limits<double>::max();
+    if (dx != 0) {
+      slope = dy / dx;
+    }
+    if (std::abs(slope) <= filter.horizontal_slope &&
+        (i == 0 || last_edge_vertical)) {
+      last_edge_vertical = false;
+      num_nearly_horizontal_slope++;
+    } else if (std::abs(slope) >= filter.vertical_slope &&
+               (i == 0 || !last_edge_vertical)) {
+      last_edge_vertical = true;
+      num_nearly_vertical_slope++;
+    } else {
+      break;
+    }
+  }
+  return num_nearly_horizontal_slope == 2 || num_nearly_vertical_slope == 2;
+}
+
+__attribute__((noinline)) bool hasTargetFullness(const TargetFilter &filter,
+                                                 double area,
+                                                 double quad_area) {
+  double fullness = area / quad_area;
+  return fullness >= filter.min_fullness && fullness <= filter.max_fullness;
+}
+
+bool oldAccept(const TargetFilter &filter, const FilterCandidate &candidate) {
+  return hasTargetSize(filter, *candidate.target) &&
+         hasTargetShape(filter, candidate.target->points) &&
+         hasTargetFullness(filter, candidate.area, candidate.quad_area);
+}
+
+typedef CascadeStage (*Check)(const TargetFilter &, const FilterCandidate &);
+
+// All three checks through function pointers, as the runtime variant runs
+// whichever of them a filter leaves switched on
+CascadeStage runtimeReject(const std::vector<Check> &checks,
+                           const TargetFilter &filter,
+                           const FilterCandidate &candidate) {
+  for (auto check : checks) {
+    CascadeStage stage = check(filter, candidate);
+    if (stage != CASCADE_NUM_STAGES) {
+      return stage;
+    }
+  }
+  return CASCADE_NUM_STAGES;
+}
+
+// Jittered axis-aligned quads of random size and fullness, so every check
+// rejects some of them
+void makeCandidates(std::vector<TargetInfo> *targets,
+                    std::vector<FilterCandidate> *candidates) {
+  cv::RNG rng(686);
+  targets->resize(kCandidates);
+  candidates->resize(kCandidates);
+  for (int i = 0; i < kCandidates; ++i) {
+    int x = rng.uniform(0, 400), y = rng.uniform(0, 300);
+    int w = rng.uniform(1, 200), h = rng.uniform(1, 120);
+    int j[8];
+    for (auto &jitter : j) {
+      jitter = rng.uniform(-10, 11);
+    }
+    TargetInfo &target = (*targets)[i];
+    target.points = {cv::Point(x + j[0], y + j[1]),
+                     cv::Point(x + w + j[2], y + j[3]),
+                     cv::Point(x + w + j[4], y + h + j[5]),
+                     cv::Point(x + j[6], y + h + j[7])};
+    target.width = w;
+    target.height = h;
+    double quad_area = static_cast<double>(w) * h;
+    FilterCandidate candidate = {&target, quad_area * rng.uniform(0.0, 1.0),
+                                 quad_area};
+    (*candidates)[i] = candidate;
+  }
+}
+
+// Accepted candidates per round and Mcandidates/s of `accept`; counts
+// verdicts that differ from the old helpers in *mismatches
+template <typename Accept>
+void timeAccept(const char *name, const TargetFilter &filter,
+                const std::vector<FilterCandidate> &candidates, Accept accept,
+                int *mismatches) {
+  int accepted = 0;
+  for (auto &candidate : candidates) {
+    bool verdict = accept(candidate);
+    accepted += verdict;
+    *mismatches += verdict != oldAccept(filter, candidate);
+  }
+  volatile int sink = 0;
+  int64_t start = getTimeNs();
+  for (int round = 0; round < kRounds; ++round) {
+    int count = 0;
+    for (auto &candidate : candidates) {
+      count += accept(candidate);
+    }
+    sink += count;
+  }
+  int64_t elapsed = getTimeNs() - start;
+  printf("  %-8s %4d/%d accepted, %6.1f M candidates/s\n", name, accepted,
+         kCandidates, static_cast<double>(kRounds) * kCandidates * 1e3 /
+                          std::max<int64_t>(elapsed, 1));
+}
+
+} // namespace
+
+int main() {
+  std::vector<TargetInfo> targets;
+  std::vector<FilterCandidate> candidates;
+  makeCandidates(&targets, &candidates);
+
+  TargetFilter default_filter = defaultTargetFilter();
+  TargetFilter tuned_filter = default_filter;
+  tuned_filter.min_width = 21;
+  TargetFilter runtime_filter = default_filter;
+  runtime_filter.min_fullness = 0;
+  runtime_filter.max_fullness = INFINITY;
+  const TargetFilter *filters[] = {&default_filter, &tuned_filter,
+                                   &runtime_filter};
+  const char *names[] = {"default", "tuned", "no fullness"};
+
+  int mismatches = 0;
+  for (int k = 0; k < 3; ++k) {
+    const TargetFilter &filter = *filters[k];
+    TargetFilterChain chain(filter);
+    printf("%s filter:\n", names[k]);
+    timeAccept("old", filter, candidates,
+               [&](const FilterCandidate &c) { return oldAccept(filter, c); },
+               &mismatches);
+    timeAccept("chain", filter, candidates,
+               [&](const FilterCandidate &c) {
+                 return chain.reject(c) == CASCADE_NUM_STAGES;
+               },
+               &mismatches);
+  }
+
+  // The same default filter through each variant
+  printf("default filter by variant:\n");
+  timeAccept("default", default_filter, candidates,
+             [&](const FilterCandidate &c) {
+               return DefaultFilterChain::reject(default_filter, c) ==
+                      CASCADE_NUM_STAGES;
+             },
+             &mismatches);
+  timeAccept("tuned", default_filter, candidates,
+             [&](const FilterCandidate &c) {
+               return TunedFilterChain::reject(default_filter, c) ==
+                      CASCADE_NUM_STAGES;
+             },
+             &mismatches);
+  // Filled at run time so the calls stay indirect
+  std::vector<Check> checks;
+  checks.push_back(FilterChain<SizePolicy<FilterLimits>>::reject);
+  checks.push_back(FilterChain<EdgeOrientationPolicy<FilterLimits>>::reject);
+  checks.push_back(FilterChain<FullnessPolicy<FilterLimits>>::reject);
+  timeAccept("runtime", default_filter, candidates,
+             [&](const FilterCandidate &c) {
+               return runtimeReject(checks, default_filter, c) ==
+                      CASCADE_NUM_STAGES;
+             },
+             &mismatches);
+
+  if (mismatches != 0) {
+    printf("%d verdicts differ from the old helpers\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
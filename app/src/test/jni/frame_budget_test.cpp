@@ -0,0 +1,127 @@
+// Drives FrameBudget with synthetic capture, pickup and end times.
+
+#include <stdint.h>
+
+#include "frame_budget.h"
+#include "test_util.h"
+
+namespace {
+
+const int64_t kFrameNs = 33333333;
+const int64_t kMs = 1000000;
+
+// Runs one frame captured at frame * kFrameNs, picked up queue_ns later and
+// processed for processing_ns unless skipped; returns its degradations
+int runFrame(FrameBudget *budget, int frame, int64_t queue_ns,
+             int64_t processing_ns) {
+  int64_t capture_ns = frame * kFrameNs;
+  int degradations = budget->begin(capture_ns, capture_ns + queue_ns);
+  if (!(degradations & DEGRADE_SKIP_FRAME)) {
+    budget->end(capture_ns + queue_ns + processing_ns);
+  }
+  return degradations;
+}
+
+// A phone whose camera always hands frames over 120 ms after capture is
+// not falling behind: nothing is shed and the level stays at 0
+void testSteadyHighLatency() {
+  FrameBudget budget;
+  for (int frame = 0; frame < 300; ++frame) {
+    int degradations = runFrame(&budget, frame, 120 * kMs, 10 * kMs);
+    CHECK(degradations == DEGRADE_NONE);
+  }
+  CHECK(budget.level() == 0);
+}
+
+// A latency that settles higher than before moves the baseline without
+// shedding
+void testBaselineFollowsCamera() {
+  FrameBudget budget;
+  int frame = 0;
+  for (; frame < 100; ++frame) {
+    runFrame(&budget, frame, 40 * kMs, 10 * kMs);
+  }
+  for (int i = 0; i < 300; ++i, ++frame) {
+    CHECK(!(runFrame(&budget, frame, 95 * kMs, 10 * kMs) &
+            DEGRADE_SKIP_FRAME));
+  }
+  // Far above the old baseline, but only a frame behind the new one
+  CHECK(!(runFrame(&budget, frame++, 140 * kMs, 10 * kMs) &
+          DEGRADE_SKIP_FRAME));
+  CHECK(budget.level() == 0);
+}
+
+// Frames picked up a few frame periods later than usual are shed, and
+// consecutive shed frames raise the level like overruns
+void testBacklogShedsAndEscalates() {
+  FrameBudget budget;
+  int frame = 0;
+  for (; frame < 60; ++frame) {
+    runFrame(&budget, frame, 50 * kMs, 10 * kMs);
+  }
+  CHECK(runFrame(&budget, frame++, 150 * kMs, 10 * kMs) &
+        DEGRADE_SKIP_FRAME);
+  CHECK(budget.level() == 0);
+  CHECK(runFrame(&budget, frame++, 150 * kMs, 10 * kMs) &
+        DEGRADE_SKIP_FRAME);
+  CHECK(budget.level() == 1);
+  // Caught up again
+  CHECK(!(runFrame(&budget, frame++, 50 * kMs, 10 * kMs) &
+          DEGRADE_SKIP_FRAME));
+}
+
+// Processing over budget on consecutive frames raises the level; a run of
+// frames under half the budget lowers it again
+void testProcessingTime() {
+  FrameBudget budget;
+  int frame = 0;
+  runFrame(&budget, frame++, 50 * kMs, 30 * kMs);
+  CHECK(budget.level() == 0);
+  runFrame(&budget, frame++, 50 * kMs, 30 * kMs);
+  CHECK(budget.level() == 1);
+  CHECK(runFrame(&budget, frame++, 50 * kMs, 20 * kMs) ==
+        DEGRADE_SKIP_VISUALIZE);
+  CHECK(budget.processingNs() == 20 * kMs);
+  for (int i = 0; i < 29; ++i) {
+    runFrame(&budget, frame++, 50 * kMs, 5 * kMs);
+  }
+  CHECK(budget.level() == 1);
+  runFrame(&budget, frame++, 50 * kMs, 5 * kMs);
+  CHECK(budget.level() == 0);
+
+  // At the top level every other frame is skipped without counting either
+  // way
+  for (int i = 0; i < 2 * FrameBudget::kMaxLevel; ++i) {
+    runFrame(&budget, frame++, 50 * kMs, 30 * kMs);
+  }
+  CHECK(budget.level() == FrameBudget::kMaxLevel);
+  int skipped = 0;
+  for (int i = 0; i < 10; ++i) {
+    skipped += (runFrame(&budget, frame++, 50 * kMs, 15 * kMs) &
+                DEGRADE_SKIP_FRAME) != 0;
+  }
+  CHECK(skipped == 5);
+  CHECK(budget.level() == FrameBudget::kMaxLevel);
+}
+
+void testFloor() {
+  FrameBudget budget;
+  budget.setFloor(2);
+  int degradations = runFrame(&budget, 0, 50 * kMs, 5 * kMs);
+  CHECK(budget.level() == 2);
+  CHECK(degradations == (DEGRADE_SKIP_VISUALIZE | DEGRADE_CAP_CANDIDATES |
+                         DEGRADE_THERMAL));
+  budget.setFloor(0);
+  CHECK(runFrame(&budget, 1, 50 * kMs, 5 * kMs) == DEGRADE_NONE);
+}
+
+} // namespace
+
+int main() {
+  testSteadyHighLatency();
+  testBaselineFollowsCamera();
+  testBacklogShedsAndEscalates();
+  testProcessingTime();
+  testFloor();
+  return testResult("frame_budget_test");
+}
@@ -0,0 +1,128 @@
+// Vision thread cost per frame of FrameRecorder::record() on 640x480 frames,
+// raw and mask recordings, against copying the frame, mask and targets into
+// staging buffers as it used to. Frames are paced so the writer keeps up,
+// as it does at the camera's frame rate. Times are the calling thread's CPU
+// time, so a writer thread that preempts it on a small machine does not
+// count against record().
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "frame_recorder.h"
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const int kFrames = 300;
+const useconds_t kFrameIntervalUs = 5000;
+
+int64_t threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Timing {
+  double mean_us;
+  double p99_us;
+  double worst_us;
+};
+
+Timing summarize(std::vector<int64_t> *times_ns) {
+  Timing timing = {0, 0, 0};
+  if (times_ns->empty()) {
+    return timing;
+  }
+  int64_t total = 0;
+  for (auto time : *times_ns) {
+    total += time;
+  }
+  std::sort(times_ns->begin(), times_ns->end());
+  timing.mean_us = total / 1e3 / times_ns->size();
+  timing.p99_us = (*times_ns)[times_ns->size() * 99 / 100] / 1e3;
+  timing.worst_us = times_ns->back() / 1e3;
+  return timing;
+}
+
+void print(const char *name, Timing timing) {
+  printf("%-12s %7.1f us mean, %7.1f us p99, %7.1f us worst\n", name,
+         timing.mean_us, timing.p99_us, timing.worst_us);
+}
+
+std::vector<TargetInfo> makeTargets() {
+  std::vector<TargetInfo> targets(2);
+  for (auto &target : targets) {
+    target.centroid_x = 320;
+    target.centroid_y = 240;
+    target.width = 80;
+    target.height = 40;
+    target.points = {cv::Point(280, 220), cv::Point(360, 220),
+                     cv::Point(360, 260), cv::Point(280, 260)};
+  }
+  return targets;
+}
+
+// What record() did before it took the frame's buffer
+Timing timeCopies(const cv::Mat &rgba, const cv::Mat &mask,
+                  const std::vector<TargetInfo> &targets) {
+  cv::Mat staged_rgba, staged_mask;
+  std::vector<TargetInfo> staged_targets;
+  std::vector<int64_t> times_ns;
+  for (int n = 0; n < kFrames; ++n) {
+    int64_t start = threadCpuNs();
+    staged_targets = targets;
+    rgba.copyTo(staged_rgba);
+    mask.copyTo(staged_mask);
+    times_ns.push_back(threadCpuNs() - start);
+    usleep(kFrameIntervalUs);
+  }
+  return summarize(&times_ns);
+}
+
+Timing timeRecord(RecordingFormat format, const cv::Mat &mask,
+                  const std::vector<TargetInfo> &targets, int *queued) {
+  std::string path = "/tmp/frame_recorder_bench-" + std::to_string(getpid());
+  FrameRecorder recorder;
+  recorder.start(path.c_str(), 8, format);
+  HsvThreshold hsv = {55, 95, 100, 255, 100, 255};
+  cv::Mat rgba;
+  std::vector<int64_t> times_ns;
+  *queued = 0;
+  for (int n = 0; n < kFrames; ++n) {
+    // Stands in for glReadPixels() filling whichever buffer came back
+    rgba.create(kHeight, kWidth, CV_8UC4);
+    rgba = cv::Scalar(n, 128, 64, 255);
+    int64_t start = threadCpuNs();
+    *queued += recorder.record(n, &rgba, mask, 1, hsv, targets);
+    times_ns.push_back(threadCpuNs() - start);
+    usleep(kFrameIntervalUs);
+  }
+  recorder.stop();
+  unlink(path.c_str());
+  return summarize(&times_ns);
+}
+
+} // namespace
+
+int main() {
+  cv::Mat rgba(kHeight, kWidth, CV_8UC4, cv::Scalar(0, 128, 64, 255));
+  cv::Mat mask(kHeight, kWidth, CV_8UC1, cv::Scalar(0));
+  mask.rowRange(200, 280).colRange(280, 360) = cv::Scalar(255);
+  std::vector<TargetInfo> targets = makeTargets();
+
+  print("copy", timeCopies(rgba, mask, targets));
+  int queued;
+  Timing raw = timeRecord(RECORDING_RAW_RGBA, mask, targets, &queued);
+  print("record raw", raw);
+  printf("             %d/%d frames queued\n", queued, kFrames);
+  Timing masked = timeRecord(RECORDING_MASK_RLE, mask, targets, &queued);
+  print("record mask", masked);
+  printf("             %d/%d frames queued\n", queued, kFrames);
+  return 0;
+}
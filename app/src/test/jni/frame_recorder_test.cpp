@@ -0,0 +1,353 @@
+// Records frames through FrameRecorder's writer thread and reads them back
+// with RecordingReader: pixels, masks and targets come back as they went
+// in, in both formats and with decimated masks, the ring keeps the newest
+// records and version 1 recordings still read. A reader
+// refuses a record rewritten since it opened the file, and one racing the
+// recorder over a two-slot ring never accepts a torn record.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "frame_recorder.h"
+#include "recording_reader.h"
+#include "test_util.h"
+
+namespace {
+
+// Multiples of kColorSubsample
+const int kWidth = 64;
+const int kHeight = 48;
+const int kFrames = 10;
+// Lets the writer drain between frames, so none is dropped
+const useconds_t kRecordIntervalUs = 5000;
+const int64_t kWaitTimeoutNs = 5000000000LL;
+const int64_t kRaceNs = 500000000LL;
+
+std::string tempPath(const char *name) {
+  return std::string("/tmp/frame_recorder_test-") + name + "-" +
+         std::to_string(getpid());
+}
+
+// Frame n: channel 0 is n everywhere, so it survives the sub-sampled colour
+// of mask recordings; channel 1 varies across the frame
+void makeFrame(int n, int width, int height, cv::Mat *rgba) {
+  rgba->create(height, width, CV_8UC4);
+  for (int y = 0; y < height; ++y) {
+    uint8_t *row = rgba->ptr<uint8_t>(y);
+    for (int x = 0; x < width; ++x) {
+      row[4 * x] = static_cast<uint8_t>(n);
+      row[4 * x + 1] = static_cast<uint8_t>(x + 3 * y + n);
+      row[4 * x + 2] = static_cast<uint8_t>(x * y);
+      row[4 * x + 3] = 255;
+    }
+  }
+}
+
+// Runs of several lengths on every row, including rows that start set, on a
+// mask scale times smaller than the frame
+void makeMask(int n, int scale, cv::Mat *mask) {
+  mask->create(kHeight / scale, kWidth / scale, CV_8UC1);
+  for (int y = 0; y < mask->rows; ++y) {
+    uint8_t *row = mask->ptr<uint8_t>(y);
+    for (int x = 0; x < mask->cols; ++x) {
+      row[x] = (x * 7 + y * 3 + n) % 11 < 4 ? 255 : 0;
+    }
+  }
+}
+
+// n % 3 targets, and more than a record holds for frame 1
+std::vector<TargetInfo> makeTargets(int n) {
+  int count = n == 1 ? kMaxRecordedTargets + 2 : n % 3;
+  std::vector<TargetInfo> targets(count);
+  for (int i = 0; i < count; ++i) {
+    TargetInfo &target = targets[i];
+    target.centroid_x = n + i;
+    target.centroid_y = 0.5 * n;
+    target.width = 20 + i;
+    target.height = 10.25;
+    for (int p = 0; p < 4; ++p) {
+      target.points.push_back(cv::Point(n + p, i - p));
+    }
+  }
+  return targets;
+}
+
+HsvThreshold makeThreshold(int n) {
+  HsvThreshold hsv = {n, n + 1, n + 2, n + 3, n + 4, n + 5};
+  return hsv;
+}
+
+bool targetsEqual(const std::vector<TargetInfo> &a,
+                  const std::vector<TargetInfo> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].centroid_x != b[i].centroid_x ||
+        a[i].centroid_y != b[i].centroid_y || a[i].width != b[i].width ||
+        a[i].height != b[i].height || a[i].points != b[i].points) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool matsEqual(const cv::Mat &a, const cv::Mat &b) {
+  if (a.size() != b.size() || a.type() != b.type()) {
+    return false;
+  }
+  for (int y = 0; y < a.rows; ++y) {
+    if (memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every pixel of channel 0 equals value
+bool channelIs(const cv::Mat &rgba, int value) {
+  for (int y = 0; y < rgba.rows; ++y) {
+    const uint8_t *row = rgba.ptr<uint8_t>(y);
+    for (int x = 0; x < rgba.cols; ++x) {
+      if (row[4 * x] != value) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Records frames first to last - 1, one every kRecordIntervalUs
+void recordFrames(FrameRecorder *recorder, int first, int last,
+                  int mask_scale = 1) {
+  cv::Mat rgba, mask;
+  for (int n = first; n < last; ++n) {
+    makeFrame(n, kWidth, kHeight, &rgba);
+    makeMask(n, mask_scale, &mask);
+    const uint8_t *handed_over = rgba.data;
+    CHECK(recorder->record(n, &rgba, mask, mask_scale, makeThreshold(n),
+                           makeTargets(n)));
+    // The buffer went to the writer; we got another one back
+    CHECK(rgba.data != handed_over);
+    usleep(kRecordIntervalUs);
+  }
+}
+
+// Opens path once its newest record is `sequence`
+bool openAt(const std::string &path, uint64_t sequence,
+            RecordingReader *reader) {
+  int64_t deadline = getTimeNs() + kWaitTimeoutNs;
+  RecordedFrame frame;
+  while (getTimeNs() < deadline) {
+    if (access(path.c_str(), F_OK) == 0 && reader->open(path.c_str()) &&
+        reader->size() > 0 && reader->read(reader->size() - 1, &frame) &&
+        frame.sequence == sequence) {
+      return true;
+    }
+    usleep(1000);
+  }
+  return false;
+}
+
+// mask_scale as with decimation: the frame is still recorded in full
+void testRoundTrip(RecordingFormat format, int mask_scale) {
+  std::string path = tempPath("round-trip");
+  FrameRecorder recorder;
+  CHECK(recorder.start(path.c_str(), kFrames, format));
+  recordFrames(&recorder, 0, kFrames, mask_scale);
+  recorder.stop();
+
+  RecordingReader reader;
+  CHECK(reader.open(path.c_str()));
+  CHECK(reader.format() == format);
+  CHECK(reader.width() == kWidth && reader.height() == kHeight);
+  CHECK(reader.size() == static_cast<size_t>(kFrames));
+  RecordedFrame frame;
+  cv::Mat rgba, mask;
+  for (int n = 0; n < static_cast<int>(reader.size()); ++n) {
+    CHECK(reader.read(n, &frame));
+    CHECK(frame.sequence == static_cast<uint64_t>(n) + 1);
+    CHECK(frame.capture_time_ns == n);
+    CHECK(frame.mask_scale == mask_scale);
+    HsvThreshold hsv = makeThreshold(n);
+    CHECK(memcmp(&frame.hsv, &hsv, sizeof(hsv)) == 0);
+    std::vector<TargetInfo> targets = makeTargets(n);
+    targets.resize(std::min<size_t>(targets.size(), kMaxRecordedTargets));
+    CHECK(targetsEqual(frame.targets, targets));
+    makeFrame(n, kWidth, kHeight, &rgba);
+    if (format == RECORDING_RAW_RGBA) {
+      CHECK(matsEqual(frame.rgba, rgba));
+      CHECK(frame.mask.empty());
+    } else {
+      makeMask(n, mask_scale, &mask);
+      CHECK(matsEqual(frame.mask, mask));
+      CHECK(frame.rgba.size() == rgba.size() && channelIs(frame.rgba, n));
+    }
+  }
+  reader.close();
+  unlink(path.c_str());
+}
+
+// A ring of four slots keeps the last four of ten frames
+void testRing() {
+  std::string path = tempPath("ring");
+  FrameRecorder recorder;
+  CHECK(recorder.start(path.c_str(), 4, RECORDING_MASK_RLE));
+  recordFrames(&recorder, 0, kFrames);
+  recorder.stop();
+
+  RecordingReader reader;
+  CHECK(reader.open(path.c_str()));
+  CHECK(reader.size() == 4);
+  RecordedFrame frame;
+  for (size_t i = 0; i < reader.size(); ++i) {
+    CHECK(reader.read(i, &frame));
+    CHECK(frame.capture_time_ns == static_cast<int64_t>(kFrames - 4 + i));
+  }
+  reader.close();
+  unlink(path.c_str());
+}
+
+// A raw recording written before records had a mask scale
+void testVersion1() {
+  std::string path = tempPath("version1");
+  size_t header_size = recordHeaderSize(1);
+  uint32_t slot_size = recordingSlotSize(RECORDING_RAW_RGBA, kWidth, kHeight);
+  std::vector<uint8_t> file(kRecordingHeaderSize + slot_size);
+  RecordingFileHeader header = RecordingFileHeader();
+  memcpy(header.magic, kRecordingMagic, sizeof(kRecordingMagic));
+  header.version = 1;
+  header.format = RECORDING_RAW_RGBA;
+  header.width = kWidth;
+  header.height = kHeight;
+  header.slot_count = 1;
+  header.slot_size = slot_size;
+  header.next_sequence = 1;
+  memcpy(&file[0], &header, sizeof(header));
+  RecordHeader record = RecordHeader();
+  record.sequence = 1;
+  record.capture_time_ns = 7;
+  record.payload_size = kWidth * kHeight * 4;
+  uint8_t *slot = &file[kRecordingHeaderSize];
+  memcpy(slot, &record, header_size);
+  cv::Mat rgba;
+  makeFrame(7, kWidth, kHeight, &rgba);
+  memcpy(slot + header_size, rgba.data, record.payload_size);
+  FILE *out = fopen(path.c_str(), "wb");
+  CHECK(out != NULL);
+  if (out != NULL) {
+    fwrite(&file[0], 1, file.size(), out);
+    fclose(out);
+  }
+
+  RecordingReader reader;
+  CHECK(reader.open(path.c_str()));
+  RecordedFrame frame;
+  CHECK(reader.size() == 1 && reader.read(0, &frame));
+  CHECK(frame.capture_time_ns == 7 && frame.mask_scale == 1);
+  CHECK(matsEqual(frame.rgba, rgba));
+  reader.close();
+  unlink(path.c_str());
+}
+
+// A reader opened on a live two-slot ring: the record the third frame
+// overwrites no longer reads, the other one still does
+void testRewrittenSinceOpen() {
+  std::string path = tempPath("rewritten");
+  FrameRecorder recorder;
+  CHECK(recorder.start(path.c_str(), 2, RECORDING_RAW_RGBA));
+  recordFrames(&recorder, 0, 2);
+  RecordingReader reader;
+  CHECK(openAt(path, 2, &reader));
+  CHECK(reader.size() == 2);
+
+  recordFrames(&recorder, 2, 3);
+  RecordingReader later;
+  CHECK(openAt(path, 3, &later));
+  RecordedFrame frame;
+  CHECK(!reader.read(0, &frame));
+  CHECK(reader.read(1, &frame) && frame.capture_time_ns == 1);
+  recorder.stop();
+  reader.close();
+  later.close();
+  unlink(path.c_str());
+}
+
+bool consistent(const RecordedFrame &frame) {
+  int n = static_cast<int>(frame.capture_time_ns);
+  cv::Mat expected;
+  makeFrame(n, frame.rgba.cols, frame.rgba.rows, &expected);
+  std::vector<TargetInfo> targets = makeTargets(n);
+  targets.resize(std::min<size_t>(targets.size(), kMaxRecordedTargets));
+  return matsEqual(frame.rgba, expected) &&
+         targetsEqual(frame.targets, targets);
+}
+
+// The recorder rewrites both slots of a ring as fast as it can while the
+// reader copies records out of it: reads of a slot rewritten mid-copy have
+// to fail, and every record that reads has to be one whole frame
+void testRacingReader() {
+  const int kRaceWidth = 320, kRaceHeight = 240;
+  std::string path = tempPath("race");
+  FrameRecorder recorder;
+  CHECK(recorder.start(path.c_str(), 2, RECORDING_RAW_RGBA));
+  std::atomic<bool> done(false);
+  std::thread producer([&] {
+    cv::Mat rgba, mask;
+    for (int n = 0; !done.load(std::memory_order_relaxed); ++n) {
+      makeFrame(n, kRaceWidth, kRaceHeight, &rgba);
+      recorder.record(n, &rgba, mask, 1, makeThreshold(n), makeTargets(n));
+    }
+  });
+
+  int64_t accepted = 0, refused = 0, torn = 0;
+  RecordingReader reader;
+  RecordedFrame frame;
+  int64_t end = getTimeNs() + kRaceNs;
+  while (getTimeNs() < end) {
+    if (access(path.c_str(), F_OK) != 0 || !reader.open(path.c_str())) {
+      continue;
+    }
+    for (size_t i = 0; i < reader.size(); ++i) {
+      if (!reader.read(i, &frame)) {
+        refused++;
+      } else if (consistent(frame)) {
+        accepted++;
+      } else {
+        torn++;
+      }
+    }
+  }
+  done = true;
+  producer.join();
+  recorder.stop();
+  reader.close();
+  unlink(path.c_str());
+  printf("%lld records read, %lld refused, %lld torn\n", (long long)accepted,
+         (long long)refused, (long long)torn);
+  CHECK(accepted > 0);
+  CHECK(torn == 0);
+}
+
+} // namespace
+
+int main() {
+  testRoundTrip(RECORDING_RAW_RGBA, 1);
+  testRoundTrip(RECORDING_MASK_RLE, 1);
+  testRoundTrip(RECORDING_RAW_RGBA, 2);
+  testRoundTrip(RECORDING_MASK_RLE, 4);
+  testVersion1();
+  testRing();
+  testRewrittenSinceOpen();
+  testRacingReader();
+  return testResult("frame_recorder_test");
+}
@@ -0,0 +1,165 @@
+// Runs the checked-in golden manifest (golden/manifest.txt) through
+// goldenVerify(): synthetic entries plus a raw and a mask recording made
+// here from seeded scenes. Any diverging frame or any entry over its time
+// budget fails the test. Also checks that goldenVerify() notices targets
+// that moved and an entry over its budget, so a pass means something.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "frame_recorder.h"
+#include "golden_corpus.h"
+#include "pipeline_plan.h"
+#include "recording_reader.h"
+#include "test_util.h"
+
+namespace {
+
+// Relative to this directory, which the tests are run from
+const char kManifest[] = "golden/manifest.txt";
+const int kRecordedFrames = 12;
+// Gives the writer thread time to drain, so no frame is dropped
+const useconds_t kRecordIntervalUs = 20000;
+
+std::string tempDir() {
+  std::string dir = "/tmp/golden_corpus_test-" + std::to_string(getpid());
+  CHECK(system(("mkdir -p '" + dir + "'").c_str()) == 0);
+  return dir;
+}
+
+bool readFile(const std::string &path, std::string *contents) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == NULL) {
+    return false;
+  }
+  char buffer[1024];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->append(buffer, count);
+  }
+  fclose(file);
+  return true;
+}
+
+void writeFile(const std::string &path, const std::string &contents) {
+  FILE *file = fopen(path.c_str(), "w");
+  CHECK(file != NULL);
+  if (file != NULL) {
+    fputs(contents.c_str(), file);
+    fclose(file);
+  }
+}
+
+int countMatches(const std::string &text, const char *needle) {
+  int count = 0;
+  for (size_t at = text.find(needle); at != std::string::npos;
+       at = text.find(needle, at + 1)) {
+    count++;
+  }
+  return count;
+}
+
+// Records seeded synthetic frames with their rendered targets, moved right
+// by shift pixels, as the recorded ones. Returns the number of records.
+int record(const std::string &path, RecordingFormat format, uint64_t seed,
+           int shift) {
+  std::vector<GoldenEntry> entries;
+  std::string spec = "synthetic seed=" + std::to_string(seed);
+  CHECK(parseGoldenManifest(spec.c_str(), ".", &entries));
+  SyntheticFrames frames(entries[0]);
+  PipelinePlan plan;
+  DetectionOptions options;
+  cv::Mat rgba, mask;
+  DetectionResult detection;
+  std::vector<TargetInfo> expected;
+
+  FrameRecorder recorder;
+  CHECK(recorder.start(path.c_str(), kRecordedFrames, format));
+  int recorded = 0;
+  for (int i = 0; recorded < kRecordedFrames && i < 2 * kRecordedFrames;
+       ++i) {
+    if (!frames.next(&rgba, &expected)) {
+      continue;
+    }
+    for (auto &target : expected) {
+      target.centroid_x += shift;
+      for (auto &point : target.points) {
+        point.x += shift;
+      }
+    }
+    // The mask as the device would record it alongside the frame
+    detectTargets(rgba, frames.threshold(), options, &plan, i, &mask,
+                  &detection);
+    recorder.record(i, &rgba, mask, 1, frames.threshold(), expected);
+    recorded++;
+    usleep(kRecordIntervalUs);
+  }
+  recorder.stop();
+
+  RecordingReader reader;
+  CHECK(reader.open(path.c_str()));
+  CHECK(static_cast<int>(reader.size()) == recorded);
+  return recorded;
+}
+
+// The checked-in manifest, next to the recordings it names
+void testManifest(const std::string &dir) {
+  std::string manifest;
+  CHECK(readFile(kManifest, &manifest));
+  writeFile(dir + "/manifest.txt", manifest);
+  CHECK(record(dir + "/short_raw.rec", RECORDING_RAW_RGBA, 11, 0) > 0);
+  CHECK(record(dir + "/short_mask.rec", RECORDING_MASK_RLE, 12, 0) > 0);
+
+  std::vector<GoldenEntry> entries;
+  CHECK(loadGoldenManifest((dir + "/manifest.txt").c_str(), &entries));
+  CHECK(entries.size() == 6);
+  std::string report_path = dir + "/report.txt";
+  int failures = goldenVerify((dir + "/manifest.txt").c_str(),
+                              report_path.c_str());
+  CHECK(failures == 0);
+
+  std::string report;
+  CHECK(readFile(report_path, &report));
+  CHECK(countMatches(report, "DIVERGED") == 0);
+  CHECK(countMatches(report, " SLOW") == 0);
+  // One summary per entry, each over some frames
+  CHECK(countMatches(report, " frames, ") == static_cast<int>(entries.size()));
+  CHECK(countMatches(report, ": 0 frames, ") == 0);
+  if (failures != 0) {
+    fputs(report.c_str(), stderr);
+  }
+}
+
+// Targets recorded 5 pixels off diverge on every frame; an entry far over
+// a tiny baseline counts as one failure
+void testFailuresCounted(const std::string &dir) {
+  int recorded = record(dir + "/shifted.rec", RECORDING_MASK_RLE, 13, 5);
+  writeFile(dir + "/shifted.txt", "shifted.rec tolerance=2\n");
+  CHECK(goldenVerify((dir + "/shifted.txt").c_str(),
+                     (dir + "/report.txt").c_str()) == recorded);
+
+  writeFile(dir + "/slow.txt",
+            "synthetic seed=1 frames=5 baseline_ms=0.0001\n");
+  CHECK(goldenVerify((dir + "/slow.txt").c_str(),
+                     (dir + "/report.txt").c_str()) == 1);
+
+  writeFile(dir + "/missing.txt", "missing.rec\n");
+  CHECK(goldenVerify((dir + "/missing.txt").c_str(),
+                     (dir + "/report.txt").c_str()) == -1);
+  CHECK(goldenVerify((dir + "/none.txt").c_str(),
+                     (dir + "/report.txt").c_str()) == -1);
+}
+
+} // namespace
+
+int main() {
+  std::string dir = tempDir();
+  testManifest(dir);
+  testFailuresCounted(dir);
+  CHECK(system(("rm -rf '" + dir + "'").c_str()) == 0);
+  return testResult("golden_corpus_test");
+}
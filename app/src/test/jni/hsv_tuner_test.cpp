@@ -0,0 +1,190 @@
+// Checks HsvHistogram::count() against counting random labelled pixels one
+// by one over random boxes, that a box and its threshold take the same
+// pixels, and that searchHsvBox() finds the box target pixels were planted
+// in among background everywhere else.
+
+#include <stdint.h>
+
+#include <opencv2/core.hpp>
+
+#include "hsv_tuner.h"
+#include "test_util.h"
+
+namespace {
+
+const int kWidth = 200;
+const int kHeight = 150;
+// Bin widths in H, S and V levels
+const int kLevels[3] = {180 / HsvHistogram::kHueBins,
+                        256 / HsvHistogram::kSatBins,
+                        256 / HsvHistogram::kValBins};
+
+uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+int uniform(uint32_t *state, int low, int high) {
+  return low + static_cast<int>(nextRandom(state) % (high - low + 1));
+}
+
+bool inBox(const cv::Vec3b &pixel, const HsvBox &box) {
+  int h = pixel[0] / kLevels[0], s = pixel[1] / kLevels[1],
+      v = pixel[2] / kLevels[2];
+  return h >= box.h_min && h <= box.h_max && s >= box.s_min &&
+         s <= box.s_max && v >= box.v_min && v <= box.v_max;
+}
+
+bool inThreshold(const cv::Vec3b &pixel, const HsvThreshold &threshold) {
+  return pixel[0] >= threshold.h_min && pixel[0] <= threshold.h_max &&
+         pixel[1] >= threshold.s_min && pixel[1] <= threshold.s_max &&
+         pixel[2] >= threshold.v_min && pixel[2] <= threshold.v_max;
+}
+
+HsvBox randomBox(uint32_t *state) {
+  HsvBox box;
+  box.h_min = uniform(state, 0, HsvHistogram::kHueBins - 1);
+  box.h_max = uniform(state, box.h_min, HsvHistogram::kHueBins - 1);
+  box.s_min = uniform(state, 0, HsvHistogram::kSatBins - 1);
+  box.s_max = uniform(state, box.s_min, HsvHistogram::kSatBins - 1);
+  box.v_min = uniform(state, 0, HsvHistogram::kValBins - 1);
+  box.v_max = uniform(state, box.v_min, HsvHistogram::kValBins - 1);
+  return box;
+}
+
+// Pixels anywhere in HSV, with a tenth of them ignored
+void randomFrame(uint32_t *state, cv::Mat *hsv, cv::Mat *label) {
+  hsv->create(kHeight, kWidth, CV_8UC3);
+  label->create(kHeight, kWidth, CV_8UC1);
+  for (int y = 0; y < kHeight; ++y) {
+    for (int x = 0; x < kWidth; ++x) {
+      hsv->at<cv::Vec3b>(y, x) =
+          cv::Vec3b(uniform(state, 0, 179), uniform(state, 0, 255),
+                    uniform(state, 0, 255));
+      int draw = uniform(state, 0, 9);
+      label->at<uint8_t>(y, x) = draw == 0   ? kIgnoreLabel
+                                 : draw < 5 ? kTargetLabel
+                                            : kBackgroundLabel;
+    }
+  }
+}
+
+void testCountMatchesBruteForce() {
+  uint32_t state = 42;
+  cv::Mat hsv[2], label[2];
+  HsvHistogram histogram;
+  for (int frame = 0; frame < 2; ++frame) {
+    randomFrame(&state, &hsv[frame], &label[frame]);
+    histogram.add(hsv[frame], label[frame]);
+  }
+  histogram.integrate();
+
+  HsvBox everything = {0, HsvHistogram::kHueBins - 1,
+                       0, HsvHistogram::kSatBins - 1,
+                       0, HsvHistogram::kValBins - 1};
+  for (int n = 0; n < 300; ++n) {
+    // The whole space first, then single bins and random boxes
+    HsvBox box = randomBox(&state);
+    if (n == 0) {
+      box = everything;
+    } else if (n < 50) {
+      box.h_max = box.h_min;
+      box.s_max = box.s_min;
+      box.v_max = box.v_min;
+    }
+    HsvThreshold threshold = HsvHistogram::toThreshold(box);
+    HsvCounts expected = {0, 0};
+    int64_t thresholded = 0;
+    for (int frame = 0; frame < 2; ++frame) {
+      for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+          const cv::Vec3b &pixel = hsv[frame].at<cv::Vec3b>(y, x);
+          uint8_t kind = label[frame].at<uint8_t>(y, x);
+          if (kind == kIgnoreLabel || !inBox(pixel, box)) {
+            continue;
+          }
+          (kind == kTargetLabel ? expected.target : expected.background)++;
+        }
+      }
+      for (int y = 0; y < kHeight; ++y) {
+        for (int x = 0; x < kWidth; ++x) {
+          const cv::Vec3b &pixel = hsv[frame].at<cv::Vec3b>(y, x);
+          if (label[frame].at<uint8_t>(y, x) != kIgnoreLabel &&
+              inThreshold(pixel, threshold)) {
+            thresholded++;
+          }
+        }
+      }
+    }
+    HsvCounts counts = histogram.count(box);
+    CHECK(counts.target == expected.target);
+    CHECK(counts.background == expected.background);
+    // The threshold a box converts to takes exactly the pixels counted
+    CHECK(thresholded == counts.target + counts.background);
+    HsvBox back = HsvHistogram::toBox(threshold);
+    CHECK(back.h_min == box.h_min && back.h_max == box.h_max &&
+          back.s_min == box.s_min && back.s_max == box.s_max &&
+          back.v_min == box.v_min && back.v_max == box.v_max);
+  }
+  HsvCounts total = histogram.total();
+  HsvCounts all = histogram.count(everything);
+  CHECK(total.target == all.target && total.background == all.background);
+}
+
+// Target pixels only inside the planted box, background only outside it,
+// plus ignored pixels inside it that must not count against it
+void testSearchFindsPlantedBox() {
+  const HsvBox planted = {30, 44, 30, 59, 35, 63};
+  uint32_t state = 7;
+  HsvHistogram histogram;
+  cv::Mat hsv(kHeight, kWidth, CV_8UC3), label(kHeight, kWidth, CV_8UC1);
+  for (int frame = 0; frame < 4; ++frame) {
+    for (int y = 0; y < kHeight; ++y) {
+      for (int x = 0; x < kWidth; ++x) {
+        int draw = uniform(&state, 0, 9);
+        uint8_t kind = draw == 0   ? kIgnoreLabel
+                       : draw < 4 ? kTargetLabel
+                                  : kBackgroundLabel;
+        cv::Vec3b pixel;
+        if (kind != kBackgroundLabel) {
+          pixel = cv::Vec3b(
+              uniform(&state, planted.h_min * kLevels[0],
+                      planted.h_max * kLevels[0] + kLevels[0] - 1),
+              uniform(&state, planted.s_min * kLevels[1],
+                      planted.s_max * kLevels[1] + kLevels[1] - 1),
+              uniform(&state, planted.v_min * kLevels[2],
+                      planted.v_max * kLevels[2] + kLevels[2] - 1));
+        } else {
+          do {
+            pixel = cv::Vec3b(uniform(&state, 0, 179),
+                              uniform(&state, 0, 255),
+                              uniform(&state, 0, 255));
+          } while (inBox(pixel, planted));
+        }
+        hsv.at<cv::Vec3b>(y, x) = pixel;
+        label.at<uint8_t>(y, x) = kind;
+      }
+    }
+    histogram.add(hsv, label);
+  }
+  histogram.integrate();
+
+  HsvBox found = searchHsvBox(histogram);
+  CHECK(found.h_min == planted.h_min && found.h_max == planted.h_max);
+  CHECK(found.s_min == planted.s_min && found.s_max == planted.s_max);
+  CHECK(found.v_min == planted.v_min && found.v_max == planted.v_max);
+  HsvScore score = histogram.score(found);
+  CHECK_NEAR(score.precision, 1, 1e-12);
+  CHECK_NEAR(score.recall, 1, 1e-12);
+  CHECK_NEAR(score.score, 1, 1e-12);
+}
+
+} // namespace
+
+int main() {
+  testCountMatchesBruteForce();
+  testSearchFindsPlantedBox();
+  return testResult("hsv_tuner_test");
+}
@@ -0,0 +1,126 @@
+// Frames per second and corner error of the default pipeline run in full
+// against the same pipeline with interlace, over rendered 640x480 frames of
+// a still target and of one sweeping across the view. Interlaced frames
+// alternate fields and fuse them as processImpl does, so the still target
+// shows what fusion recovers and the moving one what a lone field costs.
+// Times are the calling thread's CPU time for detection alone; rendering
+// is not counted.
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "golden_corpus.h"
+#include "scene_generator.h"
+
+namespace {
+
+const int kFrames = 400;
+const int kWidth = 640;
+const int kHeight = 480;
+const double kFocalLength = 520;
+const uint64_t kSeed = 47;
+
+int64_t threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Stats {
+  int frames;
+  int missed;
+  double mean_error;
+  double worst_error;
+  double frames_per_second;
+};
+
+// Largest distance from a rendered corner to the same corner of the
+// nearest detected target, or -1 if nothing was detected
+double cornerError(const SceneTruth &truth,
+                   const std::vector<TargetInfo> &targets) {
+  double best = -1;
+  for (auto &target : targets) {
+    if (target.points.size() != 4) {
+      continue;
+    }
+    double worst = 0;
+    for (int corner = 0; corner < 4; ++corner) {
+      cv::Point2d d = cv::Point2d(target.points[corner]) -
+                      truth.corners[corner];
+      worst = std::max(worst, sqrt(d.dot(d)));
+    }
+    best = best < 0 ? worst : std::min(best, worst);
+  }
+  return best;
+}
+
+// The pose at frame n: fixed, or sweeping bearing and elevation by a few
+// pixels a frame so consecutive fields never see the target in one place
+void pose(bool moving, int n, SceneParams *scene) {
+  scene->range = 3;
+  scene->skew = 0.2;
+  scene->bearing = moving ? 0.25 * sin(2 * CV_PI * n / 200.0) : 0.05;
+  scene->elevation = moving ? 0.12 * cos(2 * CV_PI * n / 150.0) : -0.03;
+}
+
+Stats run(bool interlace, bool moving) {
+  GoldenEntry entry;
+  entry.interlace = interlace;
+  entry.tiles = -1;
+  GoldenDetector detector;
+  detector.setPipeline(entry);
+  SceneGenerator generator(kSeed);
+  SceneParams scene;
+  CameraModel camera = pinholeCameraModel(kWidth, kHeight, kFocalLength);
+  HsvThreshold threshold = sceneThreshold();
+  cv::Mat rgba;
+  SceneTruth truth;
+  DetectionResult result;
+
+  Stats stats = {0, 0, 0, 0, 0};
+  int64_t total_ns = 0;
+  double total_error = 0;
+  for (int n = 0; n < kFrames; ++n) {
+    pose(moving, n, &scene);
+    generator.render(scene, camera, &rgba, &truth);
+    int64_t start = threadCpuNs();
+    detector.detect(rgba, threshold, n, &result);
+    total_ns += threadCpuNs() - start;
+    if (!truth.visible) {
+      continue;
+    }
+    stats.frames++;
+    double error = cornerError(truth, result.targets);
+    if (error < 0) {
+      stats.missed++;
+      continue;
+    }
+    total_error += error;
+    stats.worst_error = std::max(stats.worst_error, error);
+  }
+  int found = stats.frames - stats.missed;
+  stats.mean_error = found > 0 ? total_error / found : 0;
+  stats.frames_per_second = total_ns > 0 ? kFrames * 1e9 / total_ns : 0;
+  return stats;
+}
+
+void print(const char *name, const Stats &stats) {
+  printf("%-18s %7.1f frames/s, corner error %.2f px mean %.2f px worst, "
+         "%d/%d missed\n",
+         name, stats.frames_per_second, stats.mean_error, stats.worst_error,
+         stats.missed, stats.frames);
+}
+
+} // namespace
+
+int main() {
+  print("still, full", run(false, false));
+  print("still, interlace", run(true, false));
+  print("moving, full", run(false, true));
+  print("moving, interlace", run(true, true));
+  return 0;
+}
@@ -0,0 +1,193 @@
+// Checks MultiDetector's run-length blob labelling against
+// cv::connectedComponentsWithStats() on random class masks, bit by bit, and
+// runsContourArea() against the contour areas of shapes it can be worked
+// out for.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "multi_detector.h"
+#include "test_util.h"
+
+namespace {
+
+const int kDetectors = 3;
+// Odd, so rows end partway through the eight-pixel background skip
+const int kWidth = 157;
+const int kHeight = 83;
+
+// top, left, width, height, pixels
+typedef std::tuple<int, int, int, int, int> BlobStats;
+
+uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+// Each detector's bit set independently with the given probability in
+// percent, either per pixel or per 4 x 3 block so blobs get large
+void randomMask(uint32_t seed, int percent, bool blocks, cv::Mat *mask) {
+  uint32_t state = seed;
+  mask->create(kHeight, kWidth, CV_8UC1);
+  for (int y = 0; y < kHeight; ++y) {
+    uint8_t *row = mask->ptr<uint8_t>(y);
+    for (int x = 0; x < kWidth; ++x) {
+      if (blocks && (x % 4 != 0 || y % 3 != 0)) {
+        row[x] = mask->ptr<uint8_t>(y - y % 3)[x - x % 4];
+        continue;
+      }
+      uint8_t classes = 0;
+      for (int bit = 0; bit < kDetectors; ++bit) {
+        if (static_cast<int>(nextRandom(&state) % 100) < percent) {
+          classes |= 1 << bit;
+        }
+      }
+      row[x] = classes;
+    }
+  }
+}
+
+std::vector<BlobStats> expectedBlobs(const cv::Mat &mask, int bit) {
+  cv::Mat binary(mask.rows, mask.cols, CV_8UC1);
+  for (int y = 0; y < mask.rows; ++y) {
+    for (int x = 0; x < mask.cols; ++x) {
+      binary.at<uint8_t>(y, x) = mask.at<uint8_t>(y, x) & (1 << bit) ? 255 : 0;
+    }
+  }
+  cv::Mat labels, stats, centroids;
+  int count = cv::connectedComponentsWithStats(binary, labels, stats,
+                                               centroids, 8, CV_32S);
+  std::vector<BlobStats> blobs;
+  // Label 0 is the background
+  for (int i = 1; i < count; ++i) {
+    blobs.push_back(BlobStats(stats.at<int>(i, cv::CC_STAT_TOP),
+                              stats.at<int>(i, cv::CC_STAT_LEFT),
+                              stats.at<int>(i, cv::CC_STAT_WIDTH),
+                              stats.at<int>(i, cv::CC_STAT_HEIGHT),
+                              stats.at<int>(i, cv::CC_STAT_AREA)));
+  }
+  std::sort(blobs.begin(), blobs.end());
+  return blobs;
+}
+
+std::vector<BlobStats> foundBlobs(MultiDetector *detector,
+                                  const cv::Mat &mask, int bit) {
+  std::vector<MultiDetector::Blob> found;
+  detector->findBlobs(mask, bit, &found);
+  std::vector<BlobStats> blobs;
+  for (auto &blob : found) {
+    blobs.push_back(BlobStats(blob.min_y, blob.min_x,
+                              blob.max_x - blob.min_x + 1,
+                              blob.max_y - blob.min_y + 1, blob.area));
+  }
+  std::sort(blobs.begin(), blobs.end());
+  return blobs;
+}
+
+MultiDetector configuredDetector() {
+  std::vector<DetectorConfig> configs(kDetectors);
+  for (int i = 0; i < kDetectors; ++i) {
+    configs[i].name = "d" + std::to_string(i);
+    configs[i].channel = i;
+    configs[i].hsv = {0, 180, 0, 255, 0, 255};
+    configs[i].filter = defaultTargetFilter();
+  }
+  MultiDetector detector;
+  CHECK(detector.configure(configs));
+  return detector;
+}
+
+void testBlobsMatchConnectedComponents() {
+  MultiDetector detector = configuredDetector();
+  const int kPercents[] = {2, 15, 40, 60, 85};
+  cv::Mat mask;
+  uint32_t seed = 36;
+  for (int percent : kPercents) {
+    for (int blocks = 0; blocks < 2; ++blocks) {
+      for (int round = 0; round < 4; ++round) {
+        randomMask(++seed, percent, blocks != 0, &mask);
+        for (int bit = 0; bit < kDetectors; ++bit) {
+          std::vector<BlobStats> expected = expectedBlobs(mask, bit);
+          std::vector<BlobStats> found = foundBlobs(&detector, mask, bit);
+          CHECK(found.size() == expected.size());
+          CHECK(found == expected);
+        }
+      }
+    }
+  }
+
+  // Runs touching only at a corner are one blob; an empty mask has none
+  mask = cv::Scalar(0);
+  mask.at<uint8_t>(10, 10) = 1;
+  mask.at<uint8_t>(11, 11) = 1;
+  mask.at<uint8_t>(12, 10) = 1;
+  mask.row(kHeight - 1) = cv::Scalar(2);
+  CHECK(foundBlobs(&detector, mask, 0).size() == 1);
+  CHECK(foundBlobs(&detector, mask, 0) == expectedBlobs(mask, 0));
+  CHECK(foundBlobs(&detector, mask, 1) == expectedBlobs(mask, 1));
+  CHECK(foundBlobs(&detector, mask, 2).empty());
+}
+
+std::vector<RowRun> rectangleRuns(int width, int height) {
+  std::vector<RowRun> runs;
+  for (int y = 0; y < height; ++y) {
+    RowRun run = {y, 5, 5 + width};
+    runs.push_back(run);
+  }
+  return runs;
+}
+
+void testContourArea() {
+  // The contour of a w x h block runs through its corner pixels' centres
+  CHECK_NEAR(runsContourArea(rectangleRuns(60, 40)), 59 * 39, 1e-9);
+  CHECK_NEAR(runsContourArea(rectangleRuns(2, 2)), 1, 1e-9);
+  // A lone pixel, and a two-pixel line, enclose nothing
+  CHECK_NEAR(runsContourArea(rectangleRuns(1, 1)), 0, 1e-9);
+  CHECK_NEAR(runsContourArea(rectangleRuns(2, 1)), 0, 1e-9);
+
+  // The U target, open at the top, arms and base 8 pixels thick. Its
+  // contour steps diagonally round the inside corners of the notch.
+  std::vector<RowRun> u;
+  for (int y = 0; y < 40; ++y) {
+    if (y < 32) {
+      RowRun left = {y, 0, 8}, right = {y, 52, 60};
+      u.push_back(left);
+      u.push_back(right);
+    } else {
+      RowRun base = {y, 0, 60};
+      u.push_back(base);
+    }
+  }
+  std::vector<cv::Point> u_contour = {{0, 0},   {7, 0},   {7, 31},
+                                      {8, 32},  {51, 32}, {52, 31},
+                                      {52, 0},  {59, 0},  {59, 39},
+                                      {0, 39}};
+  CHECK_NEAR(runsContourArea(u), cv::contourArea(u_contour), 1e-9);
+
+  // Staircase edges: the diamond |x| + |y| <= r has its border pixels on
+  // the square with corners r from the centre, of area 2 r^2
+  for (int r = 1; r <= 20; r += 3) {
+    std::vector<RowRun> diamond;
+    for (int y = -r; y <= r; ++y) {
+      int half = r - abs(y);
+      RowRun run = {y, -half, half + 1};
+      diamond.push_back(run);
+    }
+    CHECK_NEAR(runsContourArea(diamond), 2.0 * r * r, 1e-9);
+  }
+}
+
+} // namespace
+
+int main() {
+  testBlobsMatchConnectedComponents();
+  testContourArea();
+  return testResult("multi_detector_test");
+}
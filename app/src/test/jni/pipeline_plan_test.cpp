@@ -0,0 +1,318 @@
+// Checks the pipeline parser, the fused front pass against cvtColor(),
+// inRange() and resize(), merged erodes and dilates against separate ones,
+// and PipelinePlan's tile change detection against a plan that thresholds
+// every frame in full.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "pipeline_plan.h"
+#include "test_util.h"
+
+namespace {
+
+const int kWidth = 160;
+const int kHeight = 120;
+
+// Blocks of green target and grey background, so erosion and decimation
+// have edges to work on
+void paintFrame(uint32_t seed, cv::Mat *rgba) {
+  for (int y = 0; y < rgba->rows; ++y) {
+    uint32_t *row = rgba->ptr<uint32_t>(y);
+    for (int x = 0; x < rgba->cols; ++x) {
+      uint32_t block = (y / 10) * 97 + (x / 12) * 31 + seed;
+      block ^= block >> 7;
+      block *= 0x9e3779b1u;
+      bool target = (block >> 16) % 3 == 0;
+      // RGBA in memory order
+      row[x] = target ? 0xff40f020u : 0xff808080u;
+    }
+  }
+}
+
+bool sameMask(const cv::Mat &a, const cv::Mat &b) {
+  if (a.size() != b.size() || a.type() != b.type()) {
+    return false;
+  }
+  for (int y = 0; y < a.rows; ++y) {
+    if (memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool compile(const char *spec, PipelinePlan *plan) {
+  PipelineConfig config;
+  return parsePipelineConfig(spec, &config) && plan->compile(config);
+}
+
+// Every pixel its own colour, so the conversion sees all hues, dark and
+// grey pixels, not just two
+void paintNoise(uint32_t seed, cv::Mat *rgba) {
+  uint32_t state = seed * 2654435761u + 1;
+  for (int y = 0; y < rgba->rows; ++y) {
+    uint32_t *row = rgba->ptr<uint32_t>(y);
+    for (int x = 0; x < rgba->cols; ++x) {
+      state = state * 1664525u + 1013904223u;
+      row[x] = (state >> 8) | 0xff000000u;
+    }
+  }
+}
+
+void testParser() {
+  PipelineConfig config;
+  // Comments, blank lines, trailing spaces and CRLF line ends
+  CHECK(parsePipelineConfig("# whole-line comment\n"
+                            "\n"
+                            "decimate factor=2  # trailing comment\r\n"
+                            "hsv\n"
+                            "  \t\n"
+                            "threshold h_min=40 v_max=200\n"
+                            "open size=3\n"
+                            "contours\n"
+                            "filter min_width=4.5 max_candidates=8 # cap\n",
+                            &config));
+  CHECK(config.stages.size() == 6);
+  CHECK(config.stages[0].kind == PIPELINE_DECIMATE &&
+        config.stages[0].size == 2);
+  CHECK(config.stages[2].threshold[0] == 40 &&
+        config.stages[2].threshold[1] == -1 &&
+        config.stages[2].threshold[5] == 200);
+  CHECK(config.stages[3].kind == PIPELINE_OPEN && config.stages[3].size == 3);
+  CHECK(config.filter.min_width == 4.5 && config.max_candidates == 8);
+  // Defaults of stages without parameters
+  CHECK(parsePipelineConfig("tiles\nhsv\nthreshold\nmedian\ncontours\n"
+                            "filter",
+                            &config));
+  CHECK(config.stages[0].size == 8 && config.stages[3].size == 3);
+
+  // Stages whose input is not what the stage before gives, or a pipeline
+  // that does not end in targets
+  const char *type_errors[] = {
+      "threshold\ncontours\nfilter",
+      "hsv\ncontours\nfilter",
+      "hsv\nthreshold\nfilter",
+      "hsv\nthreshold\ncontours",
+      "hsv\nerode size=3\nthreshold\ncontours\nfilter",
+      "hsv\nthreshold\ninterlace\ncontours\nfilter",
+      "hsv\nthreshold\ntiles\ncontours\nfilter",
+      "hsv\nthreshold\ncontours\ndecimate factor=2\nfilter",
+      "hsv\nthreshold\ncontours\nfilter\nfilter",
+      "hsv\nhsv\nthreshold\ncontours\nfilter",
+      "",
+      "# only a comment"};
+  for (auto spec : type_errors) {
+    CHECK(!parsePipelineConfig(spec, &config));
+  }
+
+  // Out of range, not whole, not numbers, unknown keys and stages
+  const char *value_errors[] = {
+      "decimate factor=0",     "decimate factor=9",
+      "decimate factor=1.5",   "decimate size=2",
+      "erode size=0",          "erode size=16",
+      "dilate size=-3",        "close size=2.5",
+      "median size=1",         "median size=4",
+      "tiles tolerance=-1",    "tiles tolerance=256",
+      "erode size=nan",        "erode size=inf",
+      "erode size=3x",         "erode size=",
+      "erode size",            "erode 3",
+      "erode=3",               "blur size=3"};
+  for (auto stage : value_errors) {
+    std::string spec = std::string("hsv\nthreshold\n") + stage +
+                       "\ncontours\nfilter";
+    if (std::string(stage).compare(0, 8, "decimate") == 0 ||
+        std::string(stage).compare(0, 5, "tiles") == 0) {
+      spec = std::string(stage) + "\nhsv\nthreshold\ncontours\nfilter";
+    }
+    CHECK(!parsePipelineConfig(spec.c_str(), &config));
+  }
+  const char *filter_errors[] = {
+      "threshold h_min=256",      "threshold v_max=-1",
+      "threshold h_min=1.5",      "threshold hue=10",
+      "filter max_candidates=0",  "filter max_candidates=4097",
+      "filter min_width=-1",      "filter min_fullness=nan",
+      "filter max_width=1e400",   "filter colour=1"};
+  for (auto stage : filter_errors) {
+    bool threshold = std::string(stage).compare(0, 9, "threshold") == 0;
+    std::string spec =
+        threshold ? std::string("hsv\n") + stage + "\ncontours\nfilter"
+                  : std::string("hsv\nthreshold\ncontours\n") + stage;
+    CHECK(!parsePipelineConfig(spec.c_str(), &config));
+  }
+}
+
+// The fused front pass against the separate OpenCV calls it replaces, at
+// each decimation and with fixed bounds overriding the slider
+void testFrontPass() {
+  const int kFactors[] = {1, 2, 4};
+  const HsvThreshold kThresholds[] = {{0, 180, 0, 255, 0, 255},
+                                      {40, 90, 100, 255, 100, 255},
+                                      {0, 20, 50, 200, 30, 255},
+                                      {170, 180, 0, 60, 200, 255}};
+  cv::Mat rgba(kHeight, kWidth, CV_8UC4);
+  paintNoise(3, &rgba);
+  cv::Mat hsv, thresholded, expected, mask;
+  cv::cvtColor(rgba, hsv, CV_RGB2HSV);
+  for (auto &threshold : kThresholds) {
+    cv::inRange(hsv,
+                cv::Scalar(threshold.h_min, threshold.s_min, threshold.v_min),
+                cv::Scalar(threshold.h_max, threshold.s_max, threshold.v_max),
+                thresholded);
+    for (int factor : kFactors) {
+      cv::resize(thresholded, expected,
+                 cv::Size(kWidth / factor, kHeight / factor), 0, 0,
+                 cv::INTER_NEAREST);
+      // Decimated by the caller, and by the pipeline itself
+      PipelinePlan plan;
+      CHECK(compile("hsv\nthreshold\ncontours\nfilter\n", &plan));
+      plan.buildMask(rgba, threshold, factor, -1, 0, &mask);
+      CHECK(sameMask(mask, expected));
+      std::string spec = "decimate factor=" + std::to_string(factor) +
+                         "\nhsv\nthreshold\ncontours\nfilter\n";
+      CHECK(compile(spec.c_str(), &plan));
+      plan.buildMask(rgba, threshold, 1, -1, 0, &mask);
+      CHECK(sameMask(mask, expected));
+    }
+  }
+
+  // Bounds in the pipeline replace the slider's
+  HsvThreshold wide = {0, 180, 0, 255, 0, 255};
+  const HsvThreshold &green = kThresholds[1];
+  cv::inRange(hsv, cv::Scalar(green.h_min, 0, green.v_min),
+              cv::Scalar(green.h_max, 255, green.v_max), expected);
+  PipelinePlan plan;
+  CHECK(compile("hsv\nthreshold h_min=40 h_max=90 v_min=100\ncontours\n"
+                "filter\n",
+                &plan));
+  plan.buildMask(rgba, wide, 1, -1, 0, &mask);
+  CHECK(sameMask(mask, expected));
+}
+
+// A decimate by 1 between two erodes keeps them apart, so the merged plan
+// is checked against the two kernels applied one after the other. Two even
+// kernels must not merge: their anchors are both off centre, and one kernel
+// of the summed extent would shift the mask by a pixel.
+void testMergedKernels() {
+  const char *pairs[][2] = {{"erode size=3", "erode size=2"},
+                            {"dilate size=2", "dilate size=5"},
+                            {"erode size=2", "erode size=2"},
+                            {"dilate size=4", "dilate size=2"}};
+  HsvThreshold threshold = {40, 90, 100, 255, 100, 255};
+  cv::Mat rgba(kHeight, kWidth, CV_8UC4);
+  paintFrame(5, &rgba);
+  cv::Mat mask, expected;
+  for (auto &pair : pairs) {
+    std::string first = pair[0], second = pair[1];
+    PipelinePlan merged, separate;
+    CHECK(compile(("hsv\nthreshold\n" + first + "\n" + second +
+                   "\ncontours\nfilter\n")
+                      .c_str(),
+                  &merged));
+    CHECK(compile(("hsv\nthreshold\n" + first + "\ndecimate factor=1\n" +
+                   second + "\ncontours\nfilter\n")
+                      .c_str(),
+                  &separate));
+    merged.buildMask(rgba, threshold, 1, -1, 0, &mask);
+    separate.buildMask(rgba, threshold, 1, -1, 0, &expected);
+    CHECK(sameMask(mask, expected));
+    // One step, or two for a pair of even kernels
+    bool both_even = first[first.size() - 1] % 2 == 0 &&
+                     second[second.size() - 1] % 2 == 0;
+    std::string step = " -> " + first.substr(0, first.find(' ')) + " ";
+    std::string description = merged.describe();
+    size_t at = description.find(step);
+    CHECK(at != std::string::npos);
+    CHECK((description.find(step, at + 1) != std::string::npos) == both_even);
+  }
+
+  // What merging the two even kernels would have given differs
+  PipelinePlan even, odd;
+  CHECK(compile("hsv\nthreshold\nerode size=2\nerode size=2\ncontours\n"
+                "filter\n",
+                &even));
+  CHECK(compile("hsv\nthreshold\nerode size=3\ncontours\nfilter\n", &odd));
+  even.buildMask(rgba, threshold, 1, -1, 0, &mask);
+  odd.buildMask(rgba, threshold, 1, -1, 0, &expected);
+  CHECK(!sameMask(mask, expected));
+}
+
+// A frame whose tiles all match the previous one skips every step after the
+// threshold, and must still give the previous frame's mask rather than the
+// raw threshold; a frame with a changed tile must match a full pass
+void testUnchangedFrameRepeatsMask() {
+  const char kSteps[] = "erode size=3\n"
+                        "dilate size=5\n"
+                        "decimate factor=2\n"
+                        "contours\n"
+                        "filter\n";
+  PipelinePlan tiled, full;
+  CHECK(compile((std::string("tiles\nhsv\nthreshold\n") + kSteps).c_str(),
+                &tiled));
+  CHECK(compile((std::string("hsv\nthreshold\n") + kSteps).c_str(), &full));
+  HsvThreshold threshold = {40, 90, 100, 255, 100, 255};
+  cv::Mat rgba(kHeight, kWidth, CV_8UC4);
+  cv::Mat mask, expected, previous;
+
+  paintFrame(1, &rgba);
+  tiled.buildMask(rgba, threshold, 1, -1, 0, &mask);
+  full.buildMask(rgba, threshold, 1, -1, 0, &expected);
+  CHECK(tiled.maskChanged());
+  CHECK(mask.cols == kWidth / 2 && mask.rows == kHeight / 2);
+  CHECK(sameMask(mask, expected));
+  mask.copyTo(previous);
+
+  tiled.buildMask(rgba, threshold, 1, -1, 1, &mask);
+  CHECK(!tiled.maskChanged());
+  CHECK(sameMask(mask, previous));
+
+  // One tile turns from background to target
+  for (int y = 32; y < 48; ++y) {
+    uint32_t *row = rgba.ptr<uint32_t>(y);
+    for (int x = 64; x < 80; ++x) {
+      row[x] = row[x] == 0xff808080u ? 0xff40f020u : 0xff808080u;
+    }
+  }
+  tiled.buildMask(rgba, threshold, 1, -1, 2, &mask);
+  full.buildMask(rgba, threshold, 1, -1, 2, &expected);
+  CHECK(tiled.maskChanged());
+  CHECK(sameMask(mask, expected));
+  CHECK(!sameMask(mask, previous));
+  mask.copyTo(previous);
+
+  tiled.buildMask(rgba, threshold, 1, -1, 3, &mask);
+  CHECK(!tiled.maskChanged());
+  CHECK(sameMask(mask, previous));
+}
+
+// Without steps the threshold itself is the mask, changed or not
+void testUnchangedFrameWithoutSteps() {
+  PipelinePlan tiled;
+  CHECK(compile("tiles\nhsv\nthreshold\ncontours\nfilter\n", &tiled));
+  HsvThreshold threshold = {40, 90, 100, 255, 100, 255};
+  cv::Mat rgba(kHeight, kWidth, CV_8UC4);
+  cv::Mat mask, previous;
+  paintFrame(7, &rgba);
+  tiled.buildMask(rgba, threshold, 1, -1, 0, &mask);
+  mask.copyTo(previous);
+  tiled.buildMask(rgba, threshold, 1, -1, 1, &mask);
+  CHECK(!tiled.maskChanged());
+  CHECK(mask.cols == kWidth && mask.rows == kHeight);
+  CHECK(sameMask(mask, previous));
+}
+
+} // namespace
+
+int main() {
+  testParser();
+  testFrontPass();
+  testMergedKernels();
+  testUnchangedFrameRepeatsMask();
+  testUnchangedFrameWithoutSteps();
+  return testResult("pipeline_plan_test");
+}
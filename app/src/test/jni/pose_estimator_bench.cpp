@@ -0,0 +1,96 @@
+// Cost per target of PoseEstimator, warm-started from the previous frame's
+// pose against solving from scratch every frame, over a target drifting
+// across the view of a 640x480 pinhole camera. Also reports range and
+// skew error against the poses the corners were projected from.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "camera_model.h"
+#include "common.hpp"
+#include "pose_estimator.h"
+
+namespace {
+
+const int kFrames = 3000;
+const int kWidth = 640;
+const int kHeight = 480;
+const double kFocalLength = 520;
+// Corners of the default target model, metres
+const double kHalfWidth = 0.254;
+const double kHalfHeight = 0.1778;
+
+struct Truth {
+  double range;
+  double bearing;
+  double skew;
+};
+
+// Projects the default model at frame n of a slow sweep in range, bearing
+// and skew, rounding the corners to whole pixels as fitQuad reports them
+Truth makeTarget(const CameraModel &camera, int n, TargetInfo *target) {
+  double t = static_cast<double>(n) / kFrames;
+  Truth truth;
+  truth.range = 3.5 + 2.0 * sin(2 * CV_PI * t);
+  truth.bearing = 0.35 * sin(6 * CV_PI * t);
+  truth.skew = 0.5 * sin(4 * CV_PI * t);
+  cv::Point3d centre(-truth.range * sin(truth.bearing), -0.1,
+                     truth.range * cos(truth.bearing));
+  // The target plane turned by skew about the vertical, away from facing
+  // the camera squarely
+  double yaw = truth.skew - truth.bearing;
+  cv::Point3d right(cos(yaw), 0, -sin(yaw));
+  const double kCorners[4][2] = {{-kHalfWidth, -kHalfHeight},
+                                 {kHalfWidth, -kHalfHeight},
+                                 {kHalfWidth, kHalfHeight},
+                                 {-kHalfWidth, kHalfHeight}};
+  target->points.clear();
+  for (auto &corner : kCorners) {
+    cv::Point3d p = centre + right * corner[0] + cv::Point3d(0, corner[1], 0);
+    cv::Point2d pixel = cameraProject(camera, p);
+    target->points.push_back(cv::Point(cvRound(pixel.x), cvRound(pixel.y)));
+  }
+  return truth;
+}
+
+void run(const char *name, bool warm, const CameraModel &camera) {
+  PoseEstimator estimator;
+  TargetInfo target;
+  TargetPose pose;
+  int64_t total_ns = 0, worst_ns = 0;
+  int solved = 0, warm_started = 0;
+  double range_error = 0, skew_error = 0;
+  for (int n = 0; n < kFrames; ++n) {
+    Truth truth = makeTarget(camera, n, &target);
+    int64_t start = getTimeNs();
+    bool ok = estimator.estimate(warm ? 1 : -1, target, camera, &pose);
+    int64_t elapsed = getTimeNs() - start;
+    total_ns += elapsed;
+    worst_ns = std::max(worst_ns, elapsed);
+    if (ok) {
+      solved++;
+      warm_started += pose.warm_started;
+      range_error += fabs(pose.range - truth.range);
+      skew_error += fabs(pose.skew - truth.skew);
+    }
+  }
+  double per_target_us = total_ns / 1e3 / kFrames;
+  printf("%-5s: %.1f us per target (worst %.1f us, %.2f%% of a 30 fps "
+         "frame), %d/%d solved, %d warm, mean error range %.3f m skew "
+         "%.3f rad\n",
+         name, per_target_us, worst_ns / 1e3, per_target_us / 333.33, solved,
+         kFrames, warm_started, range_error / std::max(solved, 1),
+         skew_error / std::max(solved, 1));
+}
+
+} // namespace
+
+int main() {
+  CameraModel camera = pinholeCameraModel(kWidth, kHeight, kFocalLength);
+  run("cold", false, camera);
+  run("warm", true, camera);
+  return 0;
+}
@@ -0,0 +1,130 @@
+// Cost per candidate of fitQuad, from contour points and from row runs,
+// against the convexHull + approxPolyDP + isContourConvex chain it
+// replaced, on U targets at several sizes and angles. Also counts how many
+// candidates each approach turns into a quad.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include "common.hpp"
+#include "quad_fit.h"
+
+namespace {
+
+const int kRepeats = 2000;
+const double kApproxEpsilon = 20;
+
+struct Candidate {
+  std::vector<cv::Point> contour;
+  std::vector<RowRun> runs;
+};
+
+// Rasterizes a rotated U target and takes its outer contour and row runs
+Candidate makeCandidate(double width, double degrees) {
+  double height = width * 0.6, wall = width / 8;
+  const cv::Point2d shape[] = {{0, 0},
+                               {wall, 0},
+                               {wall, height * 0.75},
+                               {width - wall, height * 0.75},
+                               {width - wall, 0},
+                               {width, 0},
+                               {width, height},
+                               {0, height}};
+  double angle = degrees * CV_PI / 180;
+  cv::Point2d along(cos(angle), sin(angle)), across(-along.y, along.x);
+  cv::Point2d offset(width, width);
+  std::vector<cv::Point> polygon;
+  for (auto &p : shape) {
+    cv::Point2d q = offset + along * (p.x - width / 2) +
+                    across * (p.y - height / 2);
+    polygon.push_back(cv::Point(cvRound(q.x), cvRound(q.y)));
+  }
+  int side = static_cast<int>(2 * width) + 1;
+  cv::Mat mask = cv::Mat::zeros(side, side, CV_8UC1);
+  cv::fillPoly(mask, std::vector<std::vector<cv::Point>>(1, polygon),
+               cv::Scalar(255));
+
+  Candidate candidate;
+  for (int y = 0; y < mask.rows; ++y) {
+    const uint8_t *row = mask.ptr<uint8_t>(y);
+    for (int x = 0; x < mask.cols; ++x) {
+      if (row[x] != 0 && (x == 0 || row[x - 1] == 0)) {
+        RowRun run = {y, x, x};
+        while (run.x_end < mask.cols && row[run.x_end] != 0) {
+          run.x_end++;
+        }
+        candidate.runs.push_back(run);
+      }
+    }
+  }
+  std::vector<std::vector<cv::Point>> contours;
+  cv::findContours(mask, contours, cv::RETR_EXTERNAL,
+                   cv::CHAIN_APPROX_NONE);
+  if (!contours.empty()) {
+    candidate.contour = contours[0];
+  }
+  return candidate;
+}
+
+bool approxQuad(const std::vector<cv::Point> &contour,
+                std::vector<cv::Point> *hull, std::vector<cv::Point> *poly) {
+  cv::convexHull(contour, *hull);
+  cv::approxPolyDP(*hull, *poly, kApproxEpsilon, true);
+  return poly->size() == 4 && cv::isContourConvex(*poly);
+}
+
+} // namespace
+
+int main() {
+  const double kWidths[] = {12, 24, 48, 120, 240};
+  const double kAngles[] = {0, 10, 25, 40};
+  std::vector<cv::Point> hull, poly;
+  QuadFit fit;
+  for (auto width : kWidths) {
+    std::vector<Candidate> candidates;
+    for (auto degrees : kAngles) {
+      candidates.push_back(makeCandidate(width, degrees));
+    }
+    int approx_quads = 0, point_quads = 0, run_quads = 0;
+    for (auto &candidate : candidates) {
+      approx_quads += approxQuad(candidate.contour, &hull, &poly);
+      point_quads += fitQuad(candidate.contour, &fit);
+      run_quads += fitQuad(candidate.runs, &fit);
+    }
+
+    int64_t start = getTimeNs();
+    for (int i = 0; i < kRepeats; ++i) {
+      for (auto &candidate : candidates) {
+        approxQuad(candidate.contour, &hull, &poly);
+      }
+    }
+    int64_t approx_ns = getTimeNs() - start;
+    start = getTimeNs();
+    for (int i = 0; i < kRepeats; ++i) {
+      for (auto &candidate : candidates) {
+        fitQuad(candidate.contour, &fit);
+      }
+    }
+    int64_t point_ns = getTimeNs() - start;
+    start = getTimeNs();
+    for (int i = 0; i < kRepeats; ++i) {
+      for (auto &candidate : candidates) {
+        fitQuad(candidate.runs, &fit);
+      }
+    }
+    int64_t run_ns = getTimeNs() - start;
+
+    double calls = static_cast<double>(kRepeats) * candidates.size();
+    printf("width %3.0f: hull+approx %7.0f ns (%d/%d quads), "
+           "fit points %6.0f ns (%d/%d), fit runs %6.0f ns (%d/%d)\n",
+           width, approx_ns / calls, approx_quads,
+           static_cast<int>(candidates.size()), point_ns / calls,
+           point_quads, static_cast<int>(candidates.size()),
+           run_ns / calls, run_quads, static_cast<int>(candidates.size()));
+  }
+  return 0;
+}
@@ -0,0 +1,197 @@
+// Fits quads to target outlines and run-length blobs: the U shape, rotated
+// rectangles, a diamond, small far-away targets, a circle that must not fit
+// cleanly and degenerate blobs.
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "quad_fit.h"
+#include "test_util.h"
+
+namespace {
+
+// Integer points every half pixel along the closed polygon, as a contour
+std::vector<cv::Point> outline(const std::vector<cv::Point2d> &polygon) {
+  std::vector<cv::Point> points;
+  for (size_t i = 0; i < polygon.size(); ++i) {
+    cv::Point2d a = polygon[i];
+    cv::Point2d b = polygon[(i + 1) % polygon.size()];
+    cv::Point2d edge = b - a;
+    int steps = std::max(1, static_cast<int>(2 * sqrt(edge.dot(edge))));
+    for (int step = 0; step < steps; ++step) {
+      cv::Point2d p = a + edge * (static_cast<double>(step) / steps);
+      cv::Point point(cvRound(p.x), cvRound(p.y));
+      if (points.empty() || points.back() != point) {
+        points.push_back(point);
+      }
+    }
+  }
+  return points;
+}
+
+// Even-odd fill of the polygon sampled on each row, as row runs; the top
+// and bottom rows are sampled just inside so they are not lost
+std::vector<RowRun> fill(const std::vector<cv::Point2d> &polygon) {
+  double min_y = polygon[0].y, max_y = polygon[0].y;
+  for (auto &p : polygon) {
+    min_y = std::min(min_y, p.y);
+    max_y = std::max(max_y, p.y);
+  }
+  std::vector<RowRun> runs;
+  for (int y = static_cast<int>(floor(min_y)); y <= ceil(max_y); ++y) {
+    double row = std::min(std::max(y + 0.0, min_y + 1e-6), max_y - 1e-6);
+    std::vector<double> crossings;
+    for (size_t i = 0; i < polygon.size(); ++i) {
+      cv::Point2d a = polygon[i];
+      cv::Point2d b = polygon[(i + 1) % polygon.size()];
+      if ((a.y <= row) != (b.y <= row)) {
+        crossings.push_back(a.x + (row - a.y) * (b.x - a.x) / (b.y - a.y));
+      }
+    }
+    std::sort(crossings.begin(), crossings.end());
+    for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+      RowRun run = {y, static_cast<int>(ceil(crossings[i])),
+                    static_cast<int>(floor(crossings[i + 1])) + 1};
+      if (run.x_end > run.x_begin) {
+        runs.push_back(run);
+      }
+    }
+  }
+  return runs;
+}
+
+// Every expected corner has a fitted corner within tolerance
+bool cornersNear(const QuadFit &fit, const std::vector<cv::Point2d> &corners,
+                 double tolerance) {
+  for (auto &expected : corners) {
+    double closest = 1e9;
+    for (auto &corner : fit.corners) {
+      cv::Point2d d = cv::Point2d(corner) - expected;
+      closest = std::min(closest, sqrt(d.dot(d)));
+    }
+    if (closest > tolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The U target with its notch: concave, but the outer corners fit exactly
+std::vector<cv::Point2d> uShape(double width, double height) {
+  double wall = width / 8, floor_height = height / 4;
+  return {{0, 0},
+          {wall, 0},
+          {wall, height - floor_height},
+          {width - wall, height - floor_height},
+          {width - wall, 0},
+          {width, 0},
+          {width, height},
+          {0, height}};
+}
+
+void testUShape() {
+  std::vector<cv::Point2d> u = uShape(40, 20);
+  QuadFit fit;
+  CHECK(fitQuad(outline(u), &fit));
+  CHECK(fit.corners[0] == cv::Point(0, 0));
+  CHECK(fit.corners[1] == cv::Point(40, 0));
+  CHECK(fit.corners[2] == cv::Point(40, 20));
+  CHECK(fit.corners[3] == cv::Point(0, 20));
+  CHECK_NEAR(fit.area, 800, 1e-9);
+  CHECK_NEAR(fit.residual, 0, 1e-9);
+
+  // Runs cover pixels [0, 40] on rows 0 to 20, so the same corners
+  QuadFit from_runs;
+  CHECK(fitQuad(fill(u), &from_runs));
+  for (int i = 0; i < 4; ++i) {
+    CHECK(from_runs.corners[i] == fit.corners[i]);
+  }
+  CHECK_NEAR(from_runs.residual, 0, 1e-9);
+}
+
+// Rotated either way up to 40 degrees, from contours and from runs
+void testRotated() {
+  for (int degrees = -40; degrees <= 40; degrees += 5) {
+    double angle = degrees * CV_PI / 180;
+    cv::Point2d centre(200, 150), along(cos(angle), sin(angle));
+    cv::Point2d across(-along.y, along.x);
+    std::vector<cv::Point2d> corners = {
+        centre - along * 60 - across * 25, centre + along * 60 - across * 25,
+        centre + along * 60 + across * 25, centre - along * 60 + across * 25};
+    QuadFit fit;
+    CHECK(fitQuad(outline(corners), &fit));
+    CHECK(cornersNear(fit, corners, 1.5));
+    CHECK(fit.residual < 1.5);
+    CHECK_NEAR(fit.area, 120 * 50, 120 * 50 * 0.05);
+
+    // Sampling rows at whole pixels clips a sharp corner by up to a pixel
+    // or two along a shallow edge
+    CHECK(fitQuad(fill(corners), &fit));
+    CHECK(cornersNear(fit, corners, 2.5));
+    CHECK(fit.residual < 2);
+  }
+}
+
+// At 45 degrees the diagonal extremes tie along whole edges, so the axis
+// extremes are the corners
+void testDiamond() {
+  std::vector<cv::Point> diamond = {{50, 0}, {100, 50}, {50, 100}, {0, 50}};
+  QuadFit fit;
+  CHECK(fitQuad(outline({{50, 0}, {100, 50}, {50, 100}, {0, 50}}), &fit));
+  for (int i = 0; i < 4; ++i) {
+    CHECK(fit.corners[i] == diamond[i]);
+  }
+  CHECK_NEAR(fit.area, 5000, 1e-9);
+  CHECK_NEAR(fit.residual, 0, 1e-9);
+}
+
+// A target a few pixels across still fits four corners; the old
+// approxPolyDP epsilon of 20 collapsed these to fewer vertices
+void testSmallTarget() {
+  std::vector<cv::Point2d> u = uShape(8, 5);
+  QuadFit fit;
+  CHECK(fitQuad(outline(u), &fit));
+  CHECK(cornersNear(fit, {{0, 0}, {8, 0}, {8, 5}, {0, 5}}, 0.5));
+  CHECK(fit.residual < 1);
+  CHECK(fitQuad(fill(u), &fit));
+  CHECK(cornersNear(fit, {{0, 0}, {8, 0}, {8, 5}, {0, 5}}, 0.5));
+}
+
+// A disc is not a quad: the arcs bulge well outside the fitted corners
+void testCircle() {
+  std::vector<cv::Point2d> circle;
+  for (int i = 0; i < 64; ++i) {
+    double angle = i * 2 * CV_PI / 64;
+    circle.push_back(cv::Point2d(100 + 30 * cos(angle), 100 + 30 * sin(angle)));
+  }
+  QuadFit fit;
+  CHECK(fitQuad(outline(circle), &fit));
+  CHECK(fit.residual > 5);
+  CHECK(fitQuad(fill(circle), &fit));
+  CHECK(fit.residual > 5);
+}
+
+void testDegenerate() {
+  QuadFit fit;
+  CHECK(!fitQuad(std::vector<cv::Point>(), &fit));
+  CHECK(!fitQuad(std::vector<RowRun>(), &fit));
+  CHECK(!fitQuad(std::vector<cv::Point>(3, cv::Point(5, 5)), &fit));
+  CHECK(!fitQuad(outline({{0, 10}, {30, 10}}), &fit));
+  CHECK(!fitQuad(std::vector<RowRun>{{10, 0, 30}}, &fit));
+  CHECK(!fitQuad(std::vector<cv::Point>{{0, 0}, {1, 1}, {2, 2}, {3, 3}},
+                 &fit));
+}
+
+} // namespace
+
+int main() {
+  testUShape();
+  testRotated();
+  testDiamond();
+  testSmallTarget();
+  testCircle();
+  testDegenerate();
+  return testResult("quad_fit_test");
+}
@@ -0,0 +1,69 @@
+// Frames per second SceneGenerator renders at a few sizes, with the
+// default scene, without sensor noise, with blur, and as YUV. Poses are
+// randomized every frame, as the golden corpus does. Times are the calling
+// thread's CPU time.
+
+#include <stdio.h>
+#include <time.h>
+
+#include "scene_generator.h"
+
+namespace {
+
+const int kFrames = 500;
+const uint64_t kSeed = 40;
+
+int64_t threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+double framesPerSecond(const SceneParams &params) {
+  SceneGenerator generator(kSeed);
+  SceneParams scene = params;
+  // Focal length for a 60 degree horizontal field of view
+  CameraModel camera = pinholeCameraModel(scene.width, scene.height,
+                                          scene.width * 0.866);
+  cv::Mat frame;
+  SceneTruth truth;
+  int64_t total_ns = 0;
+  for (int n = 0; n < kFrames; ++n) {
+    generator.randomizePose(&scene);
+    int64_t start = threadCpuNs();
+    generator.render(scene, camera, &frame, &truth);
+    total_ns += threadCpuNs() - start;
+  }
+  return total_ns > 0 ? kFrames * 1e9 / total_ns : 0;
+}
+
+void run(const char *name, const SceneParams &scene) {
+  printf("%-22s %4dx%-4d %8.0f frames/s\n", name, scene.width,
+         scene.height, framesPerSecond(scene));
+}
+
+SceneParams sized(int width, int height) {
+  SceneParams scene;
+  scene.width = width;
+  scene.height = height;
+  return scene;
+}
+
+} // namespace
+
+int main() {
+  const int kSizes[][2] = {{320, 240}, {640, 480}, {1280, 720}};
+  for (auto &size : kSizes) {
+    run("default", sized(size[0], size[1]));
+  }
+  SceneParams scene = sized(640, 480);
+  scene.noise = 0;
+  run("no noise", scene);
+  scene = sized(640, 480);
+  scene.blur = 3;
+  run("blur 3", scene);
+  scene = sized(640, 480);
+  scene.format = SCENE_YUV_I420;
+  run("yuv", scene);
+  return 0;
+}
@@ -0,0 +1,199 @@
+// Checks that SceneGenerator renders the same frames from the same seed,
+// that its ground-truth corners are the target's outer corners at the
+// requested pose projected with cameraProject(), and that the tape is
+// drawn where the truth says.
+
+#include <math.h>
+#include <string.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "camera_model.h"
+#include "scene_generator.h"
+#include "test_util.h"
+
+namespace {
+
+const int kWidth = 320;
+const int kHeight = 240;
+const double kFocalLength = 260;
+
+bool sameFrame(const cv::Mat &a, const cv::Mat &b) {
+  if (a.size() != b.size() || a.type() != b.type()) {
+    return false;
+  }
+  for (int y = 0; y < a.rows; ++y) {
+    if (memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sameTruth(const SceneTruth &a, const SceneTruth &b) {
+  bool same = a.visible == b.visible && a.centroid == b.centroid;
+  for (int i = 0; i < 4; ++i) {
+    same = same && a.corners[i] == b.corners[i];
+  }
+  return same;
+}
+
+// A busy scene, so every random draw shows up in the pixels
+SceneParams busyScene(SceneFormat format) {
+  SceneParams scene;
+  scene.width = kWidth;
+  scene.height = kHeight;
+  scene.format = format;
+  scene.blur = 3;
+  scene.noise = 4;
+  scene.distractors = 6;
+  scene.clutter = 3;
+  return scene;
+}
+
+void testSeedDeterminism() {
+  CameraModel camera = pinholeCameraModel(kWidth, kHeight, kFocalLength);
+  const SceneFormat kFormats[] = {SCENE_RGBA, SCENE_YUV_I420};
+  for (SceneFormat format : kFormats) {
+    SceneGenerator first(40), second(40), other(41);
+    SceneParams first_scene = busyScene(format);
+    SceneParams second_scene = first_scene, other_scene = first_scene;
+    cv::Mat first_frame, second_frame, other_frame;
+    SceneTruth first_truth, second_truth, other_truth;
+    bool all_same_as_other = true;
+    // Poses are drawn from the same generator as the pixels
+    for (int n = 0; n < 4; ++n) {
+      first.randomizePose(&first_scene);
+      second.randomizePose(&second_scene);
+      other.randomizePose(&other_scene);
+      first.render(first_scene, camera, &first_frame, &first_truth);
+      second.render(second_scene, camera, &second_frame, &second_truth);
+      other.render(other_scene, camera, &other_frame, &other_truth);
+      CHECK(sameFrame(first_frame, second_frame));
+      CHECK(sameTruth(first_truth, second_truth));
+      all_same_as_other =
+          all_same_as_other && sameFrame(first_frame, other_frame);
+    }
+    CHECK(!all_same_as_other);
+    if (format == SCENE_RGBA) {
+      CHECK(first_frame.type() == CV_8UC4 && first_frame.rows == kHeight);
+    } else {
+      CHECK(first_frame.type() == CV_8UC1 &&
+            first_frame.rows == kHeight * 3 / 2);
+    }
+    CHECK(first_frame.cols == kWidth);
+  }
+}
+
+// The pose as SceneParams documents it: skew about the target's vertical
+// axis, roll about the optical axis, then out to the centre at range,
+// bearing (+ left) and elevation (+ up)
+cv::Point3d posed(const SceneParams &scene, const cv::Point3d &point) {
+  const double cs = cos(scene.skew), ss = sin(scene.skew);
+  const double cr = cos(scene.roll), sr = sin(scene.roll);
+  cv::Matx33d skew(cs, 0, ss, 0, 1, 0, -ss, 0, cs);
+  cv::Matx33d roll(cr, -sr, 0, sr, cr, 0, 0, 0, 1);
+  cv::Vec3d direction(-sin(scene.bearing) * cos(scene.elevation),
+                      -sin(scene.elevation),
+                      cos(scene.bearing) * cos(scene.elevation));
+  cv::Vec3d moved = roll * skew * cv::Vec3d(point.x, point.y, point.z) +
+                    scene.range * direction;
+  return cv::Point3d(moved[0], moved[1], moved[2]);
+}
+
+void testTruthCorners() {
+  CameraModel camera = pinholeCameraModel(kWidth, kHeight, kFocalLength);
+  cv::Point3d outline[kTargetOutlinePoints];
+  targetOutline(outline);
+  SceneGenerator generator(40);
+  SceneParams scene;
+  scene.width = kWidth;
+  scene.height = kHeight;
+  cv::Mat frame;
+  SceneTruth truth;
+
+  // Head on, the U is centred and square to the image
+  generator.render(scene, camera, &frame, &truth);
+  CHECK(truth.visible);
+  CHECK_NEAR(truth.centroid.x, camera.cx, 1e-9);
+  CHECK_NEAR(truth.centroid.y, camera.cy, 1e-9);
+  CHECK_NEAR(truth.corners[0].y, truth.corners[1].y, 1e-9);
+  CHECK_NEAR(truth.corners[1].x, truth.corners[2].x, 1e-9);
+
+  for (int n = 0; n < 20; ++n) {
+    generator.randomizePose(&scene);
+    generator.render(scene, camera, &frame, &truth);
+    cv::Point2d centroid(0, 0);
+    bool inside = true;
+    for (int i = 0; i < 4; ++i) {
+      cv::Point2d expected = cameraProject(
+          camera, posed(scene, outline[kTargetOuterCorners[i]]));
+      CHECK_NEAR(truth.corners[i].x, expected.x, 1e-9);
+      CHECK_NEAR(truth.corners[i].y, expected.y, 1e-9);
+      centroid += expected * 0.25;
+      inside = inside && expected.x >= 0 && expected.x < kWidth &&
+               expected.y >= 0 && expected.y < kHeight;
+    }
+    CHECK_NEAR(truth.centroid.x, centroid.x, 1e-9);
+    CHECK_NEAR(truth.centroid.y, centroid.y, 1e-9);
+    CHECK(truth.visible == inside);
+  }
+
+  // Partly out of view, and behind the camera
+  scene = SceneParams();
+  scene.width = kWidth;
+  scene.height = kHeight;
+  scene.bearing = 0.5;
+  generator.render(scene, camera, &frame, &truth);
+  CHECK(!truth.visible);
+  scene.bearing = CV_PI;
+  generator.render(scene, camera, &frame, &truth);
+  CHECK(!truth.visible);
+}
+
+// On a clean frame the middle of the U's base is tape the scene threshold
+// takes, and the middle of the notch above it is background
+void testTapeAtTruth() {
+  CameraModel camera = pinholeCameraModel(kWidth, kHeight, kFocalLength);
+  cv::Point3d outline[kTargetOutlinePoints];
+  targetOutline(outline);
+  SceneGenerator generator(40);
+  SceneParams scene;
+  scene.width = kWidth;
+  scene.height = kHeight;
+  scene.noise = 0;
+  scene.distractors = 0;
+  scene.clutter = 0;
+  scene.range = 1.5;
+  scene.skew = 0.3;
+  scene.roll = 0.05;
+  cv::Mat frame, hsv;
+  SceneTruth truth;
+  generator.render(scene, camera, &frame, &truth);
+  cv::cvtColor(frame, hsv, CV_RGB2HSV);
+
+  // Outline points 2 and 7 are the inner and outer corners at the base
+  double base_y = (outline[2].y + outline[7].y) / 2;
+  double notch_y = (outline[0].y + outline[2].y) / 2;
+  cv::Point2d base =
+      cameraProject(camera, posed(scene, cv::Point3d(0, base_y, 0)));
+  cv::Point2d notch =
+      cameraProject(camera, posed(scene, cv::Point3d(0, notch_y, 0)));
+  const HsvThreshold threshold = sceneThreshold();
+  const cv::Vec3b tape = hsv.at<cv::Vec3b>(cvRound(base.y), cvRound(base.x));
+  CHECK(tape[0] >= threshold.h_min && tape[0] <= threshold.h_max);
+  CHECK(tape[1] >= threshold.s_min && tape[1] <= threshold.s_max);
+  CHECK(tape[2] >= threshold.v_min && tape[2] <= threshold.v_max);
+  const cv::Vec3b background =
+      hsv.at<cv::Vec3b>(cvRound(notch.y), cvRound(notch.x));
+  CHECK(background[2] < threshold.v_min);
+}
+
+} // namespace
+
+int main() {
+  testSeedDeterminism();
+  testTruthCorners();
+  testTapeAtTruth();
+  return testResult("scene_generator_test");
+}
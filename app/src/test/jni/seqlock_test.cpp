@@ -0,0 +1,132 @@
+// Checks Seqlock ordering and, under a writer racing several readers, that
+// no reader ever copies out a torn value or an older one than it saw
+// before; then the TargetResults channel built on it.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "seqlock.h"
+#include "target_results.h"
+#include "test_util.h"
+
+namespace {
+
+// Large enough that a copy spans many cache lines, odd-sized so the last
+// word is partly padding
+struct Payload {
+  uint64_t words[300];
+  uint8_t tail[3];
+};
+
+void fill(uint64_t n, Payload *payload) {
+  for (int i = 0; i < 300; ++i) {
+    payload->words[i] = n * 31 + i;
+  }
+  for (int i = 0; i < 3; ++i) {
+    payload->tail[i] = static_cast<uint8_t>(n + i);
+  }
+}
+
+bool consistent(const Payload &payload) {
+  uint64_t n = payload.words[0] / 31;
+  for (int i = 0; i < 300; ++i) {
+    if (payload.words[i] != n * 31 + i) {
+      return false;
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (payload.tail[i] != static_cast<uint8_t>(n + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void testSingleThread() {
+  Seqlock<Payload> lock;
+  Payload payload;
+  CHECK(lock.load(&payload) == 0);
+  CHECK(payload.words[0] == 0 && payload.words[299] == 0);
+  for (uint64_t n = 1; n <= 3; ++n) {
+    fill(n, &payload);
+    lock.store(payload);
+  }
+  Payload out;
+  CHECK(lock.load(&out) == 3);
+  CHECK(out.words[0] == 3 * 31 && consistent(out));
+}
+
+void testTornReads() {
+  const int kReaders = 4;
+  const uint64_t kStores = 200000;
+  Seqlock<Payload> lock;
+  std::atomic<bool> done(false);
+  std::atomic<int64_t> reads(0), torn(0), backwards(0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kReaders; ++r) {
+    readers.emplace_back([&] {
+      Payload payload;
+      uint32_t last = 0;
+      uint64_t last_n = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        uint32_t sequence = lock.load(&payload);
+        if (sequence == 0) {
+          continue;
+        }
+        reads++;
+        uint64_t n = payload.words[0] / 31;
+        if (!consistent(payload) || n != sequence) {
+          torn++;
+        }
+        if (sequence < last || n < last_n) {
+          backwards++;
+        }
+        last = sequence;
+        last_n = n;
+      }
+    });
+  }
+  Payload payload;
+  for (uint64_t n = 1; n <= kStores; ++n) {
+    fill(n, &payload);
+    lock.store(payload);
+  }
+  done = true;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  printf("%lld reads of %llu stores, %lld torn, %lld backwards\n",
+         (long long)reads.load(), (unsigned long long)kStores,
+         (long long)torn.load(), (long long)backwards.load());
+  CHECK(reads.load() > 0);
+  CHECK(torn.load() == 0);
+  CHECK(backwards.load() == 0);
+}
+
+void testTargetResults() {
+  TargetResults results = TargetResults();
+  TargetResults latest;
+  uint32_t first = latestTargetResults(&latest);
+  for (int i = 0; i < 3; ++i) {
+    results.num_targets = i;
+    results.capture_time_ns = 1000 + i;
+    publishTargetResults(&results);
+  }
+  CHECK(results.sequence == first + 3);
+  CHECK(latestTargetResults(&latest) == first + 3);
+  CHECK(latest.sequence == first + 3);
+  CHECK(latest.num_targets == 2);
+  CHECK(latest.capture_time_ns == 1002);
+}
+
+} // namespace
+
+int main() {
+  testSingleThread();
+  testTornReads();
+  testTargetResults();
+  return testResult("seqlock_test");
+}
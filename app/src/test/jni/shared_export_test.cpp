@@ -0,0 +1,227 @@
+// Runs SharedExport's consumer protocol (shared_export_format.h) in a forked
+// process against a writer publishing results and frames as fast as it
+// can, alternately copied and written in place, and checks that every
+// record the reader accepts is whole.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "common.hpp"
+#include "shared_export.h"
+#include "test_util.h"
+
+namespace {
+
+const uint64_t kRecords = 20000;
+const int kWidth = 64;
+const int kHeight = 48;
+const int64_t kReaderTimeoutNs = 20000000000LL;
+
+// What the writer puts in record n, so the reader can tell a torn copy
+void fillResults(uint32_t n, TargetResults *results) {
+  results->capture_time_ns = n;
+  results->num_targets = n % (kMaxReportedTargets + 1);
+  for (int i = 0; i < results->num_targets; ++i) {
+    results->targets[i].centroid_x = n + i;
+    results->targets[i].id = static_cast<int>(n);
+  }
+}
+
+bool wholeResults(const TargetResults &results) {
+  uint32_t n = results.sequence;
+  if (results.capture_time_ns != n ||
+      results.num_targets != static_cast<int>(n % (kMaxReportedTargets + 1))) {
+    return false;
+  }
+  for (int i = 0; i < results.num_targets; ++i) {
+    if (results.targets[i].centroid_x != n + i ||
+        results.targets[i].id != static_cast<int>(n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct ReaderCounts {
+  int64_t results;
+  int64_t torn_results;
+  int64_t frames;
+  int64_t torn_frames;
+  int64_t retries;
+};
+
+// Maps the region read-only once its magic is there
+const uint8_t *mapRegion(const char *path, size_t *size) {
+  int64_t deadline = getTimeNs() + kReaderTimeoutNs;
+  while (getTimeNs() < deadline) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (map != MAP_FAILED) {
+        if (memcmp(map, kSharedExportMagic, sizeof(kSharedExportMagic)) ==
+            0) {
+          *size = st.st_size;
+          return static_cast<const uint8_t *>(map);
+        }
+        munmap(map, st.st_size);
+      }
+    } else if (fd >= 0) {
+      ::close(fd);
+    }
+    usleep(100);
+  }
+  return NULL;
+}
+
+// The consumer, as another process would write it
+int runReader(const char *path) {
+  size_t size;
+  const uint8_t *map = mapRegion(path, &size);
+  if (map == NULL) {
+    fprintf(stderr, "reader: no region at %s\n", path);
+    return 2;
+  }
+  const SharedExportHeader *header =
+      reinterpret_cast<const SharedExportHeader *>(map);
+  ReaderCounts counts = ReaderCounts();
+  TargetResults results;
+  uint32_t last = 0;
+  int64_t deadline = getTimeNs() + kReaderTimeoutNs;
+  while (last < kRecords && getTimeNs() < deadline) {
+    uint64_t written =
+        __atomic_load_n(&header->results_written, __ATOMIC_ACQUIRE);
+    if (written == 0) {
+      continue;
+    }
+    const SharedResultSlot *slot = reinterpret_cast<const SharedResultSlot *>(
+        map + kSharedExportHeaderSize +
+        ((written - 1) % header->result_slots) * header->result_slot_size);
+    uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    memcpy(&results, &slot->results, sizeof(results));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    if (before != after || (before & 1) != 0) {
+      counts.retries++;
+      continue;
+    }
+    counts.results++;
+    if (!wholeResults(results) || before != 2 * results.sequence ||
+        results.sequence < last) {
+      counts.torn_results++;
+    }
+    last = results.sequence;
+
+    uint64_t frames =
+        __atomic_load_n(&header->frames_written, __ATOMIC_ACQUIRE);
+    if (frames == 0) {
+      continue;
+    }
+    // Frames are checked in place, without a copy
+    const uint8_t *frame_slot = map + sharedFrameOffset(*header) +
+                                ((frames - 1) % kSharedFrameSlots) *
+                                    header->frame_slot_size;
+    const SharedFrameHeader *frame =
+        reinterpret_cast<const SharedFrameHeader *>(frame_slot);
+    before = __atomic_load_n(&frame->sequence, __ATOMIC_ACQUIRE);
+    const uint8_t *pixels = frame_slot + sizeof(SharedFrameHeader);
+    uint8_t value = pixels[0];
+    bool uniform = true;
+    for (int i = 0; i < kWidth * kHeight * 4 && uniform; ++i) {
+      uniform = pixels[i] == value;
+    }
+    int64_t capture_time_ns = frame->capture_time_ns;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&frame->sequence, __ATOMIC_RELAXED);
+    if (before != after || (before & 1) != 0) {
+      counts.retries++;
+      continue;
+    }
+    counts.frames++;
+    if (!uniform || value != static_cast<uint8_t>(capture_time_ns)) {
+      counts.torn_frames++;
+    }
+  }
+  munmap(const_cast<uint8_t *>(map), size);
+  printf("reader: %lld results (%lld torn), %lld frames (%lld torn), "
+         "%lld retries, last %u\n",
+         (long long)counts.results, (long long)counts.torn_results,
+         (long long)counts.frames, (long long)counts.torn_frames,
+         (long long)counts.retries, last);
+  return last == kRecords && counts.torn_results == 0 &&
+                 counts.torn_frames == 0 && counts.results > 0
+             ? 0
+             : 1;
+}
+
+void testForkedReader() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/shared_export_test-%d.shm",
+           static_cast<int>(getpid()));
+  unlink(path);
+  fflush(stdout);
+  pid_t pid = fork();
+  CHECK(pid >= 0);
+  if (pid == 0) {
+    int result = runReader(path);
+    fflush(stdout);
+    _exit(result);
+  }
+
+  SharedExport &shared_export = sharedExport();
+  shared_export.start(path, 8, true);
+  std::vector<uint8_t> pixels(kWidth * kHeight * 4);
+  cv::Mat rgba(kHeight, kWidth, CV_8UC4, &pixels[0]);
+  TargetResults results = TargetResults();
+  for (uint32_t n = 1; n <= kRecords; ++n) {
+    shared_export.beginFrame(kWidth, kHeight);
+    if (n == 1) {
+      CHECK(shared_export.exportingFrames());
+    }
+    if (n % 2 == 0) {
+      memset(&pixels[0], n & 0xff, pixels.size());
+      shared_export.publishFrame(n, rgba);
+    } else {
+      // Written in place, as processImpl reads frames into the slot
+      cv::Mat slot = shared_export.beginFrameWrite(n, kWidth, kHeight);
+      CHECK(!slot.empty() && slot.isContinuous());
+      if (!slot.empty()) {
+        memset(slot.data, n & 0xff, pixels.size());
+        shared_export.commitFrame();
+      }
+    }
+    results.sequence = n;
+    fillResults(n, &results);
+    shared_export.publishResults(results);
+    // Let the reader in now and then on a single core
+    if (n % 64 == 0) {
+      usleep(20);
+    }
+  }
+  // No slot for a frame of another size
+  CHECK(shared_export.beginFrameWrite(0, kWidth / 2, kHeight).empty());
+  int status = 0;
+  CHECK(waitpid(pid, &status, 0) == pid);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  shared_export.stop();
+  shared_export.beginFrame(kWidth, kHeight);
+  CHECK(!shared_export.exportingFrames());
+  unlink(path);
+}
+
+} // namespace
+
+int main() {
+  testForkedReader();
+  return testResult("shared_export_test");
+}
@@ -0,0 +1,175 @@
+// Feeds filterContours() outlines that each fail one stage of the rejection
+// cascade, or pass all of them, and checks how many each stage turned down,
+// which targets came out, and that a missed deadline drops the rest.
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "target_detector.h"
+#include "test_util.h"
+
+namespace {
+
+typedef std::vector<cv::Point> Contour;
+
+// Integer points every half pixel along the closed polygon, moved by
+// offset, as findContours would give them
+Contour outline(const std::vector<cv::Point2d> &polygon,
+                cv::Point2d offset) {
+  Contour points;
+  for (size_t i = 0; i < polygon.size(); ++i) {
+    cv::Point2d a = polygon[i] + offset;
+    cv::Point2d b = polygon[(i + 1) % polygon.size()] + offset;
+    cv::Point2d edge = b - a;
+    int steps = std::max(1, static_cast<int>(2 * sqrt(edge.dot(edge))));
+    for (int step = 0; step < steps; ++step) {
+      cv::Point2d p = a + edge * (static_cast<double>(step) / steps);
+      cv::Point point(cvRound(p.x), cvRound(p.y));
+      if (points.empty() || points.back() != point) {
+        points.push_back(point);
+      }
+    }
+  }
+  return points;
+}
+
+std::vector<cv::Point2d> rectangle(double width, double height) {
+  return {{0, 0}, {width, 0}, {width, height}, {0, height}};
+}
+
+// The target: open at the top, with arms and base `thickness` thick
+std::vector<cv::Point2d> uShape(double width, double height,
+                                double thickness) {
+  return {{0, 0},
+          {thickness, 0},
+          {thickness, height - thickness},
+          {width - thickness, height - thickness},
+          {width - thickness, 0},
+          {width, 0},
+          {width, height},
+          {0, height}};
+}
+
+std::vector<cv::Point2d> rotated(const std::vector<cv::Point2d> &polygon,
+                                 double degrees) {
+  double c = cos(degrees * M_PI / 180), s = sin(degrees * M_PI / 180);
+  std::vector<cv::Point2d> turned;
+  for (auto &p : polygon) {
+    turned.push_back(cv::Point2d(c * p.x - s * p.y, s * p.x + c * p.y));
+  }
+  return turned;
+}
+
+std::vector<cv::Point2d> circle(double radius) {
+  std::vector<cv::Point2d> polygon;
+  for (int i = 0; i < 64; ++i) {
+    polygon.push_back(cv::Point2d(radius * cos(i * M_PI / 32),
+                                  radius * sin(i * M_PI / 32)));
+  }
+  return polygon;
+}
+
+// One contour for each way out of the cascade, in no particular order, and
+// two targets. With the default filter: at least 20 x 10 pixels, a blob
+// area of at least 20, quads at most 300 x 100 and 20-50% full.
+std::vector<Contour> makeContours() {
+  std::vector<Contour> contours;
+  // Bounds: too few points, and too narrow
+  contours.push_back({{10, 10}, {40, 10}, {25, 30}});
+  contours.push_back(outline(rectangle(10, 5), {50, 10}));
+  // Area: a 32 x 16 sliver of area 15
+  contours.push_back({{100, 10}, {130, 25}, {131, 25}, {101, 10}});
+  // Budget: the smallest of the rest, when one too many are left
+  contours.push_back(outline(rectangle(22, 12), {150, 10}));
+  // Quad: no four corners come within 15% of a side of a circle
+  contours.push_back(outline(circle(30), {240, 60}));
+  // Size: a U far wider than any target
+  contours.push_back(outline(uShape(400, 60, 8), {10, 300}));
+  // Shape: the target turned 45 degrees
+  contours.push_back(outline(rotated(uShape(60, 40, 8), 45), {400, 100}));
+  // Fullness: a solid block the size of the target
+  contours.push_back(outline(rectangle(60, 40), {10, 100}));
+  // Kept: two targets, 41% and 40% full
+  contours.push_back(outline(uShape(60, 40, 8), {100, 100}));
+  contours.push_back(outline(uShape(80, 50, 10), {200, 150}));
+  return contours;
+}
+
+void testCounters() {
+  std::vector<Contour> contours = makeContours();
+  DetectionOptions options;
+  // Seven candidates make it past the area check
+  options.max_candidates = 6;
+  DetectionResult result;
+  filterContours(contours, options, &result);
+  const CascadeCounters &cascade = result.cascade;
+  CHECK(cascade.contours == 10);
+  CHECK(cascade.rejected[CASCADE_BOUNDS] == 2);
+  CHECK(cascade.rejected[CASCADE_AREA] == 1);
+  CHECK(cascade.rejected[CASCADE_BUDGET] == 1);
+  CHECK(cascade.rejected[CASCADE_QUAD] == 1);
+  CHECK(cascade.rejected[CASCADE_SIZE] == 1);
+  CHECK(cascade.rejected[CASCADE_SHAPE] == 1);
+  CHECK(cascade.rejected[CASCADE_FULLNESS] == 1);
+  CHECK(result.targets.size() == 2);
+  // Everything with a fitted quad that failed a later check
+  CHECK(result.rejected_targets.size() == 3);
+  CHECK(!result.deadline_hit && result.deadline_dropped == 0);
+  // The final checks are timed as one, into CASCADE_SIZE
+  CHECK(cascade.time_ns[CASCADE_SHAPE] == 0);
+  CHECK(cascade.time_ns[CASCADE_FULLNESS] == 0);
+
+  std::vector<cv::Point2d> centres;
+  for (auto &target : result.targets) {
+    centres.push_back(cv::Point2d(target.centroid_x, target.centroid_y));
+  }
+  std::sort(centres.begin(), centres.end(),
+            [](const cv::Point2d &a, const cv::Point2d &b) {
+              return a.x < b.x;
+            });
+  CHECK(centres.size() == 2);
+  if (centres.size() == 2) {
+    CHECK_NEAR(centres[0].x, 130, 2);
+    CHECK_NEAR(centres[0].y, 120, 2);
+    CHECK_NEAR(centres[1].x, 240, 2);
+    CHECK_NEAR(centres[1].y, 175, 2);
+  }
+
+  // Without the cap the small block gets as far as the fullness check
+  options.max_candidates = kMaxGeometryCandidates;
+  filterContours(contours, options, &result);
+  CHECK(result.cascade.rejected[CASCADE_BUDGET] == 0);
+  CHECK(result.cascade.rejected[CASCADE_FULLNESS] == 2);
+  CHECK(result.targets.size() == 2);
+}
+
+// Past the deadline every candidate that survived the bounds check is
+// dropped at the first checkpoint
+void testDeadline() {
+  std::vector<Contour> contours = makeContours();
+  DetectionOptions options;
+  options.deadline_ns = 1;
+  DetectionResult result;
+  filterContours(contours, options, &result);
+  CHECK(result.deadline_hit);
+  CHECK(result.deadline_dropped == 8);
+  CHECK(result.cascade.rejected[CASCADE_BOUNDS] == 2);
+  CHECK(result.cascade.rejected[CASCADE_QUAD] == 0);
+  CHECK(result.targets.empty() && result.rejected_targets.empty());
+
+  // A fresh call starts from zero
+  options.deadline_ns = 0;
+  filterContours(contours, options, &result);
+  CHECK(!result.deadline_hit && result.deadline_dropped == 0);
+  CHECK(result.targets.size() == 2);
+}
+
+} // namespace
+
+int main() {
+  testCounters();
+  testDeadline();
+  return testResult("target_detector_test");
+}
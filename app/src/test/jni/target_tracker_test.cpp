@@ -0,0 +1,157 @@
+// Replays detection sequences with known motion through TargetTracker and
+// checks ids and latency-compensated predictions against the true motion.
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "target_tracker.h"
+#include "test_util.h"
+
+namespace {
+
+const int64_t kFrameNs = 33333333;
+// Capture to send, about what the phone measures
+const int64_t kLatencyNs = 70000000;
+
+// Deterministic +-amplitude jitter, standing in for centroid noise
+double jitter(int frame, int axis, double amplitude) {
+  uint32_t v = static_cast<uint32_t>(frame * 2654435761u + axis * 40503u);
+  v ^= v >> 13;
+  v *= 0x5bd1e995u;
+  v ^= v >> 15;
+  return amplitude * ((v % 2001) / 1000.0 - 1);
+}
+
+TargetInfo detection(double x, double y) {
+  TargetInfo target;
+  target.centroid_x = x;
+  target.centroid_y = y;
+  target.width = 40;
+  target.height = 20;
+  return target;
+}
+
+// A target panning at constant speed, as when the robot turns: once the
+// filter settles, the prediction to send time has to land on the true
+// position within the noise, while the raw centroid lags by a latency's
+// worth of motion
+void testConstantVelocity() {
+  const double vx = 300, vy = -120; // pixels / s
+  TargetTracker tracker;
+  std::vector<int> ids;
+  int first_id = -1;
+  double worst_error = 0;
+  double lag = 0;
+  for (int frame = 0; frame < 60; ++frame) {
+    double t = frame * kFrameNs / 1e9;
+    double x = 100 + vx * t;
+    double y = 300 + vy * t;
+    std::vector<TargetInfo> detections(
+        1, detection(x + jitter(frame, 0, 1), y + jitter(frame, 1, 1)));
+    tracker.update(detections, frame * kFrameNs, &ids);
+    CHECK(ids.size() == 1);
+    if (frame == 0) {
+      first_id = ids[0];
+    }
+    CHECK(ids[0] == first_id);
+
+    TrackedTarget predicted;
+    CHECK(tracker.predict(ids[0], frame * kFrameNs + kLatencyNs, &predicted));
+    if (frame >= 15) {
+      double t_send = t + kLatencyNs / 1e9;
+      double error = hypot(predicted.centroid_x - (100 + vx * t_send),
+                           predicted.centroid_y - (300 + vy * t_send));
+      worst_error = std::max(worst_error, error);
+      lag = hypot(vx, vy) * kLatencyNs / 1e9;
+      CHECK_NEAR(predicted.velocity_x, vx, 30);
+      CHECK_NEAR(predicted.velocity_y, vy, 30);
+      CHECK(predicted.variance_x > 0 && predicted.variance_y > 0);
+    }
+  }
+  printf("constant velocity: worst prediction error %.2f px, raw lag %.2f px\n",
+         worst_error, lag);
+  CHECK(worst_error < 5);
+  CHECK(worst_error < lag / 4);
+}
+
+// Two targets side by side keep their own ids, in either detection order
+void testTwoTargets() {
+  TargetTracker tracker;
+  std::vector<int> ids;
+  int left_id = -1, right_id = -1;
+  for (int frame = 0; frame < 40; ++frame) {
+    double t = frame * kFrameNs / 1e9;
+    TargetInfo left = detection(200 + 150 * t, 240);
+    TargetInfo right = detection(400 + 150 * t, 250 - 60 * t);
+    std::vector<TargetInfo> detections;
+    bool swapped = frame % 3 == 1;
+    detections.push_back(swapped ? right : left);
+    detections.push_back(swapped ? left : right);
+    tracker.update(detections, frame * kFrameNs, &ids);
+    CHECK(ids.size() == 2);
+    int left_now = ids[swapped ? 1 : 0];
+    int right_now = ids[swapped ? 0 : 1];
+    if (frame == 0) {
+      left_id = left_now;
+      right_id = right_now;
+      CHECK(left_id != right_id);
+    }
+    CHECK(left_now == left_id);
+    CHECK(right_now == right_id);
+  }
+}
+
+// A track survives a few missed frames and then coasts on its velocity; a
+// detection far from every prediction starts a new track, and a track that
+// stays unseen is dropped
+void testDropoutsAndNewTargets() {
+  TargetTracker tracker;
+  std::vector<int> ids;
+  const double vx = 200;
+  int id = -1;
+  int frame = 0;
+  for (; frame < 20; ++frame) {
+    tracker.update(std::vector<TargetInfo>(1, detection(100 + vx * frame *
+                                                              kFrameNs / 1e9,
+                                                        200)),
+                   frame * kFrameNs, &ids);
+    id = ids[0];
+  }
+  // Three frames without the target
+  for (; frame < 23; ++frame) {
+    tracker.update(std::vector<TargetInfo>(), frame * kFrameNs, &ids);
+  }
+  TrackedTarget coasting;
+  CHECK(tracker.predict(id, frame * kFrameNs, &coasting));
+  CHECK_NEAR(coasting.centroid_x, 100 + vx * frame * kFrameNs / 1e9, 5);
+  tracker.update(std::vector<TargetInfo>(
+                     1, detection(100 + vx * frame * kFrameNs / 1e9, 200)),
+                 frame * kFrameNs, &ids);
+  CHECK(ids[0] == id);
+  ++frame;
+
+  tracker.update(std::vector<TargetInfo>(1, detection(600, 50)),
+                 frame * kFrameNs, &ids);
+  CHECK(ids[0] != id);
+  int far_id = ids[0];
+  ++frame;
+
+  for (int i = 0; i < 30; ++i, ++frame) {
+    tracker.update(std::vector<TargetInfo>(), frame * kFrameNs, &ids);
+  }
+  TrackedTarget dropped;
+  CHECK(!tracker.predict(id, frame * kFrameNs, &dropped));
+  CHECK(!tracker.predict(far_id, frame * kFrameNs, &dropped));
+}
+
+} // namespace
+
+int main() {
+  testConstantVelocity();
+  testTwoTargets();
+  testDropoutsAndNewTargets();
+  return testResult("target_tracker_test");
+}
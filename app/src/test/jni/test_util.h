@@ -0,0 +1,37 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+// Assertions for the host tests. A failed check prints where it failed and
+// the test carries on, so one run shows every failure; main() returns
+// testResult().
+
+inline int &testFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+inline void testFailed(const char *file, int line, const char *what) {
+  fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+  testFailures()++;
+}
+
+#define CHECK(condition)                                                       \
+  ((condition) ? (void)0 : testFailed(__FILE__, __LINE__, #condition))
+
+#define CHECK_NEAR(actual, expected, tolerance)                                \
+  (fabs((actual) - (expected)) <= (tolerance)                                  \
+       ? (void)0                                                               \
+       : (fprintf(stderr, "  %s = %g, expected %g +- %g\n", #actual,           \
+                  (double)(actual), (double)(expected), (double)(tolerance)),  \
+          testFailed(__FILE__, __LINE__, #actual " near " #expected)))
+
+inline int testResult(const char *name) {
+  if (testFailures() == 0) {
+    printf("%s: passed\n", name);
+    return 0;
+  }
+  printf("%s: %d checks failed\n", name, testFailures());
+  return 1;
+}
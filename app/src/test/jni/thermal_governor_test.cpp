@@ -0,0 +1,259 @@
+// Replays thermal traces through the governor to check when levels are
+// entered and left, reads sensors from fake sysfs trees, and runs the
+// background sampler end to end against one, replaying the trace it
+// recorded.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "thermal_governor.h"
+#include "test_util.h"
+
+namespace {
+
+const int64_t kSamplerTimeoutNs = 5000000000LL;
+
+std::string tempPath(const char *name) {
+  return std::string("/tmp/thermal_governor_test-") + name + "-" +
+         std::to_string(getpid());
+}
+
+void writeFile(const std::string &path, const std::string &contents) {
+  std::string dir = path.substr(0, path.rfind('/'));
+  CHECK(system(("mkdir -p '" + dir + "'").c_str()) == 0);
+  FILE *file = fopen(path.c_str(), "w");
+  CHECK(file != NULL);
+  if (file != NULL) {
+    fputs(contents.c_str(), file);
+    fclose(file);
+  }
+}
+
+void removeTree(const std::string &root) {
+  CHECK(system(("rm -rf '" + root + "'").c_str()) == 0);
+}
+
+// Zones in millidegrees, one in whole degrees, one reading 0 (skipped when
+// opened) and one out of range; a little core at its full clock, a big one
+// and a big one with no current frequency
+std::string makeSysfs(const char *name, int zone0_millidegrees) {
+  std::string root = tempPath(name);
+  std::string thermal = root + "/class/thermal/thermal_zone";
+  writeFile(thermal + "0/temp", std::to_string(zone0_millidegrees) + "\n");
+  writeFile(thermal + "1/temp", "48\n");
+  writeFile(thermal + "2/temp", "0\n");
+  writeFile(thermal + "3/temp", "200000\n");
+  writeFile(root + "/class/thermal/cooling_device0/cur_state", "0\n");
+  std::string cpu = root + "/devices/system/cpu/cpu";
+  writeFile(cpu + "0/cpufreq/cpuinfo_max_freq", "1400000\n");
+  writeFile(cpu + "0/cpufreq/scaling_cur_freq", "1400000\n");
+  writeFile(cpu + "4/cpufreq/cpuinfo_max_freq", "2400000\n");
+  writeFile(cpu + "4/cpufreq/scaling_cur_freq", "1920000\n");
+  writeFile(cpu + "5/cpufreq/cpuinfo_max_freq", "2400000\n");
+  writeFile(root + "/devices/system/cpu/online", "0-4\n");
+  return root;
+}
+
+// One sample per line at time_ms, as the trace= option records them
+struct TraceLine {
+  double time_ms;
+  double temp_c;
+  double freq_ratio;
+  double frame_cost;
+};
+
+bool replay(const std::vector<TraceLine> &samples, std::vector<int> *levels,
+            const ThermalConfig &config = defaultThermalConfig()) {
+  std::string path = tempPath("trace");
+  FILE *file = fopen(path.c_str(), "w");
+  CHECK(file != NULL);
+  if (file == NULL) {
+    return false;
+  }
+  fprintf(file, "# time_ms temp_c freq_ratio frame_cost\n\n");
+  for (auto &s : samples) {
+    fprintf(file, "%.0f %.1f %.3f %.3f\n", s.time_ms, s.temp_c, s.freq_ratio,
+            s.frame_cost);
+  }
+  fclose(file);
+  bool ok = replayThermalTrace(path.c_str(), config, levels);
+  unlink(path.c_str());
+  return ok;
+}
+
+// Every 500 ms for seconds, the temperature from temp(t) in seconds
+template <typename Temp>
+std::vector<TraceLine> trace(double seconds, Temp temp,
+                             double freq_ratio = 1.0,
+                             double frame_cost = 0.3) {
+  std::vector<TraceLine> samples;
+  for (double t = 0; t < seconds; t += 0.5) {
+    TraceLine line = {t * 1000, temp(t), freq_ratio, frame_cost};
+    samples.push_back(line);
+  }
+  return samples;
+}
+
+int countChanges(const std::vector<int> &levels) {
+  int changes = 0;
+  for (size_t i = 1; i < levels.size(); ++i) {
+    changes += levels[i] != levels[i - 1];
+  }
+  return changes;
+}
+
+void testConfig() {
+  ThermalConfig config = defaultThermalConfig();
+  CHECK(parseThermalConfig("warm=50 # cooler phone\nfreq_severe=0.4 "
+                           "trace=/tmp/t sysfs=/tmp/s",
+                           &config));
+  CHECK(config.temp_c[0] == 50 && config.temp_c[1] == 65);
+  CHECK(config.freq_ratio[2] == 0.4);
+  CHECK(config.trace_path == "/tmp/t" && config.sysfs_root == "/tmp/s");
+  CHECK(parseThermalConfig("trace=off enabled=0", &config));
+  CHECK(config.trace_path.empty() && !config.enabled);
+
+  const char *bad[] = {"warm=70",  "hot=50",  "freq_warm=1.5",
+                       "warm=abc", "severe=", "enabled=yes",
+                       "trace=",   "cold=10", "freq_hot=0.9"};
+  for (auto spec : bad) {
+    ThermalConfig unchanged = defaultThermalConfig();
+    CHECK(!parseThermalConfig(spec, &unchanged));
+    CHECK(unchanged.temp_c[0] == 55 && unchanged.freq_ratio[1] == 0.7);
+  }
+}
+
+void testSensors() {
+  std::string root = makeSysfs("sensors", 61500);
+  ThermalSensors sensors;
+  CHECK(sensors.open(root));
+  ThermalSample sample;
+  sensors.read(&sample);
+  CHECK_NEAR(sample.temp_c, 61.5, 1e-9);
+  // cpu4 at 80%; the little cpu0 at 100% does not count, and cpu5 has no
+  // current frequency
+  CHECK_NEAR(sample.freq_ratio, 0.8, 1e-9);
+
+  writeFile(root + "/class/thermal/thermal_zone0/temp", "30000\n");
+  writeFile(root + "/devices/system/cpu/cpu4/cpufreq/scaling_cur_freq",
+            "2600000\n");
+  sensors.read(&sample);
+  CHECK_NEAR(sample.temp_c, 48, 1e-9);
+  CHECK_NEAR(sample.freq_ratio, 1, 1e-9);
+  removeTree(root);
+
+  CHECK(!sensors.open(tempPath("missing")));
+  sensors.read(&sample);
+  CHECK(sample.temp_c == 0 && sample.freq_ratio == 1);
+}
+
+void testReplayLevels() {
+  std::vector<int> levels;
+  // Cool: nothing happens
+  CHECK(replay(trace(60, [](double) { return 45.0; }), &levels));
+  CHECK(levels.size() == 120 && countChanges(levels) == 0 && levels[0] == 0);
+
+  // A single hot sample is not enough to raise the level
+  std::vector<TraceLine> spike = trace(10, [](double) { return 45.0; });
+  spike[5].temp_c = 80;
+  CHECK(replay(spike, &levels));
+  CHECK(countChanges(levels) == 0);
+
+  // Straight to 70 C: level 2 on the second sample, then held while hot,
+  // and only let go one level per 15 s of calm once it cools
+  CHECK(replay(trace(60, [](double t) { return t < 20 ? 70.0 : 40.0; }),
+               &levels));
+  CHECK(levels[0] == 0 && levels[1] == 2 && levels[39] == 2);
+  CHECK(levels[69] == 2 && levels[70] == 1);
+  CHECK(levels[99] == 1 && levels[100] == 0);
+  CHECK(levels.back() == 0);
+
+  // Clock capped to 60% at a normal temperature: level 2 from frequency
+  CHECK(replay(trace(5, [](double) { return 40.0; }, 0.6), &levels));
+  CHECK(levels.back() == 2);
+
+  // Warm with frames already costing most of the budget: one level more
+  CHECK(replay(trace(5, [](double) { return 56.0; }, 1.0, 0.9), &levels));
+  CHECK(levels.back() == 2);
+  CHECK(replay(trace(5, [](double) { return 56.0; }, 1.0, 0.3), &levels));
+  CHECK(levels.back() == 1);
+
+  // Disabled: always 0
+  ThermalConfig disabled = defaultThermalConfig();
+  disabled.enabled = false;
+  CHECK(replay(trace(5, [](double) { return 80.0; }), &levels, disabled));
+  CHECK(levels.back() == 0);
+}
+
+// A slow ramp through the warm threshold with +-1.5 C of sensor noise on
+// every sample, and back down: one rise and one fall, no flapping
+void testReplayNoise() {
+  std::vector<int> levels;
+  CHECK(replay(trace(260,
+                     [](double t) {
+                       double base = t < 100 ? 50 + 0.08 * t
+                                             : std::max(40.0, 66 - 0.08 * t);
+                       bool odd = static_cast<int>(t * 2) % 2 != 0;
+                       return base + (odd ? 1.5 : -1.5);
+                     }),
+               &levels));
+  CHECK(countChanges(levels) == 2);
+  CHECK(levels.front() == 0 && levels.back() == 0);
+}
+
+void testReplayErrors() {
+  std::vector<int> levels;
+  CHECK(!replayThermalTrace(tempPath("missing").c_str(),
+                            defaultThermalConfig(), &levels));
+  std::string path = tempPath("bad");
+  writeFile(path, "0 40.0 1.0 0.3\n500 41.0 1.0\n");
+  CHECK(!replayThermalTrace(path.c_str(), defaultThermalConfig(), &levels));
+  unlink(path.c_str());
+}
+
+// The sampler thread reads the fake tree and records a trace; poll() picks
+// its samples up, and replaying the trace reaches the same level
+void testSampler() {
+  std::string root = makeSysfs("sampler", 70000);
+  std::string trace_path = tempPath("recorded");
+  std::string spec = "sysfs=" + root + " trace=" + trace_path;
+  CHECK(thermalGovernorConfigure(spec.c_str()) == 0);
+
+  ThermalGovernor governor;
+  int level = 0;
+  int64_t deadline = getTimeNs() + kSamplerTimeoutNs;
+  while (level < 2 && getTimeNs() < deadline) {
+    governor.addFrameCost(10000000);
+    level = governor.poll();
+    usleep(20000);
+  }
+  CHECK(level == 2);
+  CHECK(thermalGovernorConfigure("trace=off enabled=0") == 0);
+  CHECK(governor.poll() == 0);
+
+  std::vector<int> levels;
+  CHECK(replayThermalTrace(trace_path.c_str(), defaultThermalConfig(),
+                           &levels));
+  CHECK(levels.size() >= 2);
+  CHECK(!levels.empty() && levels.back() == 2);
+  unlink(trace_path.c_str());
+  removeTree(root);
+}
+
+} // namespace
+
+int main() {
+  testConfig();
+  testSensors();
+  testReplayLevels();
+  testReplayNoise();
+  testReplayErrors();
+  testSampler();
+  return testResult("thermal_governor_test");
+}
@@ -0,0 +1,125 @@
+// Time per frame of the default pipeline with and without tile change
+// detection, over a sequence from a stationary robot and one from a robot
+// turning on the spot. Both are cut from one wide rendered frame, still or
+// panning a few pixels a frame, with fresh sensor noise on every frame so
+// unchanged tiles still differ a little, as a real camera's do. Times are
+// the calling thread's CPU time for detection alone; making the frames is
+// not counted.
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "golden_corpus.h"
+#include "scene_generator.h"
+
+namespace {
+
+const int kFrames = 300;
+const int kWidth = 640;
+const int kHeight = 480;
+// The wide frame leaves half a view on each side to pan across
+const int kSceneWidth = 2 * kWidth;
+const double kFocalLength = 520;
+const uint64_t kSeed = 48;
+// Sensor noise of up to this many levels, inside the default tolerance
+const int kNoise = 3;
+// Offset of the view into the wide frame at its widest, in pixels; about
+// 3 pixels a frame at the fastest
+const double kPanAmplitude = kWidth / 4.0;
+const double kPanPeriod = 320;
+
+int64_t threadCpuNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint32_t nextRandom(uint32_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+cv::Mat renderScene() {
+  SceneGenerator generator(kSeed);
+  SceneParams scene;
+  scene.width = kSceneWidth;
+  scene.noise = 0;
+  scene.distractors = 8;
+  scene.clutter = 2;
+  scene.skew = 0.2;
+  CameraModel camera =
+      pinholeCameraModel(kSceneWidth, kHeight, kFocalLength);
+  cv::Mat rgba;
+  SceneTruth truth;
+  generator.render(scene, camera, &rgba, &truth);
+  return rgba;
+}
+
+// Frame n of the sequence: the view at its offset into the scene, with
+// noise added
+void cutFrame(const cv::Mat &scene, bool moving, int n, uint32_t *noise,
+              cv::Mat *frame) {
+  int offset = kWidth / 2;
+  if (moving) {
+    offset += cvRound(kPanAmplitude * sin(2 * CV_PI * n / kPanPeriod));
+  }
+  scene(cv::Rect(offset, 0, kWidth, kHeight)).copyTo(*frame);
+  for (int y = 0; y < kHeight; ++y) {
+    uint8_t *row = frame->ptr<uint8_t>(y);
+    for (int x = 0; x < kWidth * 4; ++x) {
+      if ((x & 3) != 3) {
+        int level = row[x] + static_cast<int>(nextRandom(noise) %
+                                              (2 * kNoise + 1)) - kNoise;
+        row[x] = cv::saturate_cast<uint8_t>(level);
+      }
+    }
+  }
+}
+
+struct Stats {
+  double ms_per_frame;
+  int targets;
+};
+
+Stats run(const cv::Mat &scene, bool moving, bool tiles) {
+  GoldenEntry entry;
+  entry.interlace = false;
+  entry.tiles = tiles ? 8 : -1;
+  GoldenDetector detector;
+  detector.setPipeline(entry);
+  HsvThreshold threshold = sceneThreshold();
+  uint32_t noise = kSeed;
+  cv::Mat frame;
+  DetectionResult result;
+
+  Stats stats = {0, 0};
+  int64_t total_ns = 0;
+  for (int n = 0; n < kFrames; ++n) {
+    cutFrame(scene, moving, n, &noise, &frame);
+    int64_t start = threadCpuNs();
+    detector.detect(frame, threshold, n, &result);
+    total_ns += threadCpuNs() - start;
+    stats.targets += result.targets.size();
+  }
+  stats.ms_per_frame = total_ns / 1e6 / kFrames;
+  return stats;
+}
+
+void print(const char *name, const Stats &stats) {
+  printf("%-16s %6.2f ms/frame, %d targets in %d frames\n", name,
+         stats.ms_per_frame, stats.targets, kFrames);
+}
+
+} // namespace
+
+int main() {
+  cv::Mat scene = renderScene();
+  print("still, full", run(scene, false, false));
+  print("still, tiles", run(scene, false, true));
+  print("moving, full", run(scene, true, false));
+  print("moving, tiles", run(scene, true, true));
+  return 0;
+}